@@ -0,0 +1,643 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BTREEMAP_H
+#define BTREEMAP_H
+
+#include "ElementNotExist.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/**
+ * BTreeMap is an ordered map with the same interface as TreeMap, built as a
+ * B+-tree instead of a treap.  Each node holds a sorted array of keys filling
+ * about NODE_BYTES bytes, so a lookup touches a few cache lines per level of a
+ * tree only log_B(n) levels deep, instead of one node per level of a binary
+ * tree.  All the entries are kept in the leaves, which are linked in key
+ * order for the iterators.
+ *
+ * The keys within a node are searched by BTreeKeySearch, a binary search by
+ * operator< in general, which for int keys counts the keys less than the
+ * target eight at a time with AVX2 if it is enabled at compile time.
+ *
+ * Key and Val should be default-constructible.  Unlike TreeMap, a copy of a
+ * BTreeMap copies all its nodes at once.
+ */
+
+template <class Key>
+struct BTreeKeySearch {
+    // @brief Returns the number of keys less than key in keys[0..num).
+    static int countLess(const Key *keys, int num, const Key &key) {
+        int lo = 0, hi = num;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) >> 1;
+            if (keys[mid] < key) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    // @brief Returns the number of keys not greater than key.
+    static int countNotGreater(const Key *keys, int num, const Key &key) {
+        int lo = 0, hi = num;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) >> 1;
+            if (key < keys[mid]) hi = mid;
+            else lo = mid + 1;
+        }
+        return lo;
+    }
+};
+
+#ifdef __AVX2__
+template <>
+struct BTreeKeySearch<int> {
+    /**
+     * @brief Compare the key with eight keys at a time and count the lanes
+     * from the comparison mask; a node is small enough for a branch-free
+     * scan to beat a binary search.
+     */
+    template <bool GREATER>
+    static int _count(const int *keys, int num, int key) {
+        __m256i target = _mm256_set1_epi32(key);
+        int res = 0, i = 0;
+        for (; i + 8 <= num; i += 8)
+        {
+            __m256i block = _mm256_loadu_si256((const __m256i *)(keys + i));
+            __m256i mask = GREATER ? _mm256_cmpgt_epi32(block, target) :
+                                    _mm256_cmpgt_epi32(target, block);
+            res += __builtin_popcount(_mm256_movemask_ps(
+                                        _mm256_castsi256_ps(mask)));
+        }
+        for (; i < num; i++) res += GREATER ? keys[i] > key : keys[i] < key;
+        return res;
+    }
+
+    static int countLess(const int *keys, int num, int key) {
+        return _count<false>(keys, num, key);
+    }
+
+    static int countNotGreater(const int *keys, int num, int key) {
+        return num - _count<true>(keys, num, key);
+    }
+};
+#endif
+
+template <class Key, class Val, int NODE_BYTES = 512>
+class BTreeMap
+{
+    private:
+        struct Leaf;
+        struct Inner;
+        typedef BTreeKeySearch<Key> Search;
+        /**
+         * @var LEAF_CAP, INNER_CAP The most keys a leaf or an inner node can
+         * hold.
+         * @var LEAF_MIN, INNER_MIN The least keys a node other than the root
+         * holds, about half of the capacity; a full inner node is split
+         * into two of at least INNER_MIN keys after one moves up.
+         * @var root The root, a leaf if height == 0, or an inner node.
+         * @var height The number of inner levels above the leaves.
+         * @var elem_num The total number of elements in the container.
+         */
+        static const int LEAF_RAW = (NODE_BYTES - sizeof(int) -
+                    2 * sizeof(void *)) / (sizeof(Key) + sizeof(Val));
+        static const int INNER_RAW = (NODE_BYTES - sizeof(int) -
+                    sizeof(void *)) / (sizeof(Key) + sizeof(void *));
+        static const int LEAF_CAP = LEAF_RAW > 4 ? LEAF_RAW : 4;
+        static const int INNER_CAP = INNER_RAW > 4 ? INNER_RAW : 4;
+        static const int LEAF_MIN = LEAF_CAP / 2;
+        static const int INNER_MIN = (INNER_CAP - 1) / 2;
+        void *root;
+        int height;
+        int elem_num;
+
+        static void _clear_nodes_dfs(void *p, int level) {
+            if (level > 0)
+            {
+                Inner *t = (Inner *)p;
+                for (int i = 0; i <= t -> num; i++)
+                    _clear_nodes_dfs(t -> ch[i], level - 1);
+                delete t;
+            }
+            else delete (Leaf *)p;
+        }
+
+        static void *_copy_nodes_dfs(const void *src, int level, Leaf *&last) {
+            /**
+             * @brief Copy the subtree src, linking its leaves after last.
+             */
+            if (level > 0)
+            {
+                const Inner *s = (const Inner *)src;
+                Inner *t = new Inner(*s);
+                for (int i = 0; i <= s -> num; i++)
+                    t -> ch[i] = _copy_nodes_dfs(s -> ch[i], level - 1, last);
+                return t;
+            }
+            Leaf *t = new Leaf(*(const Leaf *)src);
+            if ((t -> prev = last)) last -> next = t;
+            t -> next = NULL;
+            return last = t;
+        }
+
+        void _copy(const BTreeMap &other) {
+            Leaf *last = NULL;
+            root = _copy_nodes_dfs(other.root, other.height, last);
+            height = other.height;
+            elem_num = other.elem_num;
+        }
+
+        Leaf *_find_leaf(const Key &key) const {
+            void *p = root;
+            for (int level = height; level > 0; level--)
+            {
+                Inner *t = (Inner *)p;
+                p = t -> ch[Search::countNotGreater(t -> keys, t -> num, key)];
+            }
+            return (Leaf *)p;
+        }
+
+        Leaf *_first_leaf() const {
+            void *p = root;
+            for (int level = height; level > 0; level--)
+                p = ((Inner *)p) -> ch[0];
+            return (Leaf *)p;
+        }
+
+        static Leaf *_split_leaf(Leaf *l) {
+            /**
+             * @brief Move the upper half of the full leaf l into a new leaf
+             * linked right after it.
+             */
+            Leaf *r = new Leaf();
+            int half = l -> num / 2;
+            r -> num = l -> num - half;
+            for (int i = 0; i < r -> num; i++)
+            {
+                r -> keys[i] = l -> keys[half + i];
+                r -> vals[i] = l -> vals[half + i];
+            }
+            l -> num = half;
+            if ((r -> next = l -> next)) r -> next -> prev = r;
+            (l -> next = r) -> prev = l;
+            return r;
+        }
+
+        static void _insert_at(Leaf *l, int i, const Key &key, const Val &val) {
+            for (int j = l -> num; j > i; j--)
+            {
+                l -> keys[j] = l -> keys[j - 1];
+                l -> vals[j] = l -> vals[j - 1];
+            }
+            l -> keys[i] = key;
+            l -> vals[i] = val;
+            l -> num++;
+        }
+
+        static void _insert_at(Inner *t, int i, const Key &key, void *child) {
+            /**
+             * @brief Insert key as keys[i], with child on its right.
+             */
+            for (int j = t -> num; j > i; j--)
+            {
+                t -> keys[j] = t -> keys[j - 1];
+                t -> ch[j + 1] = t -> ch[j];
+            }
+            t -> keys[i] = key;
+            t -> ch[i + 1] = child;
+            t -> num++;
+        }
+
+        static void _erase_at(Inner *t, int i) {
+            /**
+             * @brief Erase keys[i] and the child on its right.
+             */
+            for (int j = i; j + 1 < t -> num; j++)
+            {
+                t -> keys[j] = t -> keys[j + 1];
+                t -> ch[j + 1] = t -> ch[j + 2];
+            }
+            t -> num--;
+        }
+
+        /**
+         * @var INSERT_NONE The key was present, and its value replaced.
+         * @var INSERT_DONE The key was inserted.
+         * @var INSERT_SPLIT The key was inserted, and the node split; the
+         * new right node and its separator are passed up.
+         */
+        enum { INSERT_NONE, INSERT_DONE, INSERT_SPLIT };
+
+        int _insert(void *p, int level, const Key &key, const Val &val,
+                    Key &up_key, void *&up_node) {
+            if (level == 0)
+            {
+                Leaf *l = (Leaf *)p;
+                int i = Search::countLess(l -> keys, l -> num, key);
+                if (i < l -> num && l -> keys[i] == key)
+                {
+                    l -> vals[i] = val; // alter the value
+                    return INSERT_NONE;
+                }
+                if (l -> num < LEAF_CAP)
+                {
+                    _insert_at(l, i, key, val);
+                    return INSERT_DONE;
+                }
+                Leaf *r = _split_leaf(l);
+                if (i < l -> num) _insert_at(l, i, key, val);
+                else _insert_at(r, i - l -> num, key, val);
+                up_key = r -> keys[0];
+                up_node = r;
+                return INSERT_SPLIT;
+            }
+            Inner *t = (Inner *)p;
+            int i = Search::countNotGreater(t -> keys, t -> num, key);
+            Key child_key;
+            void *child_node;
+            int res = _insert(t -> ch[i], level - 1, key, val,
+                                child_key, child_node);
+            if (res != INSERT_SPLIT) return res;
+            if (t -> num < INNER_CAP)
+            {
+                _insert_at(t, i, child_key, child_node);
+                return INSERT_DONE;
+            }
+            // split t around its middle key, which moves up
+            Inner *r = new Inner();
+            int mid = t -> num / 2;
+            r -> num = t -> num - mid - 1;
+            for (int j = 0; j < r -> num; j++)
+                r -> keys[j] = t -> keys[mid + 1 + j];
+            for (int j = 0; j <= r -> num; j++)
+                r -> ch[j] = t -> ch[mid + 1 + j];
+            up_key = t -> keys[mid];
+            up_node = r;
+            t -> num = mid;
+            if (i <= mid) _insert_at(t, i, child_key, child_node);
+            else _insert_at(r, i - mid - 1, child_key, child_node);
+            return INSERT_SPLIT;
+        }
+
+        void _fix_leaf(Inner *t, int i) {
+            /**
+             * @brief The leaf t -> ch[i] is less than half full: borrow an
+             * entry from a sibling, or merge with it.
+             */
+            Leaf *l = (Leaf *)t -> ch[i];
+            Leaf *ls = i > 0 ? (Leaf *)t -> ch[i - 1] : NULL;
+            Leaf *rs = i < t -> num ? (Leaf *)t -> ch[i + 1] : NULL;
+            if (ls && ls -> num > LEAF_MIN)
+            {
+                ls -> num--;
+                _insert_at(l, 0, ls -> keys[ls -> num], ls -> vals[ls -> num]);
+                t -> keys[i - 1] = l -> keys[0];
+            }
+            else if (rs && rs -> num > LEAF_MIN)
+            {
+                _insert_at(l, l -> num, rs -> keys[0], rs -> vals[0]);
+                for (int j = 1; j < rs -> num; j++)
+                {
+                    rs -> keys[j - 1] = rs -> keys[j];
+                    rs -> vals[j - 1] = rs -> vals[j];
+                }
+                rs -> num--;
+                t -> keys[i] = rs -> keys[0];
+            }
+            else
+            {
+                if (ls) rs = l, l = ls, i--; // merge ch[i] and ch[i + 1]
+                for (int j = 0; j < rs -> num; j++)
+                {
+                    l -> keys[l -> num + j] = rs -> keys[j];
+                    l -> vals[l -> num + j] = rs -> vals[j];
+                }
+                l -> num += rs -> num;
+                if ((l -> next = rs -> next)) l -> next -> prev = l;
+                delete rs;
+                _erase_at(t, i);
+            }
+        }
+
+        void _fix_inner(Inner *t, int i) {
+            /**
+             * @brief The inner node t -> ch[i] is less than half full: rotate
+             * a key through t from a sibling, or merge with it.
+             */
+            Inner *c = (Inner *)t -> ch[i];
+            Inner *ls = i > 0 ? (Inner *)t -> ch[i - 1] : NULL;
+            Inner *rs = i < t -> num ? (Inner *)t -> ch[i + 1] : NULL;
+            if (ls && ls -> num > INNER_MIN)
+            {
+                c -> ch[c -> num + 1] = c -> ch[c -> num];
+                for (int j = c -> num; j > 0; j--)
+                {
+                    c -> keys[j] = c -> keys[j - 1];
+                    c -> ch[j] = c -> ch[j - 1];
+                }
+                c -> keys[0] = t -> keys[i - 1];
+                c -> ch[0] = ls -> ch[ls -> num];
+                c -> num++;
+                t -> keys[i - 1] = ls -> keys[--ls -> num];
+            }
+            else if (rs && rs -> num > INNER_MIN)
+            {
+                c -> keys[c -> num] = t -> keys[i];
+                c -> ch[++c -> num] = rs -> ch[0];
+                t -> keys[i] = rs -> keys[0];
+                for (int j = 1; j < rs -> num; j++)
+                {
+                    rs -> keys[j - 1] = rs -> keys[j];
+                    rs -> ch[j - 1] = rs -> ch[j];
+                }
+                rs -> ch[rs -> num - 1] = rs -> ch[rs -> num];
+                rs -> num--;
+            }
+            else
+            {
+                if (ls) rs = c, c = ls, i--; // merge ch[i] and ch[i + 1]
+                c -> keys[c -> num] = t -> keys[i];
+                for (int j = 0; j < rs -> num; j++)
+                    c -> keys[c -> num + 1 + j] = rs -> keys[j];
+                for (int j = 0; j <= rs -> num; j++)
+                    c -> ch[c -> num + 1 + j] = rs -> ch[j];
+                c -> num += rs -> num + 1;
+                delete rs;
+                _erase_at(t, i);
+            }
+        }
+
+        void _remove(void *p, int level, const Key &key) {
+            /**
+             * @brief Remove key from the subtree p, then refill the child
+             * it came from if it is left less than half full.
+             * @throw ElementNotExist
+             */
+            if (level == 0)
+            {
+                Leaf *l = (Leaf *)p;
+                int i = Search::countLess(l -> keys, l -> num, key);
+                if (i == l -> num || !(l -> keys[i] == key))
+                    throw ElementNotExist();
+                for (int j = i + 1; j < l -> num; j++)
+                {
+                    l -> keys[j - 1] = l -> keys[j];
+                    l -> vals[j - 1] = l -> vals[j];
+                }
+                l -> num--;
+                return;
+            }
+            Inner *t = (Inner *)p;
+            int i = Search::countNotGreater(t -> keys, t -> num, key);
+            _remove(t -> ch[i], level - 1, key);
+            if (level == 1)
+            {
+                if (((Leaf *)t -> ch[i]) -> num < LEAF_MIN) _fix_leaf(t, i);
+            }
+            else if (((Inner *)t -> ch[i]) -> num < INNER_MIN)
+                _fix_inner(t, i);
+        }
+
+    public:
+        class Entry;
+        class Iterator;
+
+        BTreeMap() {
+            /**
+             * @brief Constructs an empty B+-tree map.
+             */
+            root = new Leaf();
+            height = 0;
+            elem_num = 0;
+        }
+
+        ~BTreeMap() {
+            /**
+             * @brief Destructor
+             */
+            _clear_nodes_dfs(root, height);
+        }
+
+        BTreeMap &operator=(const BTreeMap &other) {
+            /**
+             * @brief Assignment operator
+             */
+            if (this != &other)
+            {
+                _clear_nodes_dfs(root, height);
+                _copy(other);
+            }
+            return *this;
+        }
+
+        BTreeMap(const BTreeMap &other) {
+            /**
+             * @brief Copy-constructor
+             */
+            _copy(other);
+        }
+
+        // @brief Returns an iterator over the elements in this map.
+        Iterator iterator() const { return Iterator(this); }
+
+        void clear() {
+            /**
+             * @brief Removes all of the mappings from this map.
+             */
+            _clear_nodes_dfs(root, height);
+            root = new Leaf();
+            height = 0;
+            elem_num = 0;
+        }
+
+        bool containsKey(const Key &key) const {
+            /**
+             * @brief Returns true if this map contains a mapping for the
+             * specified key.
+             */
+            Leaf *l = _find_leaf(key);
+            int i = Search::countLess(l -> keys, l -> num, key);
+            return i < l -> num && l -> keys[i] == key;
+        }
+
+        bool containsValue(const Val &value) const {
+            /**
+             * @brief Returns true if this map maps one or more keys to the
+             * specified value.
+             */
+            for (Leaf *l = _first_leaf(); l; l = l -> next)
+                for (int i = 0; i < l -> num; i++)
+                    if (l -> vals[i] == value) return true;
+            return false;
+        }
+
+        const Val &get(const Key &key) const {
+            /**
+             * @brief Returns a const reference to the value to which the
+             * specified key is mapped.  If the key is not present in this
+             * map, this function should throw ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            Leaf *l = _find_leaf(key);
+            int i = Search::countLess(l -> keys, l -> num, key);
+            if (i == l -> num || !(l -> keys[i] == key))
+                throw ElementNotExist();
+            return l -> vals[i];
+        }
+
+        // @brief Returns true if this map contains no key-value mappings.
+        bool isEmpty() const { return elem_num == 0; }
+
+        void put(const Key &key, const Val &value) {
+            /**
+             * @brief Associates the specified value with the specified key in
+             * this map.
+             */
+            Key up_key;
+            void *up_node;
+            int res = _insert(root, height, key, value, up_key, up_node);
+            if (res == INSERT_NONE) return;
+            if (res == INSERT_SPLIT)
+            {
+                Inner *t = new Inner();
+                t -> num = 1;
+                t -> keys[0] = up_key;
+                t -> ch[0] = root;
+                t -> ch[1] = up_node;
+                root = t;
+                height++;
+            }
+            elem_num++;
+        }
+
+        void remove(const Key &key) {
+            /**
+             * @brief Removes the mapping for the specified key from this map
+             * if present.  If there is no mapping for the specified key,
+             * throws ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            _remove(root, height, key);
+            if (height > 0 && ((Inner *)root) -> num == 0)
+            {
+                Inner *t = (Inner *)root;
+                root = t -> ch[0];
+                height--;
+                delete t;
+            }
+            elem_num--;
+        }
+
+        // @brief Returns the number of key-value mappings in this map.
+        int size() const { return elem_num; }
+};
+
+template <class Key, class Val, int NODE_BYTES>
+struct BTreeMap<Key, Val, NODE_BYTES>::Leaf {
+    /**
+     * @var prev, next The neighbouring leaves in key order.
+     */
+    int num;
+    Leaf *prev, *next;
+    Key keys[LEAF_CAP];
+    Val vals[LEAF_CAP];
+    Leaf() : num(0), prev(NULL), next(NULL) {}
+};
+
+template <class Key, class Val, int NODE_BYTES>
+struct BTreeMap<Key, Val, NODE_BYTES>::Inner {
+    /**
+     * @brief ch[i] holds the keys in [keys[i - 1], keys[i]).
+     */
+    int num;
+    Key keys[INNER_CAP];
+    void *ch[INNER_CAP + 1];
+    Inner() : num(0) {}
+};
+
+template <class Key, class Val, int NODE_BYTES>
+class BTreeMap<Key, Val, NODE_BYTES>::Entry {
+    Key key;
+    Val value;
+    public:
+    Entry(Key k, Val v)
+    {
+        key = k;
+        value = v;
+    }
+
+    Key getKey() const
+    {
+        return key;
+    }
+
+    Val getValue() const
+    {
+        return value;
+    }
+};
+
+template <class Key, class Val, int NODE_BYTES>
+class BTreeMap<Key, Val, NODE_BYTES>::Iterator {
+    private:
+        /**
+         * @var leaf, pos The entry to be returned next; leaf is NULL at the
+         * end.
+         */
+        Leaf *leaf;
+        int pos;
+
+        void _skip() {
+            while (leaf && pos == leaf -> num)
+            {
+                leaf = leaf -> next;
+                pos = 0;
+            }
+        }
+
+    public:
+        Iterator() {}
+        Iterator(const BTreeMap *con) : leaf(con -> _first_leaf()), pos(0) {
+            _skip();
+        }
+
+        bool hasNext() {
+            /**
+             * @brief Returns true if the iteration has more elements.
+             */
+            return leaf != NULL;
+        }
+
+        Entry next() {
+            /**
+             * @brief Returns the next element in the iteration.
+             * @throw ElementNotExist exception when hasNext() == false
+             */
+            if (!hasNext()) throw ElementNotExist();
+            Leaf *l = leaf;
+            int i = pos++;
+            _skip();
+            return Entry(l -> keys[i], l -> vals[i]);
+        }
+};
+
+#endif
@@ -0,0 +1,199 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <cstring>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/**
+ * BlockedBloomFilter is a Bloom filter over 32-bit hash codes, split into
+ * blocks of one cache line each.  All the bits of a key are set in the same
+ * block, so a query touches a single cache line: the key picks a block and
+ * one half of it, then sets one bit in each of the eight 32-bit words of that
+ * half.  The eight bit positions are derived from the hash code by
+ * multiplying it with different odd constants.  When the code is compiled
+ * with AVX2 (e.g. -mavx2 or -march=native), the eight words are computed and
+ * tested at once with 256-bit instructions.
+ *
+ * With the default 10 bits per key, the false-positive rate is about 1%.
+ * Keys can not be removed; the owner rebuilds the filter instead (see
+ * BloomFilteredMap).
+ */
+
+class BlockedBloomFilter
+{
+    private:
+        /**
+         * @var BLOCK_WORDS The 32-bit words in a block, a cache line.
+         * @var K The number of bits set for each key.
+         * @var raw The allocated storage, which blocks is aligned in.
+         * @var blocks The blocks, aligned to a cache line.
+         * @var block_num The number of blocks.
+         */
+        static const int BLOCK_WORDS = 16;
+        static const int K = 8;
+        struct Block {
+            unsigned int word[BLOCK_WORDS];
+        } __attribute__((aligned(64)));
+        char *raw;
+        Block *blocks;
+        unsigned int block_num;
+
+        static unsigned long long _mix(unsigned int hv) {
+            /**
+             * @brief Spread the user-defined hash code over 64 bits, the
+             * higher half choosing the block and the lower half the bits.
+             */
+            unsigned long long x = hv;
+            x *= 0x9e3779b97f4a7c15ULL;
+            x ^= x >> 32;
+            x *= 0xd6e8feb86659fd93ULL;
+            x ^= x >> 32;
+            return x;
+        }
+
+        unsigned int *_half(unsigned long long x) const {
+            /**
+             * @brief Returns the half block of x, with the range of the
+             * higher bits reduced by a multiplication instead of a modulo.
+             */
+            unsigned long long idx = ((x >> 32) * block_num) >> 32;
+            return blocks[idx].word + (x & (1ULL << 31) ? K : 0);
+        }
+
+        static unsigned int _salt(int i) {
+            static const unsigned int salt[K] = {
+                0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+            return salt[i];
+        }
+
+        void _alloc(unsigned int num) {
+            block_num = num;
+            raw = new char[sizeof(Block) * num + sizeof(Block) - 1];
+            blocks = (Block *)(((unsigned long)raw + sizeof(Block) - 1) &
+                                ~(unsigned long)(sizeof(Block) - 1));
+        }
+
+    public:
+        static const int DEFAULT_BITS_PER_KEY = 10;
+
+        BlockedBloomFilter(int key_num,
+                        int bits_per_key = DEFAULT_BITS_PER_KEY) {
+            /**
+             * @brief Constructs an empty filter sized for key_num keys.
+             */
+            unsigned long long bits = (unsigned long long)key_num *
+                                        bits_per_key;
+            unsigned long long num = (bits + sizeof(Block) * 8 - 1) /
+                                        (sizeof(Block) * 8);
+            _alloc(num > 0 ? num : 1);
+            clear();
+        }
+
+        BlockedBloomFilter(const BlockedBloomFilter &other) {
+            _alloc(other.block_num);
+            memcpy(blocks, other.blocks, sizeof(Block) * block_num);
+        }
+
+        BlockedBloomFilter &operator=(const BlockedBloomFilter &other) {
+            if (this != &other)
+            {
+                delete[] raw;
+                _alloc(other.block_num);
+                memcpy(blocks, other.blocks, sizeof(Block) * block_num);
+            }
+            return *this;
+        }
+
+        ~BlockedBloomFilter() { delete[] raw; }
+
+        void clear() { memset(blocks, 0, sizeof(Block) * block_num); }
+
+        void add(unsigned int hv) {
+            /**
+             * @brief Add the key whose hash code is hv.
+             */
+            unsigned long long x = _mix(hv);
+            unsigned int *w = _half(x);
+#ifdef __AVX2__
+            __m256i mask = _mm256_sllv_epi32(_mm256_set1_epi32(1),
+                    _mm256_srli_epi32(_mm256_mullo_epi32(
+                        _mm256_set1_epi32((unsigned int)x),
+                        _mm256_setr_epi32(_salt(0), _salt(1), _salt(2),
+                            _salt(3), _salt(4), _salt(5), _salt(6),
+                            _salt(7))), 27));
+            _mm256_store_si256((__m256i *)w,
+                    _mm256_or_si256(_mm256_load_si256((__m256i *)w), mask));
+#else
+            for (int i = 0; i < K; i++)
+                w[i] |= 1U << (((unsigned int)x * _salt(i)) >> 27);
+#endif
+        }
+
+        bool mayContain(unsigned int hv) const {
+            /**
+             * @brief Returns false if the key whose hash code is hv has
+             * definitely not been added.
+             */
+            unsigned long long x = _mix(hv);
+            const unsigned int *w = _half(x);
+#ifdef __AVX2__
+            __m256i mask = _mm256_sllv_epi32(_mm256_set1_epi32(1),
+                    _mm256_srli_epi32(_mm256_mullo_epi32(
+                        _mm256_set1_epi32((unsigned int)x),
+                        _mm256_setr_epi32(_salt(0), _salt(1), _salt(2),
+                            _salt(3), _salt(4), _salt(5), _salt(6),
+                            _salt(7))), 27));
+            return _mm256_testc_si256(
+                    _mm256_load_si256((const __m256i *)w), mask);
+#else
+            for (int i = 0; i < K; i++)
+                if (!(w[i] & (1U << (((unsigned int)x * _salt(i)) >> 27))))
+                    return false;
+            return true;
+#endif
+        }
+
+        double estimatedFalsePositiveRate() const {
+            /**
+             * @brief Estimate the false-positive rate from the fraction of
+             * the bits set: a query hits K words, each of them set with that
+             * probability.
+             */
+            unsigned long long set = 0;
+            for (unsigned int i = 0; i < block_num; i++)
+                for (int j = 0; j < BLOCK_WORDS; j++)
+                    set += __builtin_popcount(blocks[i].word[j]);
+            double p = (double)set / (block_num * (sizeof(Block) * 8.0));
+            double res = 1;
+            for (int i = 0; i < K; i++) res *= p;
+            return res;
+        }
+
+        // @brief Returns the bytes of storage used by the filter.
+        long long memoryBytes() const {
+            return sizeof(Block) * (long long)block_num;
+        }
+};
+
+#endif
@@ -0,0 +1,182 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLOOMFILTEREDMAP_H
+#define BLOOMFILTEREDMAP_H
+
+#include "ElementNotExist.h"
+#include "BloomFilter.h"
+#include "HashMap.h"
+
+/**
+ * BloomFilteredMap puts a BlockedBloomFilter in front of a map, so that most
+ * lookups of absent keys are answered by a single cache line of the filter
+ * instead of a walk down a TreeMap or along a HashMap chain.  It pays off
+ * when most lookups miss.
+ *
+ * Template argument Map is the underlying map, for example TreeMap<Key, Val>
+ * or HashMap<Key, Val, Hash>, and Hash, with the same meaning as in HashMap,
+ * hashes the keys for the filter.  For example
+ * @code
+ *      BloomFilteredMap<int, int, Hashint, TreeMap<int, int> > map;
+ * @endcode
+ *
+ * A Bloom filter can not forget a key, so the filter is rebuilt from the map
+ * when the keys removed since the last build reach half of its capacity, or
+ * when the map outgrows it; the rebuilds take amortized constant time per
+ * operation.  The filter is sized for twice the keys at each build.
+ *
+ * falsePositiveRate() reports the fraction of the containsKey() calls for
+ * absent keys which the filter failed to reject.
+ */
+
+template <class Key, class Val, class Hash,
+         class Map = HashMap<Key, Val, Hash> >
+class BloomFilteredMap
+{
+    private:
+        /**
+         * @var MIN_CAPACITY The capacity of the filter of an empty map.
+         * @var map The underlying map holding the mappings.
+         * @var filter The filter of the keys in map, and of some keys
+         * removed since it was built.
+         * @var capacity The number of keys the filter is sized for.
+         * @var removed_num The number of keys removed since the last build.
+         * @var miss_num The containsKey() calls for absent keys.
+         * @var false_pos_num Those of them which passed the filter.
+         * @var hash_func User-defined hash fuction.
+         */
+        static const int MIN_CAPACITY = 1024;
+        Map map;
+        BlockedBloomFilter filter;
+        int capacity, removed_num;
+        mutable long long miss_num, false_pos_num;
+        Hash hash_func;
+
+        // @brief Returns false if key is definitely absent.
+        bool _may_contain(const Key &key) const {
+            return filter.mayContain(hash_func.hashCode(key));
+        }
+
+        void _rebuild() {
+            /**
+             * @brief Rebuild the filter from the keys in the map.
+             */
+            capacity = map.size() * 2 > MIN_CAPACITY ? map.size() * 2 :
+                                                        MIN_CAPACITY;
+            filter = BlockedBloomFilter(capacity);
+            for (typename Map::Iterator it = map.iterator(); it.hasNext(); )
+                filter.add(hash_func.hashCode(it.next().getKey()));
+            removed_num = 0;
+        }
+
+    public:
+        typedef typename Map::Entry Entry;
+        typedef typename Map::Iterator Iterator;
+
+        BloomFilteredMap() : filter(MIN_CAPACITY) {
+            /**
+             * @brief Constructs an empty map.
+             */
+            capacity = MIN_CAPACITY;
+            removed_num = 0;
+            miss_num = false_pos_num = 0;
+            hash_func = Hash();
+        }
+
+        // @brief Returns an iterator over the elements in this map.
+        Iterator iterator() const { return map.iterator(); }
+
+        void clear() {
+            /**
+             * @brief Removes all of the mappings from this map.
+             */
+            map.clear();
+            _rebuild();
+        }
+
+        bool containsKey(const Key &key) const {
+            /**
+             * @brief Returns true if this map contains a mapping for the
+             * specified key.
+             */
+            bool passed = _may_contain(key);
+            if (passed && map.containsKey(key)) return true;
+            miss_num++;
+            false_pos_num += passed;
+            return false;
+        }
+
+        bool containsValue(const Val &value) const {
+            return map.containsValue(value);
+        }
+
+        const Val &get(const Key &key) const {
+            /**
+             * @brief Returns a const reference to the value to which the
+             * specified key is mapped.
+             * @throw ElementNotExist
+             */
+            if (!_may_contain(key)) throw ElementNotExist();
+            return map.get(key);
+        }
+
+        // @brief Returns true if this map contains no key-value mappings.
+        bool isEmpty() const { return map.isEmpty(); }
+
+        void put(const Key &key, const Val &value) {
+            /**
+             * @brief Associates the specified value with the specified key in
+             * this map.
+             */
+            map.put(key, value);
+            if (map.size() > capacity) _rebuild();
+            else filter.add(hash_func.hashCode(key));
+        }
+
+        void remove(const Key &key) {
+            /**
+             * @brief Removes the mapping for the specified key from this map.
+             * @throw ElementNotExist
+             */
+            if (!_may_contain(key)) throw ElementNotExist();
+            map.remove(key);
+            if (++removed_num * 2 >= capacity) _rebuild();
+        }
+
+        // @brief Returns the number of key-value mappings in this map.
+        int size() const { return map.size(); }
+
+        double falsePositiveRate() const {
+            /**
+             * @brief Returns the fraction of the containsKey() calls for
+             * absent keys which passed the filter so far.
+             */
+            return miss_num ? (double)false_pos_num / miss_num : 0;
+        }
+
+        // @brief Returns the false-positive rate predicted by the filter.
+        double estimatedFalsePositiveRate() const {
+            return filter.estimatedFalsePositiveRate();
+        }
+
+        // @brief Returns the bytes taken by the filter.
+        long long filterBytes() const { return filter.memoryBytes(); }
+};
+
+#endif
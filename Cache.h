@@ -0,0 +1,449 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "ElementNotExist.h"
+#include "HashMap.h"
+#include "LinkedList.h"
+
+/**
+ * Cache is a map bounded by a capacity: when a put() makes it exceed the
+ * capacity, an entry chosen by the replacement policy is evicted.  The keys
+ * are indexed by a HashMap pointing directly at the entries, which are
+ * threaded into the lists maintained by the policy, so that get(), put() and
+ * eviction all take constant time.
+ *
+ * Template argument Hash has the same meaning as in HashMap.  Policy is one
+ * of the following replacement policies:
+ *  - LRUPolicy evicts the least recently used entry;
+ *  - ClockPolicy approximates LRU with a reference bit per entry, so that a
+ *    hit does not reorder any list;
+ *  - S3FIFOPolicy keeps new entries in a small FIFO queue and promotes only
+ *    those hit again to the main queue, remembering the keys recently
+ *    evicted from the small queue in a ghost queue, which makes it resistant
+ *    to scans.
+ *
+ * Only get() and put() count as an access; containsKey() does not.
+ */
+
+template <class Key, class Val>
+struct CacheEntry {
+    /**
+     * @var prev, next Links in the list of the policy holding the entry.
+     * @var freq Reference bit (ClockPolicy) or access frequency
+     * (S3FIFOPolicy).
+     * @var queue The queue holding the entry (S3FIFOPolicy).
+     */
+    typedef Key KeyType;
+    Key key;
+    Val val;
+    CacheEntry *prev, *next;
+    int freq;
+    int queue;
+};
+
+template <class Entry>
+class CacheList {
+    /**
+     * @brief An intrusive circular doubly-linked list of entries with a
+     * sentinel, in the same way as the threaded list of TreeMap.
+     */
+    Entry *head;
+    int length;
+
+    CacheList(const CacheList &);
+    CacheList &operator=(const CacheList &);
+
+    public:
+    CacheList() : length(0) {
+        head = new Entry();
+        head -> prev = head -> next = head;
+    }
+    ~CacheList() { delete head; }
+
+    Entry *sentinel() const { return head; }
+    // @brief Returns the last entry, or the sentinel if the list is empty.
+    Entry *back() const { return head -> prev; }
+    bool isEmpty() const { return head -> next == head; }
+    int size() const { return length; }
+
+    void pushFront(Entry *e) { insertBefore(head -> next, e); }
+
+    void insertBefore(Entry *pos, Entry *e) {
+        (e -> prev = pos -> prev) -> next = e;
+        (e -> next = pos) -> prev = e;
+        length++;
+    }
+
+    void unlink(Entry *e) {
+        e -> prev -> next = e -> next;
+        e -> next -> prev = e -> prev;
+        length--;
+    }
+};
+
+template <class Entry, class Hash>
+class LRUPolicy {
+    CacheList<Entry> list;
+    public:
+    LRUPolicy(int) {}
+    void insert(Entry *e) { list.pushFront(e); }
+    void access(Entry *e) {
+        list.unlink(e);
+        list.pushFront(e);
+    }
+    void erase(Entry *e) { list.unlink(e); }
+    void clear() {}
+    Entry *victim() {
+        /**
+         * @brief Unlink and return the entry to be evicted.
+         */
+        Entry *e = list.back();
+        list.unlink(e);
+        return e;
+    }
+};
+
+template <class Entry, class Hash>
+class ClockPolicy {
+    /**
+     * @var hand The next entry to be examined; the entries are inserted
+     * right behind it.
+     */
+    CacheList<Entry> ring;
+    Entry *hand;
+
+    void _advance() {
+        hand = hand -> next;
+        if (hand == ring.sentinel()) hand = hand -> next;
+    }
+
+    public:
+    ClockPolicy(int) : hand(ring.sentinel()) {}
+    void insert(Entry *e) {
+        e -> freq = 0;
+        ring.insertBefore(hand, e);
+    }
+    void access(Entry *e) { e -> freq = 1; }
+    void erase(Entry *e) {
+        if (hand == e) _advance();
+        ring.unlink(e);
+        if (ring.isEmpty()) hand = ring.sentinel();
+    }
+    void clear() { hand = ring.sentinel(); }
+    Entry *victim() {
+        if (hand == ring.sentinel()) _advance();
+        while (hand -> freq)
+        {
+            hand -> freq = 0; // give it a second chance
+            _advance();
+        }
+        Entry *e = hand;
+        erase(e);
+        return e;
+    }
+};
+
+template <class Entry, class Hash>
+class S3FIFOPolicy {
+    /**
+     * @var MAX_FREQ The access frequency saturates here.
+     * @var small_cap The target size of the small queue, 10% of the cache.
+     * @var ghost_cap The number of evicted keys remembered.
+     * @var ghost_seq The ghost keys, each mapped to the serial number of its
+     * latest record in ghost_fifo; older records are stale.
+     */
+    enum { SMALL, MAIN };
+    static const int MAX_FREQ = 3;
+    typedef typename Entry::KeyType Key;
+    struct GhostRecord {
+        Key key;
+        unsigned int seq;
+        GhostRecord() {}
+        GhostRecord(const Key &_key, unsigned int _seq) :
+            key(_key), seq(_seq) {}
+    };
+
+    CacheList<Entry> small_q, main_q;
+    int small_cap, ghost_cap;
+    HashMap<Key, unsigned int, Hash> ghost_seq;
+    LinkedList<GhostRecord> ghost_fifo;
+    unsigned int seq;
+
+    void _remember(const Key &key) {
+        ghost_seq.put(key, ++seq);
+        ghost_fifo.addLast(GhostRecord(key, seq));
+        while (ghost_fifo.size() > ghost_cap)
+        {
+            const GhostRecord &r = ghost_fifo.getFirst();
+            unsigned int latest;
+            if (ghost_seq.tryGet(r.key, latest) && latest == r.seq)
+                ghost_seq.remove(r.key);
+            ghost_fifo.removeFirst();
+        }
+    }
+
+    public:
+    S3FIFOPolicy(int capacity) : seq(0) {
+        small_cap = capacity / 10 > 0 ? capacity / 10 : 1;
+        ghost_cap = capacity - small_cap > 0 ? capacity - small_cap : 1;
+    }
+
+    void insert(Entry *e) {
+        e -> freq = 0;
+        if (ghost_seq.containsKey(e -> key))
+        {
+            ghost_seq.remove(e -> key); // its record in the fifo gets stale
+            e -> queue = MAIN;
+            main_q.pushFront(e);
+        }
+        else
+        {
+            e -> queue = SMALL;
+            small_q.pushFront(e);
+        }
+    }
+
+    void access(Entry *e) {
+        if (e -> freq < MAX_FREQ) e -> freq++;
+    }
+
+    void erase(Entry *e) {
+        (e -> queue == SMALL ? small_q : main_q).unlink(e);
+    }
+
+    void clear() {
+        /**
+         * @brief Forget the ghost keys, once the entries have been erased.
+         */
+        ghost_seq.clear();
+        ghost_fifo.clear();
+        seq = 0;
+    }
+
+    Entry *victim() {
+        for (;;)
+            if (small_q.size() > small_cap || main_q.isEmpty())
+            {
+                Entry *e = small_q.back();
+                small_q.unlink(e);
+                if (e -> freq == 0)
+                {
+                    _remember(e -> key);
+                    return e;
+                }
+                e -> freq = 0; // hit again in the small queue: promote it
+                e -> queue = MAIN;
+                main_q.pushFront(e);
+            }
+            else
+            {
+                Entry *e = main_q.back();
+                main_q.unlink(e);
+                if (e -> freq == 0) return e;
+                e -> freq--;
+                main_q.pushFront(e);
+            }
+    }
+};
+
+template <class Key, class Val, class Hash,
+         template <class, class> class Policy = LRUPolicy>
+class Cache
+{
+    private:
+        typedef CacheEntry<Key, Val> Entry;
+    public:
+        typedef void (*EvictCallback)(const Key &key, const Val &val,
+                                    void *arg);
+    private:
+        /**
+         * @var cap The maximum number of entries.
+         * @var index Maps each key to its entry.
+         * @var policy Decides which entry to evict.
+         * @var evict_cb Called with evict_arg on each eviction, if not NULL.
+         * @var hit_cnt, miss_cnt, evict_cnt The statistics.
+         */
+        int cap;
+        HashMap<Key, Entry *, Hash> index;
+        Policy<Entry, Hash> policy;
+        EvictCallback evict_cb;
+        void *evict_arg;
+        long long hit_cnt, miss_cnt, evict_cnt;
+
+        Entry *_find(const Key &key) const {
+            Entry *e;
+            return index.tryGet(key, e) ? e : NULL;
+        }
+
+        Entry *_access(const Key &key) {
+            /**
+             * @brief Returns the entry of key after notifying the policy, or
+             * NULL; either way the statistics are updated.
+             */
+            Entry *e = _find(key);
+            if (e)
+            {
+                hit_cnt++;
+                policy.access(e);
+            }
+            else miss_cnt++;
+            return e;
+        }
+
+        void _evict() {
+            Entry *v = policy.victim();
+            index.remove(v -> key);
+            evict_cnt++;
+            if (evict_cb) evict_cb(v -> key, v -> val, evict_arg);
+            delete v;
+        }
+
+        Cache(const Cache &);
+        Cache &operator=(const Cache &);
+
+    public:
+        Cache(int capacity) : cap(capacity), policy(capacity) {
+            /**
+             * @brief Constructs an empty cache holding at most capacity
+             * entries.
+             */
+            evict_cb = NULL;
+            evict_arg = NULL;
+            hit_cnt = miss_cnt = evict_cnt = 0;
+        }
+
+        ~Cache() {
+            /**
+             * @brief Destructor. The entries left are not reported to the
+             * eviction callback.
+             */
+            clear();
+        }
+
+        void setEvictCallback(EvictCallback cb, void *arg = NULL) {
+            /**
+             * @brief Call cb(key, value, arg) whenever an entry is evicted to
+             * make room, but not when it is removed explicitly.
+             */
+            evict_cb = cb;
+            evict_arg = arg;
+        }
+
+        void clear() {
+            /**
+             * @brief Removes all of the entries from this cache.  They are
+             * not evicted, so the policy neither promotes nor remembers
+             * them.
+             */
+            for (typename HashMap<Key, Entry *, Hash>::Iterator it =
+                    index.iterator(); it.hasNext(); )
+            {
+                Entry *e = it.next().getValue();
+                policy.erase(e);
+                delete e;
+            }
+            index.clear();
+            policy.clear();
+        }
+
+        bool containsKey(const Key &key) const {
+            /**
+             * @brief Returns true if this cache contains an entry for the
+             * specified key, without counting it as an access.
+             */
+            return index.containsKey(key);
+        }
+
+        const Val &get(const Key &key) {
+            /**
+             * @brief Returns a const reference to the value cached for the
+             * specified key.  The reference is valid until the next put().
+             * @throw ElementNotExist
+             */
+            Entry *e = _access(key);
+            if (e) return e -> val;
+            throw ElementNotExist();
+        }
+
+        bool tryGet(const Key &key, Val &value) {
+            /**
+             * @brief Copy the value cached for the specified key into value
+             * and return true, or return false on a miss.
+             */
+            Entry *e = _access(key);
+            if (e) value = e -> val;
+            return e != NULL;
+        }
+
+        void put(const Key &key, const Val &value) {
+            /**
+             * @brief Associates the specified value with the specified key,
+             * evicting an entry if the cache gets over its capacity.
+             */
+            Entry *e = _find(key);
+            if (e)
+            {
+                e -> val = value;
+                policy.access(e);
+                return;
+            }
+            // make room first, so that the new entry is not its own victim
+            if (cap > 0 && index.size() >= cap) _evict();
+            e = new Entry();
+            e -> key = key;
+            e -> val = value;
+            index.put(key, e);
+            policy.insert(e);
+            if (index.size() > cap) _evict(); // a cache of capacity 0
+        }
+
+        void remove(const Key &key) {
+            /**
+             * @brief Removes the entry for the specified key.
+             * @throw ElementNotExist
+             */
+            Entry *e = _find(key);
+            if (e == NULL) throw ElementNotExist();
+            index.remove(key);
+            policy.erase(e);
+            delete e;
+        }
+
+        // @brief Returns true if this cache contains no entries.
+        bool isEmpty() const { return index.isEmpty(); }
+
+        // @brief Returns the number of entries in this cache.
+        int size() const { return index.size(); }
+
+        // @brief Returns the maximum number of entries in this cache.
+        int capacity() const { return cap; }
+
+        // @brief Returns the number of get() calls which found the key.
+        long long hitCount() const { return hit_cnt; }
+
+        // @brief Returns the number of get() calls which missed the key.
+        long long missCount() const { return miss_cnt; }
+
+        // @brief Returns the number of entries evicted to make room.
+        long long evictionCount() const { return evict_cnt; }
+};
+
+#endif
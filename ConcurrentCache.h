@@ -0,0 +1,241 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONCURRENTCACHE_H
+#define CONCURRENTCACHE_H
+
+#include "ElementNotExist.h"
+#include "Cache.h"
+#include "HashMix.h"
+#include <pthread.h>
+
+/**
+ * ConcurrentCache is a thread-safe Cache. The keys are partitioned into
+ * SHARD_NUM shards by their hash code, each of them an independent Cache
+ * with its share of the capacity, guarded by its own mutex and padded to its
+ * own cache line.  Since even a hit updates the replacement state, every
+ * operation locks its shard exclusively.
+ *
+ * The eviction is decided per shard, so the entry evicted is the one the
+ * policy would choose among the keys of the same shard, which approximates
+ * the global choice well when the keys are spread evenly.
+ *
+ * Template arguments have the same meaning as in Cache.  SHARD_NUM is
+ * expected to be a power of two; a cache of a smaller capacity uses fewer
+ * shards, so that every shard has room for an entry.  Programs using this
+ * class should be linked with -pthread.
+ */
+
+template <class Key, class Val, class Hash,
+         template <class, class> class Policy = LRUPolicy,
+         int SHARD_NUM = 16>
+class ConcurrentCache
+{
+    private:
+        typedef Cache<Key, Val, Hash, Policy> ShardCache;
+        struct Shard;
+        class Guard;
+        /**
+         * @var CACHE_LINE_SIZE The padding appended to each shard.
+         * @var cap The maximum number of entries, split among the shards.
+         * @var shard_num The shards in use, a power of two not greater than
+         * cap unless cap is 0.
+         * @var shards The shards.
+         * @var hash_func User-defined hash fuction.
+         */
+        static const int CACHE_LINE_SIZE = 64;
+        int cap, shard_num;
+        Shard shards[SHARD_NUM];
+        Hash hash_func;
+
+        Shard &_shard(const Key &key) const {
+            /**
+             * @brief Returns the shard of key, chosen by the lower bits of
+             * the scrambled hash code.
+             */
+            unsigned int h = hashMix(hash_func.hashCode(key));
+            return const_cast<Shard &>(shards[h & (shard_num - 1)]);
+        }
+
+        ConcurrentCache(const ConcurrentCache &);
+        ConcurrentCache &operator=(const ConcurrentCache &);
+
+    public:
+        typedef typename ShardCache::EvictCallback EvictCallback;
+
+        ConcurrentCache(int capacity) : cap(capacity) {
+            /**
+             * @brief Constructs an empty cache holding at most capacity
+             * entries.
+             */
+            shard_num = SHARD_NUM;
+            while (shard_num > 1 && shard_num > capacity) shard_num >>= 1;
+            for (int i = 0; i < shard_num; i++)
+                shards[i].cache = new ShardCache(capacity / shard_num +
+                                        (i < capacity % shard_num));
+            hash_func = Hash();
+        }
+
+        void setEvictCallback(EvictCallback cb, void *arg = NULL) {
+            /**
+             * @brief See Cache::setEvictCallback().  cb is called with the
+             * lock of a shard held, so it must not access this cache.
+             */
+            for (int i = 0; i < shard_num; i++)
+            {
+                Guard guard(shards[i]);
+                shards[i].cache -> setEvictCallback(cb, arg);
+            }
+        }
+
+        void clear() {
+            /**
+             * @brief Removes all of the entries from this cache, shard by
+             * shard.
+             */
+            for (int i = 0; i < shard_num; i++)
+            {
+                Guard guard(shards[i]);
+                shards[i].cache -> clear();
+            }
+        }
+
+        bool containsKey(const Key &key) const {
+            /**
+             * @brief Returns true if this cache contains an entry for the
+             * specified key, without counting it as an access.
+             */
+            Shard &s = _shard(key);
+            Guard guard(s);
+            return s.cache -> containsKey(key);
+        }
+
+        Val get(const Key &key) {
+            /**
+             * @brief Returns a copy of the value cached for the specified
+             * key.
+             * @throw ElementNotExist
+             */
+            Val value;
+            if (tryGet(key, value)) return value;
+            throw ElementNotExist();
+        }
+
+        bool tryGet(const Key &key, Val &value) {
+            /**
+             * @brief Copy the value cached for the specified key into value
+             * and return true, or return false on a miss.
+             */
+            Shard &s = _shard(key);
+            Guard guard(s);
+            return s.cache -> tryGet(key, value);
+        }
+
+        void put(const Key &key, const Val &value) {
+            /**
+             * @brief Associates the specified value with the specified key,
+             * evicting an entry of the same shard if it gets full.
+             */
+            Shard &s = _shard(key);
+            Guard guard(s);
+            s.cache -> put(key, value);
+        }
+
+        void remove(const Key &key) {
+            /**
+             * @brief Removes the entry for the specified key.
+             * @throw ElementNotExist
+             */
+            Shard &s = _shard(key);
+            Guard guard(s);
+            s.cache -> remove(key);
+        }
+
+        // @brief Returns true if this cache contains no entries.
+        bool isEmpty() const { return size() == 0; }
+
+        int size() const {
+            /**
+             * @brief Returns the number of entries in this cache. The shards
+             * are counted one by one, so the result is not a snapshot when
+             * the cache is modified concurrently.
+             */
+            int res = 0;
+            for (int i = 0; i < shard_num; i++)
+            {
+                Guard guard(const_cast<Shard &>(shards[i]));
+                res += shards[i].cache -> size();
+            }
+            return res;
+        }
+
+        // @brief Returns the maximum number of entries in this cache.
+        int capacity() const { return cap; }
+
+        // @brief Returns the number of get() calls which found the key.
+        long long hitCount() const { return _sum(&ShardCache::hitCount); }
+
+        // @brief Returns the number of get() calls which missed the key.
+        long long missCount() const { return _sum(&ShardCache::missCount); }
+
+        // @brief Returns the number of entries evicted to make room.
+        long long evictionCount() const {
+            return _sum(&ShardCache::evictionCount);
+        }
+
+    private:
+        long long _sum(long long (ShardCache::*counter)() const) const {
+            long long res = 0;
+            for (int i = 0; i < shard_num; i++)
+            {
+                Guard guard(const_cast<Shard &>(shards[i]));
+                res += (shards[i].cache ->* counter)();
+            }
+            return res;
+        }
+};
+
+template <class Key, class Val, class Hash,
+         template <class, class> class Policy, int SHARD_NUM>
+struct ConcurrentCache<Key, Val, Hash, Policy, SHARD_NUM>::Shard {
+    /**
+     * @var lock The lock guarding the cache.
+     * @var pad Keep the fields of adjacent shards in different cache lines.
+     */
+    pthread_mutex_t lock;
+    ShardCache *cache;
+    char pad[CACHE_LINE_SIZE];
+
+    Shard() : cache(NULL) { pthread_mutex_init(&lock, NULL); }
+
+    ~Shard() {
+        delete cache;
+        pthread_mutex_destroy(&lock);
+    }
+};
+
+template <class Key, class Val, class Hash,
+         template <class, class> class Policy, int SHARD_NUM>
+class ConcurrentCache<Key, Val, Hash, Policy, SHARD_NUM>::Guard {
+    pthread_mutex_t *lock;
+    public:
+    Guard(Shard &s) : lock(&s.lock) { pthread_mutex_lock(lock); }
+    ~Guard() { pthread_mutex_unlock(lock); }
+};
+
+#endif
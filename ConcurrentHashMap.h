@@ -0,0 +1,429 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONCURRENTHASHMAP_H
+#define CONCURRENTHASHMAP_H
+
+#include "ElementNotExist.h"
+#include "ArrayList.h"
+#include "HashMix.h"
+#include <cstring>
+#include <pthread.h>
+
+/**
+ * ConcurrentHashMap is a thread-safe map implemented by hashing. The keys are
+ * partitioned into SHARD_NUM shards by their hash code. Each shard is an
+ * independent chained hash table guarded by its own reader-writer lock, and
+ * is padded to its own cache line, so that threads working on different
+ * shards never contend with each other.
+ *
+ * Template arguments Key, Val and Hash have the same meaning as in HashMap.
+ * SHARD_NUM is expected to be a power of two.
+ *
+ * Unlike HashMap, get() returns a copy of the value, since a reference into a
+ * shard could be invalidated by a concurrent remove() at any time.
+ *
+ * The iterator is weakly consistent: each shard is copied out under its lock
+ * when the iteration reaches it, so an entry modified during the iteration
+ * may or may not be reflected, but each (key, value) pair which is present
+ * during the whole iteration is iterated exactly once.
+ *
+ * Programs using this class should be linked with -pthread.
+ */
+
+template <class Key, class Val, class Hash, int SHARD_NUM = 64>
+class ConcurrentHashMap
+{
+    private:
+        struct Node;
+        struct Shard;
+        class ReadGuard;
+        class WriteGuard;
+        /**
+         * @var CACHE_LINE_SIZE The padding appended to each shard.
+         * @var INIT_BUCKET_NUM The initial number of buckets in each shard,
+         * which is expected to be a power of two.
+         * @var shards The shards, each of them a small hash table.
+         * @var hash_func User-defined hash fuction.
+         */
+        static const int CACHE_LINE_SIZE = 64;
+        static const int INIT_BUCKET_NUM = 16;
+        Shard shards[SHARD_NUM];
+        Hash hash_func;
+
+        unsigned int _hash(const Key &key) const {
+            /**
+             * @brief Scramble the user-defined hash code, so that both the
+             * lower bits (choosing the shard) and the higher bits (choosing
+             * the bucket) are well distributed even for an identity hash.
+             */
+            return hashMix(hash_func.hashCode(key));
+        }
+
+        // @brief Returns the shard to which the hash value belongs.
+        Shard &_shard(unsigned int hv) const {
+            return const_cast<Shard &>(shards[hv & (SHARD_NUM - 1)]);
+        }
+
+        ConcurrentHashMap(const ConcurrentHashMap &);
+        ConcurrentHashMap &operator=(const ConcurrentHashMap &);
+
+    public:
+        class Entry;
+        class Iterator;
+
+        ConcurrentHashMap() {
+            /**
+             * @brief Constructs an empty hash map.
+             */
+            hash_func = Hash();
+        }
+
+        // @brief Returns a weakly consistent iterator over this map.
+        Iterator iterator() const { return Iterator(this); }
+
+        void clear() {
+            /**
+             * @brief Removes all of the mappings from this map. The shards are
+             * cleared one by one, so the mappings put concurrently may
+             * survive.
+             */
+            for (int i = 0; i < SHARD_NUM; i++)
+            {
+                WriteGuard guard(shards[i]);
+                shards[i].clear();
+            }
+        }
+
+        bool containsKey(const Key &key) const {
+            /**
+             * @brief Returns true if this map contains a mapping for the
+             * specified key.
+             */
+            unsigned int hv = _hash(key);
+            Shard &s = _shard(hv);
+            ReadGuard guard(s);
+            return s.find(hv, key) != NULL;
+        }
+
+        bool containsValue(const Val &value) const {
+            /**
+             * @brief Returns true if this map maps one or more keys to the
+             * specified value.
+             */
+            for (int i = 0; i < SHARD_NUM; i++)
+            {
+                Shard &s = const_cast<Shard &>(shards[i]);
+                ReadGuard guard(s);
+                for (int j = 0; j < s.bucket_num; j++)
+                    for (Node *p = s.head[j]; p; p = p -> next)
+                        if (p -> val == value) return true;
+            }
+            return false;
+        }
+
+        Val get(const Key &key) const {
+            /**
+             * @brief Returns a copy of the value to which the specified key is
+             * mapped.  If the key is not present in this map, this function
+             * should throw ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            unsigned int hv = _hash(key);
+            Shard &s = _shard(hv);
+            {
+                ReadGuard guard(s);
+                Node *p = s.find(hv, key);
+                if (p) return p -> val;
+            }
+            throw ElementNotExist();
+        }
+
+        // @brief Returns true if this map contains no key-value mappings.
+        bool isEmpty() const { return size() == 0; }
+
+        void put(const Key &key, const Val &value) {
+            /**
+             * @brief Associates the specified value with the specified key in
+             * this map.
+             */
+            unsigned int hv = _hash(key);
+            Shard &s = _shard(hv);
+            WriteGuard guard(s);
+            Node *p = s.find(hv, key);
+            if (p) p -> val = value; // alter the original value
+            else s.insert(hv, key, value);
+        }
+
+        template <class Func>
+        Val computeIfAbsent(const Key &key, Func func) {
+            /**
+             * @brief If the specified key is not associated with a value yet,
+             * computes one by calling func(key) and puts it into this map.
+             * Returns the value finally associated with the key.
+             * The whole operation is atomic, so func is called at most once
+             * for an absent key even if several threads race on it.  Since
+             * func is called with the shard locked, it should be short and
+             * must not access this map.
+             */
+            unsigned int hv = _hash(key);
+            Shard &s = _shard(hv);
+            WriteGuard guard(s);
+            Node *p = s.find(hv, key);
+            if (p) return p -> val;
+            return s.insert(hv, key, func(key)) -> val;
+        }
+
+        void remove(const Key &key) {
+            /**
+             * @brief Removes the mapping for the specified key from this map
+             * if present.  If there is no mapping for the specified key,
+             * throws ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            unsigned int hv = _hash(key);
+            Shard &s = _shard(hv);
+            {
+                WriteGuard guard(s);
+                if (s.erase(hv, key)) return;
+            }
+            throw ElementNotExist();
+        }
+
+        int size() const {
+            /**
+             * @brief Returns the number of key-value mappings in this map.
+             * The shards are counted one by one, so the result is only an
+             * estimate while the map is being modified concurrently.
+             */
+            int res = 0;
+            for (int i = 0; i < SHARD_NUM; i++)
+            {
+                Shard &s = const_cast<Shard &>(shards[i]);
+                ReadGuard guard(s);
+                res += s.elem_num;
+            }
+            return res;
+        }
+};
+
+template <class Key, class Val, class Hash, int SHARD_NUM>
+struct ConcurrentHashMap<Key, Val, Hash, SHARD_NUM>::Node {
+    Key key;
+    Val val;
+    unsigned int hash;
+    Node *next;
+    Node(const Key &_key, const Val &_val, unsigned int _hash, Node *_next) :
+        key(_key), val(_val), hash(_hash), next(_next) {}
+};
+
+template <class Key, class Val, class Hash, int SHARD_NUM>
+struct ConcurrentHashMap<Key, Val, Hash, SHARD_NUM>::Shard {
+    /**
+     * @var lock The lock guarding all the other fields.
+     * @var head The bucket, an array of pointers to Node instance.
+     * @var bucket_num The number of buckets, always a power of two.
+     * @var elem_num The number of elements in this shard.
+     * @var pad Keep the fields of adjacent shards in different cache lines.
+     */
+    pthread_rwlock_t lock;
+    Node **head;
+    int bucket_num;
+    int elem_num;
+    char pad[CACHE_LINE_SIZE];
+
+    Shard() {
+        pthread_rwlock_init(&lock, NULL);
+        bucket_num = INIT_BUCKET_NUM;
+        head = new Node*[bucket_num];
+        memset(head, 0, sizeof(Node*) * bucket_num);
+        elem_num = 0;
+    }
+
+    ~Shard() {
+        clear();
+        delete[] head;
+        pthread_rwlock_destroy(&lock);
+    }
+
+    // @brief Returns the bucket index, skipping the bits choosing the shard.
+    int index(unsigned int hv) const {
+        return (hv / SHARD_NUM) & (bucket_num - 1);
+    }
+
+    Node *find(unsigned int hv, const Key &key) const {
+        for (Node *p = head[index(hv)]; p; p = p -> next)
+            if (p -> hash == hv && p -> key == key) return p;
+        return NULL;
+    }
+
+    Node *insert(unsigned int hv, const Key &key, const Val &value) {
+        /**
+         * @brief Insert a new node without checking duplication. Double the
+         * buckets when the load factor exceeds one.
+         */
+        if (elem_num >= bucket_num) grow();
+        int idx = index(hv);
+        Node *tmp_ptr = new Node(key, value, hv, head[idx]);
+        head[idx] = tmp_ptr;
+        elem_num++;
+        return tmp_ptr;
+    }
+
+    bool erase(unsigned int hv, const Key &key) {
+        for (Node **pptr = &head[index(hv)], *p; (p = *pptr);
+                pptr = &(p -> next))
+            if (p -> hash == hv && p -> key == key)
+            {
+                *pptr = p -> next;
+                delete p;
+                elem_num--;
+                return true;
+            }
+        return false;
+    }
+
+    void grow() {
+        /**
+         * @brief Double the buckets and redistribute the nodes by their
+         * cached hash values.
+         */
+        Node **old_head = head;
+        int old_num = bucket_num;
+        bucket_num <<= 1;
+        head = new Node*[bucket_num];
+        memset(head, 0, sizeof(Node*) * bucket_num);
+        for (int i = 0; i < old_num; i++)
+            for (Node *np, *p = old_head[i]; p; p = np)
+            {
+                np = p -> next;
+                int idx = index(p -> hash);
+                p -> next = head[idx];
+                head[idx] = p;
+            }
+        delete[] old_head;
+    }
+
+    void clear() {
+        for (int i = 0; i < bucket_num; i++)
+        {
+            for (Node *np, *p = head[i]; p; p = np)
+            {
+                np = p -> next;
+                delete p;
+            }
+            head[i] = NULL;
+        }
+        elem_num = 0;
+    }
+};
+
+template <class Key, class Val, class Hash, int SHARD_NUM>
+class ConcurrentHashMap<Key, Val, Hash, SHARD_NUM>::ReadGuard {
+    pthread_rwlock_t *lock;
+    public:
+    ReadGuard(Shard &s) : lock(&s.lock) { pthread_rwlock_rdlock(lock); }
+    ~ReadGuard() { pthread_rwlock_unlock(lock); }
+};
+
+template <class Key, class Val, class Hash, int SHARD_NUM>
+class ConcurrentHashMap<Key, Val, Hash, SHARD_NUM>::WriteGuard {
+    pthread_rwlock_t *lock;
+    public:
+    WriteGuard(Shard &s) : lock(&s.lock) { pthread_rwlock_wrlock(lock); }
+    ~WriteGuard() { pthread_rwlock_unlock(lock); }
+};
+
+template <class Key, class Val, class Hash, int SHARD_NUM>
+class ConcurrentHashMap<Key, Val, Hash, SHARD_NUM>::Entry {
+    Key key;
+    Val value;
+    public:
+    Entry() {}
+    Entry(Key k, Val v)
+    {
+        key = k;
+        value = v;
+    }
+
+    Key getKey() const
+    {
+        return key;
+    }
+
+    Val getValue() const
+    {
+        return value;
+    }
+};
+
+template <class Key, class Val, class Hash, int SHARD_NUM>
+class ConcurrentHashMap<Key, Val, Hash, SHARD_NUM>::Iterator {
+    private:
+        /**
+         * @var shard_index The index of the next shard to be copied out.
+         * @var cursor The position in buff of the next element.
+         * @var buff The copy of the shard currently being iterated.
+         * @var container Reflect pointer to the container to which it applies.
+         */
+        int shard_index, cursor;
+        ArrayList<Entry> buff;
+        const ConcurrentHashMap *container;
+
+        void _fill() {
+            /**
+             * @brief Copy out the following shards until a non-empty one is
+             * met or all shards are consumed.
+             */
+            while (cursor == buff.size() && shard_index < SHARD_NUM)
+            {
+                Shard &s = const_cast<Shard &>(
+                        container -> shards[shard_index++]);
+                buff.clear();
+                cursor = 0;
+                ReadGuard guard(s);
+                for (int i = 0; i < s.bucket_num; i++)
+                    for (Node *p = s.head[i]; p; p = p -> next)
+                        buff.add(Entry(p -> key, p -> val));
+            }
+        }
+
+    public:
+        Iterator() {}
+        Iterator(const ConcurrentHashMap *con) :
+            shard_index(0), cursor(0), container(con) {}
+
+        bool hasNext() {
+            /**
+             * @brief Returns true if the iteration has more elements.
+             */
+            _fill();
+            return cursor < buff.size();
+        }
+
+        Entry next() {
+            /**
+             * @brief Returns the next element in the iteration.
+             * @throw ElementNotExist exception when hasNext() == false
+             */
+            if (!hasNext()) throw ElementNotExist();
+            return buff.get(cursor++);
+        }
+};
+
+#endif
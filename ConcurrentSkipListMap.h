@@ -0,0 +1,536 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONCURRENTSKIPLISTMAP_H
+#define CONCURRENTSKIPLISTMAP_H
+
+#include "ElementNotExist.h"
+#include "EpochManager.h"
+#include "HashMix.h"
+#include <cstddef>
+#include <new>
+
+/**
+ * ConcurrentSkipListMap is a thread-safe ordered map implemented by a
+ * lock-free skip list, in the manner of Java's ConcurrentSkipListMap.  No
+ * operation takes a lock: every modification is a compare-and-swap on a
+ * single word, and a thread which finds an operation of another one half
+ * done helps to finish it instead of waiting.
+ *
+ * A node holds a pointer to its value.  put() of a present key swaps the
+ * pointer, and remove() swaps it to NULL, which is the point where the key
+ * leaves the map.  The remover then marks the lowest bit of the node's links
+ * from the top level down, so that no node can be linked after it any more,
+ * and every traversal which meets a marked node unlinks it.  The nodes and
+ * the values are handed to the EpochManager, and a node is retired only
+ * once both its inserter and its remover have made sure that no level links
+ * to it.
+ *
+ * Template arguments Key and Val have the same meaning as in TreeMap; Key
+ * should be default-constructible.  get() returns a copy of the value.  The
+ * iterator is weakly consistent, and it pins the memory it may refer to, so
+ * like the one of ReadMostlyHashMap it must be used and destroyed by the
+ * thread which created it, and should not be kept for long.
+ *
+ * Programs using this class should be linked with -pthread.
+ */
+
+template <class Key, class Val>
+class ConcurrentSkipListMap
+{
+    private:
+        struct Node;
+        /**
+         * @var MAX_LEVEL The number of levels; a node reaches level i + 1
+         * with probability 4^-i.
+         * @var head The sentinel node before the least key, on all levels.
+         * @var elem_num The number of keys, updated after each modification.
+         */
+        static const int MAX_LEVEL = 24;
+        Node *head;
+        int elem_num;
+
+        static Node *_ptr(Node *p) { return (Node *)((size_t)p & ~(size_t)1); }
+        static bool _marked(Node *p) { return (size_t)p & 1; }
+        static Node *_mark(Node *p) { return (Node *)((size_t)p | 1); }
+
+        template <class T>
+        static T *_load(T *const &ptr) {
+            return __atomic_load_n(&ptr, __ATOMIC_ACQUIRE);
+        }
+
+        template <class T>
+        static bool _cas(T *&ptr, T *expected, T *desired) {
+            return __atomic_compare_exchange_n(&ptr, &expected, desired, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        }
+
+        static Node *_new_node(const Key &key, Val *val, int level) {
+            void *mem = ::operator new(sizeof(Node) +
+                                        (level - 1) * sizeof(Node *));
+            return new (mem) Node(key, val, level);
+        }
+
+        static void _free_node(void *ptr) {
+            Node *p = (Node *)ptr;
+            p -> ~Node();
+            ::operator delete(ptr);
+        }
+
+        static void _free_val(void *ptr) { delete (Val *)ptr; }
+
+        static int _random_level() {
+            /**
+             * @brief A per-thread xorshift32 generator, seeded from the
+             * address of its state.
+             */
+            static __thread unsigned int state = 0;
+            if (state == 0)
+            {
+                state = hashMix((unsigned int)(size_t)&state) | 1;
+            }
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            int level = 1;
+            for (unsigned int r = state; (r & 3) == 0 && level < MAX_LEVEL;
+                    r >>= 2)
+                level++;
+            return level;
+        }
+
+        bool _find(const Key &key, Node **preds, Node **succs) const {
+            /**
+             * @brief Find on every level the last node less than key and the
+             * node after it, unlinking the marked nodes met on the way.
+             * Returns true if succs[0] holds key.  Must be called in a
+             * critical section.
+             */
+        retry:
+            Node *pred = head;
+            for (int i = MAX_LEVEL - 1; i >= 0; i--)
+            {
+                Node *curr = _load(pred -> next[i]);
+                if (_marked(curr)) goto retry; // pred is being removed
+                while (curr)
+                {
+                    Node *succ = _load(curr -> next[i]);
+                    if (_marked(succ))
+                    {
+                        if (!_cas(pred -> next[i], curr, _ptr(succ)))
+                            goto retry;
+                        curr = _ptr(succ);
+                    }
+                    else if (curr -> key < key)
+                    {
+                        pred = curr;
+                        curr = succ;
+                    }
+                    else break;
+                }
+                preds[i] = pred;
+                succs[i] = curr;
+            }
+            return succs[0] && succs[0] -> key == key;
+        }
+
+        const Node *_seek(const Key &key, const Node *&pred) const {
+            /**
+             * @brief Returns the first unmarked node not less than key, or
+             * NULL, and sets pred to a node before it, without writing
+             * anything.  Must be called in a critical section.
+             */
+            const Node *p = head, *curr = NULL;
+            for (int i = MAX_LEVEL - 1; i >= 0; i--)
+            {
+                curr = _ptr(_load(p -> next[i]));
+                while (curr)
+                {
+                    Node *succ = _load(curr -> next[i]);
+                    if (_marked(succ)) curr = _ptr(succ);
+                    else if (curr -> key < key)
+                    {
+                        p = curr;
+                        curr = succ;
+                    }
+                    else break;
+                }
+            }
+            pred = p;
+            return curr;
+        }
+
+        const Node *_find_node(const Key &key) const {
+            const Node *pred;
+            const Node *p = _seek(key, pred);
+            return p && p -> key == key ? p : NULL;
+        }
+
+        static void _mark_levels(Node *p) {
+            /**
+             * @brief Mark the links of p from the top level down; the mark on
+             * level 0 makes it removed for all the traversals.
+             */
+            for (int i = p -> level - 1; i >= 0; i--)
+                for (;;)
+                {
+                    Node *succ = _load(p -> next[i]);
+                    if (_marked(succ) || _cas(p -> next[i], succ, _mark(succ)))
+                        break;
+                }
+        }
+
+        void _unlink(Node *p) {
+            /**
+             * @brief Make sure no level links to the marked node p any more,
+             * then drop one of the two claims on it; the last claim retires
+             * it.  Called by its inserter after linking it and by its
+             * remover after marking it.
+             */
+            Node *preds[MAX_LEVEL], *succs[MAX_LEVEL];
+            if (_marked(_load(p -> next[0]))) _find(p -> key, preds, succs);
+            if (__sync_sub_and_fetch(&p -> claims, 1) == 0)
+                EpochManager::instance().retire(p, _free_node);
+        }
+
+        void _link_levels(Node *n, Node **preds, Node **succs) {
+            /**
+             * @brief Link n, already on level 0, on its upper levels, giving
+             * up as soon as it is marked.
+             */
+            for (int i = 1; i < n -> level; i++)
+                for (;;)
+                {
+                    Node *next = _load(n -> next[i]);
+                    if (_marked(next)) return;
+                    if (next != succs[i] && !_cas(n -> next[i], next, succs[i]))
+                        return; // only a mark can make it fail
+                    if (_cas(preds[i] -> next[i], succs[i], n)) break;
+                    if (!_find(n -> key, preds, succs) || succs[0] != n)
+                        return;
+                }
+        }
+
+        ConcurrentSkipListMap(const ConcurrentSkipListMap &);
+        ConcurrentSkipListMap &operator=(const ConcurrentSkipListMap &);
+
+    public:
+        class Entry;
+        class Iterator;
+
+        ConcurrentSkipListMap() : elem_num(0) {
+            /**
+             * @brief Constructs an empty map.
+             */
+            head = _new_node(Key(), NULL, MAX_LEVEL);
+        }
+
+        ~ConcurrentSkipListMap() {
+            /**
+             * @brief Destructor. No other thread may use the map any more.
+             * It does not wait for readers: the nodes retired earlier are
+             * freed by the EpochManager once it is safe.
+             */
+            for (Node *p = head, *np; p; p = np)
+            {
+                np = _ptr(p -> next[0]);
+                delete p -> val;
+                _free_node(p);
+            }
+        }
+
+        // @brief Returns a weakly consistent iterator over this map.
+        Iterator iterator() const { return Iterator(this, NULL); }
+
+        /**
+         * @brief Returns a weakly consistent iterator over the mappings whose
+         * keys are not less than lo, found in O(log n).
+         */
+        Iterator iterator(const Key &lo) const { return Iterator(this, &lo); }
+
+        void clear() {
+            /**
+             * @brief Removes the least key until the map is empty.  Not
+             * atomic with respect to the other threads.  No iterator is
+             * kept across the removals, since it would keep the epoch from
+             * advancing and every node removed from being freed.
+             */
+            for (;;)
+            {
+                Key key;
+                try {
+                    key = firstKey();
+                } catch (ElementNotExist &) {
+                    return;
+                }
+                try {
+                    remove(key);
+                } catch (ElementNotExist &) {} // removed by another thread
+            }
+        }
+
+        bool containsKey(const Key &key) const {
+            /**
+             * @brief Returns true if this map contains a mapping for the
+             * specified key.
+             */
+            EpochManager::Guard guard;
+            const Node *p = _find_node(key);
+            return p && _load(p -> val);
+        }
+
+        bool containsValue(const Val &value) const {
+            /**
+             * @brief Returns true if this map maps one or more keys to the
+             * specified value.
+             */
+            for (Iterator it = iterator(); it.hasNext(); )
+                if (it.next().getValue() == value) return true;
+            return false;
+        }
+
+        Val get(const Key &key) const {
+            /**
+             * @brief Returns a copy of the value to which the specified key is
+             * mapped.  If the key is not present in this map, this function
+             * should throw ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            {
+                EpochManager::Guard guard;
+                const Node *p = _find_node(key);
+                const Val *v = p ? _load(p -> val) : NULL;
+                if (v) return *v;
+            }
+            throw ElementNotExist();
+        }
+
+        Key firstKey() const {
+            /**
+             * @brief Returns the least key in this map.
+             * @throw ElementNotExist if the map is empty
+             */
+            Iterator it = iterator();
+            if (!it.hasNext()) throw ElementNotExist();
+            return it.next().getKey();
+        }
+
+        Key ceilingKey(const Key &key) const {
+            /**
+             * @brief Returns the least key greater than or equal to the given
+             * key, in O(log n).
+             * @throw ElementNotExist if there is no such key
+             */
+            Iterator it = iterator(key);
+            if (!it.hasNext()) throw ElementNotExist();
+            return it.next().getKey();
+        }
+
+        // @brief Returns true if this map contains no key-value mappings.
+        bool isEmpty() const { return size() == 0; }
+
+        void put(const Key &key, const Val &value) {
+            /**
+             * @brief Associates the specified value with the specified key in
+             * this map.  The value of a present key is replaced by swapping
+             * the pointer to it, since readers may be copying the old one.
+             */
+            Val *nv = new Val(value);
+            Node *preds[MAX_LEVEL], *succs[MAX_LEVEL];
+            EpochManager::Guard guard;
+            for (;;)
+            {
+                if (_find(key, preds, succs))
+                {
+                    Node *p = succs[0];
+                    Val *v = _load(p -> val);
+                    if (!v) _mark_levels(p); // help the remover, then retry
+                    else if (_cas(p -> val, v, nv))
+                    {
+                        EpochManager::instance().retire(v, _free_val);
+                        return;
+                    }
+                    continue;
+                }
+                Node *n = _new_node(key, nv, _random_level());
+                for (int i = 0; i < n -> level; i++) n -> next[i] = succs[i];
+                if (!_cas(preds[0] -> next[0], succs[0], n))
+                {
+                    n -> val = NULL;
+                    _free_node(n); // never published
+                    continue;
+                }
+                __sync_add_and_fetch(&elem_num, 1);
+                _link_levels(n, preds, succs);
+                _unlink(n);
+                return;
+            }
+        }
+
+        void remove(const Key &key) {
+            /**
+             * @brief Removes the mapping for the specified key from this map
+             * if present.  If there is no mapping for the specified key,
+             * throws ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            EpochManager::Guard guard;
+            Node *p = const_cast<Node *>(_find_node(key));
+            Val *v;
+            do {
+                if (!p || !(v = _load(p -> val))) throw ElementNotExist();
+            } while (!_cas(p -> val, v, (Val *)NULL));
+            __sync_sub_and_fetch(&elem_num, 1);
+            EpochManager::instance().retire(v, _free_val);
+            _mark_levels(p);
+            _unlink(p);
+        }
+
+        // @brief Returns the number of key-value mappings in this map.
+        int size() const { return __atomic_load_n(&elem_num, __ATOMIC_RELAXED); }
+};
+
+template <class Key, class Val>
+struct ConcurrentSkipListMap<Key, Val>::Node {
+    /**
+     * @var val The value, or NULL once the key is removed.
+     * @var claims The inserter and the remover, each of which must be done
+     * with the node before it is retired; a node never removed is freed by
+     * the destructor of the map.
+     * @var next The links on the levels 0 to level - 1, allocated together
+     * with the node; the lowest bit marks the node as removed.
+     */
+    Key key;
+    Val *val;
+    int level;
+    int claims;
+    Node *next[1];
+    Node(const Key &_key, Val *_val, int _level) :
+        key(_key), val(_val), level(_level), claims(2) {
+        for (int i = 0; i < level; i++) next[i] = NULL;
+    }
+};
+
+template <class Key, class Val>
+class ConcurrentSkipListMap<Key, Val>::Entry {
+    Key key;
+    Val value;
+    public:
+    Entry(Key k, Val v)
+    {
+        key = k;
+        value = v;
+    }
+
+    Key getKey() const
+    {
+        return key;
+    }
+
+    Val getValue() const
+    {
+        return value;
+    }
+};
+
+template <class Key, class Val>
+class ConcurrentSkipListMap<Key, Val>::Iterator {
+    private:
+        /**
+         * @var cur_node The node last returned, or the one before the first
+         * node to return.
+         * @var lo, bounded The keys less than lo are skipped if bounded,
+         * since they may be inserted after cur_node once it is found.
+         * @var pinned Whether the iterator holds a critical section, false
+         * for a default constructed iterator.
+         */
+        const Node *cur_node;
+        Key lo;
+        bool bounded;
+        bool pinned;
+
+        bool _try_next(const Node *&next_node, const Val *&next_val) {
+            /**
+             * @brief Find the first node after cur_node which is neither
+             * marked nor removed, with its value.
+             */
+            for (next_node = _ptr(_load(cur_node -> next[0])); next_node;
+                    next_node = _ptr(_load(next_node -> next[0])))
+                if (!_marked(_load(next_node -> next[0])) &&
+                        !(bounded && next_node -> key < lo) &&
+                        (next_val = _load(next_node -> val)))
+                    return true;
+            return false;
+        }
+
+    public:
+        Iterator() : bounded(false), pinned(false) {}
+        Iterator(const ConcurrentSkipListMap *con, const Key *_lo) :
+            bounded(_lo != NULL), pinned(true) {
+            EpochManager::instance().enter();
+            cur_node = con -> head;
+            if (bounded)
+            {
+                lo = *_lo;
+                con -> _seek(lo, cur_node);
+            }
+        }
+
+        Iterator(const Iterator &other) :
+            cur_node(other.cur_node), lo(other.lo), bounded(other.bounded),
+            pinned(other.pinned) {
+            if (pinned) EpochManager::instance().enter();
+        }
+
+        Iterator &operator=(const Iterator &other) {
+            if (other.pinned) EpochManager::instance().enter();
+            if (pinned) EpochManager::instance().leave();
+            cur_node = other.cur_node;
+            lo = other.lo;
+            bounded = other.bounded;
+            pinned = other.pinned;
+            return *this;
+        }
+
+        ~Iterator() {
+            if (pinned) EpochManager::instance().leave();
+        }
+
+        bool hasNext() {
+            /**
+             * @brief Returns true if the iteration has more elements.
+             */
+            const Node *nnode;
+            const Val *nval;
+            return _try_next(nnode, nval);
+        }
+
+        Entry next() {
+            /**
+             * @brief Returns the next element in the iteration.
+             * @throw ElementNotExist exception when hasNext() == false
+             */
+            const Node *nnode;
+            const Val *nval;
+            if (!_try_next(nnode, nval)) throw ElementNotExist();
+            cur_node = nnode;
+            return Entry(nnode -> key, *nval);
+        }
+};
+
+#endif
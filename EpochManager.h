@@ -0,0 +1,286 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EPOCHMANAGER_H
+#define EPOCHMANAGER_H
+
+#include <cstddef>
+#include <pthread.h>
+#include <sched.h>
+
+/**
+ * EpochManager implements epoch-based memory reclamation for the lock-free
+ * containers. A thread reading shared nodes wraps the access in a critical
+ * section (see EpochManager::Guard). A node unlinked from a shared structure
+ * is handed to retire() instead of being deleted, and it is actually freed
+ * only after every thread which might still hold a pointer to it has left
+ * its critical section.
+ *
+ * Entering and leaving a critical section only writes to the cache line
+ * owned by the calling thread, so readers never contend with each other.
+ *
+ * There is a single process-wide instance. At most MAX_THREADS threads can
+ * use it simultaneously; a thread releases its slot when it exits. Critical
+ * sections can be nested but must be entered and left by the same thread.
+ */
+
+class EpochManager
+{
+    public:
+        class Guard;
+        typedef void (*Deleter)(void *);
+        static const int MAX_THREADS = 256;
+
+        static EpochManager &instance() {
+            /**
+             * @brief Returns the process-wide instance.
+             */
+            static EpochManager inst;
+            return inst;
+        }
+
+        void enter() {
+            /**
+             * @brief Enter a critical section.
+             */
+            Slot *s = _local_slot();
+            if (s -> nest++ == 0)
+            {
+                unsigned int e = __atomic_load_n(&global_epoch,
+                                                __ATOMIC_RELAXED);
+                __atomic_store_n(&s -> state, (e << 1) | 1, __ATOMIC_RELAXED);
+                // the announcement must be visible before any shared read
+                __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            }
+        }
+
+        void leave() {
+            /**
+             * @brief Leave a critical section.
+             */
+            Slot *s = _local_slot();
+            if (--s -> nest == 0)
+                __atomic_store_n(&s -> state, 0, __ATOMIC_RELEASE);
+        }
+
+        void retire(void *ptr, Deleter del) {
+            /**
+             * @brief Schedule ptr to be freed by del(ptr) once no thread
+             * could be reading it. ptr must have been unlinked from the
+             * shared structure already.
+             */
+            Slot *s = _local_slot();
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            Retired *r = new Retired;
+            r -> ptr = ptr;
+            r -> del = del;
+            r -> epoch = __atomic_load_n(&global_epoch, __ATOMIC_RELAXED);
+            _lock(s);
+            r -> next = s -> limbo;
+            s -> limbo = r;
+            bool full = ++s -> limbo_num >= s -> reclaim_at;
+            _unlock(s);
+            if (full)
+            {
+                _try_advance();
+                _reclaim(s);
+            }
+        }
+
+        void synchronize() {
+            /**
+             * @brief Wait until all the critical sections in progress have
+             * finished, then free every pointer retired so far by any
+             * thread.  Must not be called inside a critical section.
+             * The containers never call it, so that destroying one does
+             * not wait for the readers of another; a program can drain
+             * the retired pointers with it, e.g. before measuring memory.
+             */
+            unsigned int target = __atomic_load_n(&global_epoch,
+                                                __ATOMIC_SEQ_CST) + 2;
+            while ((int)(__atomic_load_n(&global_epoch,
+                            __ATOMIC_SEQ_CST) - target) < 0)
+                if (!_try_advance()) sched_yield();
+            for (int i = 0; i < MAX_THREADS; i++)
+                _reclaim(slots + i);
+        }
+
+    private:
+        struct Retired {
+            void *ptr;
+            Deleter del;
+            unsigned int epoch;
+            Retired *next;
+        };
+
+        struct Slot {
+            /**
+             * @var state (epoch << 1) | 1 if the owner is in a critical
+             * section entered at epoch, or 0.
+             * @var in_use Whether the slot is owned by a thread.
+             * @var nest The nesting depth of the owner's critical sections.
+             * @var lock Spin lock protecting limbo and limbo_num, which
+             * are touched by other threads only in synchronize().
+             * @var limbo The pointers retired by the owner.
+             * @var reclaim_at The limbo_num at which the owner tries to
+             * reclaim them next.
+             * @var pad Keep the slots in different cache lines.
+             */
+            unsigned int state;
+            int in_use;
+            int nest;
+            int lock;
+            Retired *limbo;
+            int limbo_num;
+            int reclaim_at;
+            char pad[64];
+        };
+
+        /**
+         * @var RECLAIM_THRESHOLD The number of pointers a thread retires
+         * before it tries to reclaim them.
+         * @var global_epoch The current epoch.
+         * @var key Used to release the slot when the owner thread exits.
+         */
+        static const int RECLAIM_THRESHOLD = 64;
+        unsigned int global_epoch;
+        char pad[64];
+        Slot slots[MAX_THREADS];
+        pthread_key_t key;
+
+        EpochManager() : global_epoch(0) {
+            for (int i = 0; i < MAX_THREADS; i++)
+            {
+                slots[i].state = 0;
+                slots[i].in_use = 0;
+                slots[i].nest = 0;
+                slots[i].lock = 0;
+                slots[i].limbo = NULL;
+                slots[i].limbo_num = 0;
+                slots[i].reclaim_at = RECLAIM_THRESHOLD;
+            }
+            pthread_key_create(&key, _release_slot);
+        }
+
+        EpochManager(const EpochManager &);
+        EpochManager &operator=(const EpochManager &);
+
+        static void _lock(Slot *s) {
+            while (__atomic_exchange_n(&s -> lock, 1, __ATOMIC_ACQUIRE))
+                sched_yield();
+        }
+
+        static void _unlock(Slot *s) {
+            __atomic_store_n(&s -> lock, 0, __ATOMIC_RELEASE);
+        }
+
+        static void _release_slot(void *ptr) {
+            /**
+             * @brief Called on thread exit. The pointers left in the limbo
+             * list are reclaimed by the next owner or by synchronize().
+             */
+            Slot *s = (Slot *)ptr;
+            __atomic_store_n(&s -> state, 0, __ATOMIC_RELEASE);
+            s -> nest = 0;
+            __atomic_store_n(&s -> in_use, 0, __ATOMIC_RELEASE);
+        }
+
+        Slot *_local_slot() {
+            /**
+             * @brief Returns the slot owned by the calling thread, claiming
+             * a free one on the first call. Waits when all slots are taken.
+             */
+            static __thread Slot *local = NULL;
+            if (local) return local;
+            for (int i = 0; ; i++)
+            {
+                if (i == MAX_THREADS)
+                {
+                    i = 0;
+                    sched_yield();
+                }
+                if (__atomic_load_n(&slots[i].in_use, __ATOMIC_RELAXED) == 0
+                    && !__atomic_exchange_n(&slots[i].in_use, 1,
+                                            __ATOMIC_ACQUIRE))
+                {
+                    local = slots + i;
+                    pthread_setspecific(key, local);
+                    return local;
+                }
+            }
+        }
+
+        bool _try_advance() {
+            /**
+             * @brief Advance the global epoch if all the threads in critical
+             * sections have observed the current one.
+             */
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            unsigned int e = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+            for (int i = 0; i < MAX_THREADS; i++)
+            {
+                unsigned int st = __atomic_load_n(&slots[i].state,
+                                                __ATOMIC_SEQ_CST);
+                if ((st & 1) && (st >> 1) != e) return false;
+            }
+            __atomic_compare_exchange_n(&global_epoch, &e, e + 1, false,
+                            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+            return true;
+        }
+
+        void _reclaim(Slot *s) {
+            /**
+             * @brief Free the pointers in the limbo list of s retired at
+             * least two epochs ago, when no reader can be holding them.
+             */
+            unsigned int e = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+            Retired *freed = NULL;
+            _lock(s);
+            for (Retired **pptr = &s -> limbo, *r; (r = *pptr); )
+                if (e - r -> epoch >= 2)
+                {
+                    *pptr = r -> next;
+                    r -> next = freed;
+                    freed = r;
+                    s -> limbo_num--;
+                }
+                else pptr = &(r -> next);
+            // while a reader stalls the epoch the list keeps growing, so
+            // it is not scanned again before as many new retirements
+            s -> reclaim_at = s -> limbo_num + RECLAIM_THRESHOLD;
+            _unlock(s);
+            for (Retired *nr, *r = freed; r; r = nr)
+            {
+                nr = r -> next;
+                r -> del(r -> ptr);
+                delete r;
+            }
+        }
+};
+
+class EpochManager::Guard {
+    /**
+     * @brief Keeps the calling thread in a critical section during its
+     * lifetime.
+     */
+    public:
+    Guard() { EpochManager::instance().enter(); }
+    ~Guard() { EpochManager::instance().leave(); }
+};
+
+#endif
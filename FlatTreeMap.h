@@ -0,0 +1,509 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FLATTREEMAP_H
+#define FLATTREEMAP_H
+
+#include "ElementNotExist.h"
+#include <cstddef>
+
+/**
+ * FlatTreeMap is an ordered map for data built once and read many times,
+ * with the interface of RadixTreeMap.  The keys and the values are kept in
+ * two arrays, with no pointer per entry, so it takes sizeof(Key) +
+ * sizeof(Val) bytes per entry, and a lookup reads only keys.
+ *
+ * The arrays are sorted unless EYTZINGER is true, in which case they hold
+ * the implicit binary search tree in the Eytzinger layout: the root in slot
+ * 1 and the children of slot k in slots 2k and 2k + 1.  A lookup in sorted
+ * arrays is a binary search without branches on the comparisons; in the
+ * Eytzinger layout it goes down the tree, also without branches, and
+ * prefetches the line of the descendants four levels below, which the
+ * first levels share with their siblings.  Iterating the Eytzinger layout
+ * walks the tree in order, a few slots apart at each step.
+ *
+ * freeze() fills the arrays from any ordered map, e.g. a TreeMap, in linear
+ * time.  put() of a present key replaces its value in place; a new key goes
+ * into a small sorted delta buffer, which the lookups and the iterators
+ * consult too, and which is merged into the arrays in linear time once it
+ * holds about sqrt(n) keys, or on flush().  So inserting n keys one by one
+ * takes O(n sqrt(n)) moves in total: build the map with freeze() instead.
+ * remove() of a key in the arrays rebuilds them, in linear time.
+ *
+ * Key and Val should be default-constructible.
+ */
+
+template <class Key, class Val, bool EYTZINGER = false>
+class FlatTreeMap
+{
+    private:
+        /**
+         * @var MIN_DELTA The least number of keys the delta buffer holds
+         * before it is merged.
+         * @var PREFETCH_STRIDE The keys in a cache line, so that slot k *
+         * PREFETCH_STRIDE starts the line of the first descendant of slot k
+         * four levels below, when a line holds 16 keys.
+         * @var keys, vals The main arrays of main_num entries, in slots
+         * [0, main_num) if sorted, or [1, main_num] in the Eytzinger layout.
+         * @var delta_keys, delta_vals The sorted delta buffer of delta_num
+         * keys, none of which is in the main arrays, of capacity delta_cap.
+         */
+        static const int MIN_DELTA = 64;
+        static const int PREFETCH_STRIDE =
+            sizeof(Key) < 64 ? 64 / sizeof(Key) : 1;
+        Key *keys;
+        Val *vals;
+        int main_num;
+        Key *delta_keys;
+        Val *delta_vals;
+        int delta_num, delta_cap;
+
+        /**
+         * @brief The slots of n entries in key order: from _first(n), each
+         * followed by _next(k, n), up to _end(n).
+         */
+        static int _first(int n) {
+            if (!EYTZINGER) return 0;
+            if (n == 0) return 0;
+            int k = 1;
+            while (2 * k <= n) k *= 2;
+            return k;
+        }
+
+        static int _end(int n) { return EYTZINGER ? 0 : n; }
+
+        static int _next(int k, int n) {
+            if (!EYTZINGER) return k + 1;
+            if (2 * k + 1 <= n)
+            {
+                // the leftmost slot of the right subtree
+                k = 2 * k + 1;
+                while (2 * k <= n) k *= 2;
+                return k;
+            }
+            // climb past the right children, then once more
+            return k >> __builtin_ffs(~k);
+        }
+
+        int _lower_bound(const Key &key) const {
+            /**
+             * @brief Returns the slot of the least key not less than key in
+             * the main arrays, or _end(main_num).
+             */
+            if (EYTZINGER)
+            {
+                int k = 1;
+                while (k <= main_num)
+                {
+                    __builtin_prefetch(keys + (size_t)k * PREFETCH_STRIDE);
+                    k = 2 * k + (keys[k] < key);
+                }
+                return k >> __builtin_ffs(~k);
+            }
+            if (main_num == 0) return 0;
+            const Key *base = keys;
+            for (int n = main_num; n > 1; )
+            {
+                int half = n >> 1;
+                base = base[half] < key ? base + half : base;
+                n -= half;
+            }
+            return (int)(base - keys) + (*base < key);
+        }
+
+        int _find(const Key &key) const {
+            // @brief Returns the slot of key in the main arrays, or -1.
+            int k = _lower_bound(key);
+            return k != _end(main_num) && keys[k] == key ? k : -1;
+        }
+
+        int _delta_lower_bound(const Key &key) const {
+            int lo = 0, hi = delta_num;
+            while (lo < hi)
+            {
+                int mid = (lo + hi) >> 1;
+                if (delta_keys[mid] < key) lo = mid + 1;
+                else hi = mid;
+            }
+            return lo;
+        }
+
+        int _delta_limit() const {
+            // @brief A power of two not less than sqrt(main_num).
+            int lim = MIN_DELTA;
+            while ((long long)lim * lim < main_num) lim <<= 1;
+            return lim;
+        }
+
+        void _merge(int skip) {
+            /**
+             * @brief Rebuild the main arrays from the entries of the main
+             * arrays, but the one in slot skip if it is not -1, and those of
+             * the delta buffer, in linear time.
+             */
+            int n = main_num + delta_num - (skip >= 0);
+            Key *new_keys = new Key[n + EYTZINGER];
+            Val *new_vals = new Val[n + EYTZINGER];
+            int k = _first(main_num), end = _end(main_num), d = 0;
+            for (int t = _first(n); t != _end(n); t = _next(t, n))
+            {
+                if (k == skip) k = _next(k, main_num);
+                if (k != end && (d == delta_num || keys[k] < delta_keys[d]))
+                {
+                    new_keys[t] = keys[k];
+                    new_vals[t] = vals[k];
+                    k = _next(k, main_num);
+                }
+                else
+                {
+                    new_keys[t] = delta_keys[d];
+                    new_vals[t] = delta_vals[d++];
+                }
+            }
+            delete[] keys;
+            delete[] vals;
+            keys = new_keys;
+            vals = new_vals;
+            main_num = n;
+            delta_num = 0;
+        }
+
+        void _alloc(int n) {
+            // @brief Set up main arrays of n entries and no delta buffer.
+            keys = new Key[n + EYTZINGER];
+            vals = new Val[n + EYTZINGER];
+            main_num = n;
+            delta_keys = NULL;
+            delta_vals = NULL;
+            delta_num = delta_cap = 0;
+        }
+
+        void _free() {
+            delete[] keys;
+            delete[] vals;
+            delete[] delta_keys;
+            delete[] delta_vals;
+        }
+
+        void _copy(const FlatTreeMap &other) {
+            _alloc(other.main_num);
+            for (int i = 0; i < main_num + EYTZINGER; i++)
+            {
+                keys[i] = other.keys[i];
+                vals[i] = other.vals[i];
+            }
+            if ((delta_num = delta_cap = other.delta_num))
+            {
+                delta_keys = new Key[delta_cap];
+                delta_vals = new Val[delta_cap];
+                for (int i = 0; i < delta_num; i++)
+                {
+                    delta_keys[i] = other.delta_keys[i];
+                    delta_vals[i] = other.delta_vals[i];
+                }
+            }
+        }
+
+    public:
+        class Entry;
+        class Iterator;
+
+        FlatTreeMap() {
+            /**
+             * @brief Constructs an empty flat map.
+             */
+            _alloc(0);
+        }
+
+        ~FlatTreeMap() {
+            /**
+             * @brief Destructor
+             */
+            _free();
+        }
+
+        FlatTreeMap &operator=(const FlatTreeMap &other) {
+            /**
+             * @brief Assignment operator
+             */
+            if (this != &other)
+            {
+                _free();
+                _copy(other);
+            }
+            return *this;
+        }
+
+        FlatTreeMap(const FlatTreeMap &other) {
+            /**
+             * @brief Copy-constructor
+             */
+            _copy(other);
+        }
+
+        /**
+         * @brief Returns an iterator over the elements in this map in key
+         * order, from the least key (iterator()) or from the least key not
+         * less than lo (iterator(lo)).
+         */
+        Iterator iterator() const { return Iterator(this, NULL); }
+        Iterator iterator(const Key &lo) const { return Iterator(this, &lo); }
+
+        template <class Map>
+        void freeze(const Map &map) {
+            /**
+             * @brief Replace the mappings of this map by those of an ordered
+             * map, e.g. a TreeMap, whose iterator returns its keys in
+             * ascending order, in linear time.
+             */
+            int n = map.size();
+            _free();
+            _alloc(n);
+            typename Map::Iterator it = map.iterator();
+            for (int t = _first(n); t != _end(n); t = _next(t, n))
+            {
+                typename Map::Entry e = it.next();
+                keys[t] = e.getKey();
+                vals[t] = e.getValue();
+            }
+        }
+
+        void flush() {
+            /**
+             * @brief Merge the delta buffer into the main arrays, in linear
+             * time.
+             */
+            if (delta_num) _merge(-1);
+        }
+
+        void clear() {
+            /**
+             * @brief Removes all of the mappings from this map.
+             */
+            _free();
+            _alloc(0);
+        }
+
+        bool containsKey(const Key &key) const {
+            /**
+             * @brief Returns true if this map contains a mapping for the
+             * specified key.
+             */
+            if (_find(key) >= 0) return true;
+            int i = _delta_lower_bound(key);
+            return i < delta_num && delta_keys[i] == key;
+        }
+
+        bool containsValue(const Val &value) const {
+            /**
+             * @brief Returns true if this map maps one or more keys to the
+             * specified value.
+             */
+            for (int i = EYTZINGER; i < main_num + EYTZINGER; i++)
+                if (vals[i] == value) return true;
+            for (int i = 0; i < delta_num; i++)
+                if (delta_vals[i] == value) return true;
+            return false;
+        }
+
+        const Val &get(const Key &key) const {
+            /**
+             * @brief Returns a const reference to the value to which the
+             * specified key is mapped.  If the key is not present in this
+             * map, this function should throw ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            int k = _find(key);
+            if (k >= 0) return vals[k];
+            int i = _delta_lower_bound(key);
+            if (i == delta_num || !(delta_keys[i] == key))
+                throw ElementNotExist();
+            return delta_vals[i];
+        }
+
+        const Key &firstKey() const {
+            /**
+             * @brief Returns the least key in this map.
+             * @throw ElementNotExist if the map is empty
+             */
+            Iterator it = iterator();
+            if (!it.hasNext()) throw ElementNotExist();
+            return it._key();
+        }
+
+        const Key &ceilingKey(const Key &key) const {
+            /**
+             * @brief Returns the least key greater than or equal to the given
+             * key, in O(log n).
+             * @throw ElementNotExist if there is no such key
+             */
+            Iterator it = iterator(key);
+            if (!it.hasNext()) throw ElementNotExist();
+            return it._key();
+        }
+
+        // @brief Returns true if this map contains no key-value mappings.
+        bool isEmpty() const { return size() == 0; }
+
+        void put(const Key &key, const Val &value) {
+            /**
+             * @brief Associates the specified value with the specified key in
+             * this map.  A new key is inserted into the delta buffer, which
+             * is merged into the main arrays when it is full.
+             */
+            int k = _find(key);
+            if (k >= 0)
+            {
+                vals[k] = value; // alter the value
+                return;
+            }
+            int i = _delta_lower_bound(key);
+            if (i < delta_num && delta_keys[i] == key)
+            {
+                delta_vals[i] = value;
+                return;
+            }
+            if (delta_num == delta_cap)
+            {
+                delta_cap = delta_cap ? delta_cap * 2 : MIN_DELTA;
+                Key *new_keys = new Key[delta_cap];
+                Val *new_vals = new Val[delta_cap];
+                for (int j = 0; j < delta_num; j++)
+                {
+                    new_keys[j] = delta_keys[j];
+                    new_vals[j] = delta_vals[j];
+                }
+                delete[] delta_keys;
+                delete[] delta_vals;
+                delta_keys = new_keys;
+                delta_vals = new_vals;
+            }
+            for (int j = delta_num; j > i; j--)
+            {
+                delta_keys[j] = delta_keys[j - 1];
+                delta_vals[j] = delta_vals[j - 1];
+            }
+            delta_keys[i] = key;
+            delta_vals[i] = value;
+            if (++delta_num >= _delta_limit()) _merge(-1);
+        }
+
+        void remove(const Key &key) {
+            /**
+             * @brief Removes the mapping for the specified key from this map
+             * if present.  If there is no mapping for the specified key,
+             * throws ElementNotExist exception.  Removing a key of the main
+             * arrays rebuilds them, in linear time.
+             * @throw ElementNotExist
+             */
+            int k = _find(key);
+            if (k >= 0)
+            {
+                _merge(k);
+                return;
+            }
+            int i = _delta_lower_bound(key);
+            if (i == delta_num || !(delta_keys[i] == key))
+                throw ElementNotExist();
+            for (int j = i + 1; j < delta_num; j++)
+            {
+                delta_keys[j - 1] = delta_keys[j];
+                delta_vals[j - 1] = delta_vals[j];
+            }
+            delta_num--;
+        }
+
+        // @brief Returns the number of key-value mappings in this map.
+        int size() const { return main_num + delta_num; }
+};
+
+template <class Key, class Val, bool EYTZINGER>
+class FlatTreeMap<Key, Val, EYTZINGER>::Entry {
+    Key key;
+    Val value;
+    public:
+    Entry(Key k, Val v)
+    {
+        key = k;
+        value = v;
+    }
+
+    Key getKey() const
+    {
+        return key;
+    }
+
+    Val getValue() const
+    {
+        return value;
+    }
+};
+
+template <class Key, class Val, bool EYTZINGER>
+class FlatTreeMap<Key, Val, EYTZINGER>::Iterator {
+    private:
+        friend class FlatTreeMap;
+        /**
+         * @var slot, delta The next entries of the main arrays and of the
+         * delta buffer; the iterator returns the less of them.
+         */
+        const FlatTreeMap *con;
+        int slot, delta;
+
+        bool _from_main() const {
+            return slot != _end(con -> main_num) &&
+                (delta == con -> delta_num ||
+                 con -> keys[slot] < con -> delta_keys[delta]);
+        }
+
+        const Key &_key() const {
+            return _from_main() ? con -> keys[slot] : con -> delta_keys[delta];
+        }
+
+    public:
+        Iterator() {}
+        Iterator(const FlatTreeMap *_con, const Key *lo) : con(_con) {
+            slot = lo ? con -> _lower_bound(*lo) : _first(con -> main_num);
+            delta = lo ? con -> _delta_lower_bound(*lo) : 0;
+        }
+
+        bool hasNext() {
+            /**
+             * @brief Returns true if the iteration has more elements.
+             */
+            return slot != _end(con -> main_num) || delta < con -> delta_num;
+        }
+
+        Entry next() {
+            /**
+             * @brief Returns the next element in the iteration.
+             * @throw ElementNotExist exception when hasNext() == false
+             */
+            if (!hasNext()) throw ElementNotExist();
+            if (_from_main())
+            {
+                int k = slot;
+                slot = _next(slot, con -> main_num);
+                return Entry(con -> keys[k], con -> vals[k]);
+            }
+            int i = delta++;
+            return Entry(con -> delta_keys[i], con -> delta_vals[i]);
+        }
+};
+
+#endif
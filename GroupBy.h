@@ -0,0 +1,466 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GROUPBY_H
+#define GROUPBY_H
+
+#include "ArrayList.h"
+#include "HashMix.h"
+#include <pthread.h>
+
+/**
+ * GroupBy aggregates a stream of (key, value) rows by key, replacing the
+ * naive loop of containsKey(), get() and put() on a map for every row.
+ *
+ * The rows are hashed once and appended to the buffer of their partition,
+ * chosen by the highest bits of the hash code.  When the buffers are full,
+ * each partition is aggregated into its own small open-addressing table,
+ * with a single probe per row.  A partition holds only a fraction of the
+ * groups, so its table stays in the cache while its rows are aggregated, and
+ * different partitions never share a group, so they can be aggregated by
+ * different threads without any lock.  collect() aggregates the rows left
+ * and puts the result of each group into a map.
+ *
+ * The partitions are multiplied when a table outgrows MAX_TABLE_BYTES, about
+ * a private L2 cache, by splitting each of them along the next bits of the
+ * hash codes, so the tables stay that small up to about 2^22 groups.
+ * The threads are started once by the constructor and wait for the
+ * buffers to fill between flushes; the calling thread aggregates too.
+ *
+ * Template argument Hash has the same meaning as in HashMap.  Agg is the
+ * aggregate function, a class with a type Acc and two static functions:
+ * @code
+ *      static void init(Acc &acc, const Val &val);   // the first row
+ *      static void update(Acc &acc, const Val &val); // any further row
+ * @endcode
+ * SumAgg, CountAgg, MinAgg and MaxAgg are provided.  Key and Acc should be
+ * default-constructible.  For example
+ * @code
+ *      GroupBy<int, int, Hashint, SumAgg<int> > sum(4); // with 4 threads
+ *      for (...) sum.add(key, value);
+ *      HashMap<int, int, Hashint> result;
+ *      sum.collect(result);
+ * @endcode
+ */
+
+template <class Val>
+struct SumAgg {
+    typedef Val Acc;
+    static void init(Acc &acc, const Val &val) { acc = val; }
+    static void update(Acc &acc, const Val &val) { acc += val; }
+};
+
+template <class Val>
+struct CountAgg {
+    typedef long long Acc;
+    static void init(Acc &acc, const Val &) { acc = 1; }
+    static void update(Acc &acc, const Val &) { acc++; }
+};
+
+template <class Val>
+struct MinAgg {
+    typedef Val Acc;
+    static void init(Acc &acc, const Val &val) { acc = val; }
+    static void update(Acc &acc, const Val &val) { if (val < acc) acc = val; }
+};
+
+template <class Val>
+struct MaxAgg {
+    typedef Val Acc;
+    static void init(Acc &acc, const Val &val) { acc = val; }
+    static void update(Acc &acc, const Val &val) { if (acc < val) acc = val; }
+};
+
+template <class Key, class Val, class Hash, class Agg>
+class GroupBy
+{
+    public:
+        typedef typename Agg::Acc Acc;
+    private:
+        struct Row;
+        struct Table;
+        /**
+         * @var MIN_PARTITION_BITS, MAX_PARTITION_BITS The partitions are
+         * chosen by this many highest bits of the hash code, at first and
+         * at most; scattering the rows among more buffers would cost more
+         * than the smaller tables save.
+         * @var MAX_TABLE_BYTES The partitions are multiplied when a table
+         * gets larger.
+         * @var FLUSH_ROWS The rows buffered before they are aggregated.
+         * @var partition_bits The partitions are chosen by this many highest
+         * bits of the hash code.
+         * @var partition_num The number of partitions.
+         * @var buffer The rows buffered for each partition.
+         * @var table The groups of each partition.
+         * @var buffered_num The total number of rows buffered.
+         * @var thread_num The number of threads aggregating the partitions.
+         * @var hash_func User-defined hash fuction.
+         */
+        static const int MIN_PARTITION_BITS = 6;
+        static const int MAX_PARTITION_BITS = 10;
+        static const int MAX_TABLE_BYTES = 1 << 18;
+        static const int FLUSH_ROWS = 1 << 18;
+        int partition_bits, partition_num;
+        ArrayList<Row> *buffer;
+        Table *table;
+        int buffered_num;
+        int thread_num;
+        Hash hash_func;
+        /**
+         * @var workers The threads helping the caller to aggregate.
+         * @var lock Guards round, running and stopping.
+         * @var start_cond Signalled when a round starts or the threads stop.
+         * @var done_cond Signalled when the last worker finishes its round.
+         * @var round The number of flushes run by the threads.
+         * @var running The workers still aggregating in this round.
+         * @var stopping Whether the workers should exit.
+         * @var next_part The next partition to be claimed in this round.
+         */
+        pthread_t *workers;
+        pthread_mutex_t lock;
+        pthread_cond_t start_cond, done_cond;
+        unsigned long round;
+        int running;
+        bool stopping;
+        int next_part;
+
+        unsigned int _hash(const Key &key) const {
+            /**
+             * @brief Scramble the user-defined hash code, so that both ends
+             * of it are usable.
+             */
+            return hashMix(hash_func.hashCode(key));
+        }
+
+        void _alloc_partitions(int bits) {
+            partition_bits = bits;
+            partition_num = 1 << bits;
+            buffer = new ArrayList<Row>[partition_num];
+            table = new Table[partition_num];
+        }
+
+        void _free_partitions() {
+            delete[] buffer;
+            delete[] table;
+        }
+
+        void _aggregate(int part) {
+            ArrayList<Row> &buf = buffer[part];
+            for (int i = 0; i < buf.size(); i++)
+            {
+                const Row &r = buf.get(i);
+                table[part].aggregate(r.hash, r.key, r.val);
+            }
+            buf.clear();
+        }
+
+        void _aggregate_claimed() {
+            // @brief Aggregate the partitions not claimed by other threads.
+            for (int i; (i = __sync_fetch_and_add(&next_part, 1)) <
+                        partition_num; )
+                _aggregate(i);
+        }
+
+        static void *_run_worker(void *arg) {
+            GroupBy *owner = (GroupBy *)arg;
+            unsigned long seen = 0;
+            pthread_mutex_lock(&owner -> lock);
+            for (;;)
+            {
+                while (owner -> round == seen && !owner -> stopping)
+                    pthread_cond_wait(&owner -> start_cond, &owner -> lock);
+                if (owner -> stopping) break;
+                seen = owner -> round;
+                pthread_mutex_unlock(&owner -> lock);
+                owner -> _aggregate_claimed();
+                pthread_mutex_lock(&owner -> lock);
+                if (--owner -> running == 0)
+                    pthread_cond_signal(&owner -> done_cond);
+            }
+            pthread_mutex_unlock(&owner -> lock);
+            return NULL;
+        }
+
+        void _flush() {
+            /**
+             * @brief Aggregate all the rows buffered, the threads claiming
+             * the partitions one by one, then multiply the partitions if a
+             * table got too large.
+             */
+            next_part = 0;
+            if (thread_num <= 1) _aggregate_claimed();
+            else
+            {
+                pthread_mutex_lock(&lock);
+                running = thread_num - 1;
+                round++;
+                pthread_cond_broadcast(&start_cond);
+                pthread_mutex_unlock(&lock);
+                _aggregate_claimed();
+                pthread_mutex_lock(&lock);
+                while (running) pthread_cond_wait(&done_cond, &lock);
+                pthread_mutex_unlock(&lock);
+            }
+            buffered_num = 0;
+            _repartition();
+        }
+
+        void _repartition() {
+            /**
+             * @brief If the largest table is over MAX_TABLE_BYTES, move the
+             * groups into enough partitions for the tables to be a quarter
+             * as large, splitting each partition along the next bits of the
+             * hash codes.  The buffers are empty.
+             */
+            unsigned int max_size = 0;
+            int group_num = 0;
+            for (int i = 0; i < partition_num; i++)
+            {
+                if (table[i].mask + 1 > max_size) max_size = table[i].mask + 1;
+                group_num += table[i].elem_num;
+            }
+            if ((long long)max_size * Table::SLOT_BYTES <= MAX_TABLE_BYTES ||
+                partition_bits == MAX_PARTITION_BITS)
+                return;
+            int bits = partition_bits + 1;
+            // a table is at most half full, so a group takes two slots
+            while (bits < MAX_PARTITION_BITS &&
+                    ((long long)group_num >> bits) * 2 * Table::SLOT_BYTES >
+                    MAX_TABLE_BYTES / 4)
+                bits++;
+            Table *old_table = table;
+            int old_num = partition_num, split = bits - partition_bits;
+            delete[] buffer;
+            _alloc_partitions(bits);
+            for (int i = 0; i < old_num; i++)
+            {
+                const Table &t = old_table[i];
+                // the groups of a partition go to its 1 << split children
+                for (int c = 0; c < 1 << split; c++)
+                    table[(i << split) + c].reserve(
+                            (t.elem_num >> split) * 9 / 8);
+                for (unsigned int j = 0; j <= t.mask; j++)
+                    if (t.used[j])
+                        table[t.slot[j].hash >> (32 - bits)].place(t.slot[j]);
+            }
+            delete[] old_table;
+        }
+
+        GroupBy(const GroupBy &);
+        GroupBy &operator=(const GroupBy &);
+
+    public:
+        GroupBy(int _thread_num = 1) : thread_num(_thread_num) {
+            /**
+             * @brief Constructs an empty aggregation whose partitions are
+             * aggregated by _thread_num threads, starting _thread_num - 1
+             * of them to help the calling thread.
+             */
+            _alloc_partitions(MIN_PARTITION_BITS);
+            buffered_num = 0;
+            hash_func = Hash();
+            round = 0;
+            running = 0;
+            stopping = false;
+            workers = NULL;
+            if (thread_num <= 1) return;
+            pthread_mutex_init(&lock, NULL);
+            pthread_cond_init(&start_cond, NULL);
+            pthread_cond_init(&done_cond, NULL);
+            workers = new pthread_t[thread_num - 1];
+            for (int i = 0; i < thread_num - 1; i++)
+                pthread_create(workers + i, NULL, _run_worker, this);
+        }
+
+        ~GroupBy() {
+            /**
+             * @brief Destructor. Stops the threads.
+             */
+            if (workers)
+            {
+                pthread_mutex_lock(&lock);
+                stopping = true;
+                pthread_cond_broadcast(&start_cond);
+                pthread_mutex_unlock(&lock);
+                for (int i = 0; i < thread_num - 1; i++)
+                    pthread_join(workers[i], NULL);
+                delete[] workers;
+                pthread_mutex_destroy(&lock);
+                pthread_cond_destroy(&start_cond);
+                pthread_cond_destroy(&done_cond);
+            }
+            _free_partitions();
+        }
+
+        void add(const Key &key, const Val &val) {
+            /**
+             * @brief Feed a row.
+             */
+            unsigned int hv = _hash(key);
+            buffer[hv >> (32 - partition_bits)].add(Row(hv, key, val));
+            if (++buffered_num >= FLUSH_ROWS) _flush();
+        }
+
+        void add(const Key *keys, const Val *vals, int row_num) {
+            /**
+             * @brief Feed a batch of rows.
+             */
+            for (int i = 0; i < row_num; i++) add(keys[i], vals[i]);
+        }
+
+        int groupCount() {
+            /**
+             * @brief Returns the number of groups, aggregating the rows
+             * buffered first.
+             */
+            _flush();
+            int res = 0;
+            for (int i = 0; i < partition_num; i++) res += table[i].elem_num;
+            return res;
+        }
+
+        template <class Map>
+        void collect(Map &out) {
+            /**
+             * @brief Aggregate the rows buffered, then put (key, result) of
+             * every group into out.  The groups are kept, so more rows can
+             * be added and collected again.
+             */
+            _flush();
+            for (int i = 0; i < partition_num; i++)
+            {
+                const Table &t = table[i];
+                for (unsigned int j = 0; j <= t.mask; j++)
+                    if (t.used[j]) out.put(t.slot[j].key, t.slot[j].acc);
+            }
+        }
+
+        void clear() {
+            /**
+             * @brief Drop all the rows and groups.
+             */
+            _free_partitions();
+            _alloc_partitions(MIN_PARTITION_BITS);
+            buffered_num = 0;
+        }
+};
+
+template <class Key, class Val, class Hash, class Agg>
+struct GroupBy<Key, Val, Hash, Agg>::Row {
+    unsigned int hash;
+    Key key;
+    Val val;
+    Row() {}
+    Row(unsigned int _hash, const Key &_key, const Val &_val) :
+        hash(_hash), key(_key), val(_val) {}
+};
+
+template <class Key, class Val, class Hash, class Agg>
+struct GroupBy<Key, Val, Hash, Agg>::Table {
+    /**
+     * @brief An open-addressing table probed linearly, with the cached hash
+     * code, the key and the accumulator of a group in the same slot.  It is
+     * kept at most half full.
+     * @var INIT_SIZE The initial number of slots, a power of two.
+     * @var SLOT_BYTES The bytes taken by a slot.
+     * @var used Whether each slot holds a group.
+     */
+    struct Slot {
+        unsigned int hash;
+        Key key;
+        Acc acc;
+    };
+    static const unsigned int INIT_SIZE = 16;
+    static const int SLOT_BYTES = sizeof(Slot) + sizeof(bool);
+    Slot *slot;
+    bool *used;
+    unsigned int mask;
+    int elem_num;
+
+    Table() { _alloc(INIT_SIZE); }
+
+    ~Table() {
+        delete[] slot;
+        delete[] used;
+    }
+
+    void _alloc(unsigned int size) {
+        slot = new Slot[size];
+        used = new bool[size];
+        for (unsigned int i = 0; i < size; i++) used[i] = false;
+        mask = size - 1;
+        elem_num = 0;
+    }
+
+    void aggregate(unsigned int hv, const Key &key, const Val &val) {
+        /**
+         * @brief Update the group of key with val, creating the group if it
+         * is new.
+         */
+        unsigned int i = hv & mask;
+        for (; used[i]; i = (i + 1) & mask)
+            if (slot[i].hash == hv && slot[i].key == key)
+            {
+                Agg::update(slot[i].acc, val);
+                return;
+            }
+        if ((elem_num + 1) * 2 > (int)mask + 1)
+        {
+            grow();
+            for (i = hv & mask; used[i]; i = (i + 1) & mask);
+        }
+        used[i] = true;
+        slot[i].hash = hv;
+        slot[i].key = key;
+        Agg::init(slot[i].acc, val);
+        elem_num++;
+    }
+
+    void reserve(int num) {
+        // @brief Make room for num groups while the table is empty.
+        unsigned int size = INIT_SIZE;
+        while ((int)size < num * 2 + 2) size <<= 1;
+        if (size == mask + 1) return;
+        delete[] slot;
+        delete[] used;
+        _alloc(size);
+    }
+
+    void place(const Slot &s) {
+        // @brief Add the group of s, which is not in this table.
+        if ((elem_num + 1) * 2 > (int)mask + 1) grow();
+        unsigned int i = s.hash & mask;
+        while (used[i]) i = (i + 1) & mask;
+        used[i] = true;
+        slot[i] = s;
+        elem_num++;
+    }
+
+    void grow() {
+        Slot *old_slot = slot;
+        bool *old_used = used;
+        unsigned int old_size = mask + 1;
+        _alloc(old_size * 2);
+        for (unsigned int j = 0; j < old_size; j++)
+            if (old_used[j]) place(old_slot[j]);
+        delete[] old_slot;
+        delete[] old_used;
+    }
+};
+
+#endif
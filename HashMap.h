@@ -20,6 +20,8 @@
 #define HASHMAP_H
 
 #include "ElementNotExist.h"
+#include "HashMapImage.h"
+#include "HashMapStats.h"
 #include <cstring>
 
 /**
@@ -58,42 +60,268 @@
  *
  * The order of iteration could be arbitary in HashMap. But it should be
  * guaranteed that each (key, value) pair be iterated exactly once.
+ *
+ * Each node caches the full hash code of its key, so that a chain walk only
+ * calls operator== on the keys whose hash codes are equal, and hashCode is
+ * never called again once the key is stored.
+ *
+ * When the optional template argument INLINE_HEAD is true, the first entry
+ * of each chain is stored in the bucket array itself, which saves a pointer
+ * chase and an allocation for every key without collision at the price of a
+ * larger bucket array.  Key and Val should be default-constructible then.
+ *
+ * Copying a HashMap takes constant time: the copies share the buckets and
+ * the nodes by reference counting until one of them is modified.  The bucket
+ * array is divided into pages, and a modification only copies the page of
+ * the touched bucket and the part of its chain in front of the touched node.
+ * Different copies may be used by different threads, but a single HashMap
+ * instance is not thread-safe.
+ *
+ * A HashMap with trivially copyable Key and Val can be saved to an image
+ * file by save(), which HashMapView serves directly from the page cache.
+ *
+ * stats() reports the shape of the table and, when the optional template
+ * argument Stats is HashMapProbeStats, the probes taken by the lookups (see
+ * HashMapStats).
  */
 
-template <class Key, class Val, class Hash>
+template <class Node, bool INLINE_HEAD>
+struct HashMapBucket;
+
+template <class Node>
+struct HashMapBucket<Node, false> {
+    /**
+     * @brief A bucket holding only the pointer to the chain.
+     */
+    Node *head;
+
+    // @brief Returns the first node of the chain, or NULL if it is empty.
+    Node *first() const { return head; }
+
+    // @brief Returns the link pointing to the successor of prv.
+    Node *&link(Node *prv) { return prv ? prv -> next : head; }
+
+    void init() { head = NULL; }
+
+    void share(const HashMapBucket &src) { Node::grab(head = src.head); }
+
+    void release() { Node::release(head); }
+
+    template <class Key, class Val>
+    void push(const Key &key, const Val &val, unsigned int hash) {
+        head = new Node(key, val, hash, head);
+    }
+
+    void erase(Node *prv, Node *p) {
+        /**
+         * @brief Unlink p, whose predecessor prv (NULL if p is the first
+         * one) should be private to this bucket.
+         */
+        Node::grab(link(prv) = p -> next);
+        Node::release(p);
+    }
+};
+
+template <class Node>
+struct HashMapBucket<Node, true> {
+    /**
+     * @brief A bucket holding the first node of the chain in place. The
+     * chain is empty iff used is false, and slot.next points to the rest of
+     * it.
+     */
+    Node slot;
+    bool used;
+
+    Node *first() const { return used ? const_cast<Node *>(&slot) : NULL; }
+
+    Node *&link(Node *prv) { return prv ? prv -> next : slot.next; }
+
+    void init() {
+        slot.next = NULL;
+        used = false;
+    }
+
+    void share(const HashMapBucket &src) {
+        if ((used = src.used))
+        {
+            slot.key = src.slot.key;
+            slot.val = src.slot.val;
+            slot.hash = src.slot.hash;
+        }
+        Node::grab(slot.next = src.slot.next);
+    }
+
+    void release() { Node::release(slot.next); }
+
+    template <class Key, class Val>
+    void push(const Key &key, const Val &val, unsigned int hash) {
+        if (used)
+            slot.next = new Node(key, val, hash, slot.next);
+        else
+        {
+            slot.key = key;
+            slot.val = val;
+            slot.hash = hash;
+            used = true;
+        }
+    }
+
+    void erase(Node *prv, Node *p) {
+        if (p == &slot)
+        {
+            /* move the second node into the slot */
+            if ((p = slot.next) == NULL)
+            {
+                used = false;
+                return;
+            }
+            slot.key = p -> key;
+            slot.val = p -> val;
+            slot.hash = p -> hash;
+        }
+        Node::grab(link(prv) = p -> next);
+        Node::release(p);
+    }
+};
+
+template <class Key, class Val, class Hash, bool INLINE_HEAD = false,
+         class Stats = HashMapNoStats>
 class HashMap
 {
     private:
         struct Node;
+        struct Page;
+        struct Table;
+        typedef HashMapBucket<Node, INLINE_HEAD> Bucket;
         /**
          * @var HASH_TABLE_SIZE The size of bucket which is expected to be a
          * prime.
-         * @var head The bucket, an array of pointers to Node instance.
+         * @var PAGE_SIZE The number of buckets in a page, the unit of
+         * copying when the buckets are shared.
+         * @var PAGE_NUM The number of pages.
+         * @var table The directory of the pages, shared among the copies.
          * @var hash_func User-defined hash fuction.
          * @var elem_num The total number of elements in the container.
+         * @var probe_stats The lookup counters, updated by const lookups
+         * only: put() and remove() search without counting.
          */
         static const int HASH_TABLE_SIZE = 611953;
-        Node **head;
+        static const int PAGE_SIZE = 1024;
+        static const int PAGE_NUM = (HASH_TABLE_SIZE + PAGE_SIZE - 1) / PAGE_SIZE;
+        Table *table;
         Hash hash_func;
         int elem_num;
+        mutable Stats probe_stats;
 
-        unsigned int _rectify(const Key &key) const {
+        unsigned int _hash(const Key &key) const {
             /**
-             * @brief Rectify the hash code to fit the size of the bucket.
+             * @brief Returns the full hash code to be cached in the node.
              */
-            return (unsigned int)hash_func.hashCode(key) % HASH_TABLE_SIZE;
+            return (unsigned int)hash_func.hashCode(key);
+        }
+
+        // @brief Rectify the hash code to fit the size of the bucket.
+        static int _rectify(unsigned int hv) { return hv % HASH_TABLE_SIZE; }
+
+        static bool _shared(const int &ref) {
+            return __atomic_load_n(&ref, __ATOMIC_ACQUIRE) > 1;
+        }
+
+        static void _release_page(Page *pg) {
+            if (pg && __sync_sub_and_fetch(&pg -> ref, 1) == 0)
+            {
+                for (int i = 0; i < PAGE_SIZE; i++)
+                    pg -> bucket[i].release();
+                delete pg;
+            }
         }
 
-        void _clear_nodes() {
-            /*
-             * @brief Free all allocated nodes in storage.
+        static void _release_table(Table *t) {
+            if (__sync_sub_and_fetch(&t -> ref, 1) == 0)
+            {
+                for (int i = 0; i < PAGE_NUM; i++)
+                    _release_page(t -> page[i]);
+                delete t;
+            }
+        }
+
+        const Bucket *_bucket(int idx) const {
+            /**
+             * @brief Returns the bucket for reading, or NULL if its page has
+             * not been allocated.
              */
-            for (int i = 0; i < HASH_TABLE_SIZE; i++)
-                for (Node *np, *p = head[i]; p; p = np)
-                {
-                    np = p -> next;
-                    delete p;
-                }
+            const Page *pg = table -> page[idx / PAGE_SIZE];
+            return pg ? pg -> bucket + idx % PAGE_SIZE : NULL;
+        }
+
+        Bucket &_own_bucket(int idx) {
+            /**
+             * @brief Returns the bucket for writing. The directory and the
+             * page are copied first if they are shared with other maps.
+             */
+            if (_shared(table -> ref))
+            {
+                Table *t = new Table(*table);
+                _release_table(table);
+                table = t;
+            }
+            Page *&pg = table -> page[idx / PAGE_SIZE];
+            if (pg == NULL) pg = new Page();
+            else if (_shared(pg -> ref))
+            {
+                Page *np = new Page(*pg);
+                _release_page(pg);
+                pg = np;
+            }
+            return pg -> bucket[idx % PAGE_SIZE];
+        }
+
+        static Node *_search(const Bucket *b, unsigned int hv, const Key &key) {
+            if (b)
+                for (Node *p = b -> first(); p; p = p -> next)
+                    if (p -> hash == hv && p -> key == key) return p;
+            return NULL;
+        }
+
+        Node *_lookup(const Bucket *b, unsigned int hv, const Key &key) const {
+            /**
+             * @brief _search() for the read-only operations, recording the
+             * number of keys compared.
+             */
+            int probes = 0;
+            Node *p = b ? b -> first() : NULL;
+            for (; p; p = p -> next)
+            {
+                probes++;
+                if (p -> hash == hv && p -> key == key) break;
+            }
+            probe_stats.lookup(probes);
+            return p;
+        }
+
+        static Node *_own(Bucket &b, Node *prv, Node *p) {
+            /**
+             * @brief Make p private to b, given its predecessor prv (NULL
+             * for the first node) is already private.  Returns the node
+             * that replaces p.
+             */
+            if (!_shared(p -> ref)) return p;
+            Node *q = new Node(p -> key, p -> val, p -> hash, p -> next);
+            Node::grab(p -> next);
+            b.link(prv) = q;
+            Node::release(p);
+            return q;
+        }
+
+        static Node *_own_path(Bucket &b, Node *target, Node * &prv) {
+            /**
+             * @brief Make the nodes in front of target private to b, and set
+             * prv to the predecessor of target.
+             */
+            prv = NULL;
+            for (Node *p = b.first(); p != target; p = p -> next)
+                prv = p = _own(b, prv, p);
+            return target;
         }
 
     public:
@@ -104,8 +332,7 @@ class HashMap
             /**
              * @brief Constructs an empty hash map.
              */
-            head = new Node*[HASH_TABLE_SIZE];
-            memset(head, 0, sizeof(Node*) * HASH_TABLE_SIZE);
+            table = new Table();
             elem_num = 0;
             hash_func = Hash();
         }
@@ -114,48 +341,31 @@ class HashMap
             /**
              * @brief Destructor
              */
-            _clear_nodes(); 
-            delete[] head;
+            _release_table(table);
         }
 
         HashMap &operator=(const HashMap &other) {
             /**
-             * @brief Assignment operator
+             * @brief Assignment operator. Shares the storage with other.
              */
-            if (this != &other)
-            {
-                _clear_nodes();
-                memset(head, 0, sizeof(Node*) * HASH_TABLE_SIZE);
-                for (int i = 0; i < HASH_TABLE_SIZE; i++)
-                {
-                    for (Node *p = other.head[i]; p; p = p -> next)
-                    {
-                        Node *tmp_ptr = new Node(p -> key, p -> val, head[i]);
-                        head[i] = tmp_ptr;
-                    }
-                }
-                elem_num = other.elem_num;
-                hash_func = other.hash_func;
-            }
+            __sync_add_and_fetch(&other.table -> ref, 1);
+            _release_table(table);
+            table = other.table;
+            elem_num = other.elem_num;
+            hash_func = other.hash_func;
+            probe_stats = other.probe_stats;
             return *this;
         }
 
         HashMap(const HashMap &other) {
             /**
-             * @brief Copy-constructor
+             * @brief Copy-constructor. Shares the storage with other.
              */
-            head = new Node*[HASH_TABLE_SIZE];
-            memset(head, 0, sizeof(Node*) * HASH_TABLE_SIZE);
-            for (int i = 0; i < HASH_TABLE_SIZE; i++)
-            {
-                for (Node *p = other.head[i]; p; p = p -> next)
-                {
-                    Node *tmp_ptr = new Node(p -> key, p -> val, head[i]);
-                    head[i] = tmp_ptr;
-                }
-            }
+            __sync_add_and_fetch(&other.table -> ref, 1);
+            table = other.table;
             elem_num = other.elem_num;
             hash_func = other.hash_func;
+            probe_stats = other.probe_stats;
         }
 
         Iterator iterator() const { return Iterator(this); }
@@ -165,8 +375,8 @@ class HashMap
             /**
              * @brief Removes all of the mappings from this map.
              */
-            _clear_nodes();
-            memset(head, 0, sizeof(Node*) * HASH_TABLE_SIZE);
+            _release_table(table);
+            table = new Table();
             elem_num = 0;
         }
 
@@ -175,9 +385,8 @@ class HashMap
              * @brief Returns true if this map contains a mapping for the specified
              * key.
              */
-            for (Node *p = head[_rectify(key)]; p; p = p -> next)
-                if (p -> key == key) return true;
-            return false;
+            unsigned int hv = _hash(key);
+            return _lookup(_bucket(_rectify(hv)), hv, key) != NULL;
         }
 
         bool containsValue(const Val &value) const {
@@ -185,9 +394,11 @@ class HashMap
              * @brief Returns true if this map maps one or more keys to the
              * specified value.
              */
-            for (int i = 0; i < HASH_TABLE_SIZE; i++)
-                for (Node *p = head[i]; p; p = p -> next)
-                    if (p -> val == value) return true;
+            for (int i = 0; i < PAGE_NUM; i++)
+                if (const Page *pg = table -> page[i])
+                    for (int j = 0; j < PAGE_SIZE; j++)
+                        for (Node *p = pg -> bucket[j].first(); p; p = p -> next)
+                            if (p -> val == value) return true;
             return false;
         }
 
@@ -199,11 +410,24 @@ class HashMap
              * @throw ElementNotExist
              */
 
-            for (Node *p = head[_rectify(key)]; p; p = p -> next)
-                if (p -> key == key) return p -> val;
+            unsigned int hv = _hash(key);
+            Node *p = _lookup(_bucket(_rectify(hv)), hv, key);
+            if (p) return p -> val;
             throw ElementNotExist();
         }
 
+        bool tryGet(const Key &key, Val &value) const {
+            /**
+             * @brief Copy the value to which the specified key is mapped into
+             * value and return true, or return false if the key is absent,
+             * with a single lookup.
+             */
+            unsigned int hv = _hash(key);
+            Node *p = _lookup(_bucket(_rectify(hv)), hv, key);
+            if (p) value = p -> val;
+            return p != NULL;
+        }
+
         bool isEmpty() const { return elem_num == 0; }
         // @brief Returns true if this map contains no key-value mappings.
 
@@ -212,17 +436,19 @@ class HashMap
              * @brief Associates the specified value with the specified key in this
              * map.
              */
-            Node *dup = NULL;
-            int hv = _rectify(key);
-            for (Node *p = head[hv]; p; p = p -> next)
-                if (p -> key == key) { dup = p; break; }
+            unsigned int hv = _hash(key);
+            Bucket &b = _own_bucket(_rectify(hv));
+            Node *prv, *dup = _search(&b, hv, key);
             if (dup == NULL) 
             {
-                Node *tmp_ptr = new Node(key, value, head[hv]);
-                head[hv] = tmp_ptr;
+                b.push(key, value, hv);
                 elem_num++;
             }
-            else dup -> val = value; // alter the original value
+            else
+            {
+                _own_path(b, dup, prv);
+                _own(b, prv, dup) -> val = value; // alter the original value
+            }
         }
 
         void remove(const Key &key) {
@@ -232,48 +458,159 @@ class HashMap
              * ElementNotExist exception.
              * @throw ElementNotExist
              */
-            int hv = _rectify(key);
-            if (head[hv])
+            unsigned int hv = _hash(key);
+            int idx = _rectify(hv);
+            const Bucket *shared = _bucket(idx);
+            Node *prv, *p = _search(shared, hv, key);
+            if (p == NULL) throw ElementNotExist();
+            Bucket &b = _own_bucket(idx);
+            // a copied page holds its own inline heads: search it again
+            if (&b != shared) p = _search(&b, hv, key);
+            _own_path(b, p, prv);
+            b.erase(prv, p);
+            elem_num--;
+        }
+
+        int size() const { return elem_num; }
+        // @brief Returns the number of key-value mappings in this map.
+
+        HashMapStats stats() const {
+            /**
+             * @brief Returns the statistics of this map, walking all the
+             * allocated pages.
+             */
+            HashMapStats res;
+            res.elem_num = elem_num;
+            res.bucket_num = HASH_TABLE_SIZE;
+            res.occupied_bucket_num = res.max_chain = 0;
+            memset(res.chain_hist, 0, sizeof(res.chain_hist));
+            res.memory_bytes = sizeof(HashMap) + sizeof(Table);
+            for (int i = 0; i < PAGE_NUM; i++)
             {
-                if (head[hv] -> key == key)
+                const Page *pg = table -> page[i];
+                int num = i < PAGE_NUM - 1 ? PAGE_SIZE :
+                    HASH_TABLE_SIZE - i * PAGE_SIZE;
+                if (pg == NULL)
                 {
-                    Node *np = head[hv] -> next;
-                    delete head[hv];
-                    head[hv] = np;
-                    elem_num--;
-                    return;
+                    res.chain_hist[0] += num;
+                    continue;
                 }
-                else
+                res.memory_bytes += sizeof(Page);
+                for (int j = 0; j < num; j++)
                 {
-                    for (Node *p = head[hv]; p -> next; p = p -> next)
-                        if (p -> next -> key == key)
+                    int len = 0;
+                    for (Node *p = pg -> bucket[j].first(); p; p = p -> next)
+                        len++;
+                    if (len > 0) res.occupied_bucket_num++;
+                    if (len > res.max_chain) res.max_chain = len;
+                    res.chain_hist[len < HashMapStats::HIST_SIZE ? len :
+                                    HashMapStats::HIST_SIZE - 1]++;
+                    res.memory_bytes += sizeof(Node) * (len - (INLINE_HEAD &&
+                                                                len > 0));
+                }
+            }
+            probe_stats.fill(res);
+            return res;
+        }
+
+        // @brief Reset the lookup counters of stats().
+        void resetStats() { probe_stats.reset(); }
+
+        void save(const char *path) const {
+            /**
+             * @brief Write the mappings to an image file, which HashMapView
+             * can map and use in place instead of replaying put().  Key and
+             * Val should be trivially copyable.  The cached hash codes are
+             * saved as well, so hashCode is not called.  The image replaces
+             * the file only once complete, so views of the old file stay
+             * valid.
+             * @throw IOError
+             */
+            typename HashMapImage<Key, Val>::Writer writer(path, elem_num);
+            for (int pass = 0; pass < 2; pass++)
+            {
+                for (int i = 0; i < PAGE_NUM; i++)
+                {
+                    const Page *pg = table -> page[i];
+                    if (pg == NULL) continue;
+                    for (int j = 0; j < PAGE_SIZE; j++)
+                    {
+                        for (Node *p = pg -> bucket[j].first(); p;
+                                p = p -> next)
                         {
-                            Node *np = p -> next -> next;
-                            delete p -> next;
-                            p -> next = np;
-                            elem_num--;
-                            return;
+                            if (pass == 0) writer.count(p -> hash);
+                            else writer.place(p -> hash, p -> key, p -> val);
                         }
+                    }
                 }
             }
-            throw ElementNotExist();
+            writer.finish();
         }
-
-        int size() const { return elem_num; }
-        // @brief Returns the number of key-value mappings in this map.
 };
 
-template <class Key, class Val, class Hash>
-struct HashMap<Key, Val, Hash>::Node {
+template <class Key, class Val, class Hash, bool INLINE_HEAD, class Stats>
+struct HashMap<Key, Val, Hash, INLINE_HEAD, Stats>::Node {
+    /**
+     * @var ref The number of links (from buckets or other nodes) pointing
+     * to this node.
+     */
     Key key;
     Val val;
+    unsigned int hash;
+    int ref;
     Node *next;
-    Node(Key _key, Val _val, Node *_next) : 
-        key(_key), val(_val), next(_next) {}
+    Node() : ref(1) {}
+    Node(const Key &_key, const Val &_val, unsigned int _hash, Node *_next) : 
+        key(_key), val(_val), hash(_hash), ref(1), next(_next) {}
+
+    static void grab(Node *p) {
+        if (p) __sync_add_and_fetch(&p -> ref, 1);
+    }
+
+    static void release(Node *p) {
+        /**
+         * @brief Drop a link to p, freeing the nodes no longer referred.
+         */
+        for (Node *np; p && __sync_sub_and_fetch(&p -> ref, 1) == 0; p = np)
+        {
+            np = p -> next;
+            delete p;
+        }
+    }
+};
+
+template <class Key, class Val, class Hash, bool INLINE_HEAD, class Stats>
+struct HashMap<Key, Val, Hash, INLINE_HEAD, Stats>::Page {
+    int ref;
+    Bucket bucket[PAGE_SIZE];
+
+    Page() : ref(1) {
+        for (int i = 0; i < PAGE_SIZE; i++) bucket[i].init();
+    }
+
+    Page(const Page &src) : ref(1) {
+        for (int i = 0; i < PAGE_SIZE; i++) bucket[i].share(src.bucket[i]);
+    }
+};
+
+template <class Key, class Val, class Hash, bool INLINE_HEAD, class Stats>
+struct HashMap<Key, Val, Hash, INLINE_HEAD, Stats>::Table {
+    int ref;
+    Page *page[PAGE_NUM];
+
+    Table() : ref(1) {
+        memset(page, 0, sizeof(page));
+    }
+
+    Table(const Table &src) : ref(1) {
+        for (int i = 0; i < PAGE_NUM; i++)
+            if ((page[i] = src.page[i]))
+                __sync_add_and_fetch(&page[i] -> ref, 1);
+    }
 };
 
-template <class Key, class Val, class Hash>
-class HashMap<Key, Val, Hash>::Entry {
+template <class Key, class Val, class Hash, bool INLINE_HEAD, class Stats>
+class HashMap<Key, Val, Hash, INLINE_HEAD, Stats>::Entry {
     Key key;
     Val value;
     public:
@@ -294,34 +631,28 @@ class HashMap<Key, Val, Hash>::Entry {
     }
 };
 
-template <class Key, class Val, class Hash>
-class HashMap<Key, Val, Hash>::Iterator {
+template <class Key, class Val, class Hash, bool INLINE_HEAD, class Stats>
+class HashMap<Key, Val, Hash, INLINE_HEAD, Stats>::Iterator {
     private:
         /**
          * @var cur_index The current index of the head array to which the
          * iterator is pointing.
          * @var cur_node The current node pointer.
-         * @var container Reflect pointer to the container to which it applies.
+         * @var table The directory of the pages when the iterator was
+         * created, which a copy of the map keeps after the map copies it.
          */
         int cur_index;
         Node *cur_node;
-        const HashMap *container;
+        const Table *table;
 
         bool _try_next(int &next_index, Node * &next_node) {
             next_index = cur_index;
-            next_node = cur_node;
-            if (next_index < 0) 
-            {
-                next_index = 0;
-                next_node = container -> head[0];
-            } 
-            else next_node = next_node -> next;
-            if (next_node == NULL)
+            next_node = cur_node ? cur_node -> next : NULL;
+            while (next_node == NULL && ++next_index < HashMap::HASH_TABLE_SIZE)
             {
-                while (container -> head[++next_index] == NULL && 
-                        next_index < HashMap::HASH_TABLE_SIZE);
-                if (next_index < HashMap::HASH_TABLE_SIZE)
-                    next_node = container -> head[next_index];
+                const Page *pg = table -> page[next_index / PAGE_SIZE];
+                if (pg) next_node = pg -> bucket[next_index % PAGE_SIZE].first();
+                else next_index |= PAGE_SIZE - 1; // skip the empty page
             }
             return next_node != NULL;
         }
@@ -329,7 +660,7 @@ class HashMap<Key, Val, Hash>::Iterator {
     public:
         Iterator() {}
         Iterator(const HashMap *con) {
-            container = con;
+            table = con -> table;
             cur_index = -1;
             cur_node = NULL;
         }
@@ -0,0 +1,238 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HASHMAPIMAGE_H
+#define HASHMAPIMAGE_H
+
+#include "IOError.h"
+#include "HashMix.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/**
+ * The on-disk image of a hash table, written by HashMap::save() and served
+ * by HashMapView.  The image contains no pointer, so it can be mapped at any
+ * address and used in place.  It consists of three sections, each aligned
+ * to SECTION_ALIGN bytes:
+ *
+ *  - the header (HashMapImage::Header);
+ *  - the bucket section, bucket_num + 1 unsigned ints, where the entries of
+ *    bucket i are entries [start[i], start[i + 1]);
+ *  - the entry section, elem_num HashMapImage::Entry records grouped by
+ *    bucket.
+ *
+ * The header and each of the other sections carry a checksum.  Key and Val
+ * must be trivially copyable (no pointer, no user-defined copy), and the
+ * image can only be read by a program built for the same platform, which is
+ * checked by the recorded sizes.
+ */
+
+template <class Key, class Val>
+class HashMapImage
+{
+    public:
+        struct Header;
+        struct Entry;
+        class Writer;
+        static const unsigned int VERSION = 2;
+        static const unsigned long long SECTION_ALIGN = 64;
+
+        static unsigned int index(unsigned int hv, unsigned int bucket_num) {
+            /**
+             * @brief Returns the bucket of a hash code. bucket_num is
+             * always a power of two.
+             */
+            return hashMix(hv) & (bucket_num - 1);
+        }
+
+        static unsigned long long checksum(const void *data,
+                                            unsigned long long len) {
+            /**
+             * @brief FNV-1a over 64-bit words, then over the trailing bytes.
+             */
+            const char *p = (const char *)data;
+            unsigned long long h = 0xcbf29ce484222325ULL, w;
+            for (; len >= 8; len -= 8, p += 8)
+            {
+                memcpy(&w, p, 8);
+                h = (h ^ w) * 0x100000001b3ULL;
+            }
+            for (; len; len--, p++)
+                h = (h ^ (unsigned char)*p) * 0x100000001b3ULL;
+            return h;
+        }
+
+        static unsigned long long align(unsigned long long offset) {
+            return (offset + SECTION_ALIGN - 1) & ~(SECTION_ALIGN - 1);
+        }
+};
+
+template <class Key, class Val>
+struct HashMapImage<Key, Val>::Header {
+    /**
+     * @var header_checksum The checksum of the header with this field
+     * set to zero.
+     */
+    char magic[8];
+    unsigned int version;
+    unsigned int key_size, val_size, entry_size;
+    unsigned int bucket_num, elem_num;
+    unsigned long long bucket_offset, entry_offset, file_size;
+    unsigned long long bucket_checksum, entry_checksum, header_checksum;
+
+    static const char *MAGIC() { return "SFPDSCHM"; }
+
+    void seal() {
+        header_checksum = 0;
+        header_checksum = checksum(this, sizeof(Header));
+    }
+
+    bool valid() const {
+        /**
+         * @brief Check the header alone, which is cheap.
+         */
+        Header tmp = *this;
+        tmp.header_checksum = 0;
+        return memcmp(magic, MAGIC(), 8) == 0 && version == VERSION &&
+            key_size == sizeof(Key) && val_size == sizeof(Val) &&
+            entry_size == sizeof(Entry) &&
+            checksum(&tmp, sizeof(Header)) == header_checksum;
+    }
+};
+
+template <class Key, class Val>
+struct HashMapImage<Key, Val>::Entry {
+    unsigned int hash;
+    Key key;
+    Val val;
+};
+
+template <class Key, class Val>
+class HashMapImage<Key, Val>::Writer {
+    /**
+     * @brief Write an image in two passes over the entries: first count()
+     * every hash code, then place() every entry, then finish(). The file is
+     * mapped and filled in place, so no extra copy of the entries is kept
+     * in memory.  It is written under a temporary name, which finish()
+     * renames over the path: a HashMapView still mapping the old image keeps
+     * reading it instead of faulting on a truncated file.
+     * @throw IOError
+     */
+    private:
+        std::string path, tmp_path;
+        bool finished;
+        int fd;
+        char *base;
+        Header *header;
+        unsigned int *start;
+        Entry *entries;
+        unsigned int *cursor;
+
+        Writer(const Writer &);
+        Writer &operator=(const Writer &);
+
+    public:
+        Writer(const char *_path, int elem_num)
+            : path(_path), finished(false), cursor(NULL) {
+            char pid[24];
+            sprintf(pid, ".%d.tmp", (int)getpid());
+            tmp_path = path + pid;
+            fd = open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) throw IOError("can not create " + tmp_path);
+            unsigned int bucket_num = 1;
+            while (bucket_num < (unsigned int)elem_num) bucket_num <<= 1;
+            unsigned long long bucket_offset = align(sizeof(Header));
+            unsigned long long entry_offset = align(bucket_offset +
+                    sizeof(unsigned int) * (bucket_num + 1ULL));
+            unsigned long long file_size = align(entry_offset +
+                    sizeof(Entry) * (unsigned long long)elem_num);
+            if (ftruncate(fd, file_size) != 0 ||
+                (base = (char *)mmap(NULL, file_size, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED, fd, 0)) == MAP_FAILED)
+            {
+                close(fd);
+                unlink(tmp_path.c_str());
+                throw IOError("can not write " + tmp_path);
+            }
+            header = (Header *)base;
+            memset(header, 0, sizeof(Header));
+            memcpy(header -> magic, Header::MAGIC(), 8);
+            header -> version = VERSION;
+            header -> key_size = sizeof(Key);
+            header -> val_size = sizeof(Val);
+            header -> entry_size = sizeof(Entry);
+            header -> bucket_num = bucket_num;
+            header -> elem_num = elem_num;
+            header -> bucket_offset = bucket_offset;
+            header -> entry_offset = entry_offset;
+            header -> file_size = file_size;
+            start = (unsigned int *)(base + bucket_offset);
+            entries = (Entry *)(base + entry_offset);
+            memset(start, 0, sizeof(unsigned int) * (bucket_num + 1ULL));
+        }
+
+        ~Writer() {
+            munmap(base, header -> file_size);
+            close(fd);
+            if (!finished) unlink(tmp_path.c_str());
+            delete[] cursor;
+        }
+
+        void count(unsigned int hv) {
+            start[index(hv, header -> bucket_num) + 1]++;
+        }
+
+        void place(unsigned int hv, const Key &key, const Val &val) {
+            if (cursor == NULL)
+            {
+                /* turn the counts into offsets on the first call */
+                unsigned int n = header -> bucket_num;
+                for (unsigned int i = 0; i < n; i++)
+                    start[i + 1] += start[i];
+                cursor = new unsigned int[n];
+                memcpy(cursor, start, sizeof(unsigned int) * n);
+            }
+            Entry &e = entries[cursor[index(hv, header -> bucket_num)]++];
+            memset(&e, 0, sizeof(Entry)); // keep the padding deterministic
+            e.hash = hv;
+            e.key = key;
+            e.val = val;
+        }
+
+        void finish() {
+            /**
+             * @brief Fill in the checksums, flush the image to disk and move
+             * it to the path.
+             */
+            header -> bucket_checksum = checksum(start,
+                    sizeof(unsigned int) * (header -> bucket_num + 1ULL));
+            header -> entry_checksum = checksum(entries,
+                    sizeof(Entry) * (unsigned long long)header -> elem_num);
+            header -> seal();
+            if (msync(base, header -> file_size, MS_SYNC) != 0)
+                throw IOError("can not flush the image");
+            if (rename(tmp_path.c_str(), path.c_str()) != 0)
+                throw IOError("can not replace " + path);
+            finished = true;
+        }
+};
+
+#endif
@@ -0,0 +1,141 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HASHMAPSTATS_H
+#define HASHMAPSTATS_H
+
+#include <cstdio>
+#include <string>
+
+/**
+ * The statistics of a HashMap returned by HashMap::stats(), which reveal a
+ * bad hash function long before the latency does: with a good one nearly
+ * all the occupied buckets hold one or two keys and a lookup takes about one
+ * probe.
+ *
+ * The shape of the table (chains, occupied buckets, memory) is measured by a
+ * walk over the buckets when stats() is called.  The lookup counters are
+ * only maintained when the map is instantiated with the HashMapProbeStats
+ * policy, and count the read-only lookups (containsKey(), get() and
+ * tryGet()), not the searches of put() and remove().  For example
+ * @code
+ *      HashMap<int, int, Hashint, false, HashMapProbeStats> hash;
+ * @endcode
+ * The default policy, HashMapNoStats, compiles them out, and they stay zero.
+ */
+
+struct HashMapStats {
+    /**
+     * @var HIST_SIZE The number of bins in chain_hist.
+     * @var chain_hist chain_hist[i] is the number of buckets holding i keys,
+     * and the last bin counts all the longer chains.
+     * @var memory_bytes The bytes of the directory, the allocated pages and
+     * the nodes; the storage shared with copies is counted in full.
+     * @var lookup_num, probe_num, max_probe The number of lookups, the total
+     * and the maximum number of keys compared by one of them.
+     */
+    static const int HIST_SIZE = 16;
+    int elem_num, bucket_num, occupied_bucket_num, max_chain;
+    long long chain_hist[HIST_SIZE];
+    long long memory_bytes;
+    long long lookup_num, probe_num;
+    int max_probe;
+
+    double loadFactor() const {
+        return bucket_num ? (double)elem_num / bucket_num : 0;
+    }
+
+    // @brief Returns the average length of the non-empty chains.
+    double avgChain() const {
+        return occupied_bucket_num ? (double)elem_num / occupied_bucket_num : 0;
+    }
+
+    double avgProbe() const {
+        return lookup_num ? (double)probe_num / lookup_num : 0;
+    }
+
+    std::string toJSON() const {
+        /**
+         * @brief Returns the statistics as a JSON object.
+         */
+        char buff[128];
+        std::string res;
+        snprintf(buff, sizeof(buff), "{\"elements\": %d, \"buckets\": %d, "
+                "\"occupied_buckets\": %d, ", elem_num, bucket_num,
+                occupied_bucket_num);
+        res += buff;
+        snprintf(buff, sizeof(buff), "\"load_factor\": %.6f, "
+                "\"max_chain\": %d, \"avg_chain\": %.6f, ", loadFactor(),
+                max_chain, avgChain());
+        res += buff;
+        res += "\"chain_histogram\": [";
+        for (int i = 0; i < HIST_SIZE; i++)
+        {
+            snprintf(buff, sizeof(buff), i ? ", %lld" : "%lld", chain_hist[i]);
+            res += buff;
+        }
+        snprintf(buff, sizeof(buff), "], \"lookups\": %lld, "
+                "\"avg_probes\": %.6f, \"max_probes\": %d, ", lookup_num,
+                avgProbe(), max_probe);
+        res += buff;
+        snprintf(buff, sizeof(buff), "\"memory_bytes\": %lld}",
+                memory_bytes);
+        return res + buff;
+    }
+};
+
+struct HashMapNoStats {
+    /**
+     * @brief The default policy, which counts nothing.
+     */
+    void lookup(int) {}
+    void fill(HashMapStats &res) const {
+        res.lookup_num = res.probe_num = 0;
+        res.max_probe = 0;
+    }
+    void reset() {}
+};
+
+struct HashMapProbeStats {
+    /**
+     * @brief The policy counting the keys compared by each lookup.
+     */
+    long long lookup_num, probe_num;
+    int max_probe;
+
+    HashMapProbeStats() { reset(); }
+
+    void lookup(int probes) {
+        lookup_num++;
+        probe_num += probes;
+        if (probes > max_probe) max_probe = probes;
+    }
+
+    void fill(HashMapStats &res) const {
+        res.lookup_num = lookup_num;
+        res.probe_num = probe_num;
+        res.max_probe = max_probe;
+    }
+
+    void reset() {
+        lookup_num = probe_num = 0;
+        max_probe = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,210 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HASHMAPVIEW_H
+#define HASHMAPVIEW_H
+
+#include "ElementNotExist.h"
+#include "IOError.h"
+#include "HashMapImage.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * HashMapView is a read-only map served directly from an image file written
+ * by HashMap::save().  The file is mapped into memory and never deserialized,
+ * so opening a view takes constant time regardless of its size, and the
+ * pages are loaded by the operating system on demand and shared with other
+ * processes mapping the same file.
+ *
+ * Template arguments Key, Val and Hash should be the same as those of the
+ * saved HashMap.  Only the header is checked when the view is opened; call
+ * verify() (or pass true to the constructor) to check the whole image
+ * against its checksums, which reads every page of it.
+ */
+
+template <class Key, class Val, class Hash>
+class HashMapView
+{
+    private:
+        typedef HashMapImage<Key, Val> Image;
+        typedef typename Image::Header Header;
+        typedef typename Image::Entry ImageEntry;
+        /**
+         * @var base The address at which the image is mapped.
+         * @var header The header of the image.
+         * @var start The bucket section.
+         * @var entries The entry section.
+         * @var hash_func User-defined hash fuction.
+         */
+        char *base;
+        const Header *header;
+        const unsigned int *start;
+        const ImageEntry *entries;
+        Hash hash_func;
+
+        const ImageEntry *_find(const Key &key) const {
+            unsigned int hv = (unsigned int)hash_func.hashCode(key);
+            unsigned int idx = Image::index(hv, header -> bucket_num);
+            for (const ImageEntry *p = entries + start[idx],
+                    *end = entries + start[idx + 1]; p != end; p++)
+                if (p -> hash == hv && p -> key == key) return p;
+            return NULL;
+        }
+
+        HashMapView(const HashMapView &);
+        HashMapView &operator=(const HashMapView &);
+
+    public:
+        class Entry;
+        class Iterator;
+
+        HashMapView(const char *path, bool verify_all = false) {
+            /**
+             * @brief Map the image file at path.
+             * @throw IOError if the file can not be mapped, or it is not a
+             * valid image for Key and Val.
+             */
+            int fd = open(path, O_RDONLY);
+            if (fd < 0) throw IOError(std::string("can not open ") + path);
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header) ||
+                (base = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+                                    fd, 0)) == MAP_FAILED)
+            {
+                close(fd);
+                throw IOError(std::string("can not map ") + path);
+            }
+            close(fd); // the mapping stays valid
+            header = (const Header *)base;
+            if (!header -> valid() ||
+                header -> file_size != (unsigned long long)st.st_size ||
+                (verify_all && !verify()))
+            {
+                munmap(base, st.st_size);
+                throw IOError(std::string("broken image ") + path);
+            }
+            start = (const unsigned int *)(base + header -> bucket_offset);
+            entries = (const ImageEntry *)(base + header -> entry_offset);
+        }
+
+        ~HashMapView() {
+            /**
+             * @brief Destructor
+             */
+            munmap(base, header -> file_size);
+        }
+
+        bool verify() const {
+            /**
+             * @brief Returns true if the sections match their checksums.
+             */
+            return Image::checksum(base + header -> bucket_offset,
+                    sizeof(unsigned int) * (header -> bucket_num + 1ULL))
+                    == header -> bucket_checksum &&
+                Image::checksum(base + header -> entry_offset,
+                    sizeof(ImageEntry) * (unsigned long long)header -> elem_num)
+                    == header -> entry_checksum;
+        }
+
+        // @brief Returns an iterator over the elements in this map.
+        Iterator iterator() const { return Iterator(this); }
+
+        bool containsKey(const Key &key) const {
+            /**
+             * @brief Returns true if this map contains a mapping for the
+             * specified key.
+             */
+            return _find(key) != NULL;
+        }
+
+        const Val &get(const Key &key) const {
+            /**
+             * @brief Returns a const reference to the value to which the
+             * specified key is mapped.  If the key is not present in this
+             * map, this function should throw ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            const ImageEntry *p = _find(key);
+            if (p) return p -> val;
+            throw ElementNotExist();
+        }
+
+        // @brief Returns true if this map contains no key-value mappings.
+        bool isEmpty() const { return header -> elem_num == 0; }
+
+        // @brief Returns the number of key-value mappings in this map.
+        int size() const { return header -> elem_num; }
+};
+
+template <class Key, class Val, class Hash>
+class HashMapView<Key, Val, Hash>::Entry {
+    Key key;
+    Val value;
+    public:
+    Entry(Key k, Val v)
+    {
+        key = k;
+        value = v;
+    }
+
+    Key getKey() const
+    {
+        return key;
+    }
+
+    Val getValue() const
+    {
+        return value;
+    }
+};
+
+template <class Key, class Val, class Hash>
+class HashMapView<Key, Val, Hash>::Iterator {
+    private:
+        /**
+         * @var cursor The index of the next entry in the entry section.
+         * @var container Reflect pointer to the container to which it applies.
+         */
+        unsigned int cursor;
+        const HashMapView *container;
+    public:
+        Iterator() {}
+        Iterator(const HashMapView *con) : cursor(0), container(con) {}
+
+        bool hasNext() {
+            /**
+             * @brief Returns true if the iteration has more elements.
+             */
+            return cursor < container -> header -> elem_num;
+        }
+
+        Entry next() {
+            /**
+             * @brief Returns the next element in the iteration.
+             * @throw ElementNotExist exception when hasNext() == false
+             */
+            if (!hasNext()) throw ElementNotExist();
+            const ImageEntry &e = container -> entries[cursor++];
+            return Entry(e.key, e.val);
+        }
+};
+
+#endif
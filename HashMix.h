@@ -0,0 +1,40 @@
+/** @file ElementNotExist.h
+ * Thrown when an required element does not exist
+ * For example, iter.next(); while iter.hasNext() == false
+ */
+#include <string>
+
+#ifndef ELEMENTNOTEXIST_H
+#define ELEMENTNOTEXIST_H
+
+class ElementNotExist {
+public: ElementNotExist() {}
+    ElementNotExist(std::string msg) : msg(msg) {}
+    std::string getMessage() const { return msg; }
+private:
+    std::string msg;
+};
+#endif
+
+#ifndef HASHMIX_H
+#define HASHMIX_H
+
+/**
+ * hashMix() scrambles a 32-bit hash code with the finalizer of MurmurHash3,
+ * so that every bit of the result depends on every bit of the code.  The
+ * containers which take the lower bits of a user-defined hash code (as a
+ * bucket or shard index) and the higher ones (as a partition) apply it
+ * first, so that even an identity hash is well distributed at both ends.
+ * It also turns an address into a seed for a random generator.
+ */
+
+inline unsigned int hashMix(unsigned int h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
+
+#endif
@@ -0,0 +1,19 @@
+/** @file IOError.h
+ * Thrown when a file can not be read or written, or its content is broken
+ * For example, HashMapView("missing.img") raises this exception.
+ */
+
+#include <string>
+
+#ifndef IOERROR_H
+#define IOERROR_H
+
+class IOError {
+public:
+    IOError() {}
+    IOError(std::string msg) : msg(msg) {}
+    std::string getMessage() const { return msg; }
+private:
+    std::string msg;
+};
+#endif
@@ -0,0 +1,390 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INTHASHMAP_H
+#define INTHASHMAP_H
+
+#include "ElementNotExist.h"
+
+/**
+ * IntHashMap is a hash map specialized for integral keys.  Instead of a
+ * chain of heap nodes per bucket, the keys and the values are stored in two
+ * flat parallel arrays probed linearly, so a lookup usually reads one or two
+ * adjacent keys and no pointer at all.  The number of slots is a power of
+ * two, kept at least twice the number of keys, and the slot of a key is
+ * taken from the high bits of a multiplication rather than by a modulo.
+ *
+ * Template argument Hash is a class with a static function ``index'' mapping
+ * a key to a slot, given the number of bits of the slot index, for example
+ * the default IntHashFibonacci.  Being static, it is resolved and inlined at
+ * compile time.  EMPTY_KEY marks the empty slots; it can still be used as a
+ * key, which is stored aside from the arrays.
+ *
+ * Key must be an integral type, which is checked at compile time, and Val
+ * must be default-constructible.  Removing a key shifts the following keys
+ * of its cluster back, so no tombstone is left and lookups never slow down
+ * after many removals.
+ */
+
+template <class Key>
+struct IntHashMapKey; // only defined for the integral types
+
+#define INTHASHMAP_KEY(type) \
+    template <> struct IntHashMapKey<type> { typedef type Type; }
+INTHASHMAP_KEY(char);
+INTHASHMAP_KEY(signed char);
+INTHASHMAP_KEY(unsigned char);
+INTHASHMAP_KEY(short);
+INTHASHMAP_KEY(unsigned short);
+INTHASHMAP_KEY(int);
+INTHASHMAP_KEY(unsigned int);
+INTHASHMAP_KEY(long);
+INTHASHMAP_KEY(unsigned long);
+INTHASHMAP_KEY(long long);
+INTHASHMAP_KEY(unsigned long long);
+#undef INTHASHMAP_KEY
+
+struct IntHashFibonacci {
+    /**
+     * @brief Fibonacci hashing: multiply by 2^64 / golden ratio and keep
+     * the highest bits, which depend on all the bits of the key.
+     */
+    template <class Key>
+    static unsigned int index(Key key, int bits) {
+        return (unsigned int)(((unsigned long long)key *
+                    0x9e3779b97f4a7c15ULL) >> (64 - bits));
+    }
+};
+
+template <class Key, class Val, class Hash = IntHashFibonacci,
+         Key EMPTY_KEY = Key(-1)>
+class IntHashMap
+{
+    private:
+        typedef typename IntHashMapKey<Key>::Type KeyCheck;
+        /**
+         * @var MIN_BITS The bits of the slot index of an empty map.
+         * @var keys, vals The slots; keys[i] == EMPTY_KEY if slot i is
+         * empty.
+         * @var bits The slot index bits; there are 1 << bits slots.
+         * @var elem_num The number of keys in the slots.
+         * @var has_empty_key Whether EMPTY_KEY itself is a key of the map,
+         * mapped to empty_val.
+         */
+        static const int MIN_BITS = 4;
+        Key *keys;
+        Val *vals;
+        int bits;
+        int elem_num;
+        bool has_empty_key;
+        Val empty_val;
+
+        unsigned int _mask() const { return (1U << bits) - 1; }
+
+        void _alloc(int _bits) {
+            bits = _bits;
+            keys = new Key[1U << bits];
+            vals = new Val[1U << bits];
+            for (unsigned int i = 0; i <= _mask(); i++) keys[i] = EMPTY_KEY;
+        }
+
+        int _find(Key key) const {
+            /**
+             * @brief Returns the slot of key, or -1 if it is not in the slots.
+             */
+            for (unsigned int i = Hash::index(key, bits); ;
+                    i = (i + 1) & _mask())
+            {
+                if (keys[i] == key) return i;
+                if (keys[i] == EMPTY_KEY) return -1;
+            }
+        }
+
+        void _insert(Key key, const Val &value) {
+            /**
+             * @brief Put a key known to be absent into its first empty slot.
+             */
+            unsigned int i = Hash::index(key, bits);
+            while (keys[i] != EMPTY_KEY) i = (i + 1) & _mask();
+            keys[i] = key;
+            vals[i] = value;
+        }
+
+        void _grow() {
+            /**
+             * @brief Double the slots and reinsert all the keys.
+             */
+            Key *old_keys = keys;
+            Val *old_vals = vals;
+            unsigned int old_num = 1U << bits;
+            _alloc(bits + 1);
+            for (unsigned int i = 0; i < old_num; i++)
+                if (old_keys[i] != EMPTY_KEY) _insert(old_keys[i], old_vals[i]);
+            delete[] old_keys;
+            delete[] old_vals;
+        }
+
+        void _erase(unsigned int i) {
+            /**
+             * @brief Empty slot i, then move back each following key of the
+             * cluster whose home slot is not between i and its position, so
+             * that every key stays reachable from its home slot.
+             */
+            for (unsigned int j = i; ; )
+            {
+                keys[i] = EMPTY_KEY;
+                for (;;)
+                {
+                    j = (j + 1) & _mask();
+                    if (keys[j] == EMPTY_KEY) return;
+                    unsigned int home = Hash::index(keys[j], bits);
+                    // move it unless home lies cyclically in (i, j]
+                    if (((j - home) & _mask()) >= ((j - i) & _mask())) break;
+                }
+                keys[i] = keys[j];
+                vals[i] = vals[j];
+                i = j;
+            }
+        }
+
+        void _copy(const IntHashMap &other) {
+            _alloc(other.bits);
+            for (unsigned int i = 0; i <= _mask(); i++)
+                if ((keys[i] = other.keys[i]) != EMPTY_KEY)
+                    vals[i] = other.vals[i];
+            elem_num = other.elem_num;
+            has_empty_key = other.has_empty_key;
+            empty_val = other.empty_val;
+        }
+
+    public:
+        class Entry;
+        class Iterator;
+
+        IntHashMap() {
+            /**
+             * @brief Constructs an empty hash map.
+             */
+            _alloc(MIN_BITS);
+            elem_num = 0;
+            has_empty_key = false;
+        }
+
+        ~IntHashMap() {
+            /**
+             * @brief Destructor
+             */
+            delete[] keys;
+            delete[] vals;
+        }
+
+        IntHashMap &operator=(const IntHashMap &other) {
+            /**
+             * @brief Assignment operator
+             */
+            if (this != &other)
+            {
+                delete[] keys;
+                delete[] vals;
+                _copy(other);
+            }
+            return *this;
+        }
+
+        IntHashMap(const IntHashMap &other) {
+            /**
+             * @brief Copy-constructor
+             */
+            _copy(other);
+        }
+
+        // @brief Returns an iterator over the elements in this map.
+        Iterator iterator() const { return Iterator(this); }
+
+        void clear() {
+            /**
+             * @brief Removes all of the mappings from this map.
+             */
+            delete[] keys;
+            delete[] vals;
+            _alloc(MIN_BITS);
+            elem_num = 0;
+            has_empty_key = false;
+        }
+
+        bool containsKey(const Key &key) const {
+            /**
+             * @brief Returns true if this map contains a mapping for the
+             * specified key.
+             */
+            if (key == EMPTY_KEY) return has_empty_key;
+            return _find(key) >= 0;
+        }
+
+        bool containsValue(const Val &value) const {
+            /**
+             * @brief Returns true if this map maps one or more keys to the
+             * specified value.
+             */
+            if (has_empty_key && empty_val == value) return true;
+            for (unsigned int i = 0; i <= _mask(); i++)
+                if (keys[i] != EMPTY_KEY && vals[i] == value) return true;
+            return false;
+        }
+
+        const Val &get(const Key &key) const {
+            /**
+             * @brief Returns a const reference to the value to which the
+             * specified key is mapped.  If the key is not present in this
+             * map, this function should throw ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            if (key == EMPTY_KEY)
+            {
+                if (has_empty_key) return empty_val;
+                throw ElementNotExist();
+            }
+            int i = _find(key);
+            if (i < 0) throw ElementNotExist();
+            return vals[i];
+        }
+
+        // @brief Returns true if this map contains no key-value mappings.
+        bool isEmpty() const { return size() == 0; }
+
+        void put(const Key &key, const Val &value) {
+            /**
+             * @brief Associates the specified value with the specified key in
+             * this map.
+             */
+            if (key == EMPTY_KEY)
+            {
+                has_empty_key = true;
+                empty_val = value;
+                return;
+            }
+            unsigned int i = Hash::index(key, bits);
+            for (; keys[i] != EMPTY_KEY; i = (i + 1) & _mask())
+                if (keys[i] == key)
+                {
+                    vals[i] = value; // alter the original value
+                    return;
+                }
+            if ((elem_num + 1) * 2 > (1 << bits))
+            {
+                _grow();
+                _insert(key, value);
+            }
+            else
+            {
+                keys[i] = key;
+                vals[i] = value;
+            }
+            elem_num++;
+        }
+
+        void remove(const Key &key) {
+            /**
+             * @brief Removes the mapping for the specified key from this map
+             * if present.  If there is no mapping for the specified key,
+             * throws ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            if (key == EMPTY_KEY)
+            {
+                if (!has_empty_key) throw ElementNotExist();
+                has_empty_key = false;
+                return;
+            }
+            int i = _find(key);
+            if (i < 0) throw ElementNotExist();
+            _erase(i);
+            elem_num--;
+        }
+
+        // @brief Returns the number of key-value mappings in this map.
+        int size() const { return elem_num + has_empty_key; }
+};
+
+template <class Key, class Val, class Hash, Key EMPTY_KEY>
+class IntHashMap<Key, Val, Hash, EMPTY_KEY>::Entry {
+    Key key;
+    Val value;
+    public:
+    Entry(Key k, Val v)
+    {
+        key = k;
+        value = v;
+    }
+
+    Key getKey() const
+    {
+        return key;
+    }
+
+    Val getValue() const
+    {
+        return value;
+    }
+};
+
+template <class Key, class Val, class Hash, Key EMPTY_KEY>
+class IntHashMap<Key, Val, Hash, EMPTY_KEY>::Iterator {
+    private:
+        /**
+         * @var cursor The next slot to be examined; -1 stands for EMPTY_KEY
+         * stored aside.
+         * @var container Reflect pointer to the container to which it applies.
+         */
+        int cursor;
+        const IntHashMap *container;
+
+        void _skip() {
+            if (cursor < 0 && !container -> has_empty_key) cursor = 0;
+            if (cursor < 0) return;
+            while (cursor <= (int)container -> _mask() &&
+                    container -> keys[cursor] == EMPTY_KEY) cursor++;
+        }
+
+    public:
+        Iterator() {}
+        Iterator(const IntHashMap *con) : cursor(-1), container(con) {
+            _skip();
+        }
+
+        bool hasNext() {
+            /**
+             * @brief Returns true if the iteration has more elements.
+             */
+            return cursor <= (int)container -> _mask();
+        }
+
+        Entry next() {
+            /**
+             * @brief Returns the next element in the iteration.
+             * @throw ElementNotExist exception when hasNext() == false
+             */
+            if (!hasNext()) throw ElementNotExist();
+            int i = cursor++;
+            _skip();
+            if (i < 0) return Entry(EMPTY_KEY, container -> empty_val);
+            return Entry(container -> keys[i], container -> vals[i]);
+        }
+};
+
+#endif
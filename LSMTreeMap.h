@@ -0,0 +1,585 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LSMTREEMAP_H
+#define LSMTREEMAP_H
+
+#include "ElementNotExist.h"
+#include "BloomFilter.h"
+#include <cstddef>
+
+/**
+ * LSMTreeMap is an ordered map for write-heavy workloads, with the interface
+ * of RadixTreeMap, laid out as a log-structured merge tree.  put() and
+ * remove() go into a small sorted write buffer, which stays in cache; when
+ * it is full, it is merged into the sorted run of level 0, and each level
+ * which then holds more than BUFFER_NUM * FANOUT^(i + 1) entries is merged
+ * into the next one (leveled compaction).  Every merge is sequential, and an
+ * entry is rewritten about FANOUT / 2 times per level, so an insertion costs
+ * O(log n) amortized moves of whole cache lines instead of a walk down a
+ * tree with a cache miss per node.
+ *
+ * An entry of a newer run shadows those of the older runs with the same key;
+ * remove() writes a tombstone, which is dropped when it is merged into the
+ * last level.  get() and the iterators consult the buffer and the runs from
+ * the newest, so they see the latest writes.  Each run has a
+ * BlockedBloomFilter of its keys, hashed by Hash with the same meaning as in
+ * HashMap, so a lookup binary searches only the runs which may hold the key.
+ *
+ * put() is a blind write: it does not look the key up in the levels, so it
+ * can not tell whether the key is new.  The number of live keys is known
+ * again when a merge reaches the last level with all the newer runs empty,
+ * as that level then holds exactly the live keys; otherwise size() counts
+ * them by a merged scan, O(n), whose result is kept until the next put().
+ * remove() has to look the key up anyway, to throw ElementNotExist.
+ *
+ * readAmplification() reports the runs, the buffer included, searched per
+ * lookup, and writeAmplification() the entries written by the merges per
+ * entry put into the buffer.
+ *
+ * Key and Val should be default-constructible.
+ */
+
+template <class Key, class Val, class Hash>
+class LSMTreeMap
+{
+    private:
+        /**
+         * @brief A sorted run of num entries, in three arrays; dead[i] marks
+         * the tombstone of a removed key.  filter holds the hash codes of
+         * the keys of a level, and is NULL for the buffer.
+         */
+        struct Run {
+            Key *keys;
+            Val *vals;
+            bool *dead;
+            int num;
+            BlockedBloomFilter *filter;
+            Run() : keys(NULL), vals(NULL), dead(NULL), num(0), filter(NULL) {}
+        };
+
+        /**
+         * @var BUFFER_NUM The capacity of the write buffer.
+         * @var FANOUT The ratio between the capacities of adjacent levels.
+         * @var MAX_LEVEL The number of levels, more than a map of int size
+         * needs.
+         * @var buffer The write buffer, of capacity BUFFER_NUM.
+         * @var levels The runs of the levels, from the newest.
+         * @var level_num The levels which may hold entries.
+         * @var elem_num The number of live keys, if not size_stale.
+         * @var size_stale Whether a put() since elem_num was known may have
+         * added a key.
+         * @var lookup_num, search_num The lookups, and the runs they
+         * searched.
+         * @var put_num, write_num The entries put into the buffer, and those
+         * written by the merges.
+         * @var hash_func User-defined hash fuction.
+         */
+        static const int BUFFER_NUM = 256;
+        static const int FANOUT = 8;
+        static const int MAX_LEVEL = 12;
+        Run buffer;
+        Run levels[MAX_LEVEL];
+        int level_num;
+        mutable int elem_num;
+        mutable bool size_stale;
+        mutable long long lookup_num, search_num;
+        long long put_num, write_num;
+        Hash hash_func;
+
+        static int _lower_bound(const Run &run, const Key &key) {
+            int lo = 0, hi = run.num;
+            while (lo < hi)
+            {
+                int mid = (lo + hi) >> 1;
+                if (run.keys[mid] < key) lo = mid + 1;
+                else hi = mid;
+            }
+            return lo;
+        }
+
+        static bool _at(const Run &run, int i, const Key &key) {
+            return i < run.num && run.keys[i] == key;
+        }
+
+        static long long _capacity(int level) {
+            long long cap = BUFFER_NUM;
+            for (int i = 0; i <= level; i++) cap *= FANOUT;
+            return cap;
+        }
+
+        const Run *_find(const Key &key, int &idx) const {
+            /**
+             * @brief Returns the newest run holding an entry of key, with
+             * the entry in idx, or NULL.  The filters rule out most of the
+             * runs without a search.
+             */
+            lookup_num++;
+            search_num++;
+            idx = _lower_bound(buffer, key);
+            if (_at(buffer, idx, key)) return &buffer;
+            unsigned int hv = hash_func.hashCode(key);
+            for (int i = 0; i < level_num; i++)
+            {
+                const Run &run = levels[i];
+                if (!run.num || !run.filter -> mayContain(hv)) continue;
+                search_num++;
+                idx = _lower_bound(run, key);
+                if (_at(run, idx, key)) return &run;
+            }
+            return NULL;
+        }
+
+        Run _merge(const Run &newer, const Run &older, bool drop_dead) {
+            /**
+             * @brief Returns a new run of the entries of two runs, those of
+             * newer winning over those of older with the same keys.  The
+             * tombstones are dropped if older is the last level.
+             */
+            Run run;
+            int n = newer.num + older.num;
+            if (n == 0) return run;
+            run.keys = new Key[n];
+            run.vals = new Val[n];
+            run.dead = new bool[n];
+            int i = 0, j = 0;
+            while (i < newer.num || j < older.num)
+            {
+                const Run *src;
+                int k;
+                if (j == older.num ||
+                    (i < newer.num && !(older.keys[j] < newer.keys[i])))
+                {
+                    // an entry of older with the same key is shadowed
+                    if (j < older.num && older.keys[j] == newer.keys[i]) j++;
+                    src = &newer;
+                    k = i++;
+                }
+                else
+                {
+                    src = &older;
+                    k = j++;
+                }
+                if (drop_dead && src -> dead[k]) continue;
+                run.keys[run.num] = src -> keys[k];
+                run.vals[run.num] = src -> vals[k];
+                run.dead[run.num++] = src -> dead[k];
+            }
+            write_num += run.num;
+            run.filter = new BlockedBloomFilter(run.num);
+            for (int t = 0; t < run.num; t++)
+                run.filter -> add(hash_func.hashCode(run.keys[t]));
+            return run;
+        }
+
+        static void _free_run(Run &run) {
+            delete[] run.keys;
+            delete[] run.vals;
+            delete[] run.dead;
+            delete run.filter;
+            run = Run();
+        }
+
+        static void _copy_run(Run &run, const Run &other, int cap) {
+            run.keys = new Key[cap];
+            run.vals = new Val[cap];
+            run.dead = new bool[cap];
+            run.num = other.num;
+            for (int i = 0; i < other.num; i++)
+            {
+                run.keys[i] = other.keys[i];
+                run.vals[i] = other.vals[i];
+                run.dead[i] = other.dead[i];
+            }
+            run.filter = other.filter ?
+                new BlockedBloomFilter(*other.filter) : NULL;
+        }
+
+        void _flush() {
+            /**
+             * @brief Merge the buffer into level 0, then each level over its
+             * capacity into the next one.
+             */
+            Run run = _merge(buffer, levels[0], level_num <= 1);
+            buffer.num = 0;
+            _free_run(levels[0]);
+            levels[0] = run;
+            if (level_num < 1) level_num = 1;
+            int last = 0;
+            for (int i = 0; i + 1 < MAX_LEVEL &&
+                            levels[i].num > _capacity(i); i++)
+            {
+                run = _merge(levels[i], levels[i + 1], i + 2 >= level_num);
+                _free_run(levels[i]);
+                _free_run(levels[i + 1]);
+                levels[i + 1] = run;
+                if (level_num < i + 2) level_num = i + 2;
+                last = i + 1;
+            }
+            // the newer runs are all empty now, without tombstones below
+            if (last == level_num - 1)
+            {
+                elem_num = levels[last].num;
+                size_stale = false;
+            }
+        }
+
+        void _buffer_put(int i, const Key &key, const Val &value, bool dead) {
+            /**
+             * @brief Insert an entry of a key not in the buffer into slot i
+             * of the buffer, and flush the buffer when it is full.
+             */
+            for (int j = buffer.num; j > i; j--)
+            {
+                buffer.keys[j] = buffer.keys[j - 1];
+                buffer.vals[j] = buffer.vals[j - 1];
+                buffer.dead[j] = buffer.dead[j - 1];
+            }
+            buffer.keys[i] = key;
+            buffer.vals[i] = value;
+            buffer.dead[i] = dead;
+            put_num++;
+            if (++buffer.num == BUFFER_NUM) _flush();
+        }
+
+        void _init() {
+            buffer.keys = new Key[BUFFER_NUM];
+            buffer.vals = new Val[BUFFER_NUM];
+            buffer.dead = new bool[BUFFER_NUM];
+            level_num = elem_num = 0;
+            size_stale = false;
+            resetStats();
+        }
+
+        void _free() {
+            _free_run(buffer);
+            for (int i = 0; i < level_num; i++) _free_run(levels[i]);
+        }
+
+        void _copy(const LSMTreeMap &other) {
+            _copy_run(buffer, other.buffer, BUFFER_NUM);
+            level_num = other.level_num;
+            for (int i = 0; i < level_num; i++)
+                _copy_run(levels[i], other.levels[i], other.levels[i].num);
+            elem_num = other.elem_num;
+            size_stale = other.size_stale;
+            resetStats();
+        }
+
+    public:
+        class Entry;
+        class Iterator;
+
+        LSMTreeMap() {
+            /**
+             * @brief Constructs an empty map.
+             */
+            _init();
+        }
+
+        ~LSMTreeMap() {
+            /**
+             * @brief Destructor
+             */
+            _free();
+        }
+
+        LSMTreeMap &operator=(const LSMTreeMap &other) {
+            /**
+             * @brief Assignment operator
+             */
+            if (this != &other)
+            {
+                _free();
+                _copy(other);
+            }
+            return *this;
+        }
+
+        LSMTreeMap(const LSMTreeMap &other) {
+            /**
+             * @brief Copy-constructor
+             */
+            _copy(other);
+        }
+
+        /**
+         * @brief Returns an iterator over the elements in this map in key
+         * order, from the least key (iterator()) or from the least key not
+         * less than lo (iterator(lo)).
+         */
+        Iterator iterator() const { return Iterator(this, NULL); }
+        Iterator iterator(const Key &lo) const { return Iterator(this, &lo); }
+
+        void flush() {
+            /**
+             * @brief Merge the write buffer into the levels now, e.g. before
+             * a phase of lookups.
+             */
+            if (buffer.num) _flush();
+        }
+
+        void clear() {
+            /**
+             * @brief Removes all of the mappings from this map.
+             */
+            _free();
+            _init();
+        }
+
+        bool containsKey(const Key &key) const {
+            /**
+             * @brief Returns true if this map contains a mapping for the
+             * specified key.
+             */
+            int idx;
+            const Run *run = _find(key, idx);
+            return run && !run -> dead[idx];
+        }
+
+        bool containsValue(const Val &value) const {
+            /**
+             * @brief Returns true if this map maps one or more keys to the
+             * specified value.
+             */
+            for (Iterator it = iterator(); it.hasNext(); )
+                if (it.next().getValue() == value) return true;
+            return false;
+        }
+
+        const Val &get(const Key &key) const {
+            /**
+             * @brief Returns a const reference to the value to which the
+             * specified key is mapped.  If the key is not present in this
+             * map, this function should throw ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            int idx;
+            const Run *run = _find(key, idx);
+            if (!run || run -> dead[idx]) throw ElementNotExist();
+            return run -> vals[idx];
+        }
+
+        const Key &firstKey() const {
+            /**
+             * @brief Returns the least key in this map.
+             * @throw ElementNotExist if the map is empty
+             */
+            Iterator it = iterator();
+            if (!it.hasNext()) throw ElementNotExist();
+            return it._key();
+        }
+
+        const Key &ceilingKey(const Key &key) const {
+            /**
+             * @brief Returns the least key greater than or equal to the given
+             * key, in O(log^2 n).
+             * @throw ElementNotExist if there is no such key
+             */
+            Iterator it = iterator(key);
+            if (!it.hasNext()) throw ElementNotExist();
+            return it._key();
+        }
+
+        bool isEmpty() const {
+            /**
+             * @brief Returns true if this map contains no key-value
+             * mappings.
+             */
+            if (size_stale) return !iterator().hasNext();
+            return elem_num == 0;
+        }
+
+        void put(const Key &key, const Val &value) {
+            /**
+             * @brief Associates the specified value with the specified key in
+             * this map.  The entry goes into the write buffer without
+             * looking the key up in the levels.
+             */
+            int i = _lower_bound(buffer, key);
+            if (_at(buffer, i, key))
+            {
+                if (buffer.dead[i]) elem_num++;
+                buffer.vals[i] = value; // alter the value
+                buffer.dead[i] = false;
+                return;
+            }
+            size_stale = true;
+            _buffer_put(i, key, value, false);
+        }
+
+        void remove(const Key &key) {
+            /**
+             * @brief Removes the mapping for the specified key from this map
+             * if present, by writing a tombstone into the write buffer.  If
+             * there is no mapping for the specified key, throws
+             * ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            int i = _lower_bound(buffer, key);
+            if (_at(buffer, i, key))
+            {
+                if (buffer.dead[i]) throw ElementNotExist();
+                buffer.dead[i] = true;
+                elem_num--;
+            }
+            else
+            {
+                int idx;
+                const Run *run = _find(key, idx);
+                if (!run || run -> dead[idx]) throw ElementNotExist();
+                elem_num--; // before a flush may count the keys again
+                _buffer_put(i, key, Val(), true);
+            }
+        }
+
+        int size() const {
+            /**
+             * @brief Returns the number of key-value mappings in this map,
+             * counting them if a put() may have added one since the last
+             * count or merge into the last level.
+             */
+            if (size_stale)
+            {
+                elem_num = 0;
+                for (Iterator it = iterator(); it.hasNext(); it._skip())
+                    elem_num++;
+                size_stale = false;
+            }
+            return elem_num;
+        }
+
+        double readAmplification() const {
+            /**
+             * @brief Returns the runs, the buffer included, searched per
+             * lookup by get(), containsKey(), and remove() of keys not in the
+             * buffer.
+             */
+            return lookup_num ? (double)search_num / lookup_num : 0;
+        }
+
+        double writeAmplification() const {
+            /**
+             * @brief Returns the entries written by the merges per entry put
+             * into the buffer.
+             */
+            return put_num ? (double)write_num / put_num : 0;
+        }
+
+        // @brief Reset the counters of the amplifications.
+        void resetStats() { lookup_num = search_num = put_num = write_num = 0; }
+};
+
+template <class Key, class Val, class Hash>
+class LSMTreeMap<Key, Val, Hash>::Entry {
+    Key key;
+    Val value;
+    public:
+    Entry(Key k, Val v)
+    {
+        key = k;
+        value = v;
+    }
+
+    Key getKey() const
+    {
+        return key;
+    }
+
+    Val getValue() const
+    {
+        return value;
+    }
+};
+
+template <class Key, class Val, class Hash>
+class LSMTreeMap<Key, Val, Hash>::Iterator {
+    private:
+        friend class LSMTreeMap;
+        /**
+         * @var pos The next entries of the sources: the buffer in pos[0],
+         * and level i in pos[i + 1].
+         * @var cur The source of the next live entry, the newest one holding
+         * the least key, or -1 at the end.
+         */
+        const LSMTreeMap *con;
+        int pos[MAX_LEVEL + 1];
+        int cur;
+
+        const Run &_run(int s) const {
+            return s ? con -> levels[s - 1] : con -> buffer;
+        }
+
+        const Key &_key() const { return _run(cur).keys[pos[cur]]; }
+
+        void _advance() {
+            /**
+             * @brief Find the next live entry, skipping the entries shadowed
+             * by a newer source and the tombstones.
+             */
+            for (;;)
+            {
+                cur = -1;
+                for (int s = 0; s <= con -> level_num; s++)
+                {
+                    const Run &run = _run(s);
+                    if (pos[s] == run.num) continue;
+                    if (cur < 0 || run.keys[pos[s]] < _key()) cur = s;
+                    else if (!(_key() < run.keys[pos[s]])) pos[s]++;
+                }
+                if (cur < 0 || !_run(cur).dead[pos[cur]]) return;
+                pos[cur]++;
+            }
+        }
+
+    public:
+        Iterator() {}
+        Iterator(const LSMTreeMap *_con, const Key *lo) : con(_con) {
+            for (int s = 0; s <= con -> level_num; s++)
+                pos[s] = lo ? _lower_bound(_run(s), *lo) : 0;
+            _advance();
+        }
+
+        void _skip() {
+            // @brief Move past the next element without copying it.
+            pos[cur]++;
+            _advance();
+        }
+
+        bool hasNext() {
+            /**
+             * @brief Returns true if the iteration has more elements.
+             */
+            return cur >= 0;
+        }
+
+        Entry next() {
+            /**
+             * @brief Returns the next element in the iteration.
+             * @throw ElementNotExist exception when hasNext() == false
+             */
+            if (!hasNext()) throw ElementNotExist();
+            const Run &run = _run(cur);
+            int k = pos[cur]++;
+            Entry e(run.keys[k], run.vals[k]);
+            _advance();
+            return e;
+        }
+};
+
+#endif
@@ -0,0 +1,495 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PERSISTENTTREEMAP_H
+#define PERSISTENTTREEMAP_H
+
+#include "ElementNotExist.h"
+#include "ArrayList.h"
+#include "EpochManager.h"
+#include <pthread.h>
+
+/**
+ * PersistentTreeMap is an immutable ordered map: put() and remove() leave the
+ * map untouched and return a new version of it.  It is the same treap as
+ * TreeMap, but a modification copies only the nodes on the path from the
+ * root to the key, O(log n) of them, and the new version shares all the other
+ * nodes with the old one.  A node is never modified once it is reachable
+ * from a version, so any number of threads can read any versions without a
+ * lock.
+ *
+ * Each node counts the versions and the nodes referring to it, atomically,
+ * and is freed when the last of them is gone; dropping a version frees
+ * exactly the nodes which no other version shares.  Having no threaded list,
+ * the iterator walks the tree with an explicit stack of O(log n) nodes, and
+ * keeps the version it iterates alive.  For example
+ * @code
+ *      PersistentTreeMap<int, int> v0;
+ *      PersistentTreeMap<int, int> v1 = v0.put(1, 1), v2 = v1.put(2, 2);
+ *      // v0 is empty, v1 holds 1 and v2 holds 1 and 2
+ * @endcode
+ *
+ * VersionedTreeMap below keeps a current version for writers and hands out
+ * snapshots of it.  Programs using these classes should be linked with
+ * -pthread.
+ */
+
+template <class Key, class Val>
+class PersistentTreeMap
+{
+    private:
+        struct Node;
+        /**
+         * @var root The root of this version; the version owns one reference
+         * to it.
+         * @var pri_state The state of the generator of the priorities, passed
+         * on to the versions derived from this one.
+         */
+        Node *root;
+        unsigned int pri_state;
+
+        PersistentTreeMap(Node *_root, unsigned int _pri_state) :
+            root(_root), pri_state(_pri_state) {}
+
+        static int _size(const Node *p) { return p ? p -> size : 0; }
+
+        static Node *_share(const Node *p) {
+            /**
+             * @brief Take one more reference to p, which may be NULL.
+             */
+            if (p) __sync_add_and_fetch(&p -> ref, 1);
+            return const_cast<Node *>(p);
+        }
+
+        static void _release(Node *p) {
+            /**
+             * @brief Drop one reference to p, freeing it and releasing its
+             * children when it was the last one.
+             */
+            while (p && __sync_sub_and_fetch(&p -> ref, 1) == 0)
+            {
+                Node *next = p -> ch[1];
+                _release(p -> ch[0]);
+                delete p;
+                p = next;
+            }
+        }
+
+        static Node *_clone(const Node *p, int dir) {
+            /**
+             * @brief Returns a fresh copy of p sharing its child ch[!dir]; the
+             * child ch[dir] is left for the caller to fill.
+             */
+            Node *t = new Node(p -> key, p -> val, p -> pri);
+            t -> ch[!dir] = _share(p -> ch[!dir]);
+            return t;
+        }
+
+        static unsigned int _next_pri(unsigned int &state) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return state;
+        }
+
+        static Node *_insert(const Node *p, const Key &key, const Val &value,
+                            int pri, bool &added) {
+            /**
+             * @brief Returns the root of a copy of subtree p with key mapped
+             * to value.  Only the new nodes can be out of heap order, so the
+             * rotations never touch a shared node.
+             */
+            if (!p)
+            {
+                added = true;
+                return new Node(key, value, pri);
+            }
+            if (key == p -> key)
+            {
+                Node *t = new Node(key, value, p -> pri);
+                t -> ch[0] = _share(p -> ch[0]);
+                t -> ch[1] = _share(p -> ch[1]);
+                t -> size = p -> size;
+                return t;
+            }
+            int dir = key < p -> key;
+            Node *c = _insert(p -> ch[dir], key, value, pri, added);
+            Node *t = _clone(p, dir);
+            t -> ch[dir] = c;
+            t -> size = p -> size + added;
+            if (c -> pri < t -> pri)
+            {
+                t -> ch[dir] = c -> ch[!dir];
+                c -> ch[!dir] = t;
+                t -> size = _size(t -> ch[0]) + _size(t -> ch[1]) + 1;
+                c -> size = _size(c -> ch[0]) + _size(c -> ch[1]) + 1;
+                return c;
+            }
+            return t;
+        }
+
+        static Node *_join(const Node *lo, const Node *hi) {
+            /**
+             * @brief Returns the root of a new tree holding both lo and hi,
+             * all of whose keys are greater, copying the spines it descends.
+             */
+            if (!lo) return _share(hi);
+            if (!hi) return _share(lo);
+            Node *t;
+            if (lo -> pri <= hi -> pri)
+            {
+                t = _clone(lo, 0);
+                t -> ch[0] = _join(lo -> ch[0], hi);
+            }
+            else
+            {
+                t = _clone(hi, 1);
+                t -> ch[1] = _join(lo, hi -> ch[1]);
+            }
+            t -> size = lo -> size + hi -> size;
+            return t;
+        }
+
+        static Node *_erase(const Node *p, const Key &key) {
+            /**
+             * @brief Returns the root of a copy of subtree p without key.
+             * Nothing is allocated before the key is found.
+             * @throw ElementNotExist
+             */
+            if (!p) throw ElementNotExist();
+            if (key == p -> key) return _join(p -> ch[1], p -> ch[0]);
+            int dir = key < p -> key;
+            Node *c = _erase(p -> ch[dir], key);
+            Node *t = _clone(p, dir);
+            t -> ch[dir] = c;
+            t -> size = p -> size - 1;
+            return t;
+        }
+
+        const Node *_find(const Key &key) const {
+            const Node *p = root;
+            while (p && !(key == p -> key)) p = p -> ch[key < p -> key];
+            return p;
+        }
+
+        static bool _contains_value(const Node *p, const Val &value) {
+            for (; p; p = p -> ch[1])
+            {
+                if (p -> val == value) return true;
+                if (_contains_value(p -> ch[0], value)) return true;
+            }
+            return false;
+        }
+
+    public:
+        class Entry;
+        class Iterator;
+
+        PersistentTreeMap() : root(NULL), pri_state(0x9e3779b9U) {
+            /**
+             * @brief Constructs an empty version.
+             */
+        }
+
+        ~PersistentTreeMap() {
+            /**
+             * @brief Destructor: drops this version, freeing the nodes no
+             * other version shares.
+             */
+            _release(root);
+        }
+
+        PersistentTreeMap(const PersistentTreeMap &other) :
+            root(_share(other.root)), pri_state(other.pri_state) {
+            /**
+             * @brief Copy-constructor: shares the version in O(1).
+             */
+        }
+
+        PersistentTreeMap &operator=(const PersistentTreeMap &other) {
+            /**
+             * @brief Assignment operator: shares the version in O(1).
+             */
+            Node *old = root;
+            root = _share(other.root);
+            pri_state = other.pri_state;
+            _release(old);
+            return *this;
+        }
+
+        // @brief Returns an iterator over the elements in this version.
+        Iterator iterator() const { return Iterator(*this); }
+
+        bool containsKey(const Key &key) const {
+            /**
+             * @brief Returns true if this version contains a mapping for the
+             * specified key.
+             */
+            return _find(key) != NULL;
+        }
+
+        bool containsValue(const Val &value) const {
+            /**
+             * @brief Returns true if this version maps one or more keys to
+             * the specified value.
+             */
+            return _contains_value(root, value);
+        }
+
+        const Val &get(const Key &key) const {
+            /**
+             * @brief Returns a const reference to the value to which the
+             * specified key is mapped, valid as long as this version or one
+             * sharing the key is alive.
+             * @throw ElementNotExist
+             */
+            const Node *p = _find(key);
+            if (!p) throw ElementNotExist();
+            return p -> val;
+        }
+
+        // @brief Returns true if this version contains no key-value mappings.
+        bool isEmpty() const { return root == NULL; }
+
+        PersistentTreeMap put(const Key &key, const Val &value) const {
+            /**
+             * @brief Returns a new version in which the specified key is
+             * associated with the specified value, copying O(log n) nodes.
+             */
+            unsigned int state = pri_state;
+            int pri = (int)(_next_pri(state) >> 1);
+            bool added = false;
+            return PersistentTreeMap(_insert(root, key, value, pri, added),
+                                    state);
+        }
+
+        PersistentTreeMap remove(const Key &key) const {
+            /**
+             * @brief Returns a new version without the mapping for the
+             * specified key, copying O(log n) nodes.  If there is no mapping
+             * for the key, throws ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            return PersistentTreeMap(_erase(root, key), pri_state);
+        }
+
+        // @brief Returns the number of key-value mappings in this version.
+        int size() const { return _size(root); }
+};
+
+template <class Key, class Val>
+struct PersistentTreeMap<Key, Val>::Node {
+    /**
+     * @var ref The number of versions and nodes referring to this node.  It
+     * is the only field modified after the node is published.
+     */
+    Key key;
+    Val val;
+    int pri, size;
+    mutable int ref;
+    Node *ch[2];
+    Node(const Key &_key, const Val &_val, int _pri) :
+        key(_key), val(_val), pri(_pri), size(1), ref(1) {
+        ch[0] = ch[1] = NULL;
+    }
+};
+
+template <class Key, class Val>
+class PersistentTreeMap<Key, Val>::Entry {
+    Key key;
+    Val value;
+    public:
+    Entry(Key k, Val v)
+    {
+        key = k;
+        value = v;
+    }
+
+    Key getKey() const
+    {
+        return key;
+    }
+
+    Val getValue() const
+    {
+        return value;
+    }
+};
+
+template <class Key, class Val>
+class PersistentTreeMap<Key, Val>::Iterator {
+    private:
+        /**
+         * @var version The version iterated, kept alive by the iterator.
+         * @var stack The nodes whose keys and greater subtrees are still to
+         * be visited, the next one on the top.
+         */
+        PersistentTreeMap version;
+        ArrayList<const Node *> stack;
+
+        void _push_least(const Node *p) {
+            for (; p; p = p -> ch[1]) stack.add(p);
+        }
+
+    public:
+        Iterator() {}
+        Iterator(const PersistentTreeMap &_version) : version(_version) {
+            _push_least(version.root);
+        }
+
+        bool hasNext() {
+            /**
+             * @brief Returns true if the iteration has more elements.
+             */
+            return !stack.isEmpty();
+        }
+
+        Entry next() {
+            /**
+             * @brief Returns the next element in the iteration.
+             * @throw ElementNotExist exception when hasNext() == false
+             */
+            if (!hasNext()) throw ElementNotExist();
+            const Node *p = stack.get(stack.size() - 1);
+            stack.removeIndex(stack.size() - 1);
+            _push_least(p -> ch[0]);
+            return Entry(p -> key, p -> val);
+        }
+};
+
+/**
+ * VersionedTreeMap is a thread-safe ordered map built on PersistentTreeMap,
+ * for readers which need a consistent view while writers keep updating it.
+ * Writers are serialized by a mutex; each modification derives a new version
+ * from the current one and publishes it with a release store.  snapshot()
+ * returns the current version in O(1), which then stays unchanged however
+ * long it is kept, and get() and containsKey() read the current version
+ * without taking any lock.  The versions replaced are handed to the
+ * EpochManager, so a reader loading one can always take its reference before
+ * it is dropped.
+ */
+
+template <class Key, class Val>
+class VersionedTreeMap
+{
+    public:
+        typedef PersistentTreeMap<Key, Val> Version;
+    private:
+        /**
+         * @var current The current version, replaced as a whole by the
+         * writers.
+         * @var write_lock Serializes the writers.
+         */
+        Version *current;
+        pthread_mutex_t write_lock;
+
+        static Version *_load(Version *const &ptr) {
+            return __atomic_load_n(&ptr, __ATOMIC_ACQUIRE);
+        }
+
+        static void _free_version(void *ptr) { delete (Version *)ptr; }
+
+        void _replace(Version *next) {
+            /**
+             * @brief Publish next as the current version and retire the old
+             * one; called with write_lock held.
+             */
+            Version *old = current;
+            __atomic_store_n(&current, next, __ATOMIC_RELEASE);
+            EpochManager::instance().retire(old, _free_version);
+        }
+
+        VersionedTreeMap(const VersionedTreeMap &);
+        VersionedTreeMap &operator=(const VersionedTreeMap &);
+
+    public:
+        VersionedTreeMap() : current(new Version()) {
+            pthread_mutex_init(&write_lock, NULL);
+        }
+
+        ~VersionedTreeMap() {
+            /**
+             * @brief Destructor. No other thread may use the map any more;
+             * the versions retired earlier are left to the EpochManager.
+             */
+            delete current;
+            pthread_mutex_destroy(&write_lock);
+        }
+
+        Version snapshot() const {
+            /**
+             * @brief Returns the current version, which no later modification
+             * of this map affects.
+             */
+            EpochManager::Guard guard;
+            return *_load(current);
+        }
+
+        bool containsKey(const Key &key) const {
+            /**
+             * @brief Returns true if the current version contains a mapping
+             * for the specified key.
+             */
+            EpochManager::Guard guard;
+            return _load(current) -> containsKey(key);
+        }
+
+        Val get(const Key &key) const {
+            /**
+             * @brief Returns a copy of the value to which the specified key is
+             * mapped in the current version.
+             * @throw ElementNotExist
+             */
+            EpochManager::Guard guard;
+            return _load(current) -> get(key);
+        }
+
+        void put(const Key &key, const Val &value) {
+            /**
+             * @brief Associates the specified value with the specified key,
+             * publishing a new version.
+             */
+            pthread_mutex_lock(&write_lock);
+            _replace(new Version(current -> put(key, value)));
+            pthread_mutex_unlock(&write_lock);
+        }
+
+        void remove(const Key &key) {
+            /**
+             * @brief Removes the mapping for the specified key, publishing a
+             * new version.
+             * @throw ElementNotExist
+             */
+            pthread_mutex_lock(&write_lock);
+            if (!current -> containsKey(key))
+            {
+                pthread_mutex_unlock(&write_lock);
+                throw ElementNotExist();
+            }
+            _replace(new Version(current -> remove(key)));
+            pthread_mutex_unlock(&write_lock);
+        }
+
+        // @brief Returns the number of key-value mappings in this map.
+        int size() const {
+            EpochManager::Guard guard;
+            return _load(current) -> size();
+        }
+};
+
+#endif
@@ -0,0 +1,989 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RADIXTREEMAP_H
+#define RADIXTREEMAP_H
+
+#include "ElementNotExist.h"
+#include <cstddef>
+#include <cstring>
+#include <string>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * RadixTreeMap is an ordered map with the interface of BTreeMap, built as an
+ * adaptive radix tree instead of comparing keys.  Each key is encoded by
+ * Traits into a string of bytes which sorts as the keys do, and an inner node
+ * branches on one byte of it, so a lookup descends at most one level per byte
+ * and compares keys only once, at the leaf.
+ *
+ * An inner node is a Node4, Node16, Node48 or Node256 after the most children
+ * it can hold, and is replaced by the next larger or smaller kind as its
+ * children come and go.  Node4 and Node16 keep sorted arrays of the bytes,
+ * which in a Node16 are searched sixteen at a time with SSE2 if it is enabled
+ * at compile time; Node48 maps each byte to one of its 48 slots, and Node256
+ * indexes its children by the byte directly.  The bytes shared by all the
+ * keys below a node are kept in it instead of a chain of one-child nodes
+ * (path compression); only the first MAX_PREFIX of them are stored, the rest
+ * being checked against the key at the leaf, or read from the least leaf
+ * below the node when it is split.
+ *
+ * The leaves are threaded in key order like the nodes of TreeMap, so the
+ * iterators walk a list, and iterator(lo) seeks the least key not less than
+ * lo in time proportional to the length of the key.
+ *
+ * RadixKeyTraits is defined for the signed integer types and std::string;
+ * another key type needs a traits class of the same interface, encoding the
+ * keys so that no encoding is a prefix of another.  Key and Val should be
+ * default-constructible.  A copy of a RadixTreeMap copies all its nodes at
+ * once.
+ */
+
+template <class Int>
+struct RadixSignedKeyTraits {
+    /**
+     * @brief The bytes of an integer, most significant first, with the sign
+     * bit flipped so that the negative ones come first.
+     */
+    static int length(Int) { return sizeof(Int); }
+    static void encode(Int key, unsigned char *buf) {
+        unsigned long long u = (unsigned long long)key ^
+                                (1ULL << (sizeof(Int) * 8 - 1));
+        for (int i = sizeof(Int) - 1; i >= 0; i--, u >>= 8)
+            buf[i] = (unsigned char)u;
+    }
+};
+
+template <class Key>
+struct RadixKeyTraits;
+
+template <>
+struct RadixKeyTraits<short> : RadixSignedKeyTraits<short> {};
+template <>
+struct RadixKeyTraits<int> : RadixSignedKeyTraits<int> {};
+template <>
+struct RadixKeyTraits<long> : RadixSignedKeyTraits<long> {};
+template <>
+struct RadixKeyTraits<long long> : RadixSignedKeyTraits<long long> {};
+
+template <>
+struct RadixKeyTraits<std::string> {
+    /**
+     * @brief The bytes of a string with each zero byte escaped as 0 0xff, and
+     * 0 0 appended, so that no encoding is a prefix of another and they sort
+     * as the strings do.
+     */
+    static int length(const std::string &key) {
+        int res = (int)key.size() + 2;
+        for (size_t i = 0; i < key.size(); i++) res += key[i] == 0;
+        return res;
+    }
+    static void encode(const std::string &key, unsigned char *buf) {
+        for (size_t i = 0; i < key.size(); i++)
+            if ((*buf++ = (unsigned char)key[i]) == 0) *buf++ = 0xff;
+        buf[0] = buf[1] = 0;
+    }
+};
+
+template <class Key, class Val, class Traits = RadixKeyTraits<Key> >
+class RadixTreeMap
+{
+    private:
+        struct Node;
+        struct Node4;
+        struct Node16;
+        struct Node48;
+        struct Node256;
+        struct Leaf;
+        class KeyBytes;
+        /**
+         * @var MAX_PREFIX The most bytes of a compressed path stored in a
+         * node.
+         * @var root The root, NULL if the map is empty.  A pointer to a leaf
+         * has its lowest bit set, see _tag().
+         * @var head The sentinel of the circular list of the leaves, from the
+         * least key at head -> next to the greatest at head -> prev.
+         * @var elem_num The total number of elements in the container.
+         */
+        static const int MAX_PREFIX = 8;
+        enum { NODE4, NODE16, NODE48, NODE256 };
+        Node *root;
+        Leaf *head;
+        int elem_num;
+
+        static bool _is_leaf(const Node *p) { return (size_t)p & 1; }
+        static Leaf *_leaf(const Node *p) { return (Leaf *)((size_t)p - 1); }
+        static Node *_tag(Leaf *l) { return (Node *)((size_t)l + 1); }
+
+        static Node *_new_node(int type) {
+            switch (type)
+            {
+                case NODE4: return new Node4();
+                case NODE16: return new Node16();
+                case NODE48: return new Node48();
+                default: return new Node256();
+            }
+        }
+
+        static void _free_node(Node *p) {
+            switch (p -> type)
+            {
+                case NODE4: delete (Node4 *)p; break;
+                case NODE16: delete (Node16 *)p; break;
+                case NODE48: delete (Node48 *)p; break;
+                default: delete (Node256 *)p;
+            }
+        }
+
+        static bool _full(const Node *p) {
+            static const int CAP[] = {4, 16, 48, 256};
+            return p -> num == CAP[p -> type];
+        }
+
+        static int _index16(const Node16 *t, unsigned char c) {
+            // @brief Returns the slot of byte c in t, or -1.
+#ifdef __SSE2__
+            __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char)c),
+                            _mm_loadu_si128((const __m128i *)t -> keys));
+            int mask = _mm_movemask_epi8(cmp) & ((1 << t -> num) - 1);
+            return mask ? __builtin_ctz(mask) : -1;
+#else
+            for (int i = 0; i < t -> num; i++)
+                if (t -> keys[i] == c) return i;
+            return -1;
+#endif
+        }
+
+        static int _count_less16(const Node16 *t, unsigned char c) {
+            /**
+             * @brief Returns the number of bytes less than c in t.  SSE2
+             * compares signed bytes, so the top bits are flipped first.
+             */
+#ifdef __SSE2__
+            __m128i bias = _mm_set1_epi8((char)0x80);
+            __m128i keys = _mm_xor_si128(bias,
+                            _mm_loadu_si128((const __m128i *)t -> keys));
+            __m128i cmp = _mm_cmplt_epi8(keys, _mm_set1_epi8((char)(c ^ 0x80)));
+            return __builtin_popcount(_mm_movemask_epi8(cmp) &
+                                        ((1 << t -> num) - 1));
+#else
+            int i = 0;
+            while (i < t -> num && t -> keys[i] < c) i++;
+            return i;
+#endif
+        }
+
+        static Node **_find_child(Node *p, unsigned char c) {
+            // @brief Returns the slot of the child of byte c, or NULL.
+            switch (p -> type)
+            {
+                case NODE4: {
+                    Node4 *t = (Node4 *)p;
+                    for (int i = 0; i < t -> num; i++)
+                        if (t -> keys[i] == c) return t -> ch + i;
+                    return NULL;
+                }
+                case NODE16: {
+                    Node16 *t = (Node16 *)p;
+                    int i = _index16(t, c);
+                    return i < 0 ? NULL : t -> ch + i;
+                }
+                case NODE48: {
+                    Node48 *t = (Node48 *)p;
+                    int i = t -> index[c];
+                    return i ? t -> ch + i - 1 : NULL;
+                }
+                default: {
+                    Node256 *t = (Node256 *)p;
+                    return t -> ch[c] ? t -> ch + c : NULL;
+                }
+            }
+        }
+
+        static Node *_next_child(const Node *p, int c) {
+            /**
+             * @brief Returns the child of the least byte greater than c, or
+             * NULL; c may be -1 for the first child.
+             */
+            switch (p -> type)
+            {
+                case NODE4: {
+                    const Node4 *t = (const Node4 *)p;
+                    for (int i = 0; i < t -> num; i++)
+                        if (t -> keys[i] > c) return t -> ch[i];
+                    return NULL;
+                }
+                case NODE16: {
+                    const Node16 *t = (const Node16 *)p;
+                    if (c >= 255) return NULL;
+                    int i = _count_less16(t, (unsigned char)(c + 1));
+                    return i < t -> num ? t -> ch[i] : NULL;
+                }
+                case NODE48: {
+                    const Node48 *t = (const Node48 *)p;
+                    for (int b = c + 1; b < 256; b++)
+                        if (t -> index[b]) return t -> ch[t -> index[b] - 1];
+                    return NULL;
+                }
+                default: {
+                    const Node256 *t = (const Node256 *)p;
+                    for (int b = c + 1; b < 256; b++)
+                        if (t -> ch[b]) return t -> ch[b];
+                    return NULL;
+                }
+            }
+        }
+
+        static Leaf *_min_leaf(const Node *p) {
+            while (!_is_leaf(p)) p = _next_child(p, -1);
+            return _leaf(p);
+        }
+
+        static int _children(const Node *p, unsigned char *bytes, Node **kids) {
+            /**
+             * @brief Lists the children of p in the order of their bytes, and
+             * returns their number.
+             */
+            int n = 0;
+            switch (p -> type)
+            {
+                case NODE4: {
+                    const Node4 *t = (const Node4 *)p;
+                    for (; n < t -> num; n++)
+                    {
+                        bytes[n] = t -> keys[n];
+                        kids[n] = t -> ch[n];
+                    }
+                    break;
+                }
+                case NODE16: {
+                    const Node16 *t = (const Node16 *)p;
+                    for (; n < t -> num; n++)
+                    {
+                        bytes[n] = t -> keys[n];
+                        kids[n] = t -> ch[n];
+                    }
+                    break;
+                }
+                case NODE48: {
+                    const Node48 *t = (const Node48 *)p;
+                    for (int b = 0; b < 256; b++)
+                        if (t -> index[b])
+                        {
+                            bytes[n] = b;
+                            kids[n++] = t -> ch[t -> index[b] - 1];
+                        }
+                    break;
+                }
+                default: {
+                    const Node256 *t = (const Node256 *)p;
+                    for (int b = 0; b < 256; b++)
+                        if (t -> ch[b])
+                        {
+                            bytes[n] = b;
+                            kids[n++] = t -> ch[b];
+                        }
+                }
+            }
+            return n;
+        }
+
+        template <class T>
+        static void _put_sorted(T *t, unsigned char c, Node *child, int i) {
+            // @brief Insert byte c at slot i of the sorted array of t.
+            for (int j = t -> num; j > i; j--)
+            {
+                t -> keys[j] = t -> keys[j - 1];
+                t -> ch[j] = t -> ch[j - 1];
+            }
+            t -> keys[i] = c;
+            t -> ch[i] = child;
+        }
+
+        template <class T>
+        static void _erase_sorted(T *t, int i) {
+            for (int j = i + 1; j < t -> num; j++)
+            {
+                t -> keys[j - 1] = t -> keys[j];
+                t -> ch[j - 1] = t -> ch[j];
+            }
+        }
+
+        static void _put_child(Node *p, unsigned char c, Node *child) {
+            // @brief Add a child of byte c to p, which is not full.
+            switch (p -> type)
+            {
+                case NODE4: {
+                    Node4 *t = (Node4 *)p;
+                    int i = 0;
+                    while (i < t -> num && t -> keys[i] < c) i++;
+                    _put_sorted(t, c, child, i);
+                    break;
+                }
+                case NODE16: {
+                    Node16 *t = (Node16 *)p;
+                    _put_sorted(t, c, child, _count_less16(t, c));
+                    break;
+                }
+                case NODE48: {
+                    Node48 *t = (Node48 *)p;
+                    t -> ch[t -> num] = child;
+                    t -> index[c] = t -> num + 1;
+                    break;
+                }
+                default:
+                    ((Node256 *)p) -> ch[c] = child;
+            }
+            p -> num++;
+        }
+
+        static Node *_resize(Node *p, int type) {
+            /**
+             * @brief Returns a node of the given kind holding the compressed
+             * path and the children of p, which is freed.
+             */
+            unsigned char bytes[256];
+            Node *kids[256];
+            int n = _children(p, bytes, kids);
+            Node *q = _new_node(type);
+            q -> prefix_len = p -> prefix_len;
+            memcpy(q -> prefix, p -> prefix, MAX_PREFIX);
+            for (int i = 0; i < n; i++) _put_child(q, bytes[i], kids[i]);
+            _free_node(p);
+            return q;
+        }
+
+        static void _add_child(Node *&ref, unsigned char c, Node *child) {
+            // @brief Add a child to the node ref, growing it if it is full.
+            if (_full(ref)) ref = _resize(ref, ref -> type + 1);
+            _put_child(ref, c, child);
+        }
+
+        static void _remove_child(Node *&ref, unsigned char c) {
+            /**
+             * @brief Remove the child of byte c from the node ref, shrinking
+             * it once it is well below the capacity of the smaller kind.
+             */
+            Node *p = ref;
+            switch (p -> type)
+            {
+                case NODE4: {
+                    Node4 *t = (Node4 *)p;
+                    int i = 0;
+                    while (t -> keys[i] != c) i++;
+                    _erase_sorted(t, i);
+                    break;
+                }
+                case NODE16: {
+                    Node16 *t = (Node16 *)p;
+                    _erase_sorted(t, _index16(t, c));
+                    break;
+                }
+                case NODE48: {
+                    // move the last slot into the one freed
+                    Node48 *t = (Node48 *)p;
+                    int i = t -> index[c], last = t -> num;
+                    t -> index[c] = 0;
+                    if (i != last)
+                    {
+                        int b = 0;
+                        while (t -> index[b] != last) b++;
+                        t -> ch[i - 1] = t -> ch[last - 1];
+                        t -> index[b] = i;
+                    }
+                    break;
+                }
+                default:
+                    ((Node256 *)p) -> ch[c] = NULL;
+            }
+            p -> num--;
+            if (p -> type == NODE16 && p -> num <= 3)
+                ref = _resize(p, NODE4);
+            else if (p -> type == NODE48 && p -> num <= 12)
+                ref = _resize(p, NODE16);
+            else if (p -> type == NODE256 && p -> num <= 40)
+                ref = _resize(p, NODE48);
+        }
+
+        static void _collapse(Node *&ref) {
+            /**
+             * @brief Replace the Node4 ref of a single child by the child,
+             * prepending the compressed path of ref and the byte of the child
+             * to that of the child.
+             */
+            Node4 *t = (Node4 *)ref;
+            Node *c = t -> ch[0];
+            if (!_is_leaf(c))
+            {
+                unsigned char buf[MAX_PREFIX];
+                int len = 0;
+                for (int i = 0; i < t -> prefix_len && len < MAX_PREFIX; i++)
+                    buf[len++] = t -> prefix[i];
+                if (len < MAX_PREFIX) buf[len++] = t -> keys[0];
+                for (int i = 0; i < c -> prefix_len && len < MAX_PREFIX; i++)
+                    buf[len++] = c -> prefix[i];
+                memcpy(c -> prefix, buf, len);
+                c -> prefix_len += t -> prefix_len + 1;
+            }
+            ref = c;
+            delete t;
+        }
+
+        static void _set_prefix(Node *p, const KeyBytes &k, int from, int n) {
+            p -> prefix_len = n;
+            memcpy(p -> prefix, k.bytes + from, n < MAX_PREFIX ? n : MAX_PREFIX);
+        }
+
+        static int _prefix_match(const Node *p, const KeyBytes &k, int depth) {
+            /**
+             * @brief Returns the number of leading bytes of the compressed
+             * path of p, at depth, that match k.  The bytes beyond MAX_PREFIX
+             * are read from the least leaf below p.
+             */
+            int n = p -> prefix_len, i = 0;
+            for (; i < n && i < MAX_PREFIX; i++)
+                if (depth + i >= k.len || p -> prefix[i] != k.bytes[depth + i])
+                    return i;
+            if (i == n) return n;
+            KeyBytes m(_min_leaf(p) -> key);
+            for (; i < n; i++)
+                if (depth + i >= k.len || m.bytes[depth + i] != k.bytes[depth + i])
+                    return i;
+            return n;
+        }
+
+        static bool _prefix_may_match(const Node *p, const KeyBytes &k,
+                                    int depth) {
+            /**
+             * @brief Check the stored bytes of the compressed path of p only,
+             * leaving the rest to the comparison at the leaf.
+             */
+            int n = p -> prefix_len < MAX_PREFIX ? p -> prefix_len : MAX_PREFIX;
+            return depth + p -> prefix_len < k.len &&
+                    memcmp(p -> prefix, k.bytes + depth, n) == 0;
+        }
+
+        static unsigned char _path_byte(const Node *p, int i, int depth) {
+            // @brief Returns byte i of the compressed path of p, at depth.
+            if (i < MAX_PREFIX) return p -> prefix[i];
+            KeyBytes m(_min_leaf(p) -> key);
+            return m.bytes[depth + i];
+        }
+
+        bool _insert(Node *&ref, const KeyBytes &k, int depth, const Key &key,
+                    const Val &value, Leaf *&fresh, Leaf *&succ) {
+            /**
+             * @brief Put key into the subtree ref, whose keys share the first
+             * depth bytes of k, as the new leaf fresh, and set succ to the
+             * least leaf after it on the way back, if there is one below ref.
+             * Returns false if the key was present and only its value
+             * replaced.
+             */
+            Node *p = ref;
+            if (p == NULL)
+            {
+                ref = _tag(fresh = new Leaf(key, value));
+                return true;
+            }
+            if (_is_leaf(p))
+            {
+                Leaf *l = _leaf(p);
+                if (l -> key == key)
+                {
+                    l -> val = value; // alter the value
+                    return false;
+                }
+                // no encoding is a prefix of another, so they differ at i
+                KeyBytes lk(l -> key);
+                int i = depth;
+                while (lk.bytes[i] == k.bytes[i]) i++;
+                Node *t = new Node4();
+                _set_prefix(t, k, depth, i - depth);
+                fresh = new Leaf(key, value);
+                _put_child(t, lk.bytes[i], p);
+                _put_child(t, k.bytes[i], _tag(fresh));
+                if (lk.bytes[i] > k.bytes[i]) succ = l;
+                ref = t;
+                return true;
+            }
+            int m = _prefix_match(p, k, depth);
+            if (m < p -> prefix_len)
+            {
+                // split the compressed path where it leaves k
+                unsigned char c = _path_byte(p, m, depth);
+                int rest = p -> prefix_len - m - 1;
+                if (p -> prefix_len <= MAX_PREFIX)
+                    memmove(p -> prefix, p -> prefix + m + 1, rest);
+                else
+                {
+                    KeyBytes lk(_min_leaf(p) -> key);
+                    _set_prefix(p, lk, depth + m + 1, rest);
+                }
+                p -> prefix_len = rest;
+                Node *t = new Node4();
+                _set_prefix(t, k, depth, m);
+                fresh = new Leaf(key, value);
+                _put_child(t, c, p);
+                _put_child(t, k.bytes[depth + m], _tag(fresh));
+                if (c > k.bytes[depth + m]) succ = _min_leaf(p);
+                ref = t;
+                return true;
+            }
+            depth += p -> prefix_len;
+            unsigned char c = k.bytes[depth];
+            Node **child = _find_child(p, c);
+            if (child)
+            {
+                if (!_insert(*child, k, depth + 1, key, value, fresh, succ))
+                    return false;
+            }
+            else
+            {
+                fresh = new Leaf(key, value);
+                _add_child(ref, c, _tag(fresh));
+            }
+            if (succ == NULL)
+            {
+                Node *next = _next_child(ref, c);
+                if (next) succ = _min_leaf(next);
+            }
+            return true;
+        }
+
+        void _unlink(Leaf *l) {
+            l -> prev -> next = l -> next;
+            l -> next -> prev = l -> prev;
+            delete l;
+            elem_num--;
+        }
+
+        void _remove(Node *&ref, const KeyBytes &k, int depth, const Key &key) {
+            /**
+             * @brief Remove key from the subtree ref, whose keys share the
+             * first depth bytes of k, then collapse the node it came from if
+             * a single child is left.
+             * @throw ElementNotExist
+             */
+            Node *p = ref;
+            if (!_prefix_may_match(p, k, depth)) throw ElementNotExist();
+            depth += p -> prefix_len;
+            unsigned char c = k.bytes[depth];
+            Node **child = _find_child(p, c);
+            if (child == NULL) throw ElementNotExist();
+            if (!_is_leaf(*child))
+            {
+                _remove(*child, k, depth + 1, key);
+                return;
+            }
+            Leaf *l = _leaf(*child);
+            if (!(l -> key == key)) throw ElementNotExist();
+            _unlink(l);
+            _remove_child(ref, c);
+            if (ref -> num == 1) _collapse(ref);
+        }
+
+        Leaf *_find(const Key &key) const {
+            if (root == NULL) return NULL;
+            KeyBytes k(key);
+            Node *p = root;
+            for (int depth = 0; !_is_leaf(p); depth++)
+            {
+                if (!_prefix_may_match(p, k, depth)) return NULL;
+                depth += p -> prefix_len;
+                Node **child = _find_child(p, k.bytes[depth]);
+                if (child == NULL) return NULL;
+                p = *child;
+            }
+            Leaf *l = _leaf(p);
+            return l -> key == key ? l : NULL;
+        }
+
+        static Leaf *_lower_bound(const Node *p, const KeyBytes &k, int depth) {
+            /**
+             * @brief Returns the least leaf below p whose key is not less
+             * than k, or NULL if there is none; the keys below p share the
+             * first depth bytes of k.
+             */
+            if (_is_leaf(p))
+            {
+                Leaf *l = _leaf(p);
+                KeyBytes lk(l -> key);
+                int n = lk.len < k.len ? lk.len : k.len;
+                int cmp = memcmp(lk.bytes + depth, k.bytes + depth, n - depth);
+                return cmp > 0 || (cmp == 0 && lk.len >= k.len) ? l : NULL;
+            }
+            int m = _prefix_match(p, k, depth);
+            if (m < p -> prefix_len)
+            {
+                // all the keys below p are on the same side of k
+                if (depth + m >= k.len || _path_byte(p, m, depth) > k.bytes[depth + m])
+                    return _min_leaf(p);
+                return NULL;
+            }
+            depth += p -> prefix_len;
+            if (depth >= k.len) return _min_leaf(p);
+            unsigned char c = k.bytes[depth];
+            Node **child = _find_child((Node *)p, c);
+            if (child)
+            {
+                Leaf *res = _lower_bound(*child, k, depth + 1);
+                if (res) return res;
+            }
+            Node *next = _next_child(p, c);
+            return next ? _min_leaf(next) : NULL;
+        }
+
+        Leaf *_seek(const Key &lo) const {
+            // @brief Returns the leaf of the least key not less than lo.
+            if (root == NULL) return head;
+            KeyBytes k(lo);
+            Leaf *res = _lower_bound(root, k, 0);
+            return res ? res : head;
+        }
+
+        static void _clear_nodes_dfs(Node *p) {
+            if (p == NULL) return;
+            if (_is_leaf(p))
+            {
+                delete _leaf(p);
+                return;
+            }
+            unsigned char bytes[256];
+            Node *kids[256];
+            int n = _children(p, bytes, kids);
+            for (int i = 0; i < n; i++) _clear_nodes_dfs(kids[i]);
+            _free_node(p);
+        }
+
+        Node *_copy_nodes_dfs(const Node *src) {
+            /**
+             * @brief Copy the subtree src, appending its leaves to the list
+             * in key order.
+             */
+            if (_is_leaf(src))
+            {
+                const Leaf *s = _leaf(src);
+                Leaf *l = new Leaf(s -> key, s -> val);
+                (l -> prev = head -> prev) -> next = l;
+                (l -> next = head) -> prev = l;
+                return _tag(l);
+            }
+            unsigned char bytes[256];
+            Node *kids[256];
+            int n = _children(src, bytes, kids);
+            Node *p = _new_node(src -> type);
+            p -> prefix_len = src -> prefix_len;
+            memcpy(p -> prefix, src -> prefix, MAX_PREFIX);
+            for (int i = 0; i < n; i++)
+                _put_child(p, bytes[i], _copy_nodes_dfs(kids[i]));
+            return p;
+        }
+
+        void _init() {
+            root = NULL;
+            head = new Leaf();
+            head -> prev = head -> next = head;
+            elem_num = 0;
+        }
+
+        void _copy(const RadixTreeMap &other) {
+            root = other.root ? _copy_nodes_dfs(other.root) : NULL;
+            elem_num = other.elem_num;
+        }
+
+    public:
+        class Entry;
+        class Iterator;
+
+        RadixTreeMap() {
+            /**
+             * @brief Constructs an empty radix tree map.
+             */
+            _init();
+        }
+
+        ~RadixTreeMap() {
+            /**
+             * @brief Destructor
+             */
+            _clear_nodes_dfs(root);
+            delete head;
+        }
+
+        RadixTreeMap &operator=(const RadixTreeMap &other) {
+            /**
+             * @brief Assignment operator
+             */
+            if (this != &other)
+            {
+                clear();
+                _copy(other);
+            }
+            return *this;
+        }
+
+        RadixTreeMap(const RadixTreeMap &other) {
+            /**
+             * @brief Copy-constructor
+             */
+            _init();
+            _copy(other);
+        }
+
+        /**
+         * @brief Returns an iterator over the elements in this map in key
+         * order, from the least key (iterator()) or from the least key not
+         * less than lo (iterator(lo)).
+         */
+        Iterator iterator() const { return Iterator(this, NULL); }
+        Iterator iterator(const Key &lo) const { return Iterator(this, &lo); }
+
+        void clear() {
+            /**
+             * @brief Removes all of the mappings from this map.
+             */
+            _clear_nodes_dfs(root);
+            root = NULL;
+            head -> prev = head -> next = head;
+            elem_num = 0;
+        }
+
+        bool containsKey(const Key &key) const {
+            /**
+             * @brief Returns true if this map contains a mapping for the
+             * specified key.
+             */
+            return _find(key) != NULL;
+        }
+
+        bool containsValue(const Val &value) const {
+            /**
+             * @brief Returns true if this map maps one or more keys to the
+             * specified value.
+             */
+            for (Leaf *l = head -> next; l != head; l = l -> next)
+                if (l -> val == value) return true;
+            return false;
+        }
+
+        const Val &get(const Key &key) const {
+            /**
+             * @brief Returns a const reference to the value to which the
+             * specified key is mapped.  If the key is not present in this
+             * map, this function should throw ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            Leaf *l = _find(key);
+            if (l == NULL) throw ElementNotExist();
+            return l -> val;
+        }
+
+        const Key &firstKey() const {
+            /**
+             * @brief Returns the least key in this map.
+             * @throw ElementNotExist if the map is empty
+             */
+            if (head -> next == head) throw ElementNotExist();
+            return head -> next -> key;
+        }
+
+        const Key &ceilingKey(const Key &key) const {
+            /**
+             * @brief Returns the least key greater than or equal to the given
+             * key, in time proportional to its length.
+             * @throw ElementNotExist if there is no such key
+             */
+            Leaf *l = _seek(key);
+            if (l == head) throw ElementNotExist();
+            return l -> key;
+        }
+
+        // @brief Returns true if this map contains no key-value mappings.
+        bool isEmpty() const { return elem_num == 0; }
+
+        void put(const Key &key, const Val &value) {
+            /**
+             * @brief Associates the specified value with the specified key in
+             * this map.
+             */
+            KeyBytes k(key);
+            Leaf *fresh = NULL, *succ = NULL;
+            if (!_insert(root, k, 0, key, value, fresh, succ)) return;
+            if (succ == NULL) succ = head;
+            (fresh -> prev = succ -> prev) -> next = fresh;
+            (fresh -> next = succ) -> prev = fresh;
+            elem_num++;
+        }
+
+        void remove(const Key &key) {
+            /**
+             * @brief Removes the mapping for the specified key from this map
+             * if present.  If there is no mapping for the specified key,
+             * throws ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            if (root == NULL) throw ElementNotExist();
+            if (_is_leaf(root))
+            {
+                if (!(_leaf(root) -> key == key)) throw ElementNotExist();
+                _unlink(_leaf(root));
+                root = NULL;
+                return;
+            }
+            KeyBytes k(key);
+            _remove(root, k, 0, key);
+        }
+
+        // @brief Returns the number of key-value mappings in this map.
+        int size() const { return elem_num; }
+};
+
+template <class Key, class Val, class Traits>
+struct RadixTreeMap<Key, Val, Traits>::Node {
+    /**
+     * @var type NODE4, NODE16, NODE48 or NODE256.
+     * @var num The number of children.
+     * @var prefix_len The length of the compressed path, of which the first
+     * MAX_PREFIX bytes at most are in prefix.
+     */
+    unsigned char type;
+    unsigned short num;
+    int prefix_len;
+    unsigned char prefix[MAX_PREFIX];
+    Node(int _type) : type(_type), num(0), prefix_len(0) {}
+};
+
+template <class Key, class Val, class Traits>
+struct RadixTreeMap<Key, Val, Traits>::Node4 : Node {
+    // @brief keys[0..num) is sorted, and ch[i] is the child of keys[i].
+    unsigned char keys[4];
+    Node *ch[4];
+    Node4() : Node(NODE4) {}
+};
+
+template <class Key, class Val, class Traits>
+struct RadixTreeMap<Key, Val, Traits>::Node16 : Node {
+    unsigned char keys[16];
+    Node *ch[16];
+    Node16() : Node(NODE16) {}
+};
+
+template <class Key, class Val, class Traits>
+struct RadixTreeMap<Key, Val, Traits>::Node48 : Node {
+    // @brief The child of byte b is ch[index[b] - 1], if index[b] != 0.
+    unsigned char index[256];
+    Node *ch[48];
+    Node48() : Node(NODE48) { memset(index, 0, sizeof(index)); }
+};
+
+template <class Key, class Val, class Traits>
+struct RadixTreeMap<Key, Val, Traits>::Node256 : Node {
+    Node *ch[256];
+    Node256() : Node(NODE256) { memset(ch, 0, sizeof(ch)); }
+};
+
+template <class Key, class Val, class Traits>
+struct RadixTreeMap<Key, Val, Traits>::Leaf {
+    /**
+     * @var prev, next The neighbouring leaves in key order.
+     */
+    Key key;
+    Val val;
+    Leaf *prev, *next;
+    Leaf() {}
+    Leaf(const Key &_key, const Val &_val) : key(_key), val(_val) {}
+};
+
+template <class Key, class Val, class Traits>
+class RadixTreeMap<Key, Val, Traits>::KeyBytes {
+    /**
+     * @brief The encoding of a key, kept on the stack unless it is long.
+     */
+    unsigned char local[32];
+    KeyBytes(const KeyBytes &);
+    KeyBytes &operator=(const KeyBytes &);
+    public:
+    unsigned char *bytes;
+    int len;
+    KeyBytes(const Key &key) : len(Traits::length(key)) {
+        bytes = len <= (int)sizeof(local) ? local : new unsigned char[len];
+        Traits::encode(key, bytes);
+    }
+    ~KeyBytes() {
+        if (bytes != local) delete[] bytes;
+    }
+};
+
+template <class Key, class Val, class Traits>
+class RadixTreeMap<Key, Val, Traits>::Entry {
+    Key key;
+    Val value;
+    public:
+    Entry(Key k, Val v)
+    {
+        key = k;
+        value = v;
+    }
+
+    Key getKey() const
+    {
+        return key;
+    }
+
+    Val getValue() const
+    {
+        return value;
+    }
+};
+
+template <class Key, class Val, class Traits>
+class RadixTreeMap<Key, Val, Traits>::Iterator {
+    private:
+        /**
+         * @var cur The leaf to be returned next, head at the end.
+         */
+        Leaf *cur, *head;
+
+    public:
+        Iterator() {}
+        Iterator(const RadixTreeMap *con, const Key *lo) :
+            cur(lo ? con -> _seek(*lo) : con -> head -> next),
+            head(con -> head) {}
+
+        bool hasNext() {
+            /**
+             * @brief Returns true if the iteration has more elements.
+             */
+            return cur != head;
+        }
+
+        Entry next() {
+            /**
+             * @brief Returns the next element in the iteration.
+             * @throw ElementNotExist exception when hasNext() == false
+             */
+            if (!hasNext()) throw ElementNotExist();
+            Leaf *l = cur;
+            cur = cur -> next;
+            return Entry(l -> key, l -> val);
+        }
+};
+
+#endif
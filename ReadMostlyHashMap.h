@@ -0,0 +1,425 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef READMOSTLYHASHMAP_H
+#define READMOSTLYHASHMAP_H
+
+#include "ElementNotExist.h"
+#include "EpochManager.h"
+#include "HashMix.h"
+#include <cstring>
+#include <pthread.h>
+
+/**
+ * ReadMostlyHashMap is a thread-safe map implemented by hashing, tuned for
+ * workloads dominated by lookups. Readers take no lock and perform no write
+ * to shared memory: they only announce themselves to the EpochManager and
+ * follow the bucket chains. Writers are serialized by a mutex and never
+ * modify a node reachable by readers; they publish new nodes into the chains
+ * with release stores and hand the unlinked ones to the EpochManager, which
+ * frees them once no reader can be holding them.  Growing the table is done
+ * by building a new one aside and publishing it as a whole.
+ *
+ * Template arguments Key, Val and Hash have the same meaning as in HashMap.
+ * Like ConcurrentHashMap, get() returns a copy of the value.
+ *
+ * The iterator is weakly consistent. It pins the table it was created on, so
+ * that the memory it refers to cannot be reclaimed until the iterator is
+ * destroyed; an iterator must therefore be used and destroyed by the thread
+ * which created it, and should not be kept for long.
+ *
+ * Programs using this class should be linked with -pthread.
+ */
+
+template <class Key, class Val, class Hash>
+class ReadMostlyHashMap
+{
+    private:
+        struct Node;
+        struct Table;
+        /**
+         * @var INIT_BUCKET_NUM The initial number of buckets, which is
+         * expected to be a power of two.
+         * @var table The current table, replaced as a whole when growing.
+         * @var write_lock Serializes the writers.
+         * @var hash_func User-defined hash fuction.
+         * @var elem_num The total number of elements in the container.
+         */
+        static const int INIT_BUCKET_NUM = 1024;
+        Table *table;
+        pthread_mutex_t write_lock;
+        Hash hash_func;
+        int elem_num;
+
+        template <class Tp>
+        static Tp *_load(Tp *const &ptr) {
+            return __atomic_load_n(&ptr, __ATOMIC_ACQUIRE);
+        }
+
+        template <class Tp>
+        static void _publish(Tp *&ptr, Tp *val) {
+            __atomic_store_n(&ptr, val, __ATOMIC_RELEASE);
+        }
+
+        unsigned int _hash(const Key &key) const {
+            /**
+             * @brief Scramble the user-defined hash code so that the lower
+             * bits used as the bucket index are well distributed.
+             */
+            return hashMix(hash_func.hashCode(key));
+        }
+
+        const Node *_find(unsigned int hv, const Key &key) const {
+            /**
+             * @brief The read path. Must be called in a critical section.
+             */
+            const Table *t = _load(table);
+            for (const Node *p = _load(t -> head[hv & (t -> bucket_num - 1)]);
+                    p; p = _load(p -> next))
+                if (p -> hash == hv && p -> key == key) return p;
+            return NULL;
+        }
+
+        Node **_find_link(unsigned int hv, const Key &key) {
+            /**
+             * @brief Returns the link pointing to the node of key, or the
+             * link at the end of the chain if the key is absent.  Must be
+             * called with write_lock held.
+             */
+            Node **pptr = &table -> head[hv & (table -> bucket_num - 1)];
+            for (Node *p; (p = *pptr) && !(p -> hash == hv && p -> key == key);
+                    pptr = &(p -> next));
+            return pptr;
+        }
+
+        void _insert(unsigned int hv, const Key &key, const Val &value) {
+            /**
+             * @brief Publish a new node at the head of its chain, growing
+             * the table first if the load factor exceeds one.  Must be
+             * called with write_lock held.
+             */
+            if (elem_num >= table -> bucket_num) _grow();
+            Node *&head = table -> head[hv & (table -> bucket_num - 1)];
+            _publish(head, new Node(key, value, hv, head));
+            __atomic_store_n(&elem_num, elem_num + 1, __ATOMIC_RELAXED);
+        }
+
+        void _grow() {
+            /**
+             * @brief Build a table with doubled buckets from copies of the
+             * nodes, publish it and retire the old one.
+             */
+            Table *t = new Table(table -> bucket_num << 1);
+            for (int i = 0; i < table -> bucket_num; i++)
+                for (Node *p = table -> head[i]; p; p = p -> next)
+                {
+                    Node *&head = t -> head[p -> hash & (t -> bucket_num - 1)];
+                    head = new Node(p -> key, p -> val, p -> hash, head);
+                }
+            Table *old = table;
+            _publish(table, t);
+            EpochManager::instance().retire(old, _free_table);
+        }
+
+        static void _free_node(void *ptr) { delete (Node *)ptr; }
+        static void _free_table(void *ptr) {
+            Table *t = (Table *)ptr;
+            t -> clear();
+            delete t;
+        }
+
+        ReadMostlyHashMap(const ReadMostlyHashMap &);
+        ReadMostlyHashMap &operator=(const ReadMostlyHashMap &);
+
+    public:
+        class Entry;
+        class Iterator;
+
+        ReadMostlyHashMap() {
+            /**
+             * @brief Constructs an empty hash map.
+             */
+            table = new Table(INIT_BUCKET_NUM);
+            pthread_mutex_init(&write_lock, NULL);
+            hash_func = Hash();
+            elem_num = 0;
+        }
+
+        ~ReadMostlyHashMap() {
+            /**
+             * @brief Destructor. No other thread may access the map any
+             * more.  The nodes retired earlier stay with the EpochManager,
+             * whose deleters do not refer to the map.
+             */
+            _free_table(table);
+            pthread_mutex_destroy(&write_lock);
+        }
+
+        // @brief Returns a weakly consistent iterator over this map.
+        Iterator iterator() const { return Iterator(this); }
+
+        void clear() {
+            /**
+             * @brief Removes all of the mappings from this map.
+             */
+            pthread_mutex_lock(&write_lock);
+            Table *old = table;
+            _publish(table, new Table(INIT_BUCKET_NUM));
+            __atomic_store_n(&elem_num, 0, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(&write_lock);
+            EpochManager::instance().retire(old, _free_table);
+        }
+
+        bool containsKey(const Key &key) const {
+            /**
+             * @brief Returns true if this map contains a mapping for the
+             * specified key.
+             */
+            unsigned int hv = _hash(key);
+            EpochManager::Guard guard;
+            return _find(hv, key) != NULL;
+        }
+
+        bool containsValue(const Val &value) const {
+            /**
+             * @brief Returns true if this map maps one or more keys to the
+             * specified value.
+             */
+            EpochManager::Guard guard;
+            const Table *t = _load(table);
+            for (int i = 0; i < t -> bucket_num; i++)
+                for (const Node *p = _load(t -> head[i]); p; p = _load(p -> next))
+                    if (p -> val == value) return true;
+            return false;
+        }
+
+        Val get(const Key &key) const {
+            /**
+             * @brief Returns a copy of the value to which the specified key is
+             * mapped.  If the key is not present in this map, this function
+             * should throw ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            unsigned int hv = _hash(key);
+            {
+                EpochManager::Guard guard;
+                const Node *p = _find(hv, key);
+                if (p) return p -> val;
+            }
+            throw ElementNotExist();
+        }
+
+        // @brief Returns true if this map contains no key-value mappings.
+        bool isEmpty() const { return size() == 0; }
+
+        void put(const Key &key, const Val &value) {
+            /**
+             * @brief Associates the specified value with the specified key in
+             * this map. An existing node is replaced by a new one rather
+             * than modified in place, since readers may be copying its value.
+             */
+            unsigned int hv = _hash(key);
+            pthread_mutex_lock(&write_lock);
+            Node **pptr = _find_link(hv, key), *p = *pptr;
+            if (p)
+            {
+                _publish(*pptr, new Node(key, value, hv, p -> next));
+                EpochManager::instance().retire(p, _free_node);
+            }
+            else _insert(hv, key, value);
+            pthread_mutex_unlock(&write_lock);
+        }
+
+        template <class Func>
+        Val computeIfAbsent(const Key &key, Func func) {
+            /**
+             * @brief If the specified key is not associated with a value yet,
+             * computes one by calling func(key) and puts it into this map.
+             * Returns the value finally associated with the key.
+             * The operation is atomic with respect to the other writers, so
+             * func is called at most once for an absent key.  The fast path
+             * for a present key takes no lock.
+             */
+            unsigned int hv = _hash(key);
+            {
+                EpochManager::Guard guard;
+                const Node *p = _find(hv, key);
+                if (p) return p -> val;
+            }
+            pthread_mutex_lock(&write_lock);
+            Node *p = *_find_link(hv, key);
+            Val res = p ? p -> val : func(key);
+            if (!p) _insert(hv, key, res);
+            pthread_mutex_unlock(&write_lock);
+            return res;
+        }
+
+        void remove(const Key &key) {
+            /**
+             * @brief Removes the mapping for the specified key from this map
+             * if present.  If there is no mapping for the specified key,
+             * throws ElementNotExist exception.
+             * @throw ElementNotExist
+             */
+            unsigned int hv = _hash(key);
+            pthread_mutex_lock(&write_lock);
+            Node **pptr = _find_link(hv, key), *p = *pptr;
+            if (p)
+            {
+                _publish(*pptr, p -> next);
+                __atomic_store_n(&elem_num, elem_num - 1, __ATOMIC_RELAXED);
+            }
+            pthread_mutex_unlock(&write_lock);
+            if (p == NULL) throw ElementNotExist();
+            EpochManager::instance().retire(p, _free_node);
+        }
+
+        // @brief Returns the number of key-value mappings in this map.
+        int size() const { return __atomic_load_n(&elem_num, __ATOMIC_RELAXED); }
+};
+
+template <class Key, class Val, class Hash>
+struct ReadMostlyHashMap<Key, Val, Hash>::Node {
+    Key key;
+    Val val;
+    unsigned int hash;
+    Node *next;
+    Node(const Key &_key, const Val &_val, unsigned int _hash, Node *_next) :
+        key(_key), val(_val), hash(_hash), next(_next) {}
+};
+
+template <class Key, class Val, class Hash>
+struct ReadMostlyHashMap<Key, Val, Hash>::Table {
+    int bucket_num;
+    Node **head;
+
+    Table(int _bucket_num) : bucket_num(_bucket_num) {
+        head = new Node*[bucket_num];
+        memset(head, 0, sizeof(Node*) * bucket_num);
+    }
+
+    ~Table() { delete[] head; }
+
+    void clear() {
+        /**
+         * @brief Free the nodes linked in this table.
+         */
+        for (int i = 0; i < bucket_num; i++)
+            for (Node *np, *p = head[i]; p; p = np)
+            {
+                np = p -> next;
+                delete p;
+            }
+    }
+};
+
+template <class Key, class Val, class Hash>
+class ReadMostlyHashMap<Key, Val, Hash>::Entry {
+    Key key;
+    Val value;
+    public:
+    Entry(Key k, Val v)
+    {
+        key = k;
+        value = v;
+    }
+
+    Key getKey() const
+    {
+        return key;
+    }
+
+    Val getValue() const
+    {
+        return value;
+    }
+};
+
+template <class Key, class Val, class Hash>
+class ReadMostlyHashMap<Key, Val, Hash>::Iterator {
+    private:
+        /**
+         * @var cur_index The current index of the head array to which the
+         * iterator is pointing.
+         * @var cur_node The current node pointer.
+         * @var pinned The table being iterated, or NULL for a default
+         * constructed iterator.
+         */
+        int cur_index;
+        const Node *cur_node;
+        const Table *pinned;
+
+        bool _try_next(int &next_index, const Node * &next_node) {
+            next_index = cur_index;
+            next_node = cur_node ? _load(cur_node -> next) : NULL;
+            while (next_node == NULL && ++next_index < pinned -> bucket_num)
+                next_node = _load(pinned -> head[next_index]);
+            return next_node != NULL;
+        }
+
+    public:
+        Iterator() : pinned(NULL) {}
+        Iterator(const ReadMostlyHashMap *con) :
+            cur_index(-1), cur_node(NULL) {
+            EpochManager::instance().enter();
+            pinned = _load(con -> table);
+        }
+
+        Iterator(const Iterator &other) :
+            cur_index(other.cur_index), cur_node(other.cur_node),
+            pinned(other.pinned) {
+            if (pinned) EpochManager::instance().enter();
+        }
+
+        Iterator &operator=(const Iterator &other) {
+            if (other.pinned) EpochManager::instance().enter();
+            if (pinned) EpochManager::instance().leave();
+            cur_index = other.cur_index;
+            cur_node = other.cur_node;
+            pinned = other.pinned;
+            return *this;
+        }
+
+        ~Iterator() {
+            if (pinned) EpochManager::instance().leave();
+        }
+
+        bool hasNext() {
+            /**
+             * @brief Returns true if the iteration has more elements.
+             */
+            int nidx;
+            const Node *nnode;
+            return _try_next(nidx, nnode);
+        }
+
+        Entry next() {
+            /**
+             * @brief Returns the next element in the iteration.
+             * @throw ElementNotExist exception when hasNext() == false
+             */
+            int nidx;
+            const Node *nnode;
+            if (!_try_next(nidx, nnode)) throw ElementNotExist();
+            cur_index = nidx;
+            cur_node = nnode;
+            return Entry(nnode -> key, nnode -> val);
+        }
+};
+
+#endif
@@ -20,125 +20,1208 @@
 #define TREEMAP_H
 
 #include "ElementNotExist.h"
+#include "IndexOutOfBound.h"
+#include "ArrayList.h"
 #include "LinkedList.h"
+#include "HashMix.h"
 #include <cstdlib>
+#include <pthread.h>
 
 /**
  * TreeMap is the balanced-tree implementation of map. The iterators must
  * iterate through the map in the natural order (operator<) of the key.
+ *
+ * Copying a TreeMap takes constant time: the copies share the nodes by
+ * reference counting, and the nodes are actually copied only when one of the
+ * copies is about to be modified.  Since the nodes are threaded into a
+ * doubly-linked list for iteration, they can not be shared partially, so the
+ * first modification after a copy copies the whole tree, in O(n) time and
+ * memory like a deep copy (about 0.3 s and 56 bytes per entry for a million
+ * entries, where a HashMap copies a page of buckets).  Snapshots of a map
+ * which keeps being written are thus no cheaper than copies.  Different
+ * copies may be used by different threads, but a single TreeMap instance is
+ * not thread-safe.
+ *
+ * Each node keeps the size of its subtree, maintained by the rotations of
+ * put() and remove(), so that rank(), select() and countRange() take
+ * O(log n) time.
+ *
+ * putAllSorted() and buildFromSorted() load keys given in ascending order in
+ * linear time, building the treap bottom-up along its right spine instead of
+ * descending from the root for every key.
+ *
+ * split(), join() and removeRange() cut and glue whole subtrees in O(log n)
+ * time (plus freeing the removed nodes), relinking the threaded list only at
+ * the boundaries.  putAll() merges another map by the recursive split-based
+ * union, which may fork the subproblems of a large union to other threads.
+ *
+ * The nodes also point to their parents, so that put() can start from the
+ * node it inserted last (the finger), or from a hint given by an iterator,
+ * instead of from the root: a key found within a few steps of it along the
+ * threaded list is linked as a leaf next to its neighbour, and rotated up
+ * bottom-up.  Keys arriving in order, or nearly, are then put without any
+ * descent and key comparison beyond those few steps.  The subtree sizes of
+ * all the ancestors of the new leaf are still incremented, so such a put()
+ * takes O(depth) time, not amortized O(1), while the sizes are maintained;
+ * the walk up is only cheaper than a descent, along a path hot in cache.
+ *
+ * Template argument Monoid, if given, augments each node with the aggregate
+ * of the values of its subtree, kept along with the subtree size, so that
+ * aggregate(lo, hi) combines the values of the keys in [lo, hi) in O(log n)
+ * time instead of iterating through them.  It is a class with a type Acc
+ * and two static functions:
+ * @code
+ *      static Acc of(const Val &val);                   // a single value
+ *      static Acc combine(const Acc &lo, const Acc &hi); // associative
+ * @endcode
+ * where combine() gets the aggregate of the lesser keys first, so it need
+ * not be commutative; no identity is needed as the aggregate of no values
+ * is never taken.  SumMonoid, CountMonoid, MinMonoid and MaxMonoid are
+ * provided.  For example
+ * @code
+ *      TreeMap<int, long long, SumMonoid<long long> > bytes; // by time
+ *      long long total = bytes.aggregate(from, to);
+ * @endcode
+ * The default NoMonoid adds nothing to the nodes.
+ *
+ * Template argument Balance chooses how the tree is kept balanced.
+ * TreapBalance, the default, keeps a treap of random priorities, of expected
+ * O(log n) depth.  RedBlackBalance and AVLBalance bound the depth in the
+ * worst case, AVL trees being shallower at the cost of more rotations.
+ * SplayBalance moves the node put or reached by a lookup (or the parent of
+ * the node removed) to the root, so that a few hot keys stay near it, in
+ * amortized O(log n) time; the const lookups splay only if the nodes are
+ * not shared with a copy.  So, unlike the other policies, a splay tree may
+ * not be read by several threads at once, even through const functions,
+ * unless a copy made beforehand keeps its nodes shared and still.  All of
+ * them share the nodes, the
+ * iterators and the threaded list, and rebalance bottom-up through the
+ * parent pointers after a leaf is linked or a node is unlinked.  split(),
+ * join(), removeRange(), putAll() and the sorted loads keep their bounds
+ * only in a treap: with the other policies they rebuild the trees balanced
+ * from the threaded list afterwards, in linear time.
  */
 
-template<class Key, class Val>
+template <class Val>
+struct SumMonoid {
+    typedef Val Acc;
+    static Acc of(const Val &val) { return val; }
+    static Acc combine(const Acc &lo, const Acc &hi) { return lo + hi; }
+};
+
+template <class Val>
+struct CountMonoid {
+    typedef int Acc;
+    static Acc of(const Val &) { return 1; }
+    static Acc combine(const Acc &lo, const Acc &hi) { return lo + hi; }
+};
+
+template <class Val>
+struct MinMonoid {
+    typedef Val Acc;
+    static Acc of(const Val &val) { return val; }
+    static Acc combine(const Acc &lo, const Acc &hi) {
+        return hi < lo ? hi : lo;
+    }
+};
+
+template <class Val>
+struct MaxMonoid {
+    typedef Val Acc;
+    static Acc of(const Val &val) { return val; }
+    static Acc combine(const Acc &lo, const Acc &hi) {
+        return lo < hi ? hi : lo;
+    }
+};
+
+struct NoMonoid {
+    typedef void Acc;
+};
+
+template <class Monoid>
+struct TreeMapAggregate {
+    /**
+     * @brief The part of a TreeMap node augmented by Monoid.
+     * @var agg The aggregate of the values of the subtree.
+     */
+    static const bool AGGREGATED = true;
+    typename Monoid::Acc agg;
+
+    template <class Val>
+    void pull(const Val &val, const TreeMapAggregate *lo,
+                const TreeMapAggregate *hi) {
+        // @brief Recompute agg from val and the subtrees lo and hi.
+        agg = Monoid::of(val);
+        if (lo) agg = Monoid::combine(lo -> agg, agg);
+        if (hi) agg = Monoid::combine(agg, hi -> agg);
+    }
+};
+
+template <>
+struct TreeMapAggregate<NoMonoid> {
+    static const bool AGGREGATED = false;
+
+    template <class Val>
+    void pull(const Val &, const TreeMapAggregate *,
+                const TreeMapAggregate *) {}
+};
+
+/**
+ * The balancing policies of TreeMap, used as tags to choose the algorithms.
+ */
+struct TreapBalance {};
+struct RedBlackBalance {};
+struct AVLBalance {};
+struct SplayBalance {};
+
+template<class Key, class Val, class Monoid = NoMonoid,
+        class Balance = TreapBalance>
 class TreeMap
 {
     private:
         struct Node;
         struct Seg;
+        struct UnionTask;
+        class SortedMerge;
         /**
          * @var root Pointing to the root of the balanced tree
          * @var head Sentinel pointer for iteration. It marks the beginning as
          * well as the end of a linked list.
+         * @var ref_cnt The number of maps sharing root and head.
          * @var elem_num The total number of elements in the container.
          */
         Node *root, *head;
+        int *ref_cnt;
         int elem_num;
+        /**
+         * @var pri_state The state of the generator of node priorities.
+         */
+        unsigned int pri_state;
+        /**
+         * @var finger The node put last, or NULL.
+         * @var FINGER_STEPS How far along the threaded list put() looks for
+         * the key from the finger or the hint before descending from the
+         * root.
+         */
+        Node *finger;
+        static const int FINGER_STEPS = 2;
+        /**
+         * @var RED, BLACK The colors of the nodes of a red-black tree.
+         */
+        static const int RED = 1, BLACK = 0;
+        /**
+         * @var PARALLEL_UNION_SIZE The least number of nodes of a union
+         * which is forked to another thread.
+         */
+        static const int PARALLEL_UNION_SIZE = 1 << 16;
+        /**
+         * @var PUT_ALL_RATIO putAll() merges by union if the other map is at
+         * least 1 / PUT_ALL_RATIO as large as this one.
+         */
+        static const int PUT_ALL_RATIO = 16;
+
+        static void _clear_nodes_dfs(Node *p) {
+            /**
+             * @brief Free the subtree p depth first, climbing back by the
+             * parent pointers instead of recursing, as a splay tree may be
+             * too deep to recurse.
+             */
+            if (p == NULL) return;
+            for (Node *top = p; ; )
+            {
+                bool dir = p -> ch[0] == NULL;
+                if (Node *c = p -> ch[dir])
+                {
+                    p -> ch[dir] = NULL;
+                    c -> parent = p;
+                    p = c;
+                    continue;
+                }
+                Node *up = p -> parent;
+                bool last = p == top;
+                delete p;
+                if (last) return;
+                p = up;
+            }
+        }
+
+        void _init_storage() {
+            /**
+             * @brief Set up an empty tree owned by this map only.
+             */
+            root = NULL;
+            head = new Node;
+            head -> next = head -> prev = head;
+            ref_cnt = new int(1);
+            finger = NULL;
+        }
+
+        static void _drop(Node *root, Node *head, int *ref_cnt) {
+            /**
+             * @brief Drop a reference to the shared storage, freeing it if
+             * it was the last one.
+             */
+            if (__sync_sub_and_fetch(ref_cnt, 1) == 0)
+            {
+                _clear_nodes_dfs(root);
+                delete head;
+                delete ref_cnt;
+            }
+        }
+
+        void _share(const TreeMap &other) {
+            __sync_add_and_fetch(other.ref_cnt, 1);
+            root = other.root;
+            head = other.head;
+            ref_cnt = other.ref_cnt;
+            elem_num = other.elem_num;
+            finger = NULL;
+        }
+
+        void _detach() {
+            /**
+             * @brief Make a private copy of the nodes if they are shared
+             * with other maps. Must be called before any modification.
+             */
+            if (__atomic_load_n(ref_cnt, __ATOMIC_ACQUIRE) == 1) return;
+            Node *src_root = root, *src_head = head;
+            int *src_ref_cnt = ref_cnt;
+            head = new Node;
+            ref_cnt = new int(1);
+            finger = NULL;
+            _copy_nodes(src_root, src_head, Balance());
+            _drop(src_root, src_head, src_ref_cnt);
+        }
+
+        Seg _copy_nodes_dfs(Node **des_pptr, Node *src_ptr) {
+            if (src_ptr == NULL) 
+            {
+                *des_pptr = NULL;
+                return Seg();
+            }
+            Node *des_ptr = *des_pptr = new Node();
+            *des_ptr = *src_ptr;
+            Seg res = Seg::merge(
+                    _copy_nodes_dfs(&(des_ptr -> ch[0]), src_ptr -> ch[0]),
+                    des_ptr,
+                    _copy_nodes_dfs(&(des_ptr -> ch[1]), src_ptr -> ch[1]));
+            _adopt(des_ptr);
+            return res;
+        }
+
+        void _copy_nodes(Node *src_root, Node *, TreapBalance) {
+            /**
+             * @brief Copy all the nodes of the tree src_root and rebuild the
+             * logical structure.
+             */
+            _set_chain(_copy_nodes_dfs(&root, src_root));
+        }
+
+        template <class B>
+        void _copy_nodes(Node *, Node *src_head, B) {
+            // @brief Copy the nodes of the list src_head into a balanced tree.
+            root = _copy_balanced(src_head, elem_num);
+            _set_chain(_thread_nodes_dfs(root));
+        }
+
+        Node *_copy_balanced(const Node *src_head, int n) {
+            /**
+             * @brief Returns a balanced tree of copies of the n nodes in the
+             * list src_head, left unthreaded.
+             */
+            if (n == 0) return NULL;
+            Node chain, *last = &chain;
+            for (const Node *p = src_head -> prev; p != src_head; p = p -> prev)
+                last = last -> prev = new Node(*p);
+            Node *cur = chain.prev;
+            return _build(cur, n, 0, _deepest(n));
+        }
+
+        static int _deepest(int n) {
+            // @brief Returns the depth of the deepest node _build() makes.
+            int d = 0;
+            while ((2 << d) <= n) d++;
+            return d;
+        }
+
+        Node *_build(Node *&cur, int n, int depth, int deepest) {
+            /**
+             * @brief Build the n nodes from cur along prev into a tree whose
+             * subtrees differ in size by one at most, so that all the nodes
+             * at the deepest level may be red, and the others black, in a
+             * red-black tree.  cur is moved past them.
+             */
+            if (n == 0) return NULL;
+            Node *lo = _build(cur, (n - 1) / 2, depth + 1, deepest);
+            Node *p = cur;
+            cur = cur -> prev;
+            p -> ch[1] = lo;
+            p -> ch[0] = _build(cur, n / 2, depth + 1, deepest);
+            _update(p);
+            _set_built(p, depth == deepest && depth > 0, Balance());
+            return p;
+        }
+
+        void _rebuild() {
+            // @brief Rebuild the tree balanced from the threaded list.
+            Node *cur = head -> prev;
+            root = _build(cur, elem_num, 0, _deepest(elem_num));
+        }
+
+        static Seg _thread_nodes_dfs(Node *p) {
+            if (p == NULL) return Seg();
+            return Seg::merge(_thread_nodes_dfs(p -> ch[0]), p,
+                                _thread_nodes_dfs(p -> ch[1]));
+        }
+
+        void _set_chain(const Seg &chain) {
+            /**
+             * @brief Link head to the ends of chain, the threaded list of
+             * all the nodes.
+             */
+            if (chain.begin == NULL)
+            {
+                head -> next = head -> prev = head;
+            }
+            else
+            {
+                (head -> next = chain.begin) -> prev = head;
+                (head -> prev = chain.end) -> next = head;
+            }
+        }
+
+        static int _size(const Node *p) { return p ? p -> size : 0; }
+
+        void _rotate(register Node **pptr, bool dir) {
+            register Node *ptr = *pptr, *tptr = ptr -> ch[dir];
+            if ((ptr -> ch[dir] = tptr -> ch[!dir]))
+                ptr -> ch[dir] -> parent = ptr;
+            tptr -> ch[!dir] = ptr;
+            tptr -> parent = ptr -> parent;
+            ptr -> parent = tptr;
+            *pptr = tptr;
+            tptr -> size = ptr -> size;
+            ptr -> size = _size(ptr -> ch[0]) + _size(ptr -> ch[1]) + 1;
+            _pull(ptr);
+            _pull(tptr);
+        }
+
+        static void _pull(Node *p) {
+            // @brief Recompute the aggregate of p from its children.
+            p -> pull(p -> val, p -> ch[1], p -> ch[0]);
+        }
+
+        void _pull_up(Node *p) {
+            /**
+             * @brief Recompute the aggregates of p and its ancestors, after
+             * the value of p is altered.
+             */
+            if (!Node::AGGREGATED) return;
+            for (; ; p = p -> parent)
+            {
+                _pull(p);
+                if (p == root) break;
+            }
+        }
+
+        static void _adopt(Node *p) {
+            /**
+             * @brief Point the children of p back to it.  The parent of the
+             * root is left undefined.
+             */
+            if (p -> ch[0]) p -> ch[0] -> parent = p;
+            if (p -> ch[1]) p -> ch[1] -> parent = p;
+        }
+
+        static void _update(Node *p) {
+            p -> size = _size(p -> ch[0]) + _size(p -> ch[1]) + 1;
+            _adopt(p);
+            _pull(p);
+        }
+
+        static void _split(Node *t, const Key &key, Node *&lo, Node *&hi) {
+            /**
+             * @brief Split the tree t into lo, of the keys less than key, and
+             * hi, of the others.  The threaded list is left alone.
+             */
+            if (t == NULL)
+            {
+                lo = hi = NULL;
+                return;
+            }
+            if (t -> key < key)
+            {
+                lo = t;
+                _split(t -> ch[0], key, t -> ch[0], hi);
+            }
+            else
+            {
+                hi = t;
+                _split(t -> ch[1], key, lo, t -> ch[1]);
+            }
+            _update(t);
+        }
+
+        static Node *_join(Node *lo, Node *hi) {
+            /**
+             * @brief Join two trees, all the keys of lo being less than
+             * those of hi, by merging the right spine of lo with the left
+             * spine of hi in the order of priority.
+             */
+            if (lo == NULL) return hi;
+            if (hi == NULL) return lo;
+            if (lo -> pri <= hi -> pri)
+            {
+                lo -> ch[0] = _join(lo -> ch[0], hi);
+                _update(lo);
+                return lo;
+            }
+            hi -> ch[1] = _join(lo, hi -> ch[1]);
+            _update(hi);
+            return hi;
+        }
+
+        static Node *_take_least(Node *&t, const Key &key) {
+            /**
+             * @brief Take the least node out of t if its key is key.
+             */
+            Node *p = t;
+            if (p == NULL) return NULL;
+            while (p -> ch[1]) p = p -> ch[1];
+            if (!(p -> key == key)) return NULL;
+            Node **pptr = &t, *par = NULL;
+            for (; *pptr != p; pptr = &((*pptr) -> ch[1]))
+                (par = *pptr) -> size--;
+            if ((*pptr = p -> ch[0])) p -> ch[0] -> parent = par;
+            if (Node::AGGREGATED)
+                for (Node *q = par; q; q = q == t ? NULL : q -> parent)
+                    _pull(q);
+            return p;
+        }
+
+        static Node *_union(Node *t1, Node *t2, bool t2_wins, int fork_depth) {
+            /**
+             * @brief Returns the union of the trees t1 and t2: the root of
+             * greater priority is kept, the other tree is split by its key
+             * and each part is merged with a subtree of the root.  A key in
+             * both trees takes its value from t2 if t2_wins, and the
+             * duplicate node is freed.  The subproblems of a large union
+             * are forked to new threads until fork_depth runs out.
+             */
+            if (t1 == NULL) return t2;
+            if (t2 == NULL) return t1;
+            if (t2 -> pri < t1 -> pri)
+            {
+                Node *t = t1;
+                t1 = t2;
+                t2 = t;
+                t2_wins = !t2_wins;
+            }
+            Node *lo, *hi, *dup;
+            _split(t2, t1 -> key, lo, hi);
+            if ((dup = _take_least(hi, t1 -> key)))
+            {
+                if (t2_wins) t1 -> val = dup -> val;
+                delete dup;
+            }
+            if (fork_depth > 0 &&
+                    _size(t1) + _size(lo) + _size(hi) >= PARALLEL_UNION_SIZE)
+            {
+                UnionTask task(t1 -> ch[1], lo, t2_wins, fork_depth - 1);
+                pthread_t thread;
+                bool forked = pthread_create(&thread, NULL, _run_union,
+                                            &task) == 0;
+                if (!forked) _run_union(&task);
+                t1 -> ch[0] = _union(t1 -> ch[0], hi, t2_wins,
+                                    fork_depth - 1);
+                if (forked) pthread_join(thread, NULL);
+                t1 -> ch[1] = task.res;
+            }
+            else
+            {
+                t1 -> ch[1] = _union(t1 -> ch[1], lo, t2_wins, 0);
+                t1 -> ch[0] = _union(t1 -> ch[0], hi, t2_wins, 0);
+            }
+            _update(t1);
+            return t1;
+        }
+
+        static void *_run_union(void *arg) {
+            UnionTask *task = (UnionTask *)arg;
+            task -> res = _union(task -> t1, task -> t2, task -> t2_wins,
+                                task -> fork_depth);
+            return NULL;
+        }
+
+        static Node *_copy_tree_dfs(const Node *src) {
+            /**
+             * @brief Copy the tree src, but not its threaded list.
+             */
+            if (src == NULL) return NULL;
+            Node *p = new Node();
+            *p = *src;
+            p -> ch[0] = _copy_tree_dfs(src -> ch[0]);
+            p -> ch[1] = _copy_tree_dfs(src -> ch[1]);
+            _adopt(p);
+            return p;
+        }
+
+        int _next_pri() {
+            /**
+             * @brief Returns a random priority from the xorshift generator of
+             * this map, which needs no lock unlike rand().
+             */
+            pri_state ^= pri_state << 13;
+            pri_state ^= pri_state >> 17;
+            pri_state ^= pri_state << 5;
+            return (int)pri_state;
+        }
+
+        void _init_pri() {
+            /**
+             * @brief Seed the generator from the address of this map, so
+             * that different maps draw different priorities.
+             */
+            pri_state = hashMix((unsigned int)(size_t)this) | 1;
+        }
+
+        bool _insert(Node **pptr, const Key &key, const Val &value,
+                    Node *prv, Node *nxt) {
+            /**
+             * @brief Put key into the subtree *pptr, between its neighbours
+             * prv and nxt found so far, and rotate the new node up while its
+             * priority is less than its parent's.  The recursion keeps the
+             * path, so no memory but the node is allocated.  Returns false if
+             * the key was present and only its value replaced.
+             */
+            Node *ptr = *pptr;
+            if (ptr == NULL)
+            {
+                Node *t = *pptr = new Node();
+                t -> pri = _next_pri();
+                t -> key = key;
+                t -> val = value;
+                t -> ch[0] = t -> ch[1] = NULL;
+                t -> size = 1;
+                _pull(t);
+                (t -> prev = prv) -> next = t;
+                (t -> next = nxt) -> prev = t;
+                finger = t;
+                return true;
+            }
+            if (key == ptr -> key)
+            {
+                ptr -> val = value; // alter the value
+                _pull(ptr);
+                finger = ptr;
+                return false;
+            }
+            bool dir = key < ptr -> key;
+            if (!_insert(&(ptr -> ch[dir]), key, value,
+                        dir ? ptr : prv, dir ? nxt : ptr))
+            {
+                _pull(ptr);
+                return false;
+            }
+            ptr -> size++;
+            ptr -> ch[dir] -> parent = ptr;
+            _pull(ptr);
+            if (ptr -> ch[dir] -> pri < ptr -> pri) _rotate(pptr, dir);
+            return true;
+        }
+
+        Node **_link_of(Node *p) {
+            // @brief Returns the pointer to p in its parent, or root.
+            if (p == root) return &root;
+            Node *par = p -> parent;
+            return &(par -> ch[par -> ch[1] == p]);
+        }
+
+        bool _insert_near(Node *p, const Key &key, const Val &value) {
+            /**
+             * @brief Put key next to node p if it is found within
+             * FINGER_STEPS steps of p along the threaded list: the new node
+             * is linked as a leaf to its predecessor or its successor,
+             * whichever has the child free, the sizes of its ancestors are
+             * incremented, and it is rotated up while its priority is less
+             * than its parent's.  Returns false, changing nothing, if the key
+             * is too far.
+             */
+            Node *lo, *hi; // the neighbours of key, less and greater
+            int steps = 0;
+            if (p -> key < key)
+            {
+                for (lo = p; ; lo = hi)
+                {
+                    hi = lo -> prev;
+                    if (hi == head || key < hi -> key) break;
+                    if (key == hi -> key || ++steps == FINGER_STEPS)
+                        break;
+                }
+                if (hi != head && !(key < hi -> key))
+                {
+                    if (!(key == hi -> key)) return false;
+                    _alter(hi, value);
+                    return true;
+                }
+            }
+            else if (key < p -> key)
+            {
+                for (hi = p; ; hi = lo)
+                {
+                    lo = hi -> next;
+                    if (lo == head || lo -> key < key) break;
+                    if (key == lo -> key || ++steps == FINGER_STEPS)
+                        break;
+                }
+                if (lo != head && !(lo -> key < key))
+                {
+                    if (!(key == lo -> key)) return false;
+                    _alter(lo, value);
+                    return true;
+                }
+            }
+            else
+            {
+                _alter(p, value);
+                return true;
+            }
+            // one of them is a descendant of the other with the child free
+            if (lo != head && lo -> ch[0] == NULL)
+                _link_leaf(_new_leaf(key, value, hi, lo), lo, 0);
+            else _link_leaf(_new_leaf(key, value, hi, lo), hi, 1);
+            return true;
+        }
+
+        Node *_new_leaf(const Key &key, const Val &value, Node *prv,
+                        Node *nxt) {
+            // @brief Returns a new node threaded between prv and nxt.
+            Node *t = new Node();
+            _init_balance(t, Balance());
+            t -> key = key;
+            t -> val = value;
+            t -> ch[0] = t -> ch[1] = NULL;
+            t -> size = 1;
+            (t -> prev = prv) -> next = t;
+            (t -> next = nxt) -> prev = t;
+            _pull(t);
+            return t;
+        }
+
+        void _link_leaf(Node *t, Node *par, bool dir) {
+            /**
+             * @brief Link the new leaf t as the child dir of par (or as the
+             * root if par is NULL), update its ancestors and rebalance.
+             */
+            if (par) par -> ch[dir] = t;
+            else root = t;
+            t -> parent = par;
+            for (Node *q = t; q != root; )
+            {
+                (q = q -> parent) -> size++;
+                _pull(q);
+            }
+            finger = t;
+            elem_num++;
+            _fix_insert(t, Balance());
+        }
+
+        void _alter(Node *p, const Val &value) {
+            // @brief Alter the value of p, which is being put.
+            p -> val = value;
+            _pull_up(p);
+            finger = p;
+            _touch(p, Balance());
+        }
+
+        void _put(const Key &key, const Val &value, TreapBalance) {
+            if (_insert(&root, key, value, head, head)) elem_num++;
+        }
+
+        template <class B>
+        void _put(const Key &key, const Val &value, B) {
+            /**
+             * @brief Put by an iterative descent, as a splay tree may be too
+             * deep to recurse, and rebalance bottom-up.
+             */
+            Node *par = NULL, *prv = head, *nxt = head;
+            bool dir = false;
+            for (Node *p = root; p; p = p -> ch[dir])
+            {
+                if (key == p -> key)
+                {
+                    _alter(p, value);
+                    return;
+                }
+                dir = key < p -> key;
+                (dir ? prv : nxt) = par = p;
+            }
+            _link_leaf(_new_leaf(key, value, prv, nxt), par, dir);
+        }
+
+        void _remove(const Key &key, TreapBalance) {
+            /**
+             * @brief Rotate the node of key down to a leaf and cut it off,
+             * decreasing the sizes on the way down.
+             */
+            Node **pptr = &root;
+            for (Node *ptr;
+                    (ptr = *pptr) && !(key == ptr -> key); 
+                    ptr -> size--, pptr = &(ptr -> ch[key < ptr -> key]));
+
+            Node *ptr = *pptr;
+            if (ptr == NULL)
+            {
+                _undo_path_size(key, -1);
+                throw ElementNotExist();
+            }
+            
+            Node * &chl = ptr -> ch[0], * &chr = ptr -> ch[1]; 
+            while (chl || chr)
+            {
+                bool dir = chr && (!chl || chr -> pri < chl -> pri);
+                _rotate(pptr, dir);
+                (*pptr) -> size--; // ptr is going to leave its subtree
+                pptr = &((*pptr) -> ch[!dir]);
+            }
+            ptr -> prev -> next = ptr -> next;
+            ptr -> next -> prev = ptr -> prev;
+            if (ptr == finger) finger = NULL;
+            *pptr = NULL;
+            if (pptr != &root) _pull_up(ptr -> parent);
+            delete ptr;
+            elem_num--;
+        }
+
+        template <class B>
+        void _remove(const Key &key, B) {
+            /**
+             * @brief Unlink the node of key, after exchanging its place with
+             * its successor if it has two children, and rebalance from its
+             * parent.
+             */
+            Node *x = root;
+            while (x && !(key == x -> key)) x = x -> ch[key < x -> key];
+            if (x == NULL) throw ElementNotExist();
+            if (x -> ch[0] && x -> ch[1]) _exchange(x, x -> prev);
+            Node *c = x -> ch[0] ? x -> ch[0] : x -> ch[1];
+            Node *par = x == root ? NULL : x -> parent;
+            bool dir = par && par -> ch[1] == x;
+            *_link_of(x) = c;
+            if (c) c -> parent = par;
+            for (Node *q = par; q; q = q == root ? NULL : q -> parent)
+            {
+                q -> size--;
+                _pull(q);
+            }
+            x -> prev -> next = x -> next;
+            x -> next -> prev = x -> prev;
+            if (x == finger) finger = NULL;
+            _fix_remove(par, dir, x, B());
+            delete x;
+            elem_num--;
+        }
+
+        void _exchange(Node *x, Node *y) {
+            /**
+             * @brief Exchange the places in the tree of x and its successor
+             * y, which has no lesser child, along with the balance and size
+             * of each place.
+             */
+            Node **xlink = _link_of(x), *xp = x -> parent;
+            Node *lo = x -> ch[1], *hi = x -> ch[0], *yhi = y -> ch[0];
+            int t = x -> pri;
+            x -> pri = y -> pri;
+            y -> pri = t;
+            t = x -> size;
+            x -> size = y -> size;
+            y -> size = t;
+            if (hi == y) (y -> ch[0] = x) -> parent = y;
+            else
+            {
+                (y -> parent -> ch[1] = x) -> parent = y -> parent;
+                (y -> ch[0] = hi) -> parent = y;
+            }
+            (y -> ch[1] = lo) -> parent = y;
+            if ((x -> ch[0] = yhi)) yhi -> parent = x;
+            x -> ch[1] = NULL;
+            *xlink = y;
+            y -> parent = xp;
+        }
+
+        void _access(Node *p) const {
+            // @brief Splay p, found by a lookup, in a splay tree.
+            const_cast<TreeMap *>(this) -> _touch(p, Balance());
+        }
+
+        /*{{{ Balancing policies */
+        void _init_balance(Node *t, TreapBalance) { t -> pri = _next_pri(); }
+        void _init_balance(Node *t, RedBlackBalance) { t -> pri = RED; }
+        void _init_balance(Node *t, AVLBalance) { t -> pri = 1; }
+        void _init_balance(Node *t, SplayBalance) { t -> pri = 0; }
+
+        static void _set_built(Node *, bool, TreapBalance) {}
+        static void _set_built(Node *p, bool deepest, RedBlackBalance) {
+            p -> pri = deepest ? RED : BLACK;
+        }
+        static void _set_built(Node *p, bool, AVLBalance) { _set_height(p); }
+        static void _set_built(Node *, bool, SplayBalance) {}
+
+        void _fix_insert(Node *t, TreapBalance) {
+            // @brief Rotate t up while its priority is less than its parent's.
+            while (t != root && t -> pri < t -> parent -> pri)
+            {
+                Node *par = t -> parent;
+                _rotate(_link_of(par), par -> ch[1] == t);
+            }
+        }
+
+        void _fix_insert(Node *x, RedBlackBalance) {
+            /**
+             * @brief Restore the red-black tree after the red leaf x is
+             * linked: a red uncle is recolored, moving the violation up two
+             * levels, and a black one ends it by one or two rotations.
+             */
+            while (x != root && x -> parent -> pri == RED)
+            {
+                Node *p = x -> parent, *g = p -> parent;
+                bool dir = g -> ch[1] == p;
+                Node *u = g -> ch[!dir];
+                if (_red(u))
+                {
+                    p -> pri = u -> pri = BLACK;
+                    g -> pri = RED;
+                    x = g;
+                    continue;
+                }
+                if (p -> ch[!dir] == x)
+                {
+                    _rotate(&(g -> ch[dir]), !dir);
+                    p = x;
+                }
+                p -> pri = BLACK;
+                g -> pri = RED;
+                _rotate(_link_of(g), dir);
+                break;
+            }
+            root -> pri = BLACK;
+        }
+
+        void _fix_insert(Node *t, AVLBalance) {
+            if (t != root) _fix_avl(t -> parent);
+        }
+
+        void _fix_insert(Node *t, SplayBalance) { _splay(t); }
+
+        void _fix_remove(Node *par, bool, Node *, AVLBalance) {
+            if (par) _fix_avl(par);
+        }
+
+        void _fix_remove(Node *par, bool, Node *, SplayBalance) {
+            if (par) _splay(par);
+        }
 
-        void _clear_nodes_dfs(Node *p) {
-            if (p == NULL) return; 
-            _clear_nodes_dfs(p -> ch[0]);
-            _clear_nodes_dfs(p -> ch[1]);
-            delete p;
+        void _fix_remove(Node *xp, bool dir, Node *y, RedBlackBalance) {
+            /**
+             * @brief Restore the red-black tree after the node y is unlinked
+             * from the child dir of xp: if y was black, the subtree there
+             * lacks a black node, which is taken from the sibling w, or
+             * pushed up by recoloring w when both its children are black.
+             */
+            if (y -> pri == RED) return;
+            Node *x = xp ? xp -> ch[dir] : root;
+            while (x != root && !_red(x))
+            {
+                Node *w = xp -> ch[!dir];
+                if (_red(w))
+                {
+                    w -> pri = BLACK;
+                    xp -> pri = RED;
+                    _rotate(_link_of(xp), !dir);
+                    w = xp -> ch[!dir];
+                }
+                if (!_red(w -> ch[0]) && !_red(w -> ch[1]))
+                {
+                    w -> pri = RED;
+                    x = xp;
+                    if (x == root) break;
+                    xp = x -> parent;
+                    dir = xp -> ch[1] == x;
+                    continue;
+                }
+                if (!_red(w -> ch[!dir]))
+                {
+                    w -> ch[dir] -> pri = BLACK;
+                    w -> pri = RED;
+                    _rotate(&(xp -> ch[!dir]), dir);
+                    w = xp -> ch[!dir];
+                }
+                w -> pri = xp -> pri;
+                xp -> pri = BLACK;
+                w -> ch[!dir] -> pri = BLACK;
+                _rotate(_link_of(xp), !dir);
+                x = root;
+                break;
+            }
+            if (x) x -> pri = BLACK;
+        }
+
+        static bool _red(const Node *p) { return p && p -> pri == RED; }
+
+        static int _height(const Node *p) { return p ? p -> pri : 0; }
+
+        static void _set_height(Node *p) {
+            int h0 = _height(p -> ch[0]), h1 = _height(p -> ch[1]);
+            p -> pri = (h0 < h1 ? h1 : h0) + 1;
+        }
+
+        void _fix_avl(Node *q) {
+            /**
+             * @brief Update the heights from q up, rotating where the
+             * children differ in height by two, until a subtree keeps its
+             * height.
+             */
+            for (; ; q = q -> parent)
+            {
+                int old = q -> pri;
+                int h0 = _height(q -> ch[0]), h1 = _height(q -> ch[1]);
+                if (h0 - h1 > 1 || h1 - h0 > 1)
+                {
+                    bool dir = h1 > h0;
+                    Node *c = q -> ch[dir];
+                    if (_height(c -> ch[!dir]) > _height(c -> ch[dir]))
+                    {
+                        _rotate(&(q -> ch[dir]), !dir);
+                        _set_height(c);
+                        _set_height(q -> ch[dir]);
+                    }
+                    _rotate(_link_of(q), dir);
+                    _set_height(q);
+                    q = q -> parent;
+                }
+                _set_height(q);
+                if (q -> pri == old || q == root) break;
+            }
+        }
+
+        void _splay(Node *x) {
+            // @brief Move x to the root by zig-zig and zig-zag steps.
+            while (x != root)
+            {
+                Node *p = x -> parent;
+                bool dp = p -> ch[1] == x;
+                if (p == root)
+                {
+                    _rotate(&root, dp);
+                    break;
+                }
+                Node *g = p -> parent, **glink = _link_of(g);
+                bool dg = g -> ch[1] == p;
+                if (dp == dg) _rotate(glink, dg);
+                else _rotate(&(g -> ch[dg]), dp);
+                _rotate(glink, dg);
+            }
+        }
+
+        template <class B>
+        void _touch(Node *, B) {}
+
+        void _touch(Node *p, SplayBalance) {
+            if (__atomic_load_n(ref_cnt, __ATOMIC_ACQUIRE) == 1) _splay(p);
+        }
+
+        /**
+         * @brief The bulk operations run the treap algorithms, which need
+         * the recursion depth of a splay tree bounded first, and leave the
+         * trees of the other policies to be rebuilt.
+         */
+        template <class B>
+        void _prepare_bulk(B) {}
+        void _prepare_bulk(SplayBalance) { _rebuild(); }
+        void _finish_bulk(TreapBalance) {}
+        template <class B>
+        void _finish_bulk(B) { _rebuild(); }
+
+        void _put_all(const TreeMap &other, int thread_num, TreapBalance) {
+            _detach();
+            finger = NULL; // the union may free it
+            int fork_depth = 0;
+            while ((1 << fork_depth) < thread_num) fork_depth++;
+            root = _union(root, _copy_tree_dfs(other.root), true, fork_depth);
+            _set_chain(_thread_nodes_dfs(root));
+            elem_num = _size(root);
+        }
+
+        template <class B>
+        void _put_all(const TreeMap &other, int, B) {
+            // @brief The union needs priorities, so merge the lists.
+            putAllSorted(other.iterator());
+        }
+
+        /**
+         * @brief Whether node p, whose subtrees have heights h0 and h1 and
+         * black heights b0 and b1, keeps the invariant of the policy: the
+         * priorities of a treap grow downwards, a red node has black
+         * children and equal black heights, and an AVL node records its
+         * height and its subtrees differ by one at most.
+         */
+        static bool _check_node(const Node *p, int, int, int, int,
+                                TreapBalance) {
+            return (!p -> ch[0] || p -> pri <= p -> ch[0] -> pri) &&
+                (!p -> ch[1] || p -> pri <= p -> ch[1] -> pri);
+        }
+        static bool _check_node(const Node *p, int, int, int b0, int b1,
+                                RedBlackBalance) {
+            return b0 == b1 && (p -> pri == BLACK ||
+                (p -> pri == RED && !_red(p -> ch[0]) && !_red(p -> ch[1])));
+        }
+        static bool _check_node(const Node *p, int h0, int h1, int, int,
+                                AVLBalance) {
+            return p -> pri == (h0 < h1 ? h1 : h0) + 1 && h0 - h1 <= 1 &&
+                h1 - h0 <= 1;
+        }
+        static bool _check_node(const Node *, int, int, int, int,
+                                SplayBalance) {
+            return true;
         }
 
-        // @brief Free all allocated nodes in storage.
-        void _clear_nodes() { _clear_nodes_dfs(root); }
+        template <class B>
+        static bool _check_root(const Node *, B) { return true; }
+        static bool _check_root(const Node *r, RedBlackBalance) {
+            return r == NULL || r -> pri == BLACK;
+        }
+        /*}}}*/
 
-        Seg _copy_nodes_dfs(Node **des_pptr, Node *src_ptr) {
-            if (src_ptr == NULL) 
+        int _check(const Node *p, const Node *par, const Key *lo,
+                    const Key *hi, int &black, bool &ok) const {
+            /**
+             * @brief Returns the height of the subtree p, whose keys should
+             * lie strictly between lo and hi when given, and its black
+             * height in black; ok is cleared on a broken link, size or
+             * invariant.
+             */
+            if (p == NULL)
             {
-                *des_pptr = NULL;
-                return Seg();
+                black = 0;
+                return 0;
             }
-            Node *des_ptr = *des_pptr = new Node();
-            *des_ptr = *src_ptr;
-            return Seg::merge(
-                    _copy_nodes_dfs(&(des_ptr -> ch[0]), src_ptr -> ch[0]),
-                    des_ptr,
-                    _copy_nodes_dfs(&(des_ptr -> ch[1]), src_ptr -> ch[1]));
+            if (p -> parent != par && par != NULL) ok = false;
+            if ((lo && !(*lo < p -> key)) || (hi && !(p -> key < *hi)))
+                ok = false;
+            int b0, b1;
+            int h0 = _check(p -> ch[0], p, &(p -> key), hi, b0, ok);
+            int h1 = _check(p -> ch[1], p, lo, &(p -> key), b1, ok);
+            if (p -> size != _size(p -> ch[0]) + _size(p -> ch[1]) + 1 ||
+                !_check_node(p, h0, h1, b0, b1, Balance()))
+                ok = false;
+            black = b0 + !_red(p);
+            return (h0 < h1 ? h1 : h0) + 1;
         }
 
-        void _copy_nodes(const TreeMap &src) {
+        void _undo_path_size(const Key &key, int delta) {
             /**
-             * @brief Copy all the nodes from src and rebuild the logical
-             * structure.
+             * @brief Revert the subtree sizes adjusted on the way down to
+             * key, when it turns out that the tree is not modified.
              */
-            Seg chain = _copy_nodes_dfs(&root, src.root);
-            if (chain.begin == NULL)
-            {
-                head -> next = head -> prev = head;
-            }
-            else
-            {
-                (head -> next = chain.begin) -> prev = head;
-                (head -> prev = chain.end) -> next = head;
-            }
+            for (Node *p = root; p && !(key == p -> key);
+                    p = p -> ch[key < p -> key])
+                p -> size -= delta;
         }
 
-        void _rotate(register Node **pptr, bool dir) {
-            register Node *ptr = *pptr, *tptr = ptr -> ch[dir];
-            ptr -> ch[dir] = tptr -> ch[!dir];
-            tptr -> ch[!dir] = ptr;
-            *pptr = tptr;
+        Node *_lower_bound(const Key &key) const {
+            /**
+             * @brief Returns the node of the least key not less than key, or
+             * head if there is none.  Note that the smaller keys are kept in
+             * ch[1], and the list runs from the largest key at head -> next
+             * to the smallest at head -> prev.
+             */
+            Node *res = head, *last = NULL;
+            for (Node *p = root; p; last = p)
+                if (p -> key < key) p = p -> ch[0];
+                else
+                {
+                    res = p;
+                    p = p -> ch[1];
+                }
+            if (last) _access(last);
+            return res;
         }
 
-        bool _contains_value_dfs(const Node *p, const Val &val) const {
-            if (p == NULL) return false;
-            if (p -> val == val) return true;
-            return _contains_value_dfs(p -> ch[0], val) ||
-                _contains_value_dfs(p -> ch[1], val);
+        Node *_upper_bound(const Key &key) const {
+            /**
+             * @brief Returns the node of the least key greater than key, or
+             * head if there is none.
+             */
+            Node *res = head, *last = NULL;
+            for (Node *p = root; p; last = p)
+                if (key < p -> key)
+                {
+                    res = p;
+                    p = p -> ch[1];
+                }
+                else p = p -> ch[0];
+            if (last) _access(last);
+            return res;
+        }
+
+        template <class E>
+        static void _merge_entry(SortedMerge &merge, const E &e) {
+            merge.add(e.getKey(), e.getValue());
+        }
+
+        const Key &_key_of(const Node *p) const {
+            if (p == head) throw ElementNotExist();
+            return p -> key;
+        }
+
+        bool _contains_value(const Val &val) const {
+            for (const Node *p = head -> prev; p != head; p = p -> prev)
+                if (p -> val == val) return true;
+            return false;
         }
 
     public:
         class Entry;
         class Iterator;
+        class SubMap;
+        typedef typename Monoid::Acc Acc;
 
         TreeMap() {
             /**
              * @brief Constructs an empty tree map.
              */
-            root = NULL;
-            head = new Node;
+            _init_storage();
             elem_num = 0;
+            _init_pri();
         }
 
         ~TreeMap() { 
             /**
              * @brief Destructor
              */
-            _clear_nodes();
-            delete head;
+            _drop(root, head, ref_cnt);
         }
 
         TreeMap &operator=(const TreeMap &other) {
             /**
-             * @brief Assignment operator
+             * @brief Assignment operator. Shares the nodes with other.
              */
             if (this != &other)
             {
-                _clear_nodes();
-                _copy_nodes(other);
-                elem_num = other.elem_num;
+                Node *old_root = root, *old_head = head;
+                int *old_ref_cnt = ref_cnt;
+                _share(other);
+                _drop(old_root, old_head, old_ref_cnt);
             }
             return *this;
         }
 
         TreeMap(const TreeMap &other) {
             /**
-             * @brief Copy-constructor
+             * @brief Copy-constructor. Shares the nodes with other.
              */
-            head = new Node;
-            _copy_nodes(other);
-            elem_num = other.elem_num;
+            _share(other);
+            _init_pri();
         }
 
         // @brief Returns an iterator over the elements in this map.
@@ -148,8 +1231,8 @@ class TreeMap
             /**
              * @brief Removes all of the mappings from this map.
              */
-            _clear_nodes();
-            root = NULL;
+            _drop(root, head, ref_cnt);
+            _init_storage();
             elem_num = 0;
         }
 
@@ -160,7 +1243,11 @@ class TreeMap
              */
 
             for (Node *p = root; p; p = p -> ch[key < p -> key])
-                if (key == p -> key) return true;
+                if (key == p -> key)
+                {
+                    _access(p);
+                    return true;
+                }
             return false;
         }
 
@@ -169,7 +1256,7 @@ class TreeMap
              * @brief Returns true if this map maps one or more keys to the
              * specified value.
              */
-            return _contains_value_dfs(root, value); 
+            return _contains_value(value);
         }
 
         const Val &get(const Key &key) const {
@@ -182,7 +1269,11 @@ class TreeMap
              */
 
             for (Node *p = root; p; p = p -> ch[key < p -> key])
-                if (key == p -> key) return p -> val;
+                if (key == p -> key)
+                {
+                    _access(p);
+                    return p -> val;
+                }
             throw ElementNotExist();
         }
 
@@ -192,38 +1283,28 @@ class TreeMap
         void put(const Key &key, const Val &value) {
             /**
              * @brief Associates the specified value with the specified key in this
-             * map.
+             * map.  The key is first looked for near the key put last.
              */
-            Node **pptr = &root;
-            Node *prv = head, *nxt = head;
-            LinkedList<Node **> path;
-            LinkedList<bool> drec;
-            bool dir;
-            for (Node *ptr; (ptr = *pptr); pptr = &(ptr -> ch[dir]))
-            {
-                if (key == ptr -> key)
-                {
-                    ptr -> val = value; // alter the value
-                    return;
-                }
-                ((dir = key < ptr -> key) ? prv : nxt) = ptr;
-                path.addLast(pptr);
-                drec.addLast(dir);
-            }
-            Node *t = *pptr = new Node();
-            t -> pri = rand();
-            t -> key = key;
-            t -> val = value;
-            t -> ch[0] = t -> ch[1] = NULL;
-            (t -> prev = prv) -> next = t;
-            (t -> next = nxt) -> prev = t;
-            for (; !path.isEmpty() && t -> pri < (*path.getLast()) -> pri;)
-            {
-                _rotate(path.getLast(), drec.getLast());
-                path.removeLast();
-                drec.removeLast();
-            }
-            elem_num++;
+            _detach();
+            if (finger && _insert_near(finger, key, value)) return;
+            _put(key, value, Balance());
+        }
+
+        void put(const Iterator &hint, const Key &key, const Val &value) {
+            /**
+             * @brief Associates the specified value with the specified key,
+             * looking for the key first near the entry last returned by
+             * hint, an iterator over this map which is still valid.  If the
+             * key is within a few entries of it, there is no descent, but the
+             * subtree sizes of the ancestors are updated in O(depth) time.
+             */
+            Node *old_head = head;
+            _detach();
+            Node *p = hint.cursor == head ? head -> prev : hint.cursor;
+            if (hint.end == head && head == old_head && p != head &&
+                    _insert_near(p, key, value))
+                return;
+            put(key, value);
         }
 
         void remove(const Key &key) {
@@ -234,42 +1315,375 @@ class TreeMap
              * exception.
              * @throw ElementNotExist
              */
-            Node **pptr = &root;
-            for (Node *ptr;
-                    (ptr = *pptr) && !(key == ptr -> key); 
-                    pptr = &(ptr -> ch[key < ptr -> key]));
+            // do not copy shared nodes only to find the key absent
+            if (__atomic_load_n(ref_cnt, __ATOMIC_ACQUIRE) != 1 &&
+                    !containsKey(key))
+                throw ElementNotExist();
+            _detach();
+            _remove(key, Balance());
+        }
 
-            Node *ptr = *pptr;
-            if (ptr == NULL) throw ElementNotExist();
-            
-            Node * &chl = ptr -> ch[0], * &chr = ptr -> ch[1]; 
-            while (chl || chr)
+        // @brief Returns the number of key-value mappings in this map.
+        int size() const { return elem_num; }
+
+        int height() const {
+            /**
+             * @brief Returns the number of nodes on the longest path down
+             * from the root, in O(n) time.
+             */
+            int black;
+            bool ok = true;
+            return _check(root, NULL, NULL, NULL, black, ok);
+        }
+
+        bool isValid() const {
+            /**
+             * @brief Returns true if the tree is well formed, in O(n) time,
+             * for testing: the keys are in order along the tree and the
+             * threaded list, the parents, the subtree sizes and the number
+             * of elements agree, and the invariant of the balancing policy
+             * holds, with a black root in a red-black tree.
+             */
+            int black;
+            bool ok = _check_root(root, Balance());
+            _check(root, NULL, NULL, NULL, black, ok);
+            int num = 0;
+            for (Node *p = head -> prev; p != head; p = p -> prev, num++)
+                if (p -> prev != head && !(p -> key < p -> prev -> key))
+                    ok = false;
+            return ok && num == elem_num && _size(root) == elem_num;
+        }
+
+        /**
+         * @brief Returns the least key, or the greatest key, in this map.
+         * @throw ElementNotExist if the map is empty
+         */
+        const Key &firstKey() const { return _key_of(head -> prev); }
+        const Key &lastKey() const { return _key_of(head -> next); }
+
+        /**
+         * @brief Returns the greatest key less than or equal to (floorKey),
+         * or strictly less than (lowerKey) the given key, in O(log n).
+         * @throw ElementNotExist if there is no such key
+         */
+        const Key &floorKey(const Key &key) const {
+            return _key_of(_upper_bound(key) -> next);
+        }
+        const Key &lowerKey(const Key &key) const {
+            return _key_of(_lower_bound(key) -> next);
+        }
+
+        /**
+         * @brief Returns the least key greater than or equal to
+         * (ceilingKey), or strictly greater than (higherKey) the given key,
+         * in O(log n).
+         * @throw ElementNotExist if there is no such key
+         */
+        const Key &ceilingKey(const Key &key) const {
+            return _key_of(_lower_bound(key));
+        }
+        const Key &higherKey(const Key &key) const {
+            return _key_of(_upper_bound(key));
+        }
+
+        Entry pollFirst() {
+            /**
+             * @brief Removes and returns the mapping of the least key.
+             * @throw ElementNotExist if the map is empty
+             */
+            Node *p = head -> prev;
+            Entry res(_key_of(p), p -> val);
+            remove(p -> key);
+            return res;
+        }
+
+        Entry pollLast() {
+            /**
+             * @brief Removes and returns the mapping of the greatest key.
+             * @throw ElementNotExist if the map is empty
+             */
+            Node *p = head -> next;
+            Entry res(_key_of(p), p -> val);
+            remove(p -> key);
+            return res;
+        }
+
+        /**
+         * @brief Returns a view of the mappings whose keys are in [lo, hi)
+         * (subMap), less than hi (headMap) or not less than lo (tailMap).
+         * The view is backed by this map, so it reflects the modifications
+         * made before each of its iterators is created.
+         */
+        SubMap subMap(const Key &lo, const Key &hi) const {
+            return SubMap(this, &lo, &hi);
+        }
+        SubMap headMap(const Key &hi) const { return SubMap(this, NULL, &hi); }
+        SubMap tailMap(const Key &lo) const { return SubMap(this, &lo, NULL); }
+
+        int rank(const Key &key) const {
+            /**
+             * @brief Returns the number of keys less than key, in O(log n).
+             * The key needs not be in the map.
+             */
+            int res = 0;
+            Node *last = NULL;
+            for (Node *p = root; p; last = p)
+                if (p -> key < key)
+                {
+                    res += _size(p -> ch[1]) + 1;
+                    p = p -> ch[0];
+                }
+                else p = p -> ch[1];
+            if (last) _access(last);
+            return res;
+        }
+
+        const Key &select(int k) const {
+            /**
+             * @brief Returns the k-th least key, counting from 0, in
+             * O(log n).
+             * @throw IndexOutOfBound if k < 0 or k >= size()
+             */
+            if (k < 0 || k >= elem_num) throw IndexOutOfBound();
+            for (Node *p = root; ; )
             {
-                bool dir = chr && (!chl || chr -> pri < chl -> pri);
-                _rotate(pptr, dir);
-                pptr = &((*pptr) -> ch[!dir]);
+                int less = _size(p -> ch[1]);
+                if (k == less)
+                {
+                    _access(p);
+                    return p -> key;
+                }
+                if (k < less) p = p -> ch[1];
+                else
+                {
+                    k -= less + 1;
+                    p = p -> ch[0];
+                }
             }
-            ptr -> prev -> next = ptr -> next;
-            ptr -> next -> prev = ptr -> prev;
-            delete ptr;
-            *pptr = NULL;
-            elem_num--;
         }
 
-        // @brief Returns the number of key-value mappings in this map.
-        int size() const { return elem_num; }
+        template <class Iter>
+        void putAllSorted(Iter it) {
+            /**
+             * @brief Puts all the entries of a Java-style iterator, whose
+             * next() returns an entry with getKey() and getValue(), into
+             * this map.  If the keys come in ascending order, it takes
+             * O(n + m) time for n entries put into a map of m entries;
+             * any entry out of order is put() afterwards instead.
+             */
+            _detach();
+            SortedMerge merge(this);
+            while (it.hasNext()) _merge_entry(merge, it.next());
+            merge.finish();
+        }
+
+        void putAllSorted(const Key *keys, const Val *vals, int num) {
+            /**
+             * @brief Puts the mappings from keys[i] to vals[i] into this map,
+             * in the same way as putAllSorted(Iter).
+             */
+            _detach();
+            SortedMerge merge(this);
+            for (int i = 0; i < num; i++) merge.add(keys[i], vals[i]);
+            merge.finish();
+        }
+
+        /**
+         * @brief Replaces the mappings of this map with the given ones, in
+         * linear time if the keys are in ascending order.
+         */
+        template <class Iter>
+        void buildFromSorted(Iter it) {
+            clear();
+            putAllSorted(it);
+        }
+        void buildFromSorted(const Key *keys, const Val *vals, int num) {
+            clear();
+            putAllSorted(keys, vals, num);
+        }
+
+        // @brief Returns the number of keys in [lo, hi), in O(log n).
+        int countRange(const Key &lo, const Key &hi) const {
+            return hi < lo ? 0 : rank(hi) - rank(lo);
+        }
+
+        Acc aggregate() const {
+            /**
+             * @brief Returns the aggregate of all the values by Monoid.
+             * @throw ElementNotExist if the map is empty
+             */
+            if (root == NULL) throw ElementNotExist();
+            return root -> agg;
+        }
+
+        Acc aggregate(const Key &lo, const Key &hi) const {
+            /**
+             * @brief Returns the aggregate of the values of the keys in
+             * [lo, hi) by Monoid, in O(log n): from the highest node in the
+             * range, the subtrees hanging inside the range off the paths to
+             * lo and to hi are combined without being descended.
+             * @throw ElementNotExist if there is no key in the range
+             */
+            Node *p = root;
+            while (p && (p -> key < lo || !(p -> key < hi)))
+                p = p -> ch[!(p -> key < lo)];
+            if (p == NULL) throw ElementNotExist();
+            Acc res = Monoid::of(p -> val);
+            // the keys in [lo, p -> key), from the greatest
+            for (Node *q = p -> ch[1]; q; )
+            {
+                if (q -> key < lo)
+                {
+                    q = q -> ch[0];
+                    continue;
+                }
+                if (q -> ch[0]) res = Monoid::combine(q -> ch[0] -> agg, res);
+                res = Monoid::combine(Monoid::of(q -> val), res);
+                q = q -> ch[1];
+            }
+            // the keys in (p -> key, hi), from the least
+            for (Node *q = p -> ch[0]; q; )
+            {
+                if (!(q -> key < hi))
+                {
+                    q = q -> ch[1];
+                    continue;
+                }
+                if (q -> ch[1]) res = Monoid::combine(res, q -> ch[1] -> agg);
+                res = Monoid::combine(res, Monoid::of(q -> val));
+                q = q -> ch[0];
+            }
+            return res;
+        }
+
+        TreeMap split(const Key &key) {
+            /**
+             * @brief Moves the mappings of the keys not less than key out of
+             * this map into the map returned, in O(log n).
+             */
+            _detach();
+            finger = NULL;
+            TreeMap res;
+            Node *first = _lower_bound(key);
+            if (first == head) return res;
+            _prepare_bulk(Balance());
+            Node *last = head -> next, *pred = first -> next;
+            _split(root, key, root, res.root);
+            (pred -> prev = head) -> next = pred;
+            (res.head -> prev = first) -> next = res.head;
+            (res.head -> next = last) -> prev = res.head;
+            res.elem_num = _size(res.root);
+            elem_num -= res.elem_num;
+            _finish_bulk(Balance());
+            res._finish_bulk(Balance());
+            return res;
+        }
+
+        void join(TreeMap &other) {
+            /**
+             * @brief Moves all the mappings of other into this map, leaving
+             * other empty.  If all the keys of other are greater than those
+             * of this map, or all less, it takes O(log n) time; otherwise it
+             * falls back to putAll().
+             */
+            if (&other == this || other.isEmpty()) return;
+            _detach();
+            other._detach();
+            other.finger = NULL;
+            if (!isEmpty() && !(lastKey() < other.firstKey()) &&
+                    !(other.lastKey() < firstKey()))
+            {
+                putAll(other);
+                other.clear();
+                return;
+            }
+            _prepare_bulk(Balance());
+            other._prepare_bulk(Balance());
+            Node *o_first = other.head -> prev, *o_last = other.head -> next;
+            if (isEmpty() || lastKey() < other.firstKey())
+            {
+                root = _join(root, other.root);
+                (head -> next -> prev = o_first) -> next = head -> next;
+                (head -> next = o_last) -> prev = head;
+            }
+            else
+            {
+                root = _join(other.root, root);
+                (head -> prev -> next = o_last) -> prev = head -> prev;
+                (head -> prev = o_first) -> next = head;
+            }
+            elem_num += other.elem_num;
+            other.root = NULL;
+            other.head -> next = other.head -> prev = other.head;
+            other.elem_num = 0;
+            _finish_bulk(Balance());
+        }
+
+        int removeRange(const Key &lo, const Key &hi) {
+            /**
+             * @brief Removes the mappings of the keys in [lo, hi), in
+             * O(log n) time plus that of freeing them, and returns their
+             * number.
+             */
+            if (!(lo < hi)) return 0;
+            _detach();
+            finger = NULL;
+            Node *first = _lower_bound(lo), *end = _lower_bound(hi);
+            if (first == end) return 0;
+            _prepare_bulk(Balance());
+            Node *left, *mid, *right;
+            _split(root, lo, left, mid);
+            _split(mid, hi, mid, right);
+            root = _join(left, right);
+            (first -> next -> prev = end) -> next = first -> next;
+            int res = _size(mid);
+            _clear_nodes_dfs(mid);
+            elem_num -= res;
+            _finish_bulk(Balance());
+            return res;
+        }
+
+        void putAll(const TreeMap &other, int thread_num = 1) {
+            /**
+             * @brief Puts all the mappings of other into this map, with the
+             * values of other for the keys in both maps.  The nodes of other
+             * are copied and merged by the split-based union, which takes
+             * O(m log(n / m + 1)) time for maps of n and m entries, forked
+             * among up to thread_num threads for large maps, plus O(n + m)
+             * to rethread the list.  A map much smaller than this one is
+             * put() entry by entry instead.  With the balancing policies
+             * other than the treap, the maps are merged along their lists
+             * by putAllSorted() in O(n + m) time.
+             */
+            if (other.root == root) return; // the same nodes
+            if ((long long)other.elem_num * PUT_ALL_RATIO < elem_num)
+            {
+                for (Node *p = other.head -> prev; p != other.head;
+                        p = p -> prev)
+                    put(p -> key, p -> val);
+                return;
+            }
+            _put_all(other, thread_num, Balance());
+        }
 };
 
-template<class Key, class Val>
-struct TreeMap<Key, Val>::Node {
+template<class Key, class Val, class Monoid, class Balance>
+struct TreeMap<Key, Val, Monoid, Balance>::Node :
+    public TreeMapAggregate<Monoid> {
+    /**
+     * @var size The number of nodes in the subtree rooted here.
+     * @var parent The parent, undefined for the root.
+     * @var pri The priority in a treap, the color in a red-black tree, the
+     * height in an AVL tree, and unused in a splay tree.
+     */
     Key key;
     Val val;
-    int pri;
-    Node *ch[2], *prev, *next;
+    int pri, size;
+    Node *ch[2], *prev, *next, *parent;
 };
 
-template<class Key, class Val>
-struct TreeMap<Key, Val>::Seg {
+template<class Key, class Val, class Monoid, class Balance>
+struct TreeMap<Key, Val, Monoid, Balance>::Seg {
     Node *begin, *end;
     Seg() : begin(NULL), end(NULL) {}
     Seg(Node *_begin, Node *_end) : begin(_begin), end(_end) {}
@@ -282,8 +1696,111 @@ struct TreeMap<Key, Val>::Seg {
     }
 };
 
-template<class Key, class Val>
-class TreeMap<Key, Val>::Entry {
+template<class Key, class Val, class Monoid, class Balance>
+struct TreeMap<Key, Val, Monoid, Balance>::UnionTask {
+    Node *t1, *t2, *res;
+    bool t2_wins;
+    int fork_depth;
+    UnionTask(Node *_t1, Node *_t2, bool _t2_wins, int _fork_depth) :
+        t1(_t1), t2(_t2), res(NULL), t2_wins(_t2_wins),
+        fork_depth(_fork_depth) {}
+};
+
+template<class Key, class Val, class Monoid, class Balance>
+class TreeMap<Key, Val, Monoid, Balance>::SortedMerge {
+    /**
+     * @brief Merges the nodes of a map with keys given in ascending order,
+     * rebuilding the treap as a Cartesian tree: each node is appended to the
+     * right spine, the path from the root along the larger keys (ch[0]),
+     * after popping the spine nodes of greater priority values off to be its
+     * left subtree (ch[1]).  Every node is pushed and popped once, so the
+     * build takes linear time; a popped subtree is complete, so its size is
+     * set when it is popped.  The nodes are threaded in the same order.
+     * @var cursor The least node of the map not merged yet.
+     * @var last The greatest node merged so far, or head.
+     * @var late_keys, late_vals The entries out of order, to be put() at
+     * last.
+     */
+    TreeMap *map;
+    Node *cursor, *last;
+    ArrayList<Node *> spine;
+    LinkedList<Key> late_keys;
+    LinkedList<Val> late_vals;
+
+    Node *_pop() {
+        Node *p = _top();
+        spine.removeIndex(spine.size() - 1);
+        p -> size = _size(p -> ch[0]) + _size(p -> ch[1]) + 1;
+        _pull(p);
+        return p;
+    }
+
+    Node *_top() const { return spine.get(spine.size() - 1); }
+
+    void _append(Node *x) {
+        Node *sub = NULL;
+        while (!spine.isEmpty() && x -> pri < _top() -> pri) sub = _pop();
+        x -> ch[0] = NULL;
+        if ((x -> ch[1] = sub)) sub -> parent = x;
+        if (!spine.isEmpty()) (_top() -> ch[0] = x) -> parent = _top();
+        spine.add(x);
+        (last -> prev = x) -> next = last;
+        last = x;
+    }
+
+    void _take_cursor() {
+        Node *x = cursor;
+        cursor = cursor -> prev;
+        _append(x);
+    }
+
+    public:
+    SortedMerge(TreeMap *_map) : map(_map), cursor(_map -> head -> prev),
+                                last(_map -> head) {}
+
+    void add(const Key &key, const Val &val) {
+        if (last != map -> head && !(last -> key < key))
+        {
+            if (key == last -> key) last -> val = val;
+            else
+            {
+                late_keys.addLast(key);
+                late_vals.addLast(val);
+            }
+            return;
+        }
+        while (cursor != map -> head && cursor -> key < key) _take_cursor();
+        if (cursor != map -> head && cursor -> key == key)
+        {
+            cursor -> val = val; // alter the value
+            _take_cursor();
+            return;
+        }
+        Node *x = new Node();
+        x -> key = key;
+        x -> val = val;
+        x -> pri = map -> _next_pri();
+        _append(x);
+        map -> elem_num++;
+    }
+
+    void finish() {
+        while (cursor != map -> head) _take_cursor();
+        map -> root = spine.isEmpty() ? NULL : spine.get(0);
+        while (!spine.isEmpty()) _pop();
+        (last -> prev = map -> head) -> next = last;
+        map -> _finish_bulk(Balance());
+        while (!late_keys.isEmpty())
+        {
+            map -> put(late_keys.getFirst(), late_vals.getFirst());
+            late_keys.removeFirst();
+            late_vals.removeFirst();
+        }
+    }
+};
+
+template<class Key, class Val, class Monoid, class Balance>
+class TreeMap<Key, Val, Monoid, Balance>::Entry {
     Key key;
     Val value;
     public:
@@ -304,20 +1821,117 @@ class TreeMap<Key, Val>::Entry {
     }
 };
 
-template<class Key, class Val>
-class TreeMap<Key, Val>::Iterator {
+template<class Key, class Val, class Monoid, class Balance>
+class TreeMap<Key, Val, Monoid, Balance>::SubMap {
+    /**
+     * @brief A range of keys in a TreeMap.  Its iterator finds the first key
+     * of the range in O(log n), then walks the threaded list, so iterating k
+     * mappings takes O(log n + k).
+     * @var has_lo, has_hi Whether the range is bounded below and above.
+     */
+    public:
+    class Iterator;
+
+    SubMap(const TreeMap *con, const Key *_lo, const Key *_hi) :
+        container(con), has_lo(_lo != NULL), has_hi(_hi != NULL) {
+        if (has_lo) lo = *_lo;
+        if (has_hi) hi = *_hi;
+    }
+
+    // @brief Returns an iterator over the mappings in the range.
+    Iterator iterator() const { return Iterator(this); }
+
+    bool containsKey(const Key &key) const {
+        return _in_range(key) && container -> containsKey(key);
+    }
+
+    /**
+     * @brief Returns the value of key.
+     * @throw ElementNotExist if key is out of the range or absent
+     */
+    const Val &get(const Key &key) const {
+        if (!_in_range(key)) throw ElementNotExist();
+        return container -> get(key);
+    }
+
+    // @brief Returns true if the range holds no mapping, in O(log n).
+    bool isEmpty() const { return !Iterator(this).hasNext(); }
+
+    // @brief Returns the number of mappings in the range, in O(log n).
+    int size() const {
+        int hi_rank = has_hi ? container -> rank(hi) : container -> size();
+        int lo_rank = has_lo ? container -> rank(lo) : 0;
+        return hi_rank > lo_rank ? hi_rank - lo_rank : 0;
+    }
+
+    private:
+    const TreeMap *container;
+    bool has_lo, has_hi;
+    Key lo, hi;
+
+    bool _in_range(const Key &key) const {
+        return (!has_lo || !(key < lo)) && (!has_hi || key < hi);
+    }
+};
+
+template<class Key, class Val, class Monoid, class Balance>
+class TreeMap<Key, Val, Monoid, Balance>::SubMap::Iterator {
+    private:
+        /**
+         * @var cursor The node to be returned next.
+         * @var end The node right after the range.
+         */
+        Node *cursor, *end;
+    public:
+        Iterator() {}
+        Iterator(const SubMap *range) {
+            const TreeMap *con = range -> container;
+            cursor = range -> has_lo ? con -> _lower_bound(range -> lo) :
+                con -> head -> prev;
+            end = range -> has_hi ? con -> _lower_bound(range -> hi) :
+                con -> head;
+            if (range -> has_lo && range -> has_hi && range -> hi < range -> lo)
+                cursor = end;
+        }
+
+        bool hasNext() {
+            /**
+             * @brief Returns true if the iteration has more elements.
+             */
+            return cursor != end;
+        }
+
+        Entry next() {
+            /**
+             * @brief Returns the next element in the iteration.
+             * @throw ElementNotExist exception when hasNext() == false
+             */
+            if (!hasNext()) throw ElementNotExist();
+            Node *p = cursor;
+            cursor = cursor -> prev;
+            return Entry(p -> key, p -> val);
+        }
+};
+
+template<class Key, class Val, class Monoid, class Balance>
+class TreeMap<Key, Val, Monoid, Balance>::Iterator {
+    friend class TreeMap;
     private:
-        Node *cursor;
-        const TreeMap *container;
+        /**
+         * @var cursor The node returned last, or the sentinel.
+         * @var end The sentinel of the list when the iterator was created,
+         * which a copy of the map keeps after the map detaches its own.
+         */
+        Node *cursor, *end;
     public:
         Iterator() {}
         Iterator(const TreeMap *con) 
-            : cursor(con -> head), container(con) {}
+            : cursor(con -> head), end(con -> head) {}
         bool hasNext() {
             /**
              * @brief Returns true if the iteration has more elements.
              */
-            return cursor -> prev != container -> head;
+            return cursor -> prev != end;
         }
 
         Entry next() {
@@ -0,0 +1,237 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VALUEINDEXEDMAP_H
+#define VALUEINDEXEDMAP_H
+
+#include "ElementNotExist.h"
+#include "ArrayList.h"
+#include "HashMap.h"
+
+/**
+ * ValueIndexedMap is a map which also indexes its entries by value, in the
+ * manner of a bidirectional map whose values need not be unique.  Besides
+ * the operations of the underlying map, it answers containsValue() and
+ * countValue() in constant time, and getKeysForValue() in time proportional
+ * to the number of keys returned, where HashMap and TreeMap walk all their
+ * entries.
+ *
+ * Template argument Map is the underlying map, for example TreeMap<Key, Val>
+ * or HashMap<Key, Val, KeyHash>, which keeps the entries and decides the
+ * order of iteration.  KeyHash and ValHash hash the keys and the values with
+ * the same meaning as in HashMap.  For example
+ * @code
+ *      ValueIndexedMap<int, int, Hashint, Hashint, TreeMap<int, int> > map;
+ * @endcode
+ *
+ * The index keeps a group for each distinct value, holding the number of its
+ * keys and a list of them, and a link for each key in the list of its value,
+ * so that put() and remove() update it in constant time.  It costs two hash
+ * lookups per modification (plus an insertion for a new key or value) and one list link per key, plus a group per
+ * distinct value (see the ``value_index'' benchmark).
+ */
+
+template <class Key, class Val, class KeyHash, class ValHash,
+         class Map = HashMap<Key, Val, KeyHash> >
+class ValueIndexedMap
+{
+    private:
+        struct Group;
+        struct Link;
+        /**
+         * @var map The underlying map holding the entries.
+         * @var groups Maps each value to its group.
+         * @var links Maps each key to its link in the list of its group.
+         */
+        Map map;
+        HashMap<Val, Group *, ValHash> groups;
+        HashMap<Key, Link *, KeyHash> links;
+
+        void _attach(Link *l, const Val &value) {
+            /**
+             * @brief Put l into the group of value, creating the group if
+             * needed.
+             */
+            Group *g;
+            if (!groups.tryGet(value, g))
+            {
+                g = new Group(value);
+                groups.put(value, g);
+            }
+            l -> group = g;
+            l -> prev = NULL;
+            if ((l -> next = g -> first)) l -> next -> prev = l;
+            g -> first = l;
+            g -> count++;
+        }
+
+        void _detach(Link *l) {
+            /**
+             * @brief Take l out of its group, dropping the group if it
+             * becomes empty.
+             */
+            Group *g = l -> group;
+            (l -> prev ? l -> prev -> next : g -> first) = l -> next;
+            if (l -> next) l -> next -> prev = l -> prev;
+            if (--g -> count == 0)
+            {
+                groups.remove(g -> val);
+                delete g;
+            }
+        }
+
+        void _clear_index() {
+            for (typename HashMap<Key, Link *, KeyHash>::Iterator it =
+                    links.iterator(); it.hasNext(); )
+                delete it.next().getValue();
+            for (typename HashMap<Val, Group *, ValHash>::Iterator it =
+                    groups.iterator(); it.hasNext(); )
+                delete it.next().getValue();
+            links.clear();
+            groups.clear();
+        }
+
+        ValueIndexedMap(const ValueIndexedMap &);
+        ValueIndexedMap &operator=(const ValueIndexedMap &);
+
+    public:
+        typedef typename Map::Entry Entry;
+        typedef typename Map::Iterator Iterator;
+
+        ValueIndexedMap() {}
+
+        ~ValueIndexedMap() {
+            /**
+             * @brief Destructor
+             */
+            _clear_index();
+        }
+
+        // @brief Returns an iterator over the elements in this map.
+        Iterator iterator() const { return map.iterator(); }
+
+        void clear() {
+            /**
+             * @brief Removes all of the mappings from this map.
+             */
+            map.clear();
+            _clear_index();
+        }
+
+        bool containsKey(const Key &key) const { return map.containsKey(key); }
+
+        bool containsValue(const Val &value) const {
+            /**
+             * @brief Returns true if this map maps one or more keys to the
+             * specified value, in constant time.
+             */
+            return groups.containsKey(value);
+        }
+
+        int countValue(const Val &value) const {
+            /**
+             * @brief Returns the number of keys mapped to the specified value.
+             */
+            Group *g;
+            return groups.tryGet(value, g) ? g -> count : 0;
+        }
+
+        ArrayList<Key> getKeysForValue(const Val &value) const {
+            /**
+             * @brief Returns the keys mapped to the specified value, in no
+             * particular order.
+             */
+            ArrayList<Key> res;
+            Group *g;
+            if (groups.tryGet(value, g))
+                for (Link *l = g -> first; l; l = l -> next)
+                    res.add(l -> key);
+            return res;
+        }
+
+        /**
+         * @brief Returns a const reference to the value to which the
+         * specified key is mapped.
+         * @throw ElementNotExist
+         */
+        const Val &get(const Key &key) const { return map.get(key); }
+
+        // @brief Returns true if this map contains no key-value mappings.
+        bool isEmpty() const { return map.isEmpty(); }
+
+        void put(const Key &key, const Val &value) {
+            /**
+             * @brief Associates the specified value with the specified key in
+             * this map.
+             */
+            Link *l;
+            if (links.tryGet(key, l))
+            {
+                if (l -> group -> val == value)
+                {
+                    map.put(key, value);
+                    return;
+                }
+                _detach(l);
+            }
+            else
+            {
+                l = new Link(key);
+                links.put(key, l);
+            }
+            _attach(l, value);
+            map.put(key, value);
+        }
+
+        void remove(const Key &key) {
+            /**
+             * @brief Removes the mapping for the specified key from this map.
+             * @throw ElementNotExist
+             */
+            map.remove(key);
+            Link *l = links.get(key);
+            links.remove(key);
+            _detach(l);
+            delete l;
+        }
+
+        // @brief Returns the number of key-value mappings in this map.
+        int size() const { return map.size(); }
+};
+
+template <class Key, class Val, class KeyHash, class ValHash, class Map>
+struct ValueIndexedMap<Key, Val, KeyHash, ValHash, Map>::Group {
+    /**
+     * @var count The number of keys mapped to val.
+     * @var first The first link in the list of those keys.
+     */
+    Val val;
+    int count;
+    Link *first;
+    Group(const Val &_val) : val(_val), count(0), first(NULL) {}
+};
+
+template <class Key, class Val, class KeyHash, class ValHash, class Map>
+struct ValueIndexedMap<Key, Val, KeyHash, ValHash, Map>::Link {
+    Key key;
+    Group *group;
+    Link *prev, *next;
+    Link(const Key &_key) : key(_key) {}
+};
+
+#endif
@@ -0,0 +1,1736 @@
+/**
+ * Copyright (C) 2013 Ted Yin <ted.sybil@gmail.com>
+ * This file is part of Spring 2013 Final Project for Data Structure Class.
+ *
+ * SFPDSC is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * SFPDSC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ *     along with SFPDSC.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Benchmarks for the containers. Build and run with
+ * @code
+ *      g++ -O2 -pthread benchmark.cpp -o benchmark
+ *      ./benchmark [suite ...]
+ * @endcode
+ * All the suites are run when none is given on the command line.
+ */
+
+#include "HashMap.h"
+#include "TreeMap.h"
+#include "ConcurrentHashMap.h"
+#include "ReadMostlyHashMap.h"
+#include "HashMapView.h"
+#include "Cache.h"
+#include "ConcurrentCache.h"
+#include "BloomFilteredMap.h"
+#include "IntHashMap.h"
+#include "GroupBy.h"
+#include "ValueIndexedMap.h"
+#include "BTreeMap.h"
+#include "PersistentTreeMap.h"
+#include "ConcurrentSkipListMap.h"
+#include "RadixTreeMap.h"
+#include "FlatTreeMap.h"
+#include "LSMTreeMap.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <pthread.h>
+#include <sys/time.h>
+
+long long live_bytes = 0;
+
+void * operator new(size_t size) {
+    /**
+     * @brief Keep track of the bytes allocated, with the size stored in
+     * front of each block (two words to preserve the alignment).
+     */
+    size_t *p = (size_t *)malloc(size + sizeof(size_t) * 2);
+    if (p == NULL) throw std::bad_alloc();
+    __sync_fetch_and_add(&live_bytes, (long long)size);
+    p[0] = size;
+    return p + 2;
+}
+
+void operator delete(void *ptr) {
+    if (ptr == NULL) return;
+    size_t *p = (size_t *)ptr - 2;
+    __sync_fetch_and_sub(&live_bytes, (long long)p[0]);
+    free(p);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void *ptr, size_t) { operator delete(ptr); }
+#endif
+
+class HashInt {
+public:
+    static int hashCode(int obj) {
+        return obj;
+    }
+};
+
+class Timer {
+    double start;
+    static double _now() {
+        timeval tv;
+        gettimeofday(&tv, NULL);
+        return tv.tv_sec + tv.tv_usec * 1e-6;
+    }
+    public:
+    Timer() : start(_now()) {}
+    // @brief Returns the seconds elapsed since construction.
+    double elapsed() const { return _now() - start; }
+};
+
+class FastRand {
+    /**
+     * @brief xorshift generator, cheap enough not to disturb the
+     * measurement and private to each thread unlike rand().
+     */
+    unsigned int state;
+    public:
+    FastRand(unsigned int seed) : state(seed * 2654435761U + 1) {}
+    unsigned int next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+};
+
+/*{{{ Concurrent hash maps */
+class LockedHashMap {
+    /**
+     * @brief The baseline: a HashMap wrapped in one global mutex.
+     */
+    HashMap<int, int, HashInt> map;
+    pthread_mutex_t lock;
+    public:
+    LockedHashMap() { pthread_mutex_init(&lock, NULL); }
+    ~LockedHashMap() { pthread_mutex_destroy(&lock); }
+    bool containsKey(int key) {
+        pthread_mutex_lock(&lock);
+        bool res = map.containsKey(key);
+        pthread_mutex_unlock(&lock);
+        return res;
+    }
+    void put(int key, int value) {
+        pthread_mutex_lock(&lock);
+        map.put(key, value);
+        pthread_mutex_unlock(&lock);
+    }
+};
+
+template <class Map>
+struct MixedWorker {
+    Map *map;
+    int ops, key_range, read_permille;
+    unsigned int seed;
+    int found;
+
+    static void *run(void *arg) {
+        MixedWorker *w = (MixedWorker *)arg;
+        FastRand rnd(w -> seed);
+        int found = 0;
+        for (int i = 0; i < w -> ops; i++)
+        {
+            unsigned int r = rnd.next();
+            int key = (r >> 10) % w -> key_range;
+            if ((int)(r & 1023) * 1000 < w -> read_permille * 1024)
+                found += w -> map -> containsKey(key);
+            else
+                w -> map -> put(key, i);
+        }
+        w -> found = found;
+        return NULL;
+    }
+};
+
+template <class Map>
+double run_mixed(Map *map, int thread_num, int total_ops, int key_range,
+                int read_permille) {
+    /**
+     * @brief Run total_ops mixed operations evenly split among thread_num
+     * threads and return the throughput in million operations per second.
+     */
+    pthread_t threads[64];
+    MixedWorker<Map> workers[64];
+    Timer timer;
+    for (int i = 0; i < thread_num; i++)
+    {
+        workers[i].map = map;
+        workers[i].ops = total_ops / thread_num;
+        workers[i].key_range = key_range;
+        workers[i].read_permille = read_permille;
+        workers[i].seed = i + 1;
+        pthread_create(threads + i, NULL, MixedWorker<Map>::run, workers + i);
+    }
+    for (int i = 0; i < thread_num; i++)
+        pthread_join(threads[i], NULL);
+    return total_ops / timer.elapsed() / 1e6;
+}
+
+void bench_concurrent_hashmap() {
+    const int KEY_RANGE = 1 << 20, TOTAL_OPS = 1 << 22;
+    const int read_permilles[] = {500, 900, 990};
+    puts("== ConcurrentHashMap vs. HashMap behind a mutex (Mops/s)");
+    puts("threads\tread%\tlocked\tsharded");
+    for (int r = 0; r < 3; r++)
+    {
+        LockedHashMap *locked = new LockedHashMap();
+        ConcurrentHashMap<int, int, HashInt> *sharded =
+            new ConcurrentHashMap<int, int, HashInt>();
+        for (int i = 0; i < KEY_RANGE; i += 2)
+        {
+            locked -> put(i, i);
+            sharded -> put(i, i);
+        }
+        for (int t = 1; t <= 64; t <<= 1)
+        {
+            double a = run_mixed(locked, t, TOTAL_OPS, KEY_RANGE,
+                                read_permilles[r]);
+            double b = run_mixed(sharded, t, TOTAL_OPS, KEY_RANGE,
+                                read_permilles[r]);
+            printf("%d\t%.1f\t%.2f\t%.2f\n", t, read_permilles[r] / 10.0, a, b);
+        }
+        delete locked;
+        delete sharded;
+    }
+}
+
+void bench_readmostly_hashmap() {
+    const int KEY_RANGE = 1 << 20, TOTAL_OPS = 1 << 22;
+    const int read_permilles[] = {990, 999};
+    puts("== ReadMostlyHashMap vs. ConcurrentHashMap at 1% and 0.1% churn "
+            "(Mops/s)");
+    puts("threads\tread%\tsharded\tlockfree");
+    for (int r = 0; r < 2; r++)
+    {
+        ConcurrentHashMap<int, int, HashInt> *sharded =
+            new ConcurrentHashMap<int, int, HashInt>();
+        ReadMostlyHashMap<int, int, HashInt> *lockfree =
+            new ReadMostlyHashMap<int, int, HashInt>();
+        for (int i = 0; i < KEY_RANGE; i += 2)
+        {
+            sharded -> put(i, i);
+            lockfree -> put(i, i);
+        }
+        for (int t = 1; t <= 64; t <<= 1)
+        {
+            double a = run_mixed(sharded, t, TOTAL_OPS, KEY_RANGE,
+                                read_permilles[r]);
+            double b = run_mixed(lockfree, t, TOTAL_OPS, KEY_RANGE,
+                                read_permilles[r]);
+            printf("%d\t%.1f\t%.2f\t%.2f\n", t, read_permilles[r] / 10.0, a, b);
+        }
+        delete sharded;
+        delete lockfree;
+    }
+}
+/*}}}*/
+
+/*{{{ Snapshots */
+template <class Map>
+void bench_snapshot_map(const char *name, int elem_num) {
+    const int SNAP_NUM = 1000, WRITE_NUM = 4;
+    FastRand rnd(1);
+    Map *origin = new Map();
+    for (int i = 0; i < elem_num; i++)
+        origin -> put(rnd.next() >> 1, i);
+    long long base_bytes = live_bytes;
+
+    Map **snaps = new Map*[SNAP_NUM];
+    Timer timer;
+    for (int i = 0; i < SNAP_NUM; i++)
+        snaps[i] = new Map(*origin);
+    double snap_time = timer.elapsed() / SNAP_NUM;
+    long long snap_bytes = (live_bytes - base_bytes) / SNAP_NUM;
+
+    /* the first modification of a snapshot pays for the copying */
+    base_bytes = live_bytes;
+    Timer write_timer;
+    for (int i = 0; i < WRITE_NUM; i++)
+        snaps[i] -> put(-1, i);
+    double write_time = write_timer.elapsed() / WRITE_NUM;
+    long long write_bytes = (live_bytes - base_bytes) / WRITE_NUM;
+
+    printf("%s\t%d\t%.3f\t%lld\t%.3f\t%lld\n", name, elem_num,
+            snap_time * 1e6, snap_bytes, write_time * 1e6, write_bytes);
+    for (int i = 0; i < SNAP_NUM; i++)
+        delete snaps[i];
+    delete[] snaps;
+    delete origin;
+}
+
+template <class Map>
+void bench_snapshot_cycle(const char *name, int elem_num) {
+    /**
+     * @brief Print the cost of a request taking a snapshot of a map being
+     * written: the next write after it copies what the snapshot shares.
+     */
+    const int CYCLE_NUM = 16;
+    FastRand rnd(2);
+    Map *live = new Map();
+    for (int i = 0; i < elem_num; i++)
+        live -> put(rnd.next() >> 1, i);
+    Timer timer;
+    for (int i = 0; i < CYCLE_NUM; i++)
+    {
+        Map *snap = new Map(*live);
+        live -> put(rnd.next() >> 1, i);
+        delete snap;
+    }
+    printf("%s\t%d\t%.3f\n", name, elem_num,
+            timer.elapsed() * 1e6 / CYCLE_NUM);
+    delete live;
+}
+
+void bench_snapshot() {
+    puts("== Copy-on-write snapshots of 1M-entry maps");
+    puts("map\tsize\tsnap(us)\tsnap(B)\t1st write(us)\t1st write(B)");
+    bench_snapshot_map<HashMap<int, int, HashInt> >("HashMap", 1 << 20);
+    bench_snapshot_map<TreeMap<int, int> >("TreeMap", 1 << 20);
+    /* a TreeMap can not share part of its nodes, so its first write
+     * copies the whole tree, as a deep copy would */
+    puts("== A snapshot then a write to the live map, repeated");
+    puts("map\tsize\tus/cycle");
+    bench_snapshot_cycle<HashMap<int, int, HashInt> >("HashMap", 1 << 20);
+    bench_snapshot_cycle<TreeMap<int, int> >("TreeMap", 1 << 20);
+}
+/*}}}*/
+
+/*{{{ Images */
+void bench_image() {
+    const int ELEM_NUM = 1 << 22;
+    const char *path = "/tmp/sfpdsc_bench.img";
+    int *keys = new int[ELEM_NUM];
+    FastRand rnd(7);
+    for (int i = 0; i < ELEM_NUM; i++) keys[i] = rnd.next() >> 1;
+    puts("== Time to first lookup: rebuilding by put() vs. mapping an image");
+    puts("method\tsize\ttime(ms)");
+
+    Timer rebuild_timer;
+    HashMap<int, int, HashInt> *map = new HashMap<int, int, HashInt>();
+    for (int i = 0; i < ELEM_NUM; i++) map -> put(keys[i], i);
+    bool found = map -> containsKey(keys[0]);
+    printf("rebuild\t%d\t%.3f\n", map -> size(), rebuild_timer.elapsed() * 1e3);
+
+    Timer save_timer;
+    map -> save(path);
+    printf("save\t%d\t%.3f\n", map -> size(), save_timer.elapsed() * 1e3);
+    delete map;
+
+    Timer map_timer;
+    {
+        HashMapView<int, int, HashInt> view(path);
+        found &= view.containsKey(keys[0]);
+        printf("mmap\t%d\t%.3f\n", view.size(), map_timer.elapsed() * 1e3);
+    }
+    Timer verify_timer;
+    {
+        HashMapView<int, int, HashInt> view(path, true);
+        found &= view.containsKey(keys[0]);
+        printf("mmap+verify\t%d\t%.3f\n", view.size(),
+                verify_timer.elapsed() * 1e3);
+
+        Timer lookup_timer;
+        int hit = 0;
+        for (int i = 0; i < ELEM_NUM; i++) hit += view.containsKey(keys[i]);
+        printf("lookups\t%d\t%.3f (%.1f ns each)\n", hit,
+                lookup_timer.elapsed() * 1e3,
+                lookup_timer.elapsed() * 1e9 / ELEM_NUM);
+    }
+    if (!found) puts("the first lookup failed!");
+    unlink(path);
+    delete[] keys;
+}
+/*}}}*/
+
+/*{{{ Caches */
+int cache_key(FastRand &rnd, int i, int key_range) {
+    /**
+     * @brief The workload: 80% of the accesses go to the hottest 20% of the
+     * keys, and every 64th access belongs to a scan of keys never seen again.
+     */
+    if ((i & 63) == 63) return key_range + i;
+    unsigned int r = rnd.next();
+    if (r % 10 < 8) return (r >> 4) % (key_range / 5);
+    return (r >> 4) % key_range;
+}
+
+template <class C>
+void bench_cache_policy(const char *name, int capacity, int key_range,
+                        int ops) {
+    C cache(capacity);
+    FastRand rnd(1);
+    int value;
+    Timer timer;
+    for (int i = 0; i < ops; i++)
+    {
+        int key = cache_key(rnd, i, key_range);
+        if (!cache.tryGet(key, value)) cache.put(key, i);
+    }
+    double sec = timer.elapsed();
+    printf("%s\t%.2f\t%.1f\n", name, ops / sec / 1e6,
+            100.0 * cache.hitCount() / (cache.hitCount() + cache.missCount()));
+}
+
+template <class C>
+struct CacheWorker {
+    C *cache;
+    int ops, key_range;
+    unsigned int seed;
+
+    static void *run(void *arg) {
+        CacheWorker *w = (CacheWorker *)arg;
+        FastRand rnd(w -> seed);
+        int value;
+        for (int i = 0; i < w -> ops; i++)
+        {
+            int key = cache_key(rnd, i, w -> key_range);
+            if (!w -> cache -> tryGet(key, value)) w -> cache -> put(key, i);
+        }
+        return NULL;
+    }
+};
+
+template <class C>
+double run_cache(C *cache, int thread_num, int total_ops, int key_range) {
+    pthread_t threads[64];
+    CacheWorker<C> workers[64];
+    Timer timer;
+    for (int i = 0; i < thread_num; i++)
+    {
+        workers[i].cache = cache;
+        workers[i].ops = total_ops / thread_num;
+        workers[i].key_range = key_range;
+        workers[i].seed = i + 1;
+        pthread_create(threads + i, NULL, CacheWorker<C>::run, workers + i);
+    }
+    for (int i = 0; i < thread_num; i++)
+        pthread_join(threads[i], NULL);
+    return total_ops / timer.elapsed() / 1e6;
+}
+
+void bench_cache() {
+    const int CAPACITY = 1 << 16, KEY_RANGE = 1 << 19, OPS = 1 << 22;
+    puts("== Cache policies, get-or-put on a skewed workload with scans");
+    puts("policy\tMops/s\thit%");
+    bench_cache_policy<Cache<int, int, HashInt, LRUPolicy> >(
+            "LRU", CAPACITY, KEY_RANGE, OPS);
+    bench_cache_policy<Cache<int, int, HashInt, ClockPolicy> >(
+            "CLOCK", CAPACITY, KEY_RANGE, OPS);
+    bench_cache_policy<Cache<int, int, HashInt, S3FIFOPolicy> >(
+            "S3-FIFO", CAPACITY, KEY_RANGE, OPS);
+
+    puts("== ConcurrentCache (Mops/s)");
+    puts("threads\tLRU\tCLOCK");
+    for (int t = 1; t <= 64; t <<= 1)
+    {
+        ConcurrentCache<int, int, HashInt, LRUPolicy> *lru =
+            new ConcurrentCache<int, int, HashInt, LRUPolicy>(CAPACITY);
+        ConcurrentCache<int, int, HashInt, ClockPolicy> *clock =
+            new ConcurrentCache<int, int, HashInt, ClockPolicy>(CAPACITY);
+        double a = run_cache(lru, t, OPS, KEY_RANGE);
+        double b = run_cache(clock, t, OPS, KEY_RANGE);
+        printf("%d\t%.2f\t%.2f\n", t, a, b);
+        delete lru;
+        delete clock;
+    }
+}
+/*}}}*/
+
+/*{{{ Statistics */
+class HashBad {
+public:
+    // @brief Keeps only the low 10 bits, like a careless hash of ids.
+    static int hashCode(int obj) {
+        return obj & 1023;
+    }
+};
+
+template <class Map>
+double bench_lookups(Map &map, int elem_num) {
+    /**
+     * @brief Returns the nanoseconds taken by each containsKey().
+     */
+    const int ROUNDS = 8;
+    FastRand rnd(1);
+    int found = 0;
+    Timer timer;
+    for (int i = 0; i < elem_num * ROUNDS; i++)
+        found += map.containsKey(rnd.next() % (elem_num * 2));
+    double res = timer.elapsed() * 1e9 / (elem_num * ROUNDS);
+    if (found == 0) puts("no key found!");
+    return res;
+}
+
+void bench_hashmap_stats() {
+    const int ELEM_NUM = 1 << 20;
+    HashMap<int, int, HashInt> plain;
+    HashMap<int, int, HashInt, false, HashMapProbeStats> counted;
+    for (int i = 0; i < ELEM_NUM; i++)
+    {
+        plain.put(i * 2, i);
+        counted.put(i * 2, i);
+    }
+    puts("== Overhead of HashMapProbeStats (ns per lookup)");
+    puts("plain\tcounted");
+    bench_lookups(plain, ELEM_NUM); // warm up both
+    bench_lookups(counted, ELEM_NUM);
+    double a = bench_lookups(plain, ELEM_NUM);
+    double b = bench_lookups(counted, ELEM_NUM);
+    printf("%.1f\t%.1f\n", a, b);
+    printf("identity hash: %s\n", counted.stats().toJSON().c_str());
+
+    const int BAD_NUM = 1 << 16;
+    HashMap<int, int, HashBad, false, HashMapProbeStats> bad;
+    for (int i = 0; i < BAD_NUM; i++) bad.put(i * 2, i);
+    printf("bad hash (%.1f ns per lookup): ", bench_lookups(bad, BAD_NUM));
+    printf("%s\n", bad.stats().toJSON().c_str());
+}
+/*}}}*/
+
+/*{{{ Bloom filters */
+template <class Map>
+double bench_misses(const Map &map, int elem_num, int miss_permille) {
+    /**
+     * @brief Returns the nanoseconds taken by each containsKey(), where the
+     * present keys are the even ones below elem_num * 2.
+     */
+    const int OPS = 1 << 22;
+    FastRand rnd(7);
+    int found = 0;
+    Timer timer;
+    for (int i = 0; i < OPS; i++)
+    {
+        unsigned int r = rnd.next();
+        int key = (r >> 10) % elem_num * 2;
+        if ((int)(r & 1023) * 1000 < miss_permille * 1024) key++;
+        found += map.containsKey(key);
+    }
+    double res = timer.elapsed() * 1e9 / OPS;
+    if (found == 0) puts("no key found!");
+    return res;
+}
+
+template <class Map, class Filtered>
+void bench_bloom_map(const char *name, int elem_num) {
+    long long base = live_bytes;
+    Map *map = new Map();
+    for (int i = 0; i < elem_num; i++) map -> put(i * 2, i);
+    long long map_bytes = live_bytes - base;
+    Filtered *filtered = new Filtered();
+    for (int i = 0; i < elem_num; i++) filtered -> put(i * 2, i);
+    const int miss_permilles[] = {500, 800, 990};
+    for (int r = 0; r < 3; r++)
+    {
+        double a = bench_misses(*map, elem_num, miss_permilles[r]);
+        double b = bench_misses(*filtered, elem_num, miss_permilles[r]);
+        printf("%s\t%.0f\t%.1f\t%.1f\t%.2f\t%.1f\n", name,
+                miss_permilles[r] / 10.0, a, b,
+                filtered -> falsePositiveRate() * 100,
+                100.0 * filtered -> filterBytes() / map_bytes);
+    }
+    delete map;
+    delete filtered;
+}
+
+void bench_bloom() {
+    const int ELEM_NUM = 1 << 20;
+    puts("== BloomFilteredMap on miss-heavy containsKey() (ns per lookup)");
+    puts("map\tmiss%\tplain\tfilter\tfp%\tfilter memory% of the map");
+    bench_bloom_map<TreeMap<int, int>,
+        BloomFilteredMap<int, int, HashInt, TreeMap<int, int> > >(
+            "TreeMap", ELEM_NUM);
+    bench_bloom_map<HashMap<int, int, HashInt>,
+        BloomFilteredMap<int, int, HashInt> >("HashMap", ELEM_NUM);
+}
+/*}}}*/
+
+/*{{{ Integer keys */
+template <class Map>
+void bench_int_map(const char *name, const int *keys, int elem_num) {
+    long long base = live_bytes;
+    Map *map = new Map();
+    Timer put_timer;
+    for (int i = 0; i < elem_num; i++) map -> put(keys[i], i);
+    double put_ns = put_timer.elapsed() * 1e9 / elem_num;
+    long long bytes = live_bytes - base;
+    int found = 0;
+    Timer hit_timer;
+    for (int i = 0; i < elem_num; i++) found += map -> containsKey(keys[i]);
+    double hit_ns = hit_timer.elapsed() * 1e9 / elem_num;
+    Timer miss_timer;
+    for (int i = 0; i < elem_num; i++) found -= map -> containsKey(~keys[i]);
+    double miss_ns = miss_timer.elapsed() * 1e9 / elem_num;
+    Timer remove_timer;
+    for (int i = 0; i < elem_num; i++) map -> remove(keys[i]);
+    double remove_ns = remove_timer.elapsed() * 1e9 / elem_num;
+    printf("%s\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\n", name, put_ns, hit_ns,
+            miss_ns, remove_ns, (double)bytes / elem_num);
+    if (found != elem_num) puts("wrong result!");
+    delete map;
+}
+
+void bench_inthashmap() {
+    const int ELEM_NUM = 1 << 20;
+    int *keys = new int[ELEM_NUM];
+    FastRand rnd(3);
+    for (int i = 0; i < ELEM_NUM; i++) keys[i] = rnd.next() & 0x3fffffff;
+    /* keep the keys distinct for the counts to be checked */
+    for (int i = 0; i < ELEM_NUM; i++) keys[i] = (keys[i] & ~0xfffff) | i;
+    puts("== IntHashMap vs. HashMap<int, int, HashInt> (ns per op, bytes "
+            "per key)");
+    puts("map\tput\thit\tmiss\tremove\tbytes");
+    bench_int_map<HashMap<int, int, HashInt> >("HashMap", keys, ELEM_NUM);
+    bench_int_map<IntHashMap<int, int> >("IntHashMap", keys, ELEM_NUM);
+    for (int i = 0; i < ELEM_NUM; i++) keys[i] = i;
+    bench_int_map<HashMap<int, int, HashInt> >("HashMap(seq)", keys,
+                                                ELEM_NUM);
+    bench_int_map<IntHashMap<int, int> >("IntHashMap(seq)", keys, ELEM_NUM);
+    delete[] keys;
+}
+/*}}}*/
+
+/*{{{ Aggregation */
+void bench_groupby() {
+    const int ROW_NUM = 1 << 24;
+    const int group_nums[] = {1 << 10, 1 << 16, 1 << 20, 1 << 23};
+    int *keys = new int[ROW_NUM], *vals = new int[ROW_NUM];
+    puts("== GroupBy sum vs. containsKey+get+put on a HashMap (Mrows/s)");
+    puts("groups\tnaive\t1 thread\t4 threads");
+    for (int g = 0; g < 4; g++)
+    {
+        FastRand rnd(g + 1);
+        for (int i = 0; i < ROW_NUM; i++)
+        {
+            keys[i] = rnd.next() % group_nums[g];
+            vals[i] = i & 1023;
+        }
+        HashMap<int, long long, HashInt> *naive =
+            new HashMap<int, long long, HashInt>();
+        Timer naive_timer;
+        for (int i = 0; i < ROW_NUM; i++)
+            if (naive -> containsKey(keys[i]))
+                naive -> put(keys[i], naive -> get(keys[i]) + vals[i]);
+            else naive -> put(keys[i], vals[i]);
+        double a = ROW_NUM / naive_timer.elapsed() / 1e6;
+
+        double b[2];
+        for (int t = 0; t < 2; t++)
+        {
+            GroupBy<int, int, HashInt, SumAgg<long long> > *group_by =
+                new GroupBy<int, int, HashInt, SumAgg<long long> >(t ? 4 : 1);
+            HashMap<int, long long, HashInt> *result =
+                new HashMap<int, long long, HashInt>();
+            Timer timer;
+            group_by -> add(keys, vals, ROW_NUM);
+            group_by -> collect(*result);
+            b[t] = ROW_NUM / timer.elapsed() / 1e6;
+            if (result -> size() != naive -> size() ||
+                result -> get(keys[0]) != naive -> get(keys[0]))
+                puts("wrong result!");
+            delete group_by;
+            delete result;
+        }
+        printf("%d\t%.1f\t%.1f\t%.1f\n", group_nums[g], a, b[0], b[1]);
+        delete naive;
+    }
+    delete[] keys;
+    delete[] vals;
+}
+/*}}}*/
+
+/*{{{ Value index */
+template <class Map>
+void bench_value_index_map(const char *name, int elem_num, int value_num) {
+    /**
+     * @brief Print the cost of put(), the bytes per key and the cost of
+     * containsValue() for a value missing half of the time.
+     */
+    long long base = live_bytes;
+    Map *map = new Map();
+    Timer put_timer;
+    for (int i = 0; i < elem_num; i++) map -> put(i, i % value_num);
+    double put_ns = put_timer.elapsed() * 1e9 / elem_num;
+    double bytes = (double)(live_bytes - base) / elem_num;
+    int calls = 0, found = 0;
+    Timer timer;
+    while (timer.elapsed() < 0.5 || calls < 2)
+    {
+        found += map -> containsValue(calls & 1 ? -1 : calls % value_num);
+        calls++;
+    }
+    printf("%s\t%d\t%.1f\t%.1f\t%.3f\n", name, value_num, put_ns, bytes,
+            timer.elapsed() * 1e6 / calls);
+    if (found * 2 < calls - 1) puts("wrong result!");
+    delete map;
+}
+
+void bench_value_index() {
+    const int ELEM_NUM = 1 << 20;
+    const int value_nums[] = {1 << 10, ELEM_NUM};
+    puts("== ValueIndexedMap vs. the plain maps");
+    puts("map\tvalues\tput ns\tbytes/key\tcontainsValue us");
+    for (int v = 0; v < 2; v++)
+    {
+        bench_value_index_map<HashMap<int, int, HashInt> >(
+                "HashMap", ELEM_NUM, value_nums[v]);
+        bench_value_index_map<ValueIndexedMap<int, int, HashInt, HashInt> >(
+                "indexed HashMap", ELEM_NUM, value_nums[v]);
+        bench_value_index_map<TreeMap<int, int> >(
+                "TreeMap", ELEM_NUM, value_nums[v]);
+        bench_value_index_map<ValueIndexedMap<int, int, HashInt, HashInt,
+            TreeMap<int, int> > >("indexed TreeMap", ELEM_NUM, value_nums[v]);
+    }
+}
+/*}}}*/
+
+/*{{{ Range scans */
+void bench_range_scan() {
+    /**
+     * @brief Scan 100 consecutive keys from a random key of a large TreeMap,
+     * through a subMap() view, which seeks once and walks the threaded list,
+     * and through a chain of higherKey() calls, which descends every time.
+     */
+    const int ELEM_NUM = 10000000, SCAN_LEN = 100;
+    TreeMap<int, int> *map = new TreeMap<int, int>();
+    FastRand rnd(1);
+    Timer build_timer;
+    for (int i = 0; i < ELEM_NUM; i++)
+        map -> put((int)(rnd.next() & 0x7fffffff), i);
+    printf("== TreeMap range scans of %d keys in %d entries "
+            "(built in %.1f s)\n", SCAN_LEN, map -> size(),
+            build_timer.elapsed());
+    puts("method\tus/scan\tns/key");
+    long long sum = 0, scans = 0;
+    Timer timer;
+    while (timer.elapsed() < 1 || scans < 2)
+    {
+        int lo = (int)(rnd.next() & 0x7fffffff);
+        TreeMap<int, int>::SubMap::Iterator it =
+            map -> tailMap(lo).iterator();
+        for (int j = 0; j < SCAN_LEN && it.hasNext(); j++)
+            sum += it.next().getValue();
+        scans++;
+    }
+    double t = timer.elapsed();
+    printf("subMap\t%.3f\t%.1f\n", t * 1e6 / scans,
+            t * 1e9 / (scans * SCAN_LEN));
+    scans = 0;
+    timer = Timer();
+    while (timer.elapsed() < 1 || scans < 2)
+    {
+        int key = (int)(rnd.next() & 0x7fffffff);
+        try
+        {
+            for (int j = 0; j < SCAN_LEN; j++)
+            {
+                key = map -> higherKey(key);
+                sum += map -> get(key);
+            }
+        }
+        catch (ElementNotExist) {}
+        scans++;
+    }
+    t = timer.elapsed();
+    printf("higherKey\t%.3f\t%.1f\n", t * 1e6 / scans,
+            t * 1e9 / (scans * SCAN_LEN));
+    if (sum == 0) puts("no key found!");
+    delete map;
+}
+/*}}}*/
+
+/*{{{ Order statistics */
+void bench_order_statistics() {
+    /**
+     * @brief Print the cost of put() and remove(), which maintain the
+     * subtree sizes, and that of a percentile query by select() against a
+     * walk of the iterator.
+     */
+    const int ELEM_NUM = 1 << 20;
+    int *keys = new int[ELEM_NUM];
+    FastRand rnd(1);
+    for (int i = 0; i < ELEM_NUM; i++) keys[i] = (int)rnd.next();
+    TreeMap<int, int> *map = new TreeMap<int, int>();
+    Timer put_timer;
+    for (int i = 0; i < ELEM_NUM; i++) map -> put(keys[i], i);
+    double put_ns = put_timer.elapsed() * 1e9 / ELEM_NUM;
+    printf("== TreeMap order statistics over %d keys\n", ELEM_NUM);
+    puts("query\tus/query");
+    long long sum = 0;
+    int queries = 0;
+    Timer timer;
+    while (timer.elapsed() < 0.5 || queries < 2)
+    {
+        sum += map -> select((int)(rnd.next() % ELEM_NUM));
+        queries++;
+    }
+    printf("select\t%.3f\n", timer.elapsed() * 1e6 / queries);
+    queries = 0;
+    timer = Timer();
+    while (timer.elapsed() < 0.5 || queries < 2)
+    {
+        int k = (int)(rnd.next() % ELEM_NUM);
+        TreeMap<int, int>::Iterator it = map -> iterator();
+        for (int j = 0; j < k; j++) it.next();
+        sum += it.next().getKey();
+        queries++;
+    }
+    printf("iterator\t%.3f\n", timer.elapsed() * 1e6 / queries);
+    Timer remove_timer;
+    for (int i = 0; i < ELEM_NUM; i++) map -> remove(keys[i]);
+    printf("put %.1f ns, remove %.1f ns\n", put_ns,
+            remove_timer.elapsed() * 1e9 / ELEM_NUM);
+    if (sum == 0) puts("no key found!");
+    delete map;
+    delete[] keys;
+}
+/*}}}*/
+
+/*{{{ Bulk load */
+void bench_bulk_load() {
+    /**
+     * @brief Load sorted keys into an empty TreeMap by put() and by
+     * buildFromSorted(), then merge as many keys into the loaded map by
+     * putAllSorted().
+     */
+    const int ELEM_NUM = 10000000;
+    int *keys = new int[ELEM_NUM], *vals = new int[ELEM_NUM];
+    for (int i = 0; i < ELEM_NUM; i++)
+    {
+        keys[i] = i * 2;
+        vals[i] = i;
+    }
+    printf("== Loading %d sorted keys into a TreeMap\n", ELEM_NUM);
+    puts("method\tseconds\tns/key");
+    TreeMap<int, int> *map = new TreeMap<int, int>();
+    Timer put_timer;
+    for (int i = 0; i < ELEM_NUM; i++) map -> put(keys[i], vals[i]);
+    double t = put_timer.elapsed();
+    printf("put\t%.2f\t%.1f\n", t, t * 1e9 / ELEM_NUM);
+    delete map;
+    map = new TreeMap<int, int>();
+    Timer build_timer;
+    map -> buildFromSorted(keys, vals, ELEM_NUM);
+    t = build_timer.elapsed();
+    printf("buildFromSorted\t%.2f\t%.1f\n", t, t * 1e9 / ELEM_NUM);
+    for (int i = 0; i < ELEM_NUM; i++) keys[i]++;
+    Timer merge_timer;
+    map -> putAllSorted(keys, vals, ELEM_NUM);
+    t = merge_timer.elapsed();
+    printf("putAllSorted\t%.2f\t%.1f\n", t, t * 1e9 / ELEM_NUM);
+    if (map -> size() != ELEM_NUM * 2) puts("wrong size!");
+    delete map;
+    delete[] keys;
+    delete[] vals;
+}
+/*}}}*/
+
+/*{{{ Split & join */
+void bench_split_join() {
+    /**
+     * @brief Compare removeRange() and putAll() of TreeMap with removing and
+     * putting the entries one by one, and time split() with join().
+     */
+    const int ELEM_NUM = 1 << 20, RANGE = ELEM_NUM * 4;
+    FastRand rnd(1);
+    TreeMap<int, int> base, other;
+    for (int i = 0; i < ELEM_NUM; i++)
+    {
+        base.put((int)(rnd.next() % RANGE), i);
+        other.put((int)(rnd.next() % RANGE), i);
+    }
+    printf("== TreeMap split & join over %d + %d entries\n", base.size(),
+            other.size());
+    puts("operation\tms");
+    TreeMap<int, int> map = base;
+    int lo = RANGE / 4, hi = RANGE / 4 + RANGE / 10;
+    int num = map.countRange(lo, hi);
+    Timer timer;
+    for (TreeMap<int, int>::SubMap::Iterator it =
+            base.subMap(lo, hi).iterator(); it.hasNext(); )
+        map.remove(it.next().getKey());
+    printf("remove %d one by one\t%.1f\n", num, timer.elapsed() * 1e3);
+    map = base;
+    map.put(0, 0); // copy the nodes outside the timing
+    timer = Timer();
+    map.removeRange(lo, hi);
+    printf("removeRange %d\t%.1f\n", num, timer.elapsed() * 1e3);
+    map = base;
+    map.put(0, 0);
+    timer = Timer();
+    for (TreeMap<int, int>::Iterator it = other.iterator(); it.hasNext(); )
+    {
+        TreeMap<int, int>::Entry e = it.next();
+        map.put(e.getKey(), e.getValue());
+    }
+    printf("put one by one\t%.1f\n", timer.elapsed() * 1e3);
+    int size = map.size();
+    const int thread_nums[] = {1, 4};
+    for (int t = 0; t < 2; t++)
+    {
+        map = base;
+        map.put(0, 0);
+        timer = Timer();
+        map.putAll(other, thread_nums[t]);
+        printf("putAll, %d threads\t%.1f\n", thread_nums[t],
+                timer.elapsed() * 1e3);
+        if (map.size() != size) puts("wrong size!");
+    }
+    const int SPLIT_NUM = 1000;
+    timer = Timer();
+    for (int i = 0; i < SPLIT_NUM; i++)
+    {
+        TreeMap<int, int> upper = map.split((int)(rnd.next() % RANGE));
+        map.join(upper);
+    }
+    printf("split + join, each\t%.4f\n", timer.elapsed() * 1e3 / SPLIT_NUM);
+}
+/*}}}*/
+
+/*{{{ Ordered map engines */
+template <class Map>
+void bench_ordered_map(const char *name, const int *keys, int elem_num) {
+    /**
+     * @brief Print the cost of put() and get() of random keys, and of a full
+     * scan by the iterator, per entry.
+     */
+    Map *map = new Map();
+    Timer put_timer;
+    for (int i = 0; i < elem_num; i++) map -> put(keys[i], i);
+    double put_ns = put_timer.elapsed() * 1e9 / elem_num;
+    FastRand rnd(2);
+    long long sum = 0, gets = 0;
+    Timer get_timer;
+    while (get_timer.elapsed() < 0.5 || gets < elem_num)
+    {
+        for (int i = 0; i < 1024; i++)
+            sum += map -> get(keys[rnd.next() % elem_num]);
+        gets += 1024;
+    }
+    double get_ns = get_timer.elapsed() * 1e9 / gets;
+    long long scanned = 0;
+    Timer scan_timer;
+    while (scan_timer.elapsed() < 0.5 || scanned == 0)
+        for (typename Map::Iterator it = map -> iterator(); it.hasNext(); )
+        {
+            sum += it.next().getValue();
+            scanned++;
+        }
+    printf("%s\t%d\t%.1f\t%.1f\t%.2f\n", name, elem_num, put_ns, get_ns,
+            scan_timer.elapsed() * 1e9 / scanned);
+    if (sum == 0) puts("no key found!");
+    delete map;
+}
+
+void bench_btree() {
+    const int elem_nums[] = {1000, 100000, 1000000, 10000000};
+    const int MAX_NUM = 10000000;
+    int *keys = new int[MAX_NUM];
+    FastRand rnd(1);
+    for (int i = 0; i < MAX_NUM; i++) keys[i] = (int)rnd.next(); // distinct
+    puts("== TreeMap (treap) vs. BTreeMap (B+-tree), random int keys");
+    puts("map\tentries\tput ns\tget ns\tscan ns/entry");
+    for (int i = 0; i < 4; i++)
+    {
+        bench_ordered_map<TreeMap<int, int> >("TreeMap", keys, elem_nums[i]);
+        bench_ordered_map<BTreeMap<int, int, 256> >("BTreeMap<256>", keys,
+                                                    elem_nums[i]);
+        bench_ordered_map<BTreeMap<int, int> >("BTreeMap<512>", keys,
+                                                elem_nums[i]);
+        bench_ordered_map<BTreeMap<int, int, 1024> >("BTreeMap<1024>", keys,
+                                                    elem_nums[i]);
+    }
+    delete[] keys;
+}
+/*}}}*/
+
+/*{{{ Persistent maps */
+class LockedTreeMap {
+    /**
+     * @brief The baseline: a TreeMap wrapped in one global mutex.
+     */
+    TreeMap<int, int> map;
+    pthread_mutex_t lock;
+    public:
+    LockedTreeMap() { pthread_mutex_init(&lock, NULL); }
+    ~LockedTreeMap() { pthread_mutex_destroy(&lock); }
+    bool containsKey(int key) {
+        pthread_mutex_lock(&lock);
+        bool res = map.containsKey(key);
+        pthread_mutex_unlock(&lock);
+        return res;
+    }
+    int get(int key) {
+        pthread_mutex_lock(&lock);
+        int res = map.get(key);
+        pthread_mutex_unlock(&lock);
+        return res;
+    }
+    void put(int key, int value) {
+        pthread_mutex_lock(&lock);
+        map.put(key, value);
+        pthread_mutex_unlock(&lock);
+    }
+};
+
+template <class Map>
+struct VersionReader {
+    Map *map;
+    int ops, key_range;
+    unsigned int seed;
+    long long sum;
+
+    static void *run(void *arg) {
+        VersionReader *r = (VersionReader *)arg;
+        FastRand rnd(r -> seed);
+        long long sum = 0;
+        for (int i = 0; i < r -> ops; i++)
+            sum += r -> map -> get((int)(rnd.next() % r -> key_range));
+        r -> sum = sum;
+        return NULL;
+    }
+};
+
+template <class Map>
+struct VersionWriter {
+    Map *map;
+    int key_range;
+    volatile bool stop;
+    long long writes;
+
+    static void *run(void *arg) {
+        VersionWriter *w = (VersionWriter *)arg;
+        FastRand rnd(12345);
+        long long writes = 0;
+        while (!w -> stop)
+        {
+            w -> map -> put((int)(rnd.next() % w -> key_range), (int)writes);
+            writes++;
+        }
+        w -> writes = writes;
+        return NULL;
+    }
+};
+
+template <class Map>
+void bench_reads_under_writes(const char *name, int reader_num, int key_range,
+                            int total_ops) {
+    /**
+     * @brief Time reader_num threads reading random keys while one thread
+     * keeps overwriting random keys.
+     */
+    Map *map = new Map();
+    for (int i = 0; i < key_range; i++) map -> put(i, i);
+    pthread_t writer_thread, threads[64];
+    VersionWriter<Map> writer;
+    writer.map = map;
+    writer.key_range = key_range;
+    writer.stop = false;
+    pthread_create(&writer_thread, NULL, VersionWriter<Map>::run, &writer);
+    VersionReader<Map> readers[64];
+    Timer timer;
+    for (int i = 0; i < reader_num; i++)
+    {
+        readers[i].map = map;
+        readers[i].ops = total_ops / reader_num;
+        readers[i].key_range = key_range;
+        readers[i].seed = i + 1;
+        pthread_create(threads + i, NULL, VersionReader<Map>::run,
+                        readers + i);
+    }
+    long long sum = 0;
+    for (int i = 0; i < reader_num; i++)
+    {
+        pthread_join(threads[i], NULL);
+        sum += readers[i].sum;
+    }
+    double elapsed = timer.elapsed();
+    writer.stop = true;
+    pthread_join(writer_thread, NULL);
+    printf("%s\t%d\t%.2f\t%.2f\n", name, reader_num,
+            total_ops / elapsed / 1e6, writer.writes / elapsed / 1e6);
+    if (sum == 0) puts("no key found!");
+    delete map;
+}
+
+void bench_persistent() {
+    const int ELEM_NUM = 1 << 20, VERSION_NUM = 1 << 16;
+    FastRand rnd(1);
+    int *keys = new int[ELEM_NUM];
+    for (int i = 0; i < ELEM_NUM; i++) keys[i] = (int)(rnd.next() >> 1);
+    printf("== Creating %d versions of a %d-entry map, one put each\n",
+            VERSION_NUM, ELEM_NUM);
+    puts("method\tus/version\tB/version");
+    PersistentTreeMap<int, int> base;
+    for (int i = 0; i < ELEM_NUM; i++) base = base.put(keys[i], i);
+    TreeMap<int, int> tree;
+    for (int i = 0; i < ELEM_NUM; i++) tree.put(keys[i], i);
+    {
+        /* keep all the versions alive to measure what they do not share */
+        PersistentTreeMap<int, int> *versions =
+            new PersistentTreeMap<int, int>[VERSION_NUM];
+        long long base_bytes = live_bytes;
+        Timer timer;
+        for (int i = 0; i < VERSION_NUM; i++)
+            versions[i] = (i ? versions[i - 1] : base).put(
+                    (int)(rnd.next() >> 1), i);
+        printf("PersistentTreeMap::put\t%.3f\t%lld\n",
+                timer.elapsed() * 1e6 / VERSION_NUM,
+                (live_bytes - base_bytes) / VERSION_NUM);
+        if (versions[VERSION_NUM - 1].size() < ELEM_NUM) puts("wrong size!");
+        delete[] versions;
+    }
+    {
+        const int COPY_NUM = 16;
+        long long base_bytes = live_bytes;
+        TreeMap<int, int> *copies = new TreeMap<int, int>[COPY_NUM];
+        Timer timer;
+        for (int i = 0; i < COPY_NUM; i++)
+        {
+            copies[i] = tree;
+            copies[i].put((int)(rnd.next() >> 1), i);
+        }
+        printf("TreeMap copy + put\t%.3f\t%lld\n",
+                timer.elapsed() * 1e6 / COPY_NUM,
+                (live_bytes - base_bytes) / COPY_NUM);
+        delete[] copies;
+    }
+    {
+        Timer timer;
+        for (int i = 0; i < VERSION_NUM; i++)
+            tree.put((int)(rnd.next() >> 1), i);
+        printf("TreeMap::put in place\t%.3f\t-\n",
+                timer.elapsed() * 1e6 / VERSION_NUM);
+    }
+    delete[] keys;
+
+    puts("== Reads of a 1M-entry map under one concurrent writer (Mops/s)");
+    puts("map\treaders\treads\twrites");
+    for (int t = 1; t <= 8; t <<= 1)
+    {
+        bench_reads_under_writes<LockedTreeMap>("TreeMap+mutex", t, ELEM_NUM,
+                                                1 << 20);
+        bench_reads_under_writes<VersionedTreeMap<int, int> >(
+                "VersionedTreeMap", t, ELEM_NUM, 1 << 20);
+    }
+}
+/*}}}*/
+
+/*{{{ Concurrent ordered maps */
+void bench_skiplist() {
+    const int KEY_RANGE = 1 << 20, TOTAL_OPS = 1 << 21;
+    const int read_permilles[] = {500, 900, 990};
+    puts("== ConcurrentSkipListMap vs. TreeMap behind a mutex (Mops/s)");
+    puts("threads\tread%\tlocked\tskiplist");
+    for (int r = 0; r < 3; r++)
+    {
+        LockedTreeMap *locked = new LockedTreeMap();
+        ConcurrentSkipListMap<int, int> *skiplist =
+            new ConcurrentSkipListMap<int, int>();
+        for (int i = 0; i < KEY_RANGE; i += 2)
+        {
+            locked -> put(i, i);
+            skiplist -> put(i, i);
+        }
+        for (int t = 1; t <= 64; t <<= 1)
+        {
+            double a = run_mixed(locked, t, TOTAL_OPS, KEY_RANGE,
+                                read_permilles[r]);
+            double b = run_mixed(skiplist, t, TOTAL_OPS, KEY_RANGE,
+                                read_permilles[r]);
+            printf("%d\t%.1f\t%.2f\t%.2f\n", t, read_permilles[r] / 10.0, a, b);
+        }
+        delete locked;
+        delete skiplist;
+    }
+}
+/*}}}*/
+
+/*{{{ Insertion patterns */
+template <class Map>
+double time_puts(const int *keys, int elem_num) {
+    // @brief Returns ns per put() of the keys into an empty map.
+    Map *map = new Map();
+    Timer timer;
+    for (int i = 0; i < elem_num; i++) map -> put(keys[i], i);
+    double t = timer.elapsed() * 1e9 / elem_num;
+    delete map;
+    return t;
+}
+
+void bench_insert_patterns() {
+    /**
+     * @brief Time put() of keys in ascending, descending, nearly sorted
+     * (each displaced by up to 8 places), clustered (runs of 64 keys starting
+     * at random places) and random order, then filling the gaps between the
+     * keys of a map by put() with the iterator as the hint.
+     */
+    const int ELEM_NUM = 1 << 22;
+    int *keys = new int[ELEM_NUM];
+    FastRand rnd(1);
+    printf("== put() of %d keys by pattern (ns/put)\n", ELEM_NUM);
+    puts("pattern\tTreeMap\tBTreeMap");
+    const char *patterns[] = {"ascending", "descending", "nearly sorted",
+                                "clustered", "random"};
+    for (int p = 0; p < 5; p++)
+    {
+        for (int i = 0; i < ELEM_NUM; i++)
+        {
+            switch (p)
+            {
+                case 0: keys[i] = i; break;
+                case 1: keys[i] = ELEM_NUM - i; break;
+                case 2: keys[i] = i + (int)(rnd.next() % 8); break;
+                case 3: keys[i] = i % 64 == 0 ?
+                        (int)(rnd.next() >> 1) : keys[i - 1] + 1; break;
+                default: keys[i] = (int)(rnd.next() >> 1);
+            }
+        }
+        double a = time_puts<TreeMap<int, int> >(keys, ELEM_NUM);
+        double b = time_puts<BTreeMap<int, int> >(keys, ELEM_NUM);
+        printf("%s\t%.1f\t%.1f\n", patterns[p], a, b);
+    }
+    TreeMap<int, int> base;
+    for (int i = 0; i < ELEM_NUM; i++) keys[i] = (int)(rnd.next() >> 1) & ~1;
+    for (int i = 0; i < ELEM_NUM; i++) base.put(keys[i], i);
+    int size = base.size();
+    TreeMap<int, int> map = base;
+    map.put(0, 0); // copy the nodes outside the timing
+    Timer timer;
+    for (TreeMap<int, int>::Iterator it = base.iterator(); it.hasNext(); )
+    {
+        int k = it.next().getKey();
+        map.put(k + 1, k);
+    }
+    printf("filling the gaps of %d keys by put\t%.1f\n", size,
+            timer.elapsed() * 1e9 / size);
+    map = base;
+    map.put(0, 0);
+    timer = Timer();
+    for (TreeMap<int, int>::Iterator it = map.iterator(); it.hasNext(); )
+    {
+        int k = it.next().getKey();
+        map.put(it, k + 1, k);
+        it.next(); // skip the key just put
+    }
+    printf("filling the gaps of %d keys by hinted put\t%.1f\n", size,
+            timer.elapsed() * 1e9 / size);
+
+    /* put() from the finger skips the descent, but still increments the
+     * subtree sizes of all the ancestors of the new leaf */
+    puts("== put() of ascending keys by map size");
+    puts("keys	ns/put	height");
+    for (int i = 0; i < ELEM_NUM; i++) keys[i] = i;
+    for (int n = 1 << 13; n <= ELEM_NUM; n <<= 3)
+    {
+        TreeMap<int, int> *seq = new TreeMap<int, int>();
+        Timer seq_timer;
+        for (int i = 0; i < n; i++) seq -> put(keys[i], i);
+        double ns = seq_timer.elapsed() * 1e9 / n;
+        printf("%d\t%.1f\t%d\n", n, ns, seq -> height());
+        delete seq;
+    }
+    delete[] keys;
+}
+/*}}}*/
+
+/*{{{ Range aggregates */
+void bench_range_aggregate() {
+    /**
+     * @brief Sum the values of ranges of 1K to 1M keys of a TreeMap by
+     * scanning a subMap() view and by aggregate() of a TreeMap augmented
+     * by SumMonoid, after timing put() into both.
+     */
+    typedef TreeMap<int, long long> PlainMap;
+    typedef TreeMap<int, long long, SumMonoid<long long> > SumMap;
+    const int ELEM_NUM = 1 << 22;
+    int *keys = new int[ELEM_NUM];
+    for (int i = 0; i < ELEM_NUM; i++) keys[i] = i;
+    FastRand rnd(1);
+    for (int i = ELEM_NUM - 1; i > 0; i--)
+    {
+        int j = (int)(rnd.next() % (i + 1));
+        int t = keys[i];
+        keys[i] = keys[j];
+        keys[j] = t;
+    }
+    PlainMap *plain = new PlainMap();
+    SumMap *sum_map = new SumMap();
+    Timer timer;
+    for (int i = 0; i < ELEM_NUM; i++) plain -> put(keys[i], i);
+    double plain_put = timer.elapsed() * 1e9 / ELEM_NUM;
+    timer = Timer();
+    for (int i = 0; i < ELEM_NUM; i++) sum_map -> put(keys[i], i);
+    double sum_put = timer.elapsed() * 1e9 / ELEM_NUM;
+    printf("== Range sums over %d entries (put: %.0f ns plain, %.0f ns "
+            "with SumMonoid)\n", ELEM_NUM, plain_put, sum_put);
+    puts("range\tscan us\taggregate us");
+    long long check = 0;
+    for (int len = 1000; len <= 1000000; len *= 10)
+    {
+        long long scans = 0;
+        timer = Timer();
+        while (timer.elapsed() < 0.5 || scans < 2)
+        {
+            int lo = (int)(rnd.next() % (ELEM_NUM - len));
+            for (PlainMap::SubMap::Iterator it =
+                    plain -> subMap(lo, lo + len).iterator(); it.hasNext(); )
+                check += it.next().getValue();
+            scans++;
+        }
+        double scan_us = timer.elapsed() * 1e6 / scans;
+        long long aggs = 0;
+        timer = Timer();
+        while (timer.elapsed() < 0.5 || aggs < 2)
+        {
+            int lo = (int)(rnd.next() % (ELEM_NUM - len));
+            check -= sum_map -> aggregate(lo, lo + len);
+            aggs++;
+        }
+        printf("%d\t%.2f\t%.3f\n", len, scan_us,
+                timer.elapsed() * 1e6 / aggs);
+    }
+    if (check == 0) puts("nothing summed!");
+    delete plain;
+    delete sum_map;
+    delete[] keys;
+}
+/*}}}*/
+
+/*{{{ Balancing policies */
+template <class Map>
+double time_mixed_ops(const int *load, int load_num, const int *ops,
+                        int op_num) {
+    /**
+     * @brief Returns ns per operation of ops on a map loaded with the keys
+     * load, each a get(), or a put() for every tenth.
+     */
+    Map *map = new Map();
+    for (int i = 0; i < load_num; i++) map -> put(load[i], i);
+    long long sum = 0;
+    Timer timer;
+    for (int i = 0; i < op_num; i++)
+    {
+        if (i % 10 == 0) map -> put(ops[i], i);
+        else sum += map -> get(ops[i]);
+    }
+    double t = timer.elapsed() * 1e9 / op_num;
+    if (sum == 42) puts("");
+    delete map;
+    return t;
+}
+
+template <class Map>
+double time_sequential(int elem_num) {
+    // @brief Returns ns per put() and get() of ascending keys.
+    Map *map = new Map();
+    long long sum = 0;
+    Timer timer;
+    for (int i = 0; i < elem_num; i++) map -> put(i, i);
+    for (int i = 0; i < elem_num; i++) sum += map -> get(i);
+    double t = timer.elapsed() * 1e9 / (elem_num * 2);
+    if (sum == 42) puts("");
+    delete map;
+    return t;
+}
+
+template <class Map>
+void bench_balance_policy(const char *name, const int *load, int load_num,
+                            const int *uniform, const int *zipf,
+                            int op_num) {
+    double u = time_mixed_ops<Map>(load, load_num, uniform, op_num);
+    double z = time_mixed_ops<Map>(load, load_num, zipf, op_num);
+    double s = time_sequential<Map>(load_num);
+    printf("%s\t%.0f\t%.0f\t%.0f\n", name, u, z, s);
+}
+
+void bench_balance() {
+    /**
+     * @brief Time each balancing policy of TreeMap on a map of 1M keys,
+     * getting and putting keys drawn uniformly or by a Zipf distribution
+     * (s = 0.99, the hot keys scattered over the key range), and putting
+     * then getting ascending keys.
+     */
+    const int ELEM_NUM = 1 << 20, OP_NUM = 1 << 22;
+    int *load = new int[ELEM_NUM];
+    int *uniform = new int[OP_NUM], *zipf = new int[OP_NUM];
+    FastRand rnd(1);
+    for (int i = 0; i < ELEM_NUM; i++) load[i] = i;
+    for (int i = ELEM_NUM - 1; i > 0; i--)
+    {
+        int j = (int)(rnd.next() % (i + 1));
+        int t = load[i];
+        load[i] = load[j];
+        load[j] = t;
+    }
+    double *cdf = new double[ELEM_NUM];
+    double total = 0;
+    for (int i = 0; i < ELEM_NUM; i++)
+    {
+        total += 1 / pow(i + 1.0, 0.99);
+        cdf[i] = total;
+    }
+    for (int i = 0; i < OP_NUM; i++)
+    {
+        uniform[i] = (int)(rnd.next() % ELEM_NUM);
+        double x = rnd.next() / 4294967296.0 * total;
+        int lo = 0, hi = ELEM_NUM - 1;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (cdf[mid] < x) lo = mid + 1;
+            else hi = mid;
+        }
+        zipf[i] = load[lo]; // the rank-th hottest key
+    }
+    delete[] cdf;
+    printf("== TreeMap balancing policies, %d keys, 90%% get / 10%% put "
+            "(ns/op)\n", ELEM_NUM);
+    puts("policy\tuniform\tzipfian\tsequential");
+    bench_balance_policy<TreeMap<int, int> >("treap", load, ELEM_NUM,
+            uniform, zipf, OP_NUM);
+    bench_balance_policy<TreeMap<int, int, NoMonoid, RedBlackBalance> >(
+            "red-black", load, ELEM_NUM, uniform, zipf, OP_NUM);
+    bench_balance_policy<TreeMap<int, int, NoMonoid, AVLBalance> >(
+            "AVL", load, ELEM_NUM, uniform, zipf, OP_NUM);
+    bench_balance_policy<TreeMap<int, int, NoMonoid, SplayBalance> >(
+            "splay", load, ELEM_NUM, uniform, zipf, OP_NUM);
+    delete[] load;
+    delete[] uniform;
+    delete[] zipf;
+}
+/*}}}*/
+
+/*{{{ Radix trees */
+template <class Key>
+long long scan_range(const TreeMap<Key, int> *map, const Key &lo,
+                    const Key &hi, long long &scanned) {
+    long long sum = 0;
+    typename TreeMap<Key, int>::SubMap::Iterator it =
+        map -> subMap(lo, hi).iterator();
+    for (; it.hasNext(); scanned++) sum += it.next().getValue();
+    return sum;
+}
+
+template <class Key>
+long long scan_range(const RadixTreeMap<Key, int> *map, const Key &lo,
+                    const Key &hi, long long &scanned) {
+    long long sum = 0;
+    for (typename RadixTreeMap<Key, int>::Iterator it = map -> iterator(lo);
+            it.hasNext(); scanned++)
+    {
+        typename RadixTreeMap<Key, int>::Entry e = it.next();
+        if (!(e.getKey() < hi)) break;
+        sum += e.getValue();
+    }
+    return sum;
+}
+
+template <class Map, class Key>
+void bench_radix_map(const char *name, const Key *keys, const Key *los,
+                    const Key *his, int elem_num) {
+    /**
+     * @brief Print the cost of put() and get() of the keys, and of scanning
+     * [los[i], his[i]) after a seek, per key.
+     */
+    Map *map = new Map();
+    Timer put_timer;
+    for (int i = 0; i < elem_num; i++) map -> put(keys[i], i);
+    double put_ns = put_timer.elapsed() * 1e9 / elem_num;
+    FastRand rnd(2);
+    long long sum = 0, gets = 0, scans = 0, scanned = 0;
+    Timer get_timer;
+    while (get_timer.elapsed() < 0.5 || gets < elem_num)
+    {
+        for (int i = 0; i < 1024; i++)
+            sum += map -> get(keys[rnd.next() % elem_num]);
+        gets += 1024;
+    }
+    double get_ns = get_timer.elapsed() * 1e9 / gets;
+    Timer scan_timer;
+    while (scan_timer.elapsed() < 0.5 || scans < 1024)
+    {
+        int i = rnd.next() % elem_num;
+        sum += scan_range(map, los[i], his[i], scanned);
+        scans++;
+    }
+    double t = scan_timer.elapsed();
+    printf("%s\t%d\t%.1f\t%.1f\t%.2f\t%.1f\n", name, elem_num, put_ns, get_ns,
+            t * 1e6 / scans, t * 1e9 / scanned);
+    if (sum == 0) puts("no key found!");
+    delete map;
+}
+
+void bench_radix() {
+    /**
+     * @brief Compare the treap and the adaptive radix tree on random int
+     * keys, scanning ranges of about 100 keys, and on string keys of the
+     * form "user:xxxxxxxx:yyyy", scanning all the keys of a 3-digit prefix.
+     */
+    const int elem_nums[] = {100000, 1000000, 4000000};
+    const int MAX_NUM = 4000000;
+    int *keys = new int[MAX_NUM], *los = new int[MAX_NUM];
+    int *his = new int[MAX_NUM];
+    FastRand rnd(1);
+    puts("== TreeMap (treap) vs. RadixTreeMap (adaptive radix tree)");
+    puts("map\tentries\tput ns\tget ns\tus/scan\tscan ns/key");
+    for (int n = 0; n < 3; n++)
+    {
+        int elem_num = elem_nums[n];
+        long long span = (long long)(100 * (4294967296.0 / elem_num));
+        for (int i = 0; i < elem_num; i++)
+        {
+            keys[i] = (int)rnd.next(); // distinct
+            los[i] = (int)rnd.next();
+            long long hi = (long long)los[i] + span;
+            his[i] = hi > 0x7fffffff ? 0x7fffffff : (int)hi;
+        }
+        bench_radix_map<TreeMap<int, int> >("TreeMap<int>", keys, los, his,
+                                            elem_num);
+        bench_radix_map<RadixTreeMap<int, int> >("RadixTreeMap<int>", keys,
+                                                los, his, elem_num);
+    }
+    delete[] keys;
+    delete[] los;
+    delete[] his;
+    const int STR_NUM = 1000000;
+    std::string *skeys = new std::string[STR_NUM];
+    std::string *slos = new std::string[STR_NUM];
+    std::string *shis = new std::string[STR_NUM];
+    char buf[32];
+    for (int i = 0; i < STR_NUM; i++)
+    {
+        unsigned int a = rnd.next();
+        sprintf(buf, "user:%08x:%04x", a, i & 0xffff);
+        skeys[i] = buf;
+        sprintf(buf, "user:%03x", rnd.next() & 0xfff);
+        slos[i] = buf;
+        shis[i] = slos[i] + "~"; // past all the digits
+    }
+    bench_radix_map<TreeMap<std::string, int> >("TreeMap<string>", skeys,
+                                                slos, shis, STR_NUM);
+    bench_radix_map<RadixTreeMap<std::string, int> >("RadixTreeMap<string>",
+                                                    skeys, slos, shis, STR_NUM);
+    delete[] skeys;
+    delete[] slos;
+    delete[] shis;
+}
+/*}}}*/
+
+/*{{{ Flat maps */
+template <class Map>
+void time_flat_reads(const char *name, const Map *map, const int *keys,
+                    int elem_num, long long bytes, double build_s) {
+    /**
+     * @brief Print the memory and the build time of the map, and the cost of
+     * get() of present keys and of a full scan, per entry.
+     */
+    FastRand rnd(2);
+    long long sum = 0, gets = 0, scanned = 0;
+    Timer get_timer;
+    while (get_timer.elapsed() < 0.5 || gets < elem_num)
+    {
+        for (int i = 0; i < 1024; i++)
+            sum += map -> get(keys[rnd.next() % elem_num]);
+        gets += 1024;
+    }
+    double get_ns = get_timer.elapsed() * 1e9 / gets;
+    Timer scan_timer;
+    while (scan_timer.elapsed() < 0.5 || scanned == 0)
+        for (typename Map::Iterator it = map -> iterator(); it.hasNext(); )
+        {
+            sum += it.next().getValue();
+            scanned++;
+        }
+    printf("%s\t%d\t%.1f\t%.0f\t%.1f\t%.2f", name, elem_num,
+            (double)bytes / elem_num, build_s * 1e3, get_ns,
+            scan_timer.elapsed() * 1e9 / scanned);
+    if (sum == 0) puts("no key found!");
+}
+
+template <class Map>
+void time_flat_puts(Map *map, const int *keys, int put_num) {
+    // @brief Print the cost of put() of new keys into the built map.
+    Timer timer;
+    for (int i = 0; i < put_num; i++) map -> put(keys[i], i);
+    printf("\t%.1f\n", timer.elapsed() * 1e9 / put_num);
+}
+
+template <class Flat>
+void bench_flat_map(const char *name, const TreeMap<int, int> *tree,
+                    const int *keys, int elem_num) {
+    long long base = live_bytes;
+    Timer build_timer;
+    Flat *flat = new Flat();
+    flat -> freeze(*tree);
+    double build_s = build_timer.elapsed();
+    time_flat_reads(name, flat, keys, elem_num, live_bytes - base, build_s);
+    time_flat_puts(flat, keys + elem_num, elem_num / 10);
+    delete flat;
+}
+
+void bench_flat() {
+    /**
+     * @brief Compare a TreeMap built by put() with FlatTreeMaps frozen from
+     * it, on random int keys: bytes allocated per entry, build time, get()
+     * and scan costs, and then put() of 10% new keys.
+     */
+    const int elem_nums[] = {100000, 1000000, 10000000};
+    const int MAX_NUM = 11000000;
+    int *keys = new int[MAX_NUM];
+    FastRand rnd(1);
+    for (int i = 0; i < MAX_NUM; i++) keys[i] = (int)rnd.next(); // distinct
+    puts("== TreeMap (treap) vs. FlatTreeMap (sorted / Eytzinger arrays)");
+    puts("map\tentries\tbytes/entry\tbuild ms\tget ns\tscan ns/entry"
+            "\tput ns (+10%)");
+    for (int n = 0; n < 3; n++)
+    {
+        int elem_num = elem_nums[n];
+        long long base = live_bytes;
+        Timer build_timer;
+        TreeMap<int, int> *tree = new TreeMap<int, int>();
+        for (int i = 0; i < elem_num; i++) tree -> put(keys[i], i);
+        double build_s = build_timer.elapsed();
+        long long tree_bytes = live_bytes - base;
+        bench_flat_map<FlatTreeMap<int, int> >("FlatTreeMap", tree, keys,
+                                                elem_num);
+        bench_flat_map<FlatTreeMap<int, int, true> >("Eytzinger", tree,
+                                                    keys, elem_num);
+        time_flat_reads("TreeMap", tree, keys, elem_num, tree_bytes, build_s);
+        time_flat_puts(tree, keys + elem_num, elem_num / 10);
+        delete tree;
+    }
+    delete[] keys;
+}
+/*}}}*/
+
+/*{{{ Write buffering */
+template <class Map>
+double time_lsm_gets(const Map *map, const int *keys, int key_num) {
+    /**
+     * @brief Returns the ns per containsKey() and get() of keys drawn at
+     * random from keys.
+     */
+    FastRand rnd(3);
+    long long sum = 0, gets = 0;
+    Timer timer;
+    while (timer.elapsed() < 0.5)
+    {
+        for (int i = 0; i < 1024; i++)
+        {
+            int k = keys[rnd.next() % key_num];
+            if (map -> containsKey(k)) sum += map -> get(k);
+        }
+        gets += 1024;
+    }
+    if (sum == 42) puts("");
+    return timer.elapsed() * 1e9 / gets;
+}
+
+void bench_lsm() {
+    /**
+     * @brief Compare put() of random new keys into a TreeMap and into an
+     * LSMTreeMap, whose put() is a blind write, then the lookups of present
+     * and of absent keys, with the runs the LSMTreeMap searched per lookup
+     * and the entries its merges wrote per put().
+     */
+    const int elem_nums[] = {100000, 1000000, 10000000};
+    const int MAX_NUM = 20000000;
+    int *keys = new int[MAX_NUM];
+    FastRand rnd(1);
+    for (int i = 0; i < MAX_NUM; i++) keys[i] = (int)rnd.next(); // distinct
+    puts("== TreeMap (treap) vs. LSMTreeMap (write buffer + leveled runs)");
+    puts("map\tentries\tput ns\twrite amp\thit ns\thit read amp"
+            "\tmiss ns\tmiss read amp");
+    for (int n = 0; n < 3; n++)
+    {
+        int elem_num = elem_nums[n];
+        const int *absent = keys + MAX_NUM - elem_num;
+        LSMTreeMap<int, int, HashInt> *lsm =
+            new LSMTreeMap<int, int, HashInt>();
+        Timer lsm_timer;
+        for (int i = 0; i < elem_num; i++) lsm -> put(keys[i], i);
+        double put_ns = lsm_timer.elapsed() * 1e9 / elem_num;
+        double write_amp = lsm -> writeAmplification();
+        lsm -> resetStats();
+        double hit_ns = time_lsm_gets(lsm, keys, elem_num);
+        double hit_amp = lsm -> readAmplification();
+        lsm -> resetStats();
+        double miss_ns = time_lsm_gets(lsm, absent, elem_num);
+        printf("LSMTreeMap\t%d\t%.1f\t%.2f\t%.1f\t%.2f\t%.1f\t%.2f\n",
+                elem_num, put_ns, write_amp, hit_ns, hit_amp, miss_ns,
+                lsm -> readAmplification());
+        delete lsm;
+
+        TreeMap<int, int> *tree = new TreeMap<int, int>();
+        Timer tree_timer;
+        for (int i = 0; i < elem_num; i++) tree -> put(keys[i], i);
+        put_ns = tree_timer.elapsed() * 1e9 / elem_num;
+        printf("TreeMap\t%d\t%.1f\t-\t%.1f\t-\t%.1f\t-\n", elem_num,
+                put_ns, time_lsm_gets(tree, keys, elem_num),
+                time_lsm_gets(tree, absent, elem_num));
+        delete tree;
+    }
+    delete[] keys;
+}
+/*}}}*/
+
+struct Suite {
+    const char *name;
+    void (*run)();
+};
+
+const Suite suites[] = {
+    {"concurrent_hashmap", bench_concurrent_hashmap},
+    {"readmostly_hashmap", bench_readmostly_hashmap},
+    {"snapshot", bench_snapshot},
+    {"image", bench_image},
+    {"cache", bench_cache},
+    {"hashmap_stats", bench_hashmap_stats},
+    {"bloom", bench_bloom},
+    {"inthashmap", bench_inthashmap},
+    {"groupby", bench_groupby},
+    {"value_index", bench_value_index},
+    {"range_scan", bench_range_scan},
+    {"order_statistics", bench_order_statistics},
+    {"bulk_load", bench_bulk_load},
+    {"split_join", bench_split_join},
+    {"btree", bench_btree},
+    {"persistent", bench_persistent},
+    {"skiplist", bench_skiplist},
+    {"insert_patterns", bench_insert_patterns},
+    {"range_aggregate", bench_range_aggregate},
+    {"balance", bench_balance},
+    {"radix", bench_radix},
+    {"flat", bench_flat},
+    {"lsm", bench_lsm},
+};
+
+int main(int argc, char **argv) {
+    int suite_num = sizeof(suites) / sizeof(suites[0]);
+    for (int i = 0; i < suite_num; i++)
+    {
+        bool selected = argc == 1;
+        for (int j = 1; j < argc; j++)
+            if (strcmp(argv[j], suites[i].name) == 0) selected = true;
+        if (selected) suites[i].run();
+    }
+    return 0;
+}
@@ -28,12 +28,31 @@
 #include "TreeMap.h"
 #include "ArrayList.h"
 #include "LinkedList.h"
+#include "ConcurrentHashMap.h"
+#include "ReadMostlyHashMap.h"
+#include "HashMapView.h"
+#include "Cache.h"
+#include "ConcurrentCache.h"
+#include "BloomFilteredMap.h"
+#include "IntHashMap.h"
+#include "GroupBy.h"
+#include "ValueIndexedMap.h"
+#include "BTreeMap.h"
+#include "PersistentTreeMap.h"
+#include "ConcurrentSkipListMap.h"
+#include "RadixTreeMap.h"
+#include "FlatTreeMap.h"
+#include "LSMTreeMap.h"
 
 #include <cstdlib>
 #include <vector>
 #include <ctime>
 #include <set>
+#include <map>
+#include <list>
 #include <algorithm>
+#include <pthread.h>
+#include <unistd.h>
 
 using UnitTest::TestCase;
 using UnitTest::TestFixture;
@@ -45,6 +64,8 @@ using std::vector;
 using std::pair;
 using std::sort;
 using std::set;
+using std::map;
+using std::list;
 
 template <class List>
 class ListTest : public TestCase {/*{{{*/
@@ -378,6 +399,8 @@ class MapTest: public TestCase { /*{{{*/
 
 		void tear_down() {
 			delete map_ptr;
+			/* free the nodes retired by the lock-free maps */
+			EpochManager::instance().synchronize();
             this -> stop_memory_watching();
 		}
 };/*}}}*/
@@ -585,4 +608,2616 @@ class MapTestAllRandomly: public MapTest <Map> {/*{{{*/
 			puts("OK\n");
 		}
 };/*}}}*/ /*}}}*/
+
+template <class Map, bool COW = false>
+class MapTestCopy: public MapTest <Map> {/*{{{*/
+	private:
+		int times;
+
+		void _check_same(const Map &map, const vector <pair <int, int> > &events) {
+			if (map.size() != (int)events.size()) {
+				throw TestException("Ooooops, the size() function "\
+						"goes wrong after copying!!!");
+			}
+			for (int i = 0; i < (int)events.size(); i++) {
+				if (!map.containsKey(events[i].first) ||
+						map.get(events[i].first) != events[i].second) {
+					throw TestException("Ooooops, the copy of the Map "\
+							"differs from the original!!!");
+				}
+			}
+			int counter = 0;
+			for (typename Map::Iterator it = map.iterator(); it.hasNext(); it.next()) {
+				counter++;
+			}
+			if (counter != (int)events.size()) {
+				throw TestException("Ooooops, the Iterator of the copied Map "\
+						"goes wrong!!!");
+			}
+		}
+
+	public:
+		MapTestCopy(int _times, TestFixture *_fixture):
+			MapTest <Map>("MapTestCopy", _fixture), times(_times) {}
+		MapTestCopy(string case_name, int _times, TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test copying...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			vector <pair <int, int> > events, changed;
+			for (int i = 0; i < times; i++) {
+				events.push_back(make_pair(i * 7, rand()));
+				this->map_ptr->put(events[i].first, events[i].second);
+			}
+
+			if (COW) {
+				/* a copy-on-write map detaches from its copy on put(), and
+				 * an iterator taken before goes on over the copy */
+				puts("checking an iterator taken before copying:");
+				typename Map::Iterator it = this->map_ptr->iterator();
+				Map *shared = new Map(*this->map_ptr);
+				this->map_ptr->put(-1, 0);
+				int counter = 0;
+				for (; it.hasNext() && counter <= times; it.next()) {
+					counter++;
+				}
+				if (counter != times) {
+					throw TestException("Ooooops, the Iterator taken "\
+							"before copying goes wrong!!!");
+				}
+				delete shared;
+				this->map_ptr->remove(-1);
+				try {
+					shared = new Map(*this->map_ptr);
+					shared->remove(-1);
+					throw TestException("Ooooops, remove() of an absent "\
+							"key did not throw!!!");
+				} catch (ElementNotExist) {
+					_check_same(*shared, events);
+					delete shared;
+				}
+			}
+
+			puts("checking copy-constructor & operator=:");
+			Map *copy = new Map(*this->map_ptr);
+			_check_same(*copy, events);
+			for (int i = 0; i < times; i++) {
+				if (i & 1) {
+					copy->remove(events[i].first);
+				} else {
+					changed.push_back(make_pair(events[i].first, -i));
+					copy->put(events[i].first, -i);
+				}
+			}
+			_check_same(*copy, changed);
+			_check_same(*this->map_ptr, events);
+
+			*copy = *this->map_ptr;
+			_check_same(*copy, events);
+			this->map_ptr->clear();
+			_check_same(*copy, events);
+			*this->map_ptr = *copy;
+			delete copy;
+			_check_same(*this->map_ptr, events);
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map, class View>
+class MapTestImage: public MapTest <Map> {/*{{{*/
+	private:
+		int times;
+
+	public:
+		MapTestImage(int _times, TestFixture *_fixture):
+			MapTest <Map>("MapTestImage", _fixture), times(_times) {}
+		MapTestImage(string case_name, int _times, TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test saving to an image...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			set <int> all_keys;
+			for (int i = 0; i < times; i++) {
+				int key = rand();
+				all_keys.insert(key);
+				this->map_ptr->put(key, ~key);
+			}
+			char path[] = "/tmp/sfpdsc_image_XXXXXX";
+			close(mkstemp(path));
+			this->map_ptr->save(path);
+
+			puts("checking the view of the image:");
+			{
+				View view(path, true);
+				if (view.size() != this->map_ptr->size()) {
+					throw TestException("Ooooops, the size() function "\
+							"of the View goes wrong!!!");
+				}
+				for (int i = 0; i < times; i++) {
+					int key = rand();
+					if (view.containsKey(key) != (all_keys.count(key) > 0)) {
+						throw TestException("Ooooops, the containsKey() function "\
+								"of the View goes wrong!!!");
+					}
+				}
+				int counter = 0;
+				for (typename View::Iterator it = view.iterator(); it.hasNext(); ) {
+					typename View::Entry tmp = it.next();
+					if (!all_keys.count(tmp.getKey()) || tmp.getValue() != ~tmp.getKey() ||
+							view.get(tmp.getKey()) != tmp.getValue()) {
+						throw TestException("Ooooops, the View gives wrong "\
+								"key-value pairs!!!");
+					}
+					counter++;
+				}
+				if (counter != (int)all_keys.size()) {
+					throw TestException("Ooooops, the Iterator of the View "\
+							"goes wrong!!!");
+				}
+
+				/* saving over the file must not truncate it under the view */
+				Map small;
+				small.put(1, ~1);
+				small.save(path);
+				counter = 0;
+				for (typename View::Iterator it = view.iterator(); it.hasNext(); it.next()) {
+					counter++;
+				}
+				if (counter != (int)all_keys.size()) {
+					throw TestException("Ooooops, saving over the image "\
+							"changes the View!!!");
+				}
+				this->map_ptr->save(path);
+			}
+			puts("OK\n");
+
+			puts("checking the checksums of the image:");
+			FILE *f = fopen(path, "r+b");
+			typename HashMapImage<int, int>::Header header;
+			if (fread(&header, sizeof(header), 1, f) != 1) {
+				throw TestException("Ooooops, the image is truncated!!!");
+			}
+			fseek(f, header.entry_offset + 4, SEEK_SET);
+			int c = fgetc(f);
+			fseek(f, header.entry_offset + 4, SEEK_SET);
+			fputc(c ^ 1, f);
+			fclose(f);
+			bool flag = false;
+			try {
+				View view(path, true);
+			} catch (IOError) {
+				flag = true;
+			}
+			remove(path);
+			if (!flag) {
+				throw TestException("Ooooops, the broken image is not detected!!!");
+			}
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestStats: public MapTest <Map> {/*{{{*/
+	private:
+		int times, max_chain;
+
+	public:
+		MapTestStats(string case_name, int _times, int _max_chain,
+				TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture),
+			times(_times), max_chain(_max_chain) {}
+
+		void set_up() {
+			puts("== Now Preparing to test the statistics...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			for (int i = 0; i < times; i++) {
+				this->map_ptr->put(i, i);
+			}
+			for (int i = 0; i < times; i++) {
+				if (!this->map_ptr->containsKey(i) ||
+						this->map_ptr->get(i) != i) {
+					throw TestException("Ooooops, the Map goes wrong "\
+							"with the statistics enabled!!!");
+				}
+			}
+
+			puts("checking the shape of the table:");
+			HashMapStats st = this->map_ptr->stats();
+			long long bucket_sum = 0, elem_sum = 0;
+			for (int i = 0; i < HashMapStats::HIST_SIZE; i++) {
+				bucket_sum += st.chain_hist[i];
+				elem_sum += st.chain_hist[i] * i;
+			}
+			if (st.elem_num != times || st.max_chain != max_chain ||
+					bucket_sum != st.bucket_num ||
+					st.occupied_bucket_num != st.bucket_num - st.chain_hist[0] ||
+					(max_chain < HashMapStats::HIST_SIZE && elem_sum != times) ||
+					st.memory_bytes <= 0) {
+				throw TestException("Ooooops, the statistics of "\
+						"the table are wrong!!!");
+			}
+
+			puts("checking the lookup counters:");
+			/* each containsKey() and get() takes one lookup, comparing at
+			 * least one key; put() is not counted */
+			if (st.lookup_num != times * 2LL || st.probe_num < times * 2LL ||
+					st.max_probe > max_chain || st.max_probe < 1) {
+				throw TestException("Ooooops, the lookup counters "\
+						"are wrong!!!");
+			}
+			this->map_ptr->resetStats();
+			this->map_ptr->remove(0);
+			if (this->map_ptr->containsKey(0)) {
+				throw TestException("Ooooops, the remove() function "\
+						"goes wrong!!!");
+			}
+			st = this->map_ptr->stats();
+			if (st.lookup_num != 1 || st.elem_num != times - 1) {
+				throw TestException("Ooooops, resetStats() goes wrong!!!");
+			}
+			char expected[64];
+			sprintf(expected, "\"elements\": %d,", times - 1);
+			if (st.toJSON().find(expected) == string::npos) {
+				throw TestException("Ooooops, the JSON dump goes wrong!!!");
+			}
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestBloom: public MapTest <Map> {/*{{{*/
+	private:
+		int times;
+
+		void _check_keys(int upper) {
+			/* the even keys below upper are present, the others absent */
+			for (int i = 0; i < times * 4; i++) {
+				if (this->map_ptr->containsKey(i) != (i < upper && i % 2 == 0)) {
+					throw TestException("Ooooops, the containsKey() function "\
+							"goes wrong behind the filter!!!");
+				}
+			}
+		}
+
+	public:
+		MapTestBloom(string case_name, int _times, TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test the Bloom filter...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			for (int i = 0; i < times * 2; i += 2) {
+				this->map_ptr->put(i, i);
+			}
+			_check_keys(times * 2);
+			puts("checking the false-positive rate:");
+			if (this->map_ptr->falsePositiveRate() > 0.05 ||
+					this->map_ptr->estimatedFalsePositiveRate() > 0.05 ||
+					this->map_ptr->filterBytes() <= 0) {
+				throw TestException("Ooooops, the filter lets "\
+						"too many absent keys pass!!!");
+			}
+
+			puts("checking the rebuilding after remove():");
+			for (int i = times; i < times * 2; i += 2) {
+				this->map_ptr->remove(i);
+			}
+			_check_keys(times);
+			try {
+				this->map_ptr->remove(times + 1);
+				throw TestException("Ooooops, remove() an absent key "\
+						"does not throw!!!");
+			} catch (ElementNotExist &) {}
+			this->map_ptr->clear();
+			_check_keys(0);
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestValueIndex: public MapTest <Map> {/*{{{*/
+	private:
+		static const int VALUE_NUM = 37;
+		int times;
+
+		void _check_index(const vector <int> &value_of) {
+			/* value_of[k] is the value of key k, or -1 if k is absent */
+			vector <int> count(VALUE_NUM + 1, 0);
+			for (int k = 0; k < (int)value_of.size(); k++) {
+				if (value_of[k] >= 0) {
+					count[value_of[k]]++;
+				}
+			}
+			for (int v = 0; v <= VALUE_NUM; v++) {
+				if (this->map_ptr->containsValue(v) != (count[v] > 0) ||
+						this->map_ptr->countValue(v) != count[v]) {
+					throw TestException("Ooooops, the containsValue() function "\
+							"goes wrong with the value index!!!");
+				}
+				ArrayList <int> keys = this->map_ptr->getKeysForValue(v);
+				if (keys.size() != count[v]) {
+					throw TestException("Ooooops, getKeysForValue() "\
+							"misses some keys!!!");
+				}
+				for (int i = 0; i < keys.size(); i++) {
+					if (value_of[keys.get(i)] != v) {
+						throw TestException("Ooooops, getKeysForValue() "\
+								"returns a wrong key!!!");
+					}
+				}
+			}
+		}
+
+	public:
+		MapTestValueIndex(string case_name, int _times, TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test the value index...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			vector <int> value_of(times, -1);
+			for (int i = 0; i < times; i++) {
+				value_of[i] = i % VALUE_NUM;
+				this->map_ptr->put(i, value_of[i]);
+			}
+			_check_index(value_of);
+
+			puts("checking the index after changing & removing:");
+			for (int i = 0; i < times * 4; i++) {
+				int k = rand() % times;
+				if (rand() % 3 == 0) {
+					if (value_of[k] >= 0) {
+						this->map_ptr->remove(k);
+						value_of[k] = -1;
+					}
+				} else {
+					value_of[k] = rand() % VALUE_NUM;
+					this->map_ptr->put(k, value_of[k]);
+				}
+			}
+			_check_index(value_of);
+			this->map_ptr->clear();
+			_check_index(vector <int>(times, -1));
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestNavigation: public MapTest <Map> {/*{{{*/
+	private:
+		int times;
+		map <int, int> std_map;
+
+		template <class Nav>
+		bool _throws(const Map &m, Nav nav, int key) {
+			try {
+				(m.*nav)(key);
+			} catch (ElementNotExist) {
+				return true;
+			}
+			return false;
+		}
+
+		void _check_key(bool exists, int expected, bool thrown, int actual,
+						const char *name) {
+			if (exists ? thrown || actual != expected : !thrown) {
+				char buf[128];
+				sprintf(buf, "Ooooops, the %s() function goes wrong!!!", name);
+				throw TestException(buf);
+			}
+		}
+
+		void _check_nav(int key) {
+			const Map &m = *this->map_ptr;
+			typedef const int &(Map::*Nav)(const int &) const;
+			map <int, int>::iterator up = std_map.upper_bound(key);
+			map <int, int>::iterator lo = std_map.lower_bound(key);
+			Nav navs[4] = {&Map::floorKey, &Map::lowerKey,
+							&Map::ceilingKey, &Map::higherKey};
+			const char *names[4] = {"floorKey", "lowerKey",
+							"ceilingKey", "higherKey"};
+			/* the key floorKey() returns is right before upper_bound(), and
+			 * so on */
+			map <int, int>::iterator bound[4] = {up, lo, lo, up};
+			bool exists[4] = {up != std_map.begin(), lo != std_map.begin(),
+							lo != std_map.end(), up != std_map.end()};
+			for (int i = 0; i < 4; i++) {
+				bool thrown = _throws(m, navs[i], key);
+				int expected = 0, actual = 0;
+				if (exists[i]) {
+					expected = (i < 2 ? --bound[i] : bound[i]) -> first;
+				}
+				if (!thrown) actual = (m.*navs[i])(key);
+				_check_key(exists[i], expected, thrown, actual, names[i]);
+			}
+		}
+
+		void _check_range(typename Map::SubMap range, int lo, int hi,
+							bool has_lo, bool has_hi) {
+			map <int, int>::iterator it = has_lo ? std_map.lower_bound(lo) :
+				std_map.begin();
+			map <int, int>::iterator end = has_hi ? std_map.lower_bound(hi) :
+				std_map.end();
+			if (has_lo && has_hi && hi < lo) it = end;
+			if (range.isEmpty() != (it == end)) {
+				throw TestException("Ooooops, the isEmpty() function of the "\
+						"view goes wrong!!!");
+			}
+			for (typename Map::SubMap::Iterator vi = range.iterator();
+					vi.hasNext(); ++it) {
+				typename Map::Entry e = vi.next();
+				if (it == end || e.getKey() != it -> first ||
+						e.getValue() != it -> second) {
+					throw TestException("Ooooops, the view iterates a wrong "\
+							"mapping!!!");
+				}
+			}
+			if (it != end) {
+				throw TestException("Ooooops, the view misses some "\
+						"mappings!!!");
+			}
+		}
+
+	public:
+		MapTestNavigation(string case_name, int _times,
+							TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test the navigation...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			std_map.clear();
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			int range = times * 4;
+			for (int i = 0; i < times; i++) {
+				int k = rand() % range, v = rand();
+				this->map_ptr->put(k, v);
+				std_map[k] = v;
+			}
+			puts("checking floorKey(), ceilingKey(), lowerKey(), higherKey():");
+			for (int i = 0; i < times; i++) {
+				_check_nav(rand() % (range + 2) - 1);
+			}
+			puts("checking subMap(), headMap(), tailMap():");
+			for (int i = 0; i < times / 10; i++) {
+				int lo = rand() % (range + 2) - 1;
+				int hi = lo + rand() % 100 - 10;
+				_check_range(this->map_ptr->subMap(lo, hi), lo, hi, true, true);
+				if (i % 100 == 0) {
+					_check_range(this->map_ptr->headMap(hi), lo, hi,
+									false, true);
+					_check_range(this->map_ptr->tailMap(lo), lo, hi,
+									true, false);
+				}
+				int k = lo + rand() % 10;
+				if (this->map_ptr->subMap(lo, hi).containsKey(k) !=
+						(k >= lo && k < hi && std_map.count(k))) {
+					throw TestException("Ooooops, the containsKey() function "\
+							"of the view goes wrong!!!");
+				}
+			}
+			puts("checking pollFirst(), pollLast():");
+			while (!std_map.empty()) {
+				bool first = rand() & 1;
+				map <int, int>::iterator it = first ? std_map.begin() :
+					--std_map.end();
+				if ((first ? this->map_ptr->firstKey() :
+						this->map_ptr->lastKey()) != it -> first) {
+					throw TestException("Ooooops, the firstKey() or lastKey() "\
+							"function goes wrong!!!");
+				}
+				typename Map::Entry e = first ? this->map_ptr->pollFirst() :
+					this->map_ptr->pollLast();
+				if (e.getKey() != it -> first || e.getValue() != it -> second) {
+					throw TestException("Ooooops, the pollFirst() or "\
+							"pollLast() function goes wrong!!!");
+				}
+				std_map.erase(it);
+				if (this->map_ptr->size() != (int)std_map.size()) {
+					throw TestException("Ooooops, pollFirst() or pollLast() "\
+							"leaves a wrong size!!!");
+				}
+			}
+			bool thrown = false;
+			try {
+				this->map_ptr->pollFirst();
+			} catch (ElementNotExist) {
+				thrown = true;
+			}
+			if (!thrown || !_throws(*this->map_ptr, &Map::ceilingKey, 0)) {
+				throw TestException("Ooooops, an empty map returns a key!!!");
+			}
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestRank: public MapTest <Map> {/*{{{*/
+	private:
+		int times;
+		map <int, int> std_map;
+
+		void _check_rank(const Map &m) {
+			if (m.size() != (int)std_map.size()) {
+				throw TestException("Ooooops, the size() function goes "\
+						"wrong!!!");
+			}
+			int k = 0;
+			for (map <int, int>::iterator it = std_map.begin();
+					it != std_map.end(); ++it, k++) {
+				if (m.select(k) != it -> first || m.rank(it -> first) != k ||
+						m.rank(it -> first + 1) != k + 1) {
+					throw TestException("Ooooops, the rank() or select() "\
+							"function goes wrong!!!");
+				}
+			}
+			bool thrown = false;
+			try {
+				m.select(k);
+			} catch (IndexOutOfBound) {
+				thrown = true;
+			}
+			if (!thrown) {
+				throw TestException("Ooooops, select() returns a key out of "\
+						"the map!!!");
+			}
+		}
+
+	public:
+		MapTestRank(string case_name, int _times, TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test the order statistics...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			std_map.clear();
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			int range = times / 2;
+			puts("checking rank(), select() after random put & remove:");
+			for (int i = 0; i < times * 4; i++) {
+				int k = rand() % range, v = rand();
+				if (rand() % 3 == 0) {
+					/* removing an absent key must not change the sizes */
+					try {
+						this->map_ptr->remove(k);
+					} catch (ElementNotExist) {}
+					std_map.erase(k);
+				} else {
+					this->map_ptr->put(k, v);
+					std_map[k] = v;
+				}
+			}
+			_check_rank(*this->map_ptr);
+			Map copy = *this->map_ptr;
+			copy.put(range, 0);
+			_check_rank(*this->map_ptr);
+
+			puts("checking countRange() and the size of subMap():");
+			for (int i = 0; i < times; i++) {
+				int lo = rand() % (range + 2) - 1;
+				int hi = lo + rand() % 100 - 10;
+				int expected = 0;
+				if (lo <= hi) {
+					expected = distance(std_map.lower_bound(lo),
+										std_map.lower_bound(hi));
+				}
+				if (this->map_ptr->countRange(lo, hi) != expected ||
+						this->map_ptr->subMap(lo, hi).size() != expected) {
+					throw TestException("Ooooops, the countRange() function "\
+							"goes wrong!!!");
+				}
+			}
+			if (this->map_ptr->headMap(range / 2).size() !=
+					this->map_ptr->rank(range / 2) ||
+					this->map_ptr->tailMap(-1).size() !=
+					this->map_ptr->size()) {
+				throw TestException("Ooooops, the size() function of the "\
+						"view goes wrong!!!");
+			}
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestBuildSorted: public MapTest <Map> {/*{{{*/
+	private:
+		int times;
+		map <int, int> std_map;
+
+		void _check_same(const Map &m) {
+			if (m.size() != (int)std_map.size()) {
+				throw TestException("Ooooops, the bulk load leaves a wrong "\
+						"size!!!");
+			}
+			int k = 0;
+			typename Map::Iterator it = m.iterator();
+			for (map <int, int>::iterator sit = std_map.begin();
+					sit != std_map.end(); ++sit, k++) {
+				typename Map::Entry e = it.next();
+				if (e.getKey() != sit -> first ||
+						e.getValue() != sit -> second ||
+						m.get(sit -> first) != sit -> second ||
+						m.select(k) != sit -> first) {
+					throw TestException("Ooooops, the bulk load builds a "\
+							"wrong tree!!!");
+				}
+			}
+			if (it.hasNext()) {
+				throw TestException("Ooooops, the bulk load leaves extra "\
+						"mappings!!!");
+			}
+		}
+
+	public:
+		MapTestBuildSorted(string case_name, int _times,
+							TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test the bulk load...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			std_map.clear();
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			vector <int> keys, vals;
+			for (int i = 0; i < times; i++) {
+				keys.push_back(i * 3);
+				vals.push_back(rand());
+				std_map[i * 3] = vals[i];
+			}
+			puts("checking buildFromSorted():");
+			this->map_ptr->put(-1, 0);
+			this->map_ptr->buildFromSorted(&keys[0], &vals[0], times);
+			_check_same(*this->map_ptr);
+
+			puts("checking putAllSorted() with duplicates & disorder:");
+			keys.clear();
+			vals.clear();
+			for (int i = 0; i < times; i++) {
+				/* mostly ascending, sometimes repeating or going back */
+				int k = keys.empty() ? 0 : keys.back() + rand() % 5;
+				if (rand() % 50 == 0) {
+					k = rand() % (times * 3);
+				}
+				keys.push_back(k);
+				vals.push_back(rand());
+				std_map[k] = vals.back();
+			}
+			this->map_ptr->putAllSorted(&keys[0], &vals[0], times);
+			_check_same(*this->map_ptr);
+
+			puts("checking buildFromSorted() from an iterator:");
+			Map copy;
+			copy.buildFromSorted(this->map_ptr->iterator());
+			_check_same(copy);
+			for (map <int, int>::iterator it = std_map.begin();
+					it != std_map.end(); ++it) {
+				if (rand() & 1) {
+					copy.remove(it -> first);
+				}
+			}
+			copy.putAllSorted(this->map_ptr->iterator());
+			_check_same(copy);
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestSplitJoin: public MapTest <Map> {/*{{{*/
+	private:
+		int times;
+
+		void _check_same(const Map &m, const map <int, int> &expected) {
+			if (m.size() != (int)expected.size()) {
+				throw TestException("Ooooops, the map gets a wrong size!!!");
+			}
+			int k = 0;
+			typename Map::Iterator it = m.iterator();
+			for (map <int, int>::const_iterator sit = expected.begin();
+					sit != expected.end(); ++sit, k++) {
+				typename Map::Entry e = it.next();
+				if (e.getKey() != sit -> first ||
+						e.getValue() != sit -> second ||
+						m.get(sit -> first) != sit -> second ||
+						m.select(k) != sit -> first) {
+					throw TestException("Ooooops, the map gets a wrong "\
+							"mapping!!!");
+				}
+			}
+			if (it.hasNext()) {
+				throw TestException("Ooooops, the map keeps extra "\
+						"mappings!!!");
+			}
+			if (!expected.empty() &&
+					(m.firstKey() != expected.begin() -> first ||
+					 m.lastKey() != (--expected.end()) -> first)) {
+				throw TestException("Ooooops, the threaded list is "\
+						"broken!!!");
+			}
+		}
+
+		void _fill(Map &m, map <int, int> &expected, int num, int range) {
+			for (int i = 0; i < num; i++) {
+				int k = rand() % range, v = rand();
+				m.put(k, v);
+				expected[k] = v;
+			}
+		}
+
+	public:
+		MapTestSplitJoin(string case_name, int _times,
+							TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test split & join...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			Map &m = *this->map_ptr;
+			map <int, int> all, hi_part;
+			_fill(m, all, times, times * 2);
+
+			puts("checking split() and join():");
+			for (int i = 0; i < 20; i++) {
+				int key = rand() % (times * 2 + 2) - 1;
+				Map hi = m.split(key);
+				hi_part.clear();
+				hi_part.insert(all.lower_bound(key), all.end());
+				map <int, int> lo_part(all.begin(), all.lower_bound(key));
+				_check_same(m, lo_part);
+				_check_same(hi, hi_part);
+				if (i & 1) {
+					m.join(hi);
+				} else {
+					hi.join(m);
+					m = hi;
+					hi.clear();
+				}
+				_check_same(m, all);
+				_check_same(hi, map <int, int>());
+			}
+			Map other;
+			map <int, int> both = all;
+			_fill(other, both, times / 10, times * 2);
+			m.join(other); // overlapping
+			_check_same(m, both);
+			_check_same(other, map <int, int>());
+			all = both;
+
+			puts("checking removeRange():");
+			for (int i = 0; i < 20; i++) {
+				int lo = rand() % (times * 2), hi = lo + rand() % (times / 5);
+				int num = distance(all.lower_bound(lo), all.lower_bound(hi));
+				map <int, int> before = all;
+				all.erase(all.lower_bound(lo), all.lower_bound(hi));
+				Map copy = m; // must not see the removal
+				if (m.removeRange(lo, hi) != num ||
+						m.removeRange(hi, lo) != 0) {
+					throw TestException("Ooooops, removeRange() removes a "\
+							"wrong number of mappings!!!");
+				}
+				_check_same(m, all);
+				_check_same(copy, before);
+				m.put(lo, 1);
+				m.remove(lo);
+			}
+
+			puts("checking putAll():");
+			int thread_nums[3] = {1, 4, 3};
+			for (int i = 0; i < 3; i++) {
+				other.clear();
+				both = all;
+				map <int, int> other_part;
+				_fill(other, other_part, times, times * 2);
+				for (map <int, int>::iterator it = other_part.begin();
+						it != other_part.end(); ++it) {
+					both[it -> first] = it -> second;
+				}
+				Map copy = other;
+				m.putAll(other, thread_nums[i]);
+				_check_same(m, both);
+				_check_same(copy, other_part);
+				all = both;
+			}
+			other.clear();
+			both = all;
+			_fill(other, both, 100, times * 4); // put one by one
+			m.putAll(other);
+			_check_same(m, both);
+			Map copy = m;
+			m.putAll(copy);
+			_check_same(m, both);
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestAllocCount: public MapTest <Map> {/*{{{*/
+	private:
+		int times;
+
+		void _expect_allocs(int base, int expected, const char *name) {
+			if (total_alloc_cnt - base != expected) {
+				char buf[128];
+				sprintf(buf, "Ooooops, %s allocates %d times instead of "\
+						"%d!!!", name, total_alloc_cnt - base, expected);
+				throw TestException(buf);
+			}
+		}
+
+	public:
+		MapTestAllocCount(string case_name, int _times,
+							TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to count the allocations...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			vector <int> keys;
+			for (int i = 0; i < times; i++) {
+				keys.push_back(i);
+			}
+			random_shuffle(keys.begin(), keys.end());
+			puts("checking put() of new keys allocates once each:");
+			int base = total_alloc_cnt;
+			for (int i = 0; i < times; i++) {
+				this->map_ptr->put(keys[i], i);
+			}
+			_expect_allocs(base, times, "put()");
+			puts("checking put() of present keys does not allocate:");
+			base = total_alloc_cnt;
+			for (int i = 0; i < times; i++) {
+				this->map_ptr->put(keys[i], -i);
+			}
+			_expect_allocs(base, 0, "put()");
+			puts("checking remove() only frees the nodes:");
+			base = total_alloc_cnt;
+			for (int i = 0; i < times; i++) {
+				this->map_ptr->remove(keys[i]);
+			}
+			_expect_allocs(base, -times, "remove()");
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestHintedPut: public MapTest <Map> {/*{{{*/
+	private:
+		int times;
+		map <int, int> std_map;
+
+		void _check(const Map &m) {
+			if (m.size() != (int)std_map.size()) {
+				throw TestException("Ooooops, the size() function goes "\
+						"wrong!!!");
+			}
+			typename Map::Iterator it = m.iterator();
+			int k = 0;
+			for (map <int, int>::iterator sit = std_map.begin();
+					sit != std_map.end(); ++sit, k++) {
+				typename Map::Entry e = it.next();
+				if (e.getKey() != sit -> first ||
+						e.getValue() != sit -> second) {
+					throw TestException("Ooooops, the put() function "\
+							"goes wrong!!!");
+				}
+				if (k % 7 == 0 && (m.select(k) != sit -> first ||
+							m.rank(sit -> first) != k)) {
+					throw TestException("Ooooops, the rank() or select() "\
+							"function goes wrong!!!");
+				}
+			}
+			if (it.hasNext()) {
+				throw TestException("Ooooops, the iterator goes wrong!!!");
+			}
+		}
+
+		void _put(int k, int v) {
+			this->map_ptr->put(k, v);
+			std_map[k] = v;
+		}
+
+	public:
+		MapTestHintedPut(string case_name, int _times,
+							TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test the hinted put...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			std_map.clear();
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			puts("checking put() of ascending and descending keys:");
+			for (int i = 0; i < times; i++) {
+				_put(i * 4, i);
+			}
+			for (int i = times; i > 0; i--) {
+				_put(i * 4 - 2, i);
+			}
+			_check(*this->map_ptr);
+
+			puts("checking put() of nearly sorted keys with removes:");
+			int base = total_alloc_cnt, added = 0;
+			for (int i = 0; i < times; i++) {
+				int k = i * 4 + 1 + (rand() % 16) * 4;
+				if (!std_map.count(k)) added++;
+				_put(k, -i);
+				if (rand() % 5 == 0) {
+					k = rand() % (times * 4);
+					try {
+						this->map_ptr->remove(k);
+					} catch (ElementNotExist) {}
+					if (std_map.erase(k)) added--;
+				}
+			}
+			/* std_map allocates a node for each new key as well */
+			if (total_alloc_cnt - base != added * 2) {
+				throw TestException("Ooooops, put() allocates more than "\
+						"the new nodes!!!");
+			}
+			_check(*this->map_ptr);
+
+			puts("checking put() with an iterator as the hint:");
+			for (int i = 0; i < times / 10; i++) {
+				typename Map::Iterator it = this->map_ptr->iterator();
+				int skip = rand() % 64;
+				for (int j = 0; j < skip && it.hasNext(); j++) {
+					it.next();
+				}
+				int k = skip * 4 + rand() % 9 - 4, v = rand();
+				if (rand() % 2) {
+					k = rand() % (times * 4);
+				}
+				this->map_ptr->put(it, k, v);
+				std_map[k] = v;
+			}
+			_check(*this->map_ptr);
+
+			puts("checking put() after copying and restructuring:");
+			for (int i = 0; i < times / 100; i++) {
+				Map copy = *this->map_ptr;
+				typename Map::Iterator it = this->map_ptr->iterator();
+				it.next();
+				int k = rand() % (times * 4);
+				switch (rand() % 4) {
+					case 0:
+						copy.put(it, k, 0);
+						break;
+					case 1: {
+						Map hi = this->map_ptr->split(k);
+						this->map_ptr->join(hi);
+						break;
+					}
+					case 2:
+						this->map_ptr->removeRange(k, k + 8);
+						std_map.erase(std_map.lower_bound(k),
+									std_map.lower_bound(k + 8));
+						break;
+					default:
+						this->map_ptr->putAll(copy);
+				}
+				_put(k + 1, i);
+				this->map_ptr->put(it, k + 2, i);
+				std_map[k + 2] = i;
+			}
+			_check(*this->map_ptr);
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestBalance: public MapTest <Map> {/*{{{*/
+	private:
+		int times;
+		double height_factor;
+		map <int, int> std_map;
+
+		void _check(const Map &m) {
+			/* the height should not exceed height_factor * log2(n + 2),
+			 * rounded up, unless height_factor is 0 */
+			if (m.size() != (int)std_map.size()) {
+				throw TestException("Ooooops, the size() function goes "\
+						"wrong!!!");
+			}
+			if (!m.isValid()) {
+				throw TestException("Ooooops, the tree breaks the "\
+						"invariant of its balancing policy!!!");
+			}
+			int lg = 1;
+			for (int n = m.size() + 2; n > 1; n >>= 1) {
+				lg++;
+			}
+			if (height_factor > 0 && m.height() > height_factor * lg) {
+				throw TestException("Ooooops, the tree is too deep!!!");
+			}
+		}
+
+		void _put(int k, int v) {
+			this->map_ptr->put(k, v);
+			std_map[k] = v;
+		}
+
+	public:
+		MapTestBalance(string case_name, int _times, double _height_factor,
+				TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times),
+			height_factor(_height_factor) {}
+
+		void set_up() {
+			puts("== Now Preparing to test the shape of the tree...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			std_map.clear();
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			Map *m = this->map_ptr;
+			puts("checking put() in ascending order:");
+			for (int i = 0; i < times; i++) {
+				_put(i, i);
+				if (i % (times / 8) == 0) {
+					_check(*m);
+				}
+			}
+			_check(*m);
+
+			puts("checking random put(), remove() and lookups:");
+			for (int i = 0; i < times; i++) {
+				int k = rand() % (times * 2);
+				switch (rand() % 3) {
+					case 0:
+						_put(k, i);
+						break;
+					case 1:
+						if (std_map.count(k)) {
+							m->remove(k);
+							std_map.erase(k);
+						}
+						break;
+					default:
+						if (m->containsKey(k) != (std_map.count(k) > 0) ||
+								(std_map.count(k) && m->get(k) != std_map[k])) {
+							throw TestException("Ooooops, the lookups go "\
+									"wrong!!!");
+						}
+				}
+				if (i % (times / 8) == 0) {
+					_check(*m);
+				}
+			}
+			_check(*m);
+
+			puts("checking split(), join() and putAllSorted():");
+			Map hi = m->split(times);
+			if (!hi.isValid()) {
+				throw TestException("Ooooops, split() breaks the tree!!!");
+			}
+			m->join(hi);
+			_check(*m);
+			Map more;
+			for (int i = 0; i < times / 4; i++) {
+				more.put(times * 2 + i, i);
+				std_map[times * 2 + i] = i;
+			}
+			m->putAllSorted(more.iterator());
+			_check(*m);
+
+			puts("checking remove() in descending order:");
+			for (int i = 0; !std_map.empty(); i++) {
+				int k = (--std_map.end())->first;
+				m->remove(k);
+				std_map.erase(k);
+				if (i % (times / 8) == 0) {
+					_check(*m);
+				}
+			}
+			_check(*m);
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map, class Monoid>
+class MapTestAggregate: public MapTest <Map> {/*{{{*/
+	private:
+		int times;
+		map <int, int> std_map;
+
+		bool _expected(int lo, int hi, typename Monoid::Acc &res) {
+			bool found = false;
+			for (map <int, int>::iterator it = std_map.lower_bound(lo);
+					it != std_map.end() && it -> first < hi; ++it) {
+				typename Monoid::Acc a = Monoid::of(it -> second);
+				res = found ? Monoid::combine(res, a) : a;
+				found = true;
+			}
+			return found;
+		}
+
+		void _check_range(int lo, int hi) {
+			typename Monoid::Acc expected = typename Monoid::Acc(), got;
+			bool found = _expected(lo, hi, expected), thrown = false;
+			try {
+				got = this->map_ptr->aggregate(lo, hi);
+			} catch (ElementNotExist) {
+				thrown = true;
+			}
+			if (thrown == found || (found && !(got == expected))) {
+				throw TestException("Ooooops, the aggregate() function goes "\
+						"wrong!!!");
+			}
+		}
+
+	public:
+		MapTestAggregate(string case_name, int _times,
+							TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test the range aggregates...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			std_map.clear();
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			int range = times / 2;
+			puts("checking aggregate() after random put & remove:");
+			for (int i = 0; i < times; i++) {
+				int k = rand() % range, v = rand() % 1000 - 500;
+				if (rand() % 3 == 0) {
+					try {
+						this->map_ptr->remove(k);
+					} catch (ElementNotExist) {}
+					std_map.erase(k);
+				} else {
+					this->map_ptr->put(k, v);
+					std_map[k] = v;
+				}
+				if (i % 16 == 0) {
+					int lo = rand() % (range + 2) - 1;
+					_check_range(lo, lo + rand() % 200);
+				}
+			}
+			_check_range(-1, range);
+
+			puts("checking aggregate() over growing ranges:");
+			for (int len = 1; len <= range; len *= 2) {
+				for (int i = 0; i < 20; i++) {
+					int lo = rand() % range;
+					_check_range(lo, lo + len);
+				}
+			}
+
+			puts("checking aggregate() after the bulk operations:");
+			for (int i = 0; i < 10; i++) {
+				int k = rand() % range;
+				Map hi = this->map_ptr->split(k);
+				_check_range(k - 100, k);
+				this->map_ptr->join(hi);
+				this->map_ptr->removeRange(k, k + 50);
+				std_map.erase(std_map.lower_bound(k),
+							std_map.lower_bound(k + 50));
+				Map other;
+				for (int j = 0; j < 100; j++) {
+					int ok = rand() % range, ov = rand() % 1000;
+					other.put(ok, ov);
+					std_map[ok] = ov;
+				}
+				this->map_ptr->putAll(other);
+				_check_range(-1, range);
+				_check_range(k - 100, k + 100);
+			}
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestPersistent: public MapTest <Map> {/*{{{*/
+	private:
+		static const int VERSION_NUM = 64;
+		int times;
+
+		void _check_version(const Map &version, const map <int, int> &model) {
+			if (version.size() != (int)model.size()) {
+				throw TestException("Ooooops, the size() function "\
+						"goes wrong on an old version!!!");
+			}
+			typename Map::Iterator it = version.iterator();
+			for (map <int, int>::const_iterator mit = model.begin();
+					mit != model.end(); mit++) {
+				if (!it.hasNext()) {
+					throw TestException("Ooooops, the Iterator of the Map "\
+							"misses some elements!!!");
+				}
+				typename Map::Entry e = it.next();
+				if (e.getKey() != mit->first || e.getValue() != mit->second ||
+						version.get(mit->first) != mit->second) {
+					throw TestException("Ooooops, an old version "\
+							"has been modified!!!");
+				}
+			}
+			if (it.hasNext()) {
+				throw TestException("Ooooops, the Iterator of the Map "\
+						"returns extra elements!!!");
+			}
+		}
+
+	public:
+		MapTestPersistent(string case_name, int _times,
+							TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test the persistent versions...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			vector <Map> versions(VERSION_NUM, *this->map_ptr);
+			vector <map <int, int> > models(VERSION_NUM);
+			puts("deriving versions from random older ones:");
+			for (int i = 0; i < times; i++) {
+				int from = rand() % VERSION_NUM, to = rand() % VERSION_NUM;
+				int key = rand() % (times / 2);
+				const Map &src = versions[from];
+				map <int, int> model = models[from];
+				Map next;
+				if (rand() % 3 == 0) {
+					bool thrown = false;
+					try {
+						next = src.remove(key);
+					} catch (ElementNotExist) {
+						thrown = true;
+						next = src;
+					}
+					if (thrown != !model.count(key)) {
+						throw TestException("Ooooops, the remove() function "\
+								"goes wrong!!!");
+					}
+					model.erase(key);
+				} else {
+					next = src.put(key, i);
+					model[key] = i;
+				}
+				if (!model.empty() && next.get(model.begin()->first) !=
+						model.begin()->second) {
+					throw TestException("Ooooops, the get() function "\
+							"goes wrong!!!");
+				}
+				if (next.containsKey(key) != (model.count(key) > 0)) {
+					throw TestException("Ooooops, the containsKey() function "\
+							"goes wrong!!!");
+				}
+				if (i % (times / 16) == 0) {
+					_check_version(versions[to], models[to]);
+				}
+				versions[to] = next;
+				models[to] = model;
+			}
+			puts("checking no version has been modified:");
+			for (int i = 0; i < VERSION_NUM; i++) {
+				_check_version(versions[i], models[i]);
+			}
+			if (!this->map_ptr->isEmpty()) {
+				throw TestException("Ooooops, the initial version "\
+						"has been modified!!!");
+			}
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestSnapshot: public MapTest <Map> {/*{{{*/
+	private:
+		static const int READER_NUM = 4;
+		int times;
+		volatile bool writing;
+
+		struct Reader {
+			MapTestSnapshot *test;
+			int snapshot_num;
+			bool failed;
+		};
+
+		static void *_run_reader(void *arg) {
+			Reader *r = (Reader *)arg;
+			Map *map_ptr = r->test->map_ptr;
+			while (r->test->writing) {
+				/* the writer adds 0, 1, 2, ... then removes them in the
+				 * same order, so any snapshot holds a range of keys */
+				typename Map::Version v = map_ptr->snapshot();
+				typename Map::Version::Iterator it = v.iterator();
+				int first = -1, last = -1, cnt = 0;
+				while (it.hasNext()) {
+					typename Map::Version::Entry e = it.next();
+					if (e.getValue() != e.getKey() ||
+							(last >= 0 && e.getKey() != last + 1)) {
+						r->failed = true;
+					}
+					if (first < 0) first = e.getKey();
+					last = e.getKey();
+					cnt++;
+				}
+				if (cnt != v.size() || (cnt && !v.containsKey(first))) {
+					r->failed = true;
+				}
+				/* the writer may remove last at any moment, so the live map
+				 * is read in a single get() */
+				if (cnt) {
+					try {
+						if (map_ptr->get(last) != last) {
+							r->failed = true;
+						}
+					} catch (ElementNotExist) {}
+				}
+				r->snapshot_num++;
+			}
+			return NULL;
+		}
+
+	public:
+		MapTestSnapshot(string case_name, int _times, TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test snapshots under concurrent writes...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			pthread_t threads[READER_NUM];
+			Reader readers[READER_NUM];
+			writing = true;
+			for (int i = 0; i < READER_NUM; i++) {
+				readers[i].test = this;
+				readers[i].snapshot_num = 0;
+				readers[i].failed = false;
+				pthread_create(threads + i, NULL, _run_reader, readers + i);
+			}
+			typename Map::Version empty = this->map_ptr->snapshot();
+			for (int i = 0; i < times; i++) {
+				this->map_ptr->put(i, i);
+			}
+			typename Map::Version full = this->map_ptr->snapshot();
+			for (int i = 0; i < times; i++) {
+				this->map_ptr->remove(i);
+			}
+			writing = false;
+			for (int i = 0; i < READER_NUM; i++) {
+				pthread_join(threads[i], NULL);
+			}
+			puts("checking the snapshots taken during the writes:");
+			for (int i = 0; i < READER_NUM; i++) {
+				if (readers[i].failed) {
+					throw TestException("Ooooops, a snapshot is "\
+							"inconsistent!!!");
+				}
+			}
+			puts("checking the snapshots kept:");
+			if (!empty.isEmpty() || full.size() != times ||
+					!this->map_ptr->snapshot().isEmpty()) {
+				throw TestException("Ooooops, a snapshot has been "\
+						"modified!!!");
+			}
+			for (int i = 0; i < times; i++) {
+				if (full.get(i) != i) {
+					throw TestException("Ooooops, a snapshot has been "\
+							"modified!!!");
+				}
+			}
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestConcurrent: public MapTest <Map> {/*{{{*/
+	private:
+		static const int THREAD_NUM = 8;
+		int times;
+
+		struct CountingFactory {
+			int *cnt;
+			CountingFactory(int *_cnt) : cnt(_cnt) {}
+			int operator()(int key) {
+				__sync_fetch_and_add(cnt, 1);
+				return -key;
+			}
+		};
+
+		struct Worker {
+			MapTestConcurrent *test;
+			int id;
+			bool failed;
+		};
+
+		static void *_run_worker(void *arg) {
+			Worker *w = (Worker *)arg;
+			Map *map_ptr = w->test->map_ptr;
+			int times = w->test->times;
+			/* each thread owns the keys congruent to its id */
+			for (int i = 0; i < times; i++) {
+				map_ptr->put(i * THREAD_NUM + w->id, i);
+			}
+			/* read back while the others are still writing */
+			for (int i = 0; i < times; i++) {
+				if (!map_ptr->containsKey(i * THREAD_NUM + w->id)) {
+					w->failed = true;
+				}
+			}
+			/* all threads race on the same negative keys */
+			for (int i = 1; i <= times; i++) {
+				map_ptr->computeIfAbsent(-i, CountingFactory(&w->test->factory_cnt));
+			}
+			for (int i = 0; i < times; i += 2) {
+				map_ptr->remove(i * THREAD_NUM + w->id);
+			}
+			return NULL;
+		}
+
+	public:
+		int factory_cnt;
+
+		MapTestConcurrent(int _times, TestFixture *_fixture):
+			MapTest <Map>("MapTestConcurrent", _fixture), times(_times) {}
+		MapTestConcurrent(string case_name, int _times, TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test concurrent access...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			pthread_t threads[THREAD_NUM];
+			Worker workers[THREAD_NUM];
+			factory_cnt = 0;
+			for (int i = 0; i < THREAD_NUM; i++) {
+				workers[i].test = this;
+				workers[i].id = i;
+				workers[i].failed = false;
+				pthread_create(threads + i, NULL, _run_worker, workers + i);
+			}
+			for (int i = 0; i < THREAD_NUM; i++) {
+				pthread_join(threads[i], NULL);
+			}
+
+			puts("checking the result of concurrent put() & remove():");
+			for (int i = 0; i < THREAD_NUM; i++) {
+				if (workers[i].failed) {
+					throw TestException("Ooooops, the containsKey() function "\
+							"goes wrong during concurrent put()!!!");
+				}
+			}
+			if (factory_cnt != times) {
+				throw TestException("Ooooops, computeIfAbsent() is not atomic!!!");
+			}
+			if (this->map_ptr->size() != times + THREAD_NUM * (times / 2)) {
+				throw TestException("Ooooops, the size() function "\
+						"goes wrong!!!");
+			}
+			for (int i = 0; i < times; i++) {
+				for (int j = 0; j < THREAD_NUM; j++) {
+					int key = i * THREAD_NUM + j;
+					if (this->map_ptr->containsKey(key) != (i & 1)) {
+						throw TestException("Ooooops, the containsKey() function "\
+								"goes wrong!!!");
+					}
+					if ((i & 1) && this->map_ptr->get(key) != i) {
+						throw TestException("Ooooops, the get() function of the Map"\
+								"goes wrong!!!");
+					}
+				}
+				if (this->map_ptr->get(-i - 1) != i + 1) {
+					throw TestException("Ooooops, the get() function of the Map"\
+							"goes wrong!!!");
+				}
+			}
+			int counter = 0;
+			for (typename Map::Iterator it = this->map_ptr->iterator();
+					it.hasNext(); it.next()) {
+				counter++;
+			}
+			if (counter != this->map_ptr->size()) {
+				throw TestException("Ooooops, the Iterator of the Map "\
+						"misses some elements!!!");
+			}
+			puts("destroying a map while iterating it:");
+			{
+				Map *doomed = new Map();
+				doomed->put(1, 1);
+				typename Map::Iterator it = doomed->iterator();
+				/* must not wait for the epoch pinned by it */
+				delete doomed;
+			}
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestConcurrentOrdered: public MapTest <Map> {/*{{{*/
+	private:
+		static const int THREAD_NUM = 8;
+		int times;
+		volatile bool writing;
+
+		struct Worker {
+			MapTestConcurrentOrdered *test;
+			int id;
+			bool failed;
+		};
+
+		static void *_run_writer(void *arg) {
+			Worker *w = (Worker *)arg;
+			Map *map_ptr = w->test->map_ptr;
+			int times = w->test->times;
+			/* each thread owns the keys congruent to its id */
+			for (int i = 0; i < times; i++) {
+				map_ptr->put(i * THREAD_NUM + w->id, -i);
+				if (!map_ptr->containsKey(i * THREAD_NUM + w->id)) {
+					w->failed = true;
+				}
+			}
+			for (int i = 0; i < times; i += 2) {
+				map_ptr->remove(i * THREAD_NUM + w->id);
+			}
+			for (int i = 1; i < times; i += 2) {
+				map_ptr->put(i * THREAD_NUM + w->id, i);
+			}
+			return NULL;
+		}
+
+		static void *_run_reader(void *arg) {
+			Worker *w = (Worker *)arg;
+			Map *map_ptr = w->test->map_ptr;
+			int range = w->test->times * THREAD_NUM;
+			while (w->test->writing) {
+				/* the keys seen must be increasing, and a seek must not
+				 * return a key less than where it starts */
+				int lo = rand() % range, last = -1, cnt = 0;
+				for (typename Map::Iterator it = map_ptr->iterator(lo);
+						it.hasNext() && cnt < 100; cnt++) {
+					int key = it.next().getKey();
+					if (key < lo || key <= last) {
+						w->failed = true;
+					}
+					last = key;
+				}
+			}
+			return NULL;
+		}
+
+	public:
+		MapTestConcurrentOrdered(string case_name, int _times,
+									TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test concurrent ordered access...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			pthread_t threads[THREAD_NUM + 1];
+			Worker workers[THREAD_NUM + 1];
+			writing = true;
+			for (int i = 0; i <= THREAD_NUM; i++) {
+				workers[i].test = this;
+				workers[i].id = i;
+				workers[i].failed = false;
+				pthread_create(threads + i, NULL, i < THREAD_NUM ?
+						_run_writer : _run_reader, workers + i);
+			}
+			for (int i = 0; i < THREAD_NUM; i++) {
+				pthread_join(threads[i], NULL);
+			}
+			writing = false;
+			pthread_join(threads[THREAD_NUM], NULL);
+
+			puts("checking the order seen during concurrent put() & remove():");
+			for (int i = 0; i <= THREAD_NUM; i++) {
+				if (workers[i].failed) {
+					throw TestException("Ooooops, the map goes wrong "\
+							"during concurrent put() & remove()!!!");
+				}
+			}
+			puts("checking the result:");
+			if (this->map_ptr->size() != THREAD_NUM * (times / 2)) {
+				throw TestException("Ooooops, the size() function "\
+						"goes wrong!!!");
+			}
+			int expected = THREAD_NUM;
+			for (typename Map::Iterator it = this->map_ptr->iterator();
+					it.hasNext(); expected++) {
+				typename Map::Entry e = it.next();
+				if (expected % (2 * THREAD_NUM) == 0) {
+					expected += THREAD_NUM;
+				}
+				if (e.getKey() != expected ||
+						e.getValue() != expected / THREAD_NUM) {
+					throw TestException("Ooooops, the Iterator of the Map "\
+							"goes wrong!!!");
+				}
+			}
+			if (expected != THREAD_NUM * times) {
+				throw TestException("Ooooops, the Iterator of the Map "\
+						"misses some elements!!!");
+			}
+			for (int i = 0; i < times; i++) {
+				int key = i * THREAD_NUM + rand() % THREAD_NUM;
+				if (this->map_ptr->containsKey(key) != (i & 1) ||
+						this->map_ptr->ceilingKey(key) !=
+						((i & 1) ? key : (i + 1) * THREAD_NUM)) {
+					throw TestException("Ooooops, the ceilingKey() function "\
+							"goes wrong!!!");
+				}
+			}
+			puts("destroying a map while iterating it:");
+			{
+				Map *doomed = new Map();
+				doomed->put(1, 1);
+				typename Map::Iterator it = doomed->iterator(0);
+				/* must not wait for the epoch pinned by it */
+				delete doomed;
+			}
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestFreeze: public MapTest <Map> {/*{{{*/
+	private:
+		int times;
+		map <int, int> std_map;
+
+		void _check(const Map &m) {
+			if (m.size() != (int)std_map.size()) {
+				throw TestException("Ooooops, the size() function goes "\
+						"wrong!!!");
+			}
+			typename Map::Iterator it = m.iterator();
+			for (map <int, int>::iterator sit = std_map.begin();
+					sit != std_map.end(); ++sit) {
+				if (!it.hasNext()) {
+					throw TestException("Ooooops, the Iterator of the Map "\
+							"misses some elements!!!");
+				}
+				typename Map::Entry e = it.next();
+				if (e.getKey() != sit->first || e.getValue() != sit->second ||
+						m.get(sit->first) != sit->second) {
+					throw TestException("Ooooops, the keys are out of "\
+							"order or mapped wrong!!!");
+				}
+			}
+			if (it.hasNext()) {
+				throw TestException("Ooooops, the Iterator of the Map "\
+						"returns extra elements!!!");
+			}
+		}
+
+	public:
+		MapTestFreeze(string case_name, int _times, TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test freezing a TreeMap...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			std_map.clear();
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			puts("checking freeze() of a TreeMap:");
+			TreeMap <int, int> tree;
+			for (int i = 0; i < times; i++) {
+				int k = rand() % (times * 4);
+				tree.put(k, i);
+				std_map[k] = i;
+			}
+			this->map_ptr->freeze(tree);
+			_check(*this->map_ptr);
+
+			puts("checking put() through the delta buffer:");
+			for (int i = 0; i < times; i++) {
+				int k = rand() % (times * 8);
+				this->map_ptr->put(k, -i);
+				std_map[k] = -i;
+				k = rand() % (times * 8);
+				if (this->map_ptr->containsKey(k) != (std_map.count(k) > 0)) {
+					throw TestException("Ooooops, the containsKey() function "\
+							"goes wrong!!!");
+				}
+				if (i % (times / 8) == 0) {
+					_check(*this->map_ptr);
+				}
+			}
+			_check(*this->map_ptr);
+			this->map_ptr->flush();
+			_check(*this->map_ptr);
+
+			puts("checking freeze() of an empty map:");
+			tree.clear();
+			std_map.clear();
+			this->map_ptr->freeze(tree);
+			_check(*this->map_ptr);
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Map>
+class MapTestCompaction: public MapTest <Map> {/*{{{*/
+	private:
+		int times;
+		map <int, int> std_map;
+
+		void _check(const Map &m) {
+			if (m.size() != (int)std_map.size() ||
+					m.isEmpty() != std_map.empty()) {
+				throw TestException("Ooooops, the size() function goes "\
+						"wrong!!!");
+			}
+			typename Map::Iterator it = m.iterator();
+			for (map <int, int>::iterator sit = std_map.begin();
+					sit != std_map.end(); ++sit) {
+				if (!it.hasNext()) {
+					throw TestException("Ooooops, the Iterator of the Map "\
+							"misses some elements!!!");
+				}
+				typename Map::Entry e = it.next();
+				if (e.getKey() != sit->first || e.getValue() != sit->second ||
+						m.get(sit->first) != sit->second) {
+					throw TestException("Ooooops, the keys are out of "\
+							"order or mapped wrong!!!");
+				}
+			}
+			if (it.hasNext()) {
+				throw TestException("Ooooops, the Iterator of the Map "\
+						"returns extra elements!!!");
+			}
+		}
+
+		void _put(int k, int v) {
+			this->map_ptr->put(k, v);
+			std_map[k] = v;
+		}
+
+		void _remove(int k) {
+			if (this->map_ptr->containsKey(k) != (std_map.count(k) > 0)) {
+				throw TestException("Ooooops, the containsKey() function "\
+						"goes wrong!!!");
+			}
+			if (std_map.count(k)) {
+				this->map_ptr->remove(k);
+				std_map.erase(k);
+			}
+			else {
+				try {
+					this->map_ptr->remove(k);
+					throw TestException("Ooooops, remove() of an absent "\
+							"key did not throw!!!");
+				} catch (ElementNotExist) {}
+			}
+		}
+
+	public:
+		MapTestCompaction(string case_name, int _times, TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test the compaction of the runs...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			std_map.clear();
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			puts("checking put() through several levels:");
+			for (int i = 0; i < times; i++) {
+				_put(rand() % (times * 2), i);
+				if (i % (times / 8) == 0) {
+					_check(*this->map_ptr);
+				}
+			}
+			_check(*this->map_ptr);
+			if (this->map_ptr->writeAmplification() <= 0) {
+				throw TestException("Ooooops, the buffer was never "\
+						"merged!!!");
+			}
+
+			puts("checking tombstones shadowing older runs:");
+			for (int i = 0; i < times; i++) {
+				int k = rand() % (times * 2);
+				if (rand() % 3) _remove(k);
+				else _put(k, -i);
+				if (i % (times / 8) == 0) {
+					_check(*this->map_ptr);
+				}
+			}
+			_check(*this->map_ptr);
+			this->map_ptr->flush();
+			_check(*this->map_ptr);
+
+			puts("checking a copy, then removing all of the keys:");
+			Map copy(*this->map_ptr);
+			_check(copy);
+			while (!std_map.empty()) {
+				_remove(std_map.begin()->first);
+			}
+			_check(*this->map_ptr);
+			for (int i = 0; i < times; i++) {
+				_put(rand() % (times * 2), i);
+			}
+			_check(*this->map_ptr);
+			if (this->map_ptr->readAmplification() < 1) {
+				throw TestException("Ooooops, readAmplification() goes "\
+						"wrong!!!");
+			}
+			puts("OK\n");
+		}
+};/*}}}*/
+
+struct RandomIntKeys {
+	typedef int Key;
+	/* all over the range, and near zero or the extremes, so that many keys
+	 * share their leading bytes */
+	static int make(int times) {
+		switch (rand() % 3) {
+			case 0:
+				return (int)(((unsigned)rand() << 16) ^ (unsigned)rand());
+			case 1:
+				return rand() % times - times / 2;
+			default:
+				return rand() % 2 ? 0x7fffffff - rand() % 4 :
+									-0x7fffffff - 1 + rand() % 4;
+		}
+	}
+};
+
+struct RandomStringKeys {
+	typedef string Key;
+	/* short strings of zero, high and two other bytes, many being prefixes
+	 * of others, and some sharing a path too long to be stored in a node */
+	static string make(int) {
+		static const char letters[] = {'a', 'b', '\0', '\xff'};
+		string res(rand() % 4 == 0 ? "a long shared path, " : "");
+		for (int n = rand() % 7; n > 0; n--) {
+			res += letters[rand() % 4];
+		}
+		return res;
+	}
+};
+
+template <class Map, class Keys>
+class MapTestOrderedKeys: public MapTest <Map> {/*{{{*/
+	private:
+		typedef typename Keys::Key Key;
+		int times;
+		map <Key, int> std_map;
+
+		void _check(const Map &m) {
+			if (m.size() != (int)std_map.size()) {
+				throw TestException("Ooooops, the size() function goes "\
+						"wrong!!!");
+			}
+			typename Map::Iterator it = m.iterator();
+			for (typename map <Key, int>::iterator sit = std_map.begin();
+					sit != std_map.end(); ++sit) {
+				if (!it.hasNext()) {
+					throw TestException("Ooooops, the Iterator of the Map "\
+							"misses some elements!!!");
+				}
+				typename Map::Entry e = it.next();
+				if (!(e.getKey() == sit->first) ||
+						e.getValue() != sit->second ||
+						m.get(sit->first) != sit->second) {
+					throw TestException("Ooooops, the keys are out of "\
+							"order or mapped wrong!!!");
+				}
+			}
+			if (it.hasNext()) {
+				throw TestException("Ooooops, the Iterator of the Map "\
+						"returns extra elements!!!");
+			}
+		}
+
+	public:
+		MapTestOrderedKeys(string case_name, int _times,
+							TestFixture *_fixture):
+			MapTest <Map>(case_name, _fixture), times(_times) {}
+
+		void set_up() {
+			puts("== Now Preparing to test the ordered keys...");
+			MapTest <Map>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			std_map.clear();
+			MapTest <Map>::tear_down();
+		}
+
+		void run_test() {
+			puts("checking put() and remove() of random keys:");
+			for (int i = 0; i < times; i++) {
+				Key k = Keys::make(times);
+				if (rand() % 3 == 0) {
+					bool thrown = false;
+					try {
+						this->map_ptr->remove(k);
+					} catch (ElementNotExist) {
+						thrown = true;
+					}
+					if (thrown != !std_map.erase(k) ||
+							this->map_ptr->containsKey(k)) {
+						throw TestException("Ooooops, the remove() function "\
+								"goes wrong!!!");
+					}
+				} else {
+					this->map_ptr->put(k, i);
+					std_map[k] = i;
+				}
+				if (i % (times / 8) == 0) {
+					_check(*this->map_ptr);
+				}
+			}
+			_check(*this->map_ptr);
+
+			puts("checking iterator(lo) and ceilingKey():");
+			for (int i = 0; i < times / 10; i++) {
+				Key lo = Keys::make(times);
+				typename map <Key, int>::iterator sit = std_map.lower_bound(lo);
+				Key got;
+				bool thrown = false;
+				try {
+					got = this->map_ptr->ceilingKey(lo);
+				} catch (ElementNotExist) {
+					thrown = true;
+				}
+				if (thrown != (sit == std_map.end()) ||
+						(!thrown && !(got == sit->first))) {
+					throw TestException("Ooooops, the ceilingKey() function "\
+							"goes wrong!!!");
+				}
+				typename Map::Iterator it = this->map_ptr->iterator(lo);
+				for (int j = 0; j < 20 && sit != std_map.end(); j++, ++sit) {
+					if (!it.hasNext() || !(it.next().getKey() == sit->first)) {
+						throw TestException("Ooooops, the iterator(lo) "\
+								"function goes wrong!!!");
+					}
+				}
+				if (sit == std_map.end() && it.hasNext()) {
+					throw TestException("Ooooops, the iterator(lo) function "\
+							"returns extra elements!!!");
+				}
+			}
+
+			puts("checking the copies:");
+			Map copy(*this->map_ptr), assigned;
+			assigned = copy;
+			for (int i = 0; i < times / 10; i++) {
+				copy.put(Keys::make(times), -1);
+			}
+			_check(*this->map_ptr);
+			_check(assigned);
+
+			puts("checking removing all the keys:");
+			vector <Key> keys;
+			for (typename map <Key, int>::iterator sit = std_map.begin();
+					sit != std_map.end(); ++sit) {
+				keys.push_back(sit->first);
+			}
+			random_shuffle(keys.begin(), keys.end());
+			for (size_t i = 0; i < keys.size(); i++) {
+				this->map_ptr->remove(keys[i]);
+				std_map.erase(keys[i]);
+				if (i % (keys.size() / 8 + 1) == 0) {
+					_check(*this->map_ptr);
+				}
+			}
+			if (!this->map_ptr->isEmpty() ||
+					this->map_ptr->iterator().hasNext()) {
+				throw TestException("Ooooops, the map is not empty after "\
+						"removing all the keys!!!");
+			}
+			puts("OK\n");
+		}
+};/*}}}*/
+
+/*{{{ Cache Tester */
+template <class Cache>
+class CacheTest: public TestCase { /*{{{*/
+	protected:
+		Cache *cache_ptr;
+		int capacity;
+		int evict_cnt;
+
+		static void _on_evict(const int &key, const int &value, void *arg) {
+			CacheTest *test = (CacheTest *)arg;
+			__sync_fetch_and_add(&test->evict_cnt, 1);
+			test->check_evicted(key, value);
+		}
+
+	public:
+		CacheTest(string case_name, int _capacity, TestFixture *_fixture):
+			TestCase(case_name, _fixture), capacity(_capacity) {}
+
+		virtual void check_evicted(const int &, const int &) {}
+
+		void set_up() {
+			this -> start_memory_watching();
+			cache_ptr = new Cache(capacity);
+			evict_cnt = 0;
+			cache_ptr->setEvictCallback(_on_evict, this);
+		}
+
+		void tear_down() {
+			delete cache_ptr;
+			this -> stop_memory_watching();
+		}
+};/*}}}*/
+
+template <class Cache>
+class CacheTestRandomly: public CacheTest <Cache> {/*{{{*/
+	private:
+		int times;
+		bool exact_lru;
+		map <int, int> latest;
+		list <int> recency;
+
+		void _touch(int key) {
+			recency.remove(key);
+			recency.push_front(key);
+		}
+
+	public:
+		CacheTestRandomly(string case_name, int _capacity, int _times,
+				bool _exact_lru, TestFixture *_fixture):
+			CacheTest <Cache>(case_name, _capacity, _fixture),
+			times(_times), exact_lru(_exact_lru) {}
+
+		void check_evicted(const int &key, const int &value) {
+			if (latest.count(key) == 0 || latest[key] != value) {
+				throw TestException("Ooooops, the eviction callback "\
+						"reports a wrong entry!!!");
+			}
+			if (exact_lru && recency.back() != key) {
+				throw TestException("Ooooops, the evicted entry "\
+						"is not the least recently used one!!!");
+			}
+			latest.erase(key);
+			if (exact_lru) {
+				recency.pop_back();
+			}
+		}
+
+		void set_up() {
+			puts("== Now Preparing to test the cache randomly...");
+			CacheTest <Cache>::set_up();
+			latest.clear();
+			recency.clear();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			latest.clear();
+			recency.clear();
+			CacheTest <Cache>::tear_down();
+		}
+
+		void run_test() {
+			Cache *cache = this->cache_ptr;
+			long long get_cnt = 0, hit_cnt = 0;
+			for (int i = 0; i < times; i++) {
+				int key = rand() % (this->capacity * 2 + 1);
+				int op = rand() % 10, value;
+				if (op < 5) {
+					value = rand();
+					if (exact_lru) {
+						_touch(key);
+					}
+					bool present = latest.count(key);
+					latest[key] = value;
+					cache->put(key, value);
+					if (present && !cache->containsKey(key)) {
+						throw TestException("Ooooops, put() evicts "\
+								"an entry being updated!!!");
+					}
+				} else if (op < 9) {
+					get_cnt++;
+					bool hit = cache->tryGet(key, value);
+					if (hit != (latest.count(key) > 0)) {
+						throw TestException("Ooooops, the tryGet() function "\
+								"goes wrong!!!");
+					}
+					if (hit) {
+						hit_cnt++;
+						if (value != latest[key]) {
+							throw TestException("Ooooops, the tryGet() function "\
+									"returns a wrong value!!!");
+						}
+						if (exact_lru) {
+							_touch(key);
+						}
+					}
+				} else if (latest.count(key)) {
+					cache->remove(key);
+					latest.erase(key);
+					if (exact_lru) {
+						recency.remove(key);
+					}
+				}
+				if (cache->size() != (int)latest.size() ||
+						cache->size() > this->capacity) {
+					throw TestException("Ooooops, the size() function "\
+							"goes wrong!!!");
+				}
+			}
+
+			puts("checking the statistics:");
+			if (cache->hitCount() != hit_cnt ||
+					cache->missCount() != get_cnt - hit_cnt ||
+					cache->evictionCount() != this->evict_cnt) {
+				throw TestException("Ooooops, the statistics are wrong!!!");
+			}
+			try {
+				cache->get(-1);
+				throw TestException("Ooooops, get() a missing key "\
+						"does not throw!!!");
+			} catch (ElementNotExist &) {}
+			cache->clear();
+			if (!cache->isEmpty() || cache->evictionCount() != this->evict_cnt) {
+				throw TestException("Ooooops, the clear() function "\
+						"goes wrong!!!");
+			}
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Cache>
+class CacheTestTrace: public CacheTest <Cache> {/*{{{*/
+	/* replays a fixed trace and records the keys evicted, in order */
+	protected:
+		vector <int> evicted;
+
+		void _expect(const int *keys, int num) {
+			if ((int)evicted.size() != num ||
+					!equal(keys, keys + num, evicted.begin())) {
+				throw TestException("Ooooops, the policy evicts "\
+						"the wrong entries!!!");
+			}
+		}
+
+		void _expect_cached(const int *keys, int num) {
+			if (this->cache_ptr->size() != num) {
+				throw TestException("Ooooops, the size() function "\
+						"goes wrong!!!");
+			}
+			for (int i = 0; i < num; i++) {
+				if (!this->cache_ptr->containsKey(keys[i])) {
+					throw TestException("Ooooops, the policy evicts "\
+							"an entry it should keep!!!");
+				}
+			}
+		}
+
+	public:
+		CacheTestTrace(string case_name, int _capacity, TestFixture *_fixture):
+			CacheTest <Cache>(case_name, _capacity, _fixture) {}
+
+		void check_evicted(const int &key, const int &) {
+			evicted.push_back(key);
+		}
+
+		void set_up() {
+			puts("== Now Preparing to replay a trace on the cache...");
+			CacheTest <Cache>::set_up();
+			evicted.clear();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			vector <int>().swap(evicted);
+			CacheTest <Cache>::tear_down();
+		}
+};/*}}}*/
+
+template <class Cache>
+class CacheTestSecondChance: public CacheTestTrace <Cache> {/*{{{*/
+	/* CLOCK with a capacity of 4 */
+	public:
+		CacheTestSecondChance(string case_name, TestFixture *_fixture):
+			CacheTestTrace <Cache>(case_name, 4, _fixture) {}
+
+		void run_test() {
+			Cache *cache = this->cache_ptr;
+			int value;
+			puts("checking the second chance of the entries hit:");
+			for (int k = 0; k < 4; k++) {
+				cache->put(k, k);
+			}
+			/* hit in reverse order: the hand clears every bit, then evicts
+			 * the entry it started from, 0, where LRU would evict 3 */
+			for (int k = 3; k >= 0; k--) {
+				cache->tryGet(k, value);
+			}
+			cache->put(4, 4);
+			const int first[] = {0};
+			this->_expect(first, 1);
+
+			puts("checking the hand going round:");
+			/* the ring is 4 1 2 3 with the hand on 1; 2 is hit again */
+			cache->tryGet(2, value);
+			cache->put(5, 5);
+			cache->put(6, 6);
+			const int all[] = {0, 1, 3};
+			this->_expect(all, 3);
+			const int kept[] = {2, 4, 5, 6};
+			this->_expect_cached(kept, 4);
+
+			puts("checking clear():");
+			cache->clear();
+			for (int k = 10; k < 15; k++) {
+				cache->put(k, k);
+			}
+			const int after[] = {0, 1, 3, 10};
+			this->_expect(after, 4);
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Cache>
+class CacheTestGhost: public CacheTestTrace <Cache> {/*{{{*/
+	/* S3-FIFO with a capacity of 10, so a small queue of 1 entry and 9 ghost
+	 * keys */
+	public:
+		CacheTestGhost(string case_name, TestFixture *_fixture):
+			CacheTestTrace <Cache>(case_name, 10, _fixture) {}
+
+		void run_test() {
+			Cache *cache = this->cache_ptr;
+			int value;
+			puts("checking the small queue and the promotion:");
+			for (int k = 0; k <= 10; k++) {
+				cache->put(k, k);
+			}
+			/* 1 is hit in the small queue and moves to the main queue */
+			cache->tryGet(1, value);
+			cache->put(11, 11);
+			const int first[] = {0, 2};
+			this->_expect(first, 2);
+
+			puts("checking the readmission of a ghost key:");
+			/* 0 is remembered, so it goes straight to the main queue and
+			 * survives a scan flushing the small queue */
+			cache->put(0, 0);
+			for (int k = 12; k < 20; k++) {
+				cache->put(k, k);
+			}
+			const int scanned[] = {0, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+			this->_expect(scanned, 11);
+			const int kept[] = {0, 1, 12, 13, 14, 15, 16, 17, 18, 19};
+			this->_expect_cached(kept, 10);
+
+			puts("checking clear() forgetting the ghost keys:");
+			/* clear() evicts nothing, so 12 is not remembered, nor is 11 any
+			 * longer: both are new keys, evicted first from the small queue */
+			cache->clear();
+			cache->put(12, 12);
+			cache->put(11, 11);
+			for (int k = 100; k < 109; k++) {
+				cache->put(k, k);
+			}
+			const int after[] = {0, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+			this->_expect(after, 12);
+			puts("OK\n");
+		}
+};/*}}}*/
+
+template <class Cache>
+class CacheTestConcurrent: public CacheTest <Cache> {/*{{{*/
+	private:
+		static const int THREAD_NUM = 8;
+		int times;
+
+		struct Worker {
+			CacheTestConcurrent *test;
+			int id;
+			long long get_cnt;
+			bool failed;
+		};
+
+		static void *_run_worker(void *arg) {
+			Worker *w = (Worker *)arg;
+			Cache *cache = w->test->cache_ptr;
+			int range = w->test->capacity * 2;
+			unsigned int seed = w->id;
+			/* every key is always mapped to twice itself */
+			for (int i = 0; i < w->test->times; i++) {
+				int key = rand_r(&seed) % range, value;
+				if (i & 1) {
+					cache->put(key, key * 2);
+				} else {
+					w->get_cnt++;
+					if (cache->tryGet(key, value) && value != key * 2) {
+						w->failed = true;
+					}
+				}
+			}
+			return NULL;
+		}
+
+	public:
+		CacheTestConcurrent(string case_name, int _capacity, int _times,
+				TestFixture *_fixture):
+			CacheTest <Cache>(case_name, _capacity, _fixture), times(_times) {}
+
+		void check_evicted(const int &key, const int &value) {
+			if (value != key * 2) {
+				throw TestException("Ooooops, the eviction callback "\
+						"reports a wrong entry!!!");
+			}
+		}
+
+		void set_up() {
+			puts("== Now Preparing to test the cache concurrently...");
+			CacheTest <Cache>::set_up();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			CacheTest <Cache>::tear_down();
+		}
+
+		void run_test() {
+			pthread_t threads[THREAD_NUM];
+			Worker workers[THREAD_NUM];
+			for (int i = 0; i < THREAD_NUM; i++) {
+				workers[i].test = this;
+				workers[i].id = i;
+				workers[i].get_cnt = 0;
+				workers[i].failed = false;
+				pthread_create(threads + i, NULL, _run_worker, workers + i);
+			}
+			long long get_cnt = 0;
+			for (int i = 0; i < THREAD_NUM; i++) {
+				pthread_join(threads[i], NULL);
+				get_cnt += workers[i].get_cnt;
+				if (workers[i].failed) {
+					throw TestException("Ooooops, the tryGet() function "\
+							"returns a wrong value!!!");
+				}
+			}
+
+			puts("checking a cache smaller than its shards:");
+			{
+				Cache small(3);
+				for (int k = 0; k < 100; k++) {
+					small.put(k, k * 2);
+					int value;
+					if (!small.tryGet(k, value) || value != k * 2 ||
+							small.size() > 3) {
+						throw TestException("Ooooops, a shard of the small "\
+								"cache has no room!!!");
+					}
+				}
+			}
+
+			puts("checking the size & the statistics:");
+			if (this->cache_ptr->size() > this->capacity) {
+				throw TestException("Ooooops, the cache exceeds "\
+						"its capacity!!!");
+			}
+			if (this->cache_ptr->hitCount() + this->cache_ptr->missCount()
+					!= get_cnt ||
+					this->cache_ptr->evictionCount() != this->evict_cnt) {
+				throw TestException("Ooooops, the statistics are wrong!!!");
+			}
+			puts("OK\n");
+		}
+};/*}}}*/
+/*}}}*/
+
+/*{{{ GroupBy Tester */
+template <class Agg>
+class GroupByTestRandomly: public TestCase {/*{{{*/
+	private:
+		typedef typename Agg::Acc Acc;
+		int rows, groups, thread_num;
+
+		struct HashInt {
+			static int hashCode(int obj) {
+				return obj;
+			}
+		};
+
+	public:
+		GroupByTestRandomly(string case_name, int _rows, int _groups,
+				int _thread_num, TestFixture *_fixture):
+			TestCase(case_name, _fixture),
+			rows(_rows), groups(_groups), thread_num(_thread_num) {}
+
+		void set_up() {
+			puts("== Now Preparing to test the aggregation...");
+			this -> start_memory_watching();
+		}
+
+		void tear_down() {
+			puts("== Finishing the test...");
+			this -> stop_memory_watching();
+		}
+
+		void run_test() {
+			GroupBy<int, int, HashInt, Agg> *group_by =
+				new GroupBy<int, int, HashInt, Agg>(thread_num);
+			map <int, Acc> expected;
+			vector <int> keys, vals;
+			for (int i = 0; i < rows; i++) {
+				keys.push_back(rand() % groups - groups / 2);
+				vals.push_back(rand() % 1000 - 500);
+				typename map <int, Acc>::iterator it = expected.find(keys[i]);
+				if (it == expected.end()) {
+					Agg::init(expected[keys[i]], vals[i]);
+				} else {
+					Agg::update(it->second, vals[i]);
+				}
+			}
+			/* half of the rows one by one, the rest as a batch */
+			for (int i = 0; i < rows / 2; i++) {
+				group_by->add(keys[i], vals[i]);
+			}
+			group_by->add(&keys[rows / 2], &vals[rows / 2], rows - rows / 2);
+
+			puts("checking the groups:");
+			if (group_by->groupCount() != (int)expected.size()) {
+				throw TestException("Ooooops, the groupCount() function "\
+						"goes wrong!!!");
+			}
+			HashMap<int, Acc, HashInt> *result = new HashMap<int, Acc, HashInt>();
+			group_by->collect(*result);
+			if (result->size() != (int)expected.size()) {
+				throw TestException("Ooooops, collect() misses some groups!!!");
+			}
+			for (typename map <int, Acc>::iterator it = expected.begin();
+					it != expected.end(); it++) {
+				if (!result->containsKey(it->first) ||
+						result->get(it->first) != it->second) {
+					throw TestException("Ooooops, the result of a group "\
+							"is wrong!!!");
+				}
+			}
+			group_by->clear();
+			if (group_by->groupCount() != 0) {
+				throw TestException("Ooooops, the clear() function "\
+						"goes wrong!!!");
+			}
+			group_by->add(keys[0], vals[0]);
+			if (group_by->groupCount() != 1) {
+				throw TestException("Ooooops, rows added after clear() "\
+						"are lost!!!");
+			}
+			delete result;
+			delete group_by;
+			puts("OK\n");
+		}
+};/*}}}*/
+/*}}}*/
 #endif
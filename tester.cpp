@@ -25,6 +25,20 @@ public:
     }
 };
 
+class HashConst {
+public:
+    static int hashCode(int) {
+        return 42;
+    }
+};
+
+class IntHashConst {
+public:
+    static unsigned int index(int, int bits) {
+        return (1U << bits) - 3; // the probing wraps around
+    }
+};
+
 int main() {
 
     TestFixture t;
@@ -60,6 +74,167 @@ int main() {
         tree_all("TreeMapAllRandom", 100000, 10000000, &t);
     MapTestAllRandomly<HashMap<int, int, HashInt> > 
         hash_all("HashMapAllRandom", 100000, 10000000, &t);
+    MapTestAllRandomly<HashMap<int, int, HashInt, true> > 
+        ihash_all("InlineHashMapAllRandom", 100000, 10000000, &t);
+    MapTestAllRandomly<HashMap<int, int, HashConst, true> > 
+        chash_collide("InlineHashMapCollision", 2000, 10000, &t);
+    MapTestCopy<TreeMap<int, int>, true> 
+        tree_copy("TreeMapCopy", 10000, &t);
+    MapTestCopy<HashMap<int, int, HashInt>, true> 
+        hash_copy("HashMapCopy", 10000, &t);
+    MapTestImage<HashMap<int, int, HashInt>, HashMapView<int, int, HashInt> > 
+        hash_image("HashMapImage", 100000, &t);
+    MapTestCopy<HashMap<int, int, HashConst>, true> 
+        chash_copy("CollidingHashMapCopy", 1000, &t);
+    MapTestCopy<HashMap<int, int, HashConst, true>, true> 
+        ihash_copy("InlineHashMapCopy", 1000, &t);
+    MapTestAllRandomly<HashMap<int, int, HashInt, false, HashMapProbeStats> > 
+        shash_all("StatsHashMapAllRandom", 100000, 10000000, &t);
+    MapTestStats<HashMap<int, int, HashInt, false, HashMapProbeStats> > 
+        hash_stats("HashMapStats", 10000, 1, &t);
+    MapTestStats<HashMap<int, int, HashConst, true, HashMapProbeStats> > 
+        chash_stats("CollidingHashMapStats", 1000, 1000, &t);
+    MapTestAllRandomly<BloomFilteredMap<int, int, HashInt, TreeMap<int, int> > > 
+        btree_all("BloomTreeMapAllRandom", 100000, 10000000, &t);
+    MapTestAllRandomly<BloomFilteredMap<int, int, HashInt> > 
+        bhash_all("BloomHashMapAllRandom", 100000, 10000000, &t);
+    MapTestBloom<BloomFilteredMap<int, int, HashInt, TreeMap<int, int> > > 
+        btree_bloom("BloomTreeMapFilter", 100000, &t);
+    MapTestAllRandomly<IntHashMap<int, int> > 
+        ihmap_all("IntHashMapAllRandom", 100000, 10000000, &t);
+    MapTestAllRandomly<IntHashMap<int, int, IntHashConst> > 
+        ihmap_collide("IntHashMapCollision", 2000, 10000, &t);
+    MapTestCopy<IntHashMap<int, int, IntHashFibonacci, 0> > 
+        ihmap_copy("IntHashMapCopy", 10000, &t);
+    GroupByTestRandomly<SumAgg<int> > 
+        group_sum("GroupBySum", 1000000, 100000, 1, &t);
+    GroupByTestRandomly<CountAgg<int> > 
+        group_count("GroupByCount", 1000000, 1000, 4, &t);
+    GroupByTestRandomly<MinAgg<int> > 
+        group_min("GroupByMin", 100000, 10, 4, &t);
+    GroupByTestRandomly<MaxAgg<int> > 
+        group_max("GroupByMax", 1000000, 1000000, 3, &t);
+    MapTestAllRandomly<ValueIndexedMap<int, int, HashInt, HashInt> > 
+        vhash_all("ValueIndexedHashMapAllRandom", 100000, 10000000, &t);
+    MapTestValueIndex<ValueIndexedMap<int, int, HashInt, HashInt> > 
+        vhash_index("ValueIndexedHashMapIndex", 10000, &t);
+    MapTestValueIndex<ValueIndexedMap<int, int, HashInt, HashInt,
+        TreeMap<int, int> > > 
+        vtree_index("ValueIndexedTreeMapIndex", 10000, &t);
+    MapTestNavigation<TreeMap<int, int> > 
+        tree_nav("TreeMapNavigation", 100000, &t);
+    MapTestRank<TreeMap<int, int> > 
+        tree_rank("TreeMapRank", 10000, &t);
+    MapTestBuildSorted<TreeMap<int, int> > 
+        tree_build("TreeMapBuildSorted", 100000, &t);
+    MapTestSplitJoin<TreeMap<int, int> > 
+        tree_split("TreeMapSplitJoin", 100000, &t);
+    MapTestAllocCount<TreeMap<int, int> > 
+        tree_alloc("TreeMapAllocCount", 100000, &t);
+    MapTestHintedPut<TreeMap<int, int> > 
+        tree_hint("TreeMapHintedPut", 100000, &t);
+    MapTestBalance<TreeMap<int, int> > 
+        treap_shape("TreeMapBalance", 20000, 4, &t);
+    MapTestAllRandomly<TreeMap<int, int, NoMonoid, RedBlackBalance> > 
+        redblack_all("RedBlackTreeMapAllRandom", 100000, 10000000, &t);
+    MapTestBuildSorted<TreeMap<int, int, NoMonoid, RedBlackBalance> > 
+        redblack_build("RedBlackTreeMapBuildSorted", 100000, &t);
+    MapTestSplitJoin<TreeMap<int, int, NoMonoid, RedBlackBalance> > 
+        redblack_split("RedBlackTreeMapSplitJoin", 5000, &t);
+    MapTestHintedPut<TreeMap<int, int, NoMonoid, RedBlackBalance> > 
+        redblack_hint("RedBlackTreeMapHintedPut", 20000, &t);
+    MapTestBalance<TreeMap<int, int, NoMonoid, RedBlackBalance> > 
+        redblack_shape("RedBlackTreeMapBalance", 20000, 2, &t);
+    MapTestAllRandomly<TreeMap<int, int, NoMonoid, AVLBalance> > 
+        avl_all("AVLTreeMapAllRandom", 100000, 10000000, &t);
+    MapTestBuildSorted<TreeMap<int, int, NoMonoid, AVLBalance> > 
+        avl_build("AVLTreeMapBuildSorted", 100000, &t);
+    MapTestSplitJoin<TreeMap<int, int, NoMonoid, AVLBalance> > 
+        avl_split("AVLTreeMapSplitJoin", 5000, &t);
+    MapTestHintedPut<TreeMap<int, int, NoMonoid, AVLBalance> > 
+        avl_hint("AVLTreeMapHintedPut", 20000, &t);
+    MapTestBalance<TreeMap<int, int, NoMonoid, AVLBalance> > 
+        avl_shape("AVLTreeMapBalance", 20000, 1.45, &t);
+    MapTestAllRandomly<TreeMap<int, int, NoMonoid, SplayBalance> > 
+        splay_all("SplayTreeMapAllRandom", 100000, 10000000, &t);
+    MapTestBuildSorted<TreeMap<int, int, NoMonoid, SplayBalance> > 
+        splay_build("SplayTreeMapBuildSorted", 100000, &t);
+    MapTestSplitJoin<TreeMap<int, int, NoMonoid, SplayBalance> > 
+        splay_split("SplayTreeMapSplitJoin", 5000, &t);
+    MapTestHintedPut<TreeMap<int, int, NoMonoid, SplayBalance> > 
+        splay_hint("SplayTreeMapHintedPut", 20000, &t);
+    MapTestBalance<TreeMap<int, int, NoMonoid, SplayBalance> > 
+        splay_shape("SplayTreeMapBalance", 20000, 0, &t);
+    MapTestAllRandomly<TreeMap<int, int, SumMonoid<int> > > 
+        stree_all("SumTreeMapAllRandom", 100000, 10000000, &t);
+    MapTestAggregate<TreeMap<int, int, SumMonoid<int> >, SumMonoid<int> > 
+        stree_agg("SumTreeMapAggregate", 100000, &t);
+    MapTestAggregate<TreeMap<int, int, MinMonoid<int> >, MinMonoid<int> > 
+        mtree_agg("MinTreeMapAggregate", 100000, &t);
+    MapTestAllRandomly<BTreeMap<int, int> > 
+        btree_map_all("BTreeMapAllRandom", 100000, 10000000, &t);
+    MapTestAllRandomly<BTreeMap<int, int, 64> > 
+        sbtree_map_all("SmallNodeBTreeMapAllRandom", 100000, 100000, &t);
+    MapTestCopy<BTreeMap<int, int> > 
+        btree_map_copy("BTreeMapCopy", 10000, &t);
+    MapTestAllRandomly<RadixTreeMap<int, int> > 
+        radix_all("RadixTreeMapAllRandom", 100000, 10000000, &t);
+    MapTestCopy<RadixTreeMap<int, int> > 
+        radix_copy("RadixTreeMapCopy", 10000, &t);
+    MapTestOrderedKeys<RadixTreeMap<int, int>, RandomIntKeys> 
+        radix_int("RadixTreeMapIntKeys", 100000, &t);
+    MapTestOrderedKeys<RadixTreeMap<string, int>, RandomStringKeys> 
+        radix_str("RadixTreeMapStringKeys", 100000, &t);
+    MapTestAllRandomly<FlatTreeMap<int, int> > 
+        flat_all("FlatTreeMapAllRandom", 20000, 10000000, &t);
+    MapTestAllRandomly<FlatTreeMap<int, int, true> > 
+        eflat_all("EytzingerFlatTreeMapAllRandom", 20000, 10000000, &t);
+    MapTestCopy<FlatTreeMap<int, int> > 
+        flat_copy("FlatTreeMapCopy", 10000, &t);
+    MapTestOrderedKeys<FlatTreeMap<int, int>, RandomIntKeys> 
+        flat_int("FlatTreeMapIntKeys", 20000, &t);
+    MapTestOrderedKeys<FlatTreeMap<int, int, true>, RandomIntKeys> 
+        eflat_int("EytzingerFlatTreeMapIntKeys", 20000, &t);
+    MapTestFreeze<FlatTreeMap<int, int> > 
+        flat_freeze("FlatTreeMapFreeze", 100000, &t);
+    MapTestFreeze<FlatTreeMap<int, int, true> > 
+        eflat_freeze("EytzingerFlatTreeMapFreeze", 100000, &t);
+    MapTestAllRandomly<LSMTreeMap<int, int, HashInt> > 
+        lsm_all("LSMTreeMapAllRandom", 100000, 10000000, &t);
+    MapTestCopy<LSMTreeMap<int, int, HashInt> > 
+        lsm_copy("LSMTreeMapCopy", 10000, &t);
+    MapTestOrderedKeys<LSMTreeMap<int, int, HashInt>, RandomIntKeys> 
+        lsm_int("LSMTreeMapIntKeys", 100000, &t);
+    MapTestCompaction<LSMTreeMap<int, int, HashInt> > 
+        lsm_compact("LSMTreeMapCompaction", 200000, &t);
+    MapTestPersistent<PersistentTreeMap<int, int> > 
+        ptree_versions("PersistentTreeMapVersions", 100000, &t);
+    MapTestSnapshot<VersionedTreeMap<int, int> > 
+        vtree_snap("VersionedTreeMapSnapshot", 100000, &t);
+    MapTestAllRandomly<ConcurrentHashMap<int, int, HashInt> > 
+        chash_all("ConcurrentHashMapAllRandom", 100000, 10000000, &t);
+    MapTestConcurrent<ConcurrentHashMap<int, int, HashInt> > 
+        chash_conc("ConcurrentHashMapConcurrent", 10000, &t);
+    MapTestAllRandomly<ReadMostlyHashMap<int, int, HashInt> > 
+        rmhash_all("ReadMostlyHashMapAllRandom", 100000, 10000000, &t);
+    MapTestConcurrent<ReadMostlyHashMap<int, int, HashInt> > 
+        rmhash_conc("ReadMostlyHashMapConcurrent", 10000, &t);
+    MapTestAllRandomly<ConcurrentSkipListMap<int, int> > 
+        skiplist_all("ConcurrentSkipListMapAllRandom", 100000, 10000000, &t);
+    MapTestConcurrentOrdered<ConcurrentSkipListMap<int, int> > 
+        skiplist_conc("ConcurrentSkipListMapConcurrent", 10000, &t);
+    CacheTestRandomly<Cache<int, int, HashInt, LRUPolicy> > 
+        lru_all("LRUCacheAllRandom", 1000, 200000, true, &t);
+    CacheTestRandomly<Cache<int, int, HashInt, ClockPolicy> > 
+        clock_all("ClockCacheAllRandom", 1000, 200000, false, &t);
+    CacheTestRandomly<Cache<int, int, HashInt, S3FIFOPolicy> > 
+        s3fifo_all("S3FIFOCacheAllRandom", 1000, 200000, false, &t);
+    CacheTestSecondChance<Cache<int, int, HashInt, ClockPolicy> > 
+        clock_trace("ClockCacheSecondChance", &t);
+    CacheTestGhost<Cache<int, int, HashInt, S3FIFOPolicy> > 
+        s3fifo_trace("S3FIFOCacheGhost", &t);
+    CacheTestConcurrent<ConcurrentCache<int, int, HashInt, S3FIFOPolicy> > 
+        ccache_conc("ConcurrentCacheConcurrent", 1000, 100000, &t);
 
     if (t.test_all()) puts("All tests have finished without errors.");
     else return 1;
@@ -36,7 +36,7 @@ int total_alloc_cnt = 0;
 
 void * operator new(size_t size) throw (std::bad_alloc) {
     void *p = malloc(size);
-    total_alloc_cnt++;
+    __sync_fetch_and_add(&total_alloc_cnt, 1); // may be called concurrently
     //fprintf(stderr,"+ allocate mem size %d at %llx\n", (int)size, (ll)p);
     /*if (NULL == p)
         fprintf(stderr, "Can not allocate memory");
@@ -46,7 +46,7 @@ void * operator new(size_t size) throw (std::bad_alloc) {
 
 void operator delete(void * p) throw() {
 
-    total_alloc_cnt--;
+    __sync_fetch_and_sub(&total_alloc_cnt, 1);
     free(p);
     //fprintf(stderr, "- %llx\n", (ll)p);
 }